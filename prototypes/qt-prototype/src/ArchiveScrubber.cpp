@@ -0,0 +1,299 @@
+#include "ArchiveScrubber.h"
+#include "TransferJournal.h"
+#include "RateLimiter.h"
+#include "PlatformIo.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QThread>
+#include <algorithm>
+
+namespace {
+
+// チェックポイントを保存する間隔
+const qint64 checkpointIntervalMs = 30 * 1000;
+
+} // namespace
+
+ArchiveScrubber::ArchiveScrubber(const ScrubOptions &options, QObject *parent)
+    : QObject(parent)
+    , options(options)
+    , logPath(QDir::cleanPath(options.root) + "/.media-transfer-scrub")
+    , checkpointPath(QDir::cleanPath(options.root) + "/.media-transfer-scrub-checkpoint")
+    , next(0)
+    , verified(0)
+    , corrupted(0)
+    , missing(0)
+    , baselined(0)
+    , bytes(0)
+    , cancelled(0)
+    , lastPercentage(-1)
+{
+}
+
+ArchiveScrubber::~ArchiveScrubber()
+{
+}
+
+bool ArchiveScrubber::run(QString *error)
+{
+    elapsed.start();
+    if (!loadRecords(error)) {
+        return false;
+    }
+    if (paths.isEmpty()) {
+        completed = true;
+        return true;
+    }
+    loadCheckpoint();
+    log.setFileName(logPath);
+    if (!log.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        *error = "検査記録を開けません: " + log.errorString();
+        return false;
+    }
+
+    RateLimit limit = RateLimiter::instance()->limit(rateScope());
+    limit.megabytesPerSecond = options.megabytesPerSecond;
+    RateLimiter::instance()->setLimit(rateScope(), limit);
+
+    sinceCheckpoint.start();
+    QVector<QThread *> workers;
+    const int workerCount = qBound(1, options.workerCount, static_cast<int>(paths.size()));
+    for (int i = 0; i < workerCount; ++i) {
+        QThread *worker = QThread::create([this]() { workerLoop(); });
+        workers.append(worker);
+        worker->start();
+    }
+    for (QThread *worker : workers) {
+        worker->wait();
+        delete worker;
+    }
+
+    const bool saved = saveCheckpoint();
+    log.close();
+    if (!saved) {
+        *error = "チェックポイントを保存できません: " + checkpointPath;
+        return false;
+    }
+    return corrupted.loadRelaxed() == 0 && missing.loadRelaxed() == 0;
+}
+
+void ArchiveScrubber::cancel()
+{
+    cancelled.storeRelaxed(1);
+}
+
+bool ArchiveScrubber::loadRecords(QString *error)
+{
+    const QString root = QDir::cleanPath(options.root);
+    if (!QFileInfo(root).isDir()) {
+        *error = "フォルダがありません: " + root;
+        return false;
+    }
+    const QDir rootDir(root);
+
+    // 取り込み時のジャーナル（検証を有効にしていればハッシュ付き）
+    TransferJournal::readEntries(root + "/.media-transfer-journal", [&](const JournalEntry &entry) {
+        const QString relative = rootDir.relativeFilePath(entry.destinationPath);
+        if (relative.startsWith("../")) {
+            return;
+        }
+        Record &record = records[relative];
+        record.size = entry.size;
+        if (!entry.hash.isEmpty()) {
+            record.hash = entry.hash;
+        }
+    });
+
+    // 前回までの検査の記録（後の行が優先、書式: path \t size \t mtime \t sha256）
+    QFile in(logPath);
+    int lines = 0;
+    if (in.open(QIODevice::ReadOnly)) {
+        while (!in.atEnd()) {
+            const QList<QByteArray> fields = in.readLine().trimmed().split('\t');
+            if (fields.size() < 4) {
+                continue;
+            }
+            Record &record = records[QString::fromUtf8(fields[0])];
+            record.size = fields[1].toLongLong();
+            record.modifiedMs = fields[2].toLongLong();
+            record.hash = fields[3];
+            ++lines;
+        }
+        in.close();
+    }
+
+    // 追記で膨らんだ記録は1ファイル1行に書き直す
+    if (lines > 2 * records.size() + 1024) {
+        QSaveFile out(logPath);
+        if (out.open(QIODevice::WriteOnly)) {
+            for (auto it = records.constBegin(); it != records.constEnd(); ++it) {
+                if (it.value().hash.isEmpty()) {
+                    continue;
+                }
+                out.write(it.key().toUtf8() + '\t' + QByteArray::number(it.value().size) + '\t'
+                          + QByteArray::number(it.value().modifiedMs) + '\t' + it.value().hash + '\n');
+            }
+            out.commit();
+        }
+    }
+
+    paths = records.keys();
+    std::sort(paths.begin(), paths.end());
+    done.fill(false, paths.size());
+    return true;
+}
+
+void ArchiveScrubber::loadCheckpoint()
+{
+    // 前回中断した位置（次に検査する相対パス）から続ける
+    QFile in(checkpointPath);
+    if (!in.open(QIODevice::ReadOnly)) {
+        return;
+    }
+    const QString resumeAt = QString::fromUtf8(in.readLine().trimmed());
+    const int start = static_cast<int>(std::lower_bound(paths.begin(), paths.end(), resumeAt) - paths.begin());
+    for (int i = 0; i < start; ++i) {
+        done[i] = true;
+    }
+    lowWater = start;
+    next.storeRelaxed(start);
+}
+
+bool ArchiveScrubber::saveCheckpoint()
+{
+    // チェックポイントより前の記録が先に永続化されているようにする
+    {
+        QMutexLocker locker(&logMutex);
+        log.flush();
+        PlatformIo::syncFile(log.handle());
+    }
+
+    QMutexLocker locker(&progressMutex);
+    sinceCheckpoint.restart();
+    if (lowWater >= paths.size()) {
+        // 一巡したので次回は最初から
+        completed = true;
+        return !QFile::exists(checkpointPath) || QFile::remove(checkpointPath);
+    }
+    QSaveFile out(checkpointPath);
+    if (!out.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    out.write(paths.at(lowWater).toUtf8() + '\n');
+    return out.commit();
+}
+
+void ArchiveScrubber::workerLoop()
+{
+    if (options.idleIoPriority) {
+        PlatformIo::setIdleIoPriority(true);
+    }
+    const qint64 deadlineMs = options.maxMinutes > 0 ? qint64(options.maxMinutes) * 60 * 1000 : 0;
+    while (!cancelled.loadRelaxed()) {
+        if (deadlineMs > 0 && elapsed.elapsed() >= deadlineMs) {
+            break;
+        }
+        const int index = next.fetchAndAddRelaxed(1);
+        if (index >= paths.size()) {
+            break;
+        }
+        scrubFile(index);
+        markDone(index);
+    }
+}
+
+void ArchiveScrubber::scrubFile(int index)
+{
+    const QString &relative = paths.at(index);
+    const QString path = QDir::cleanPath(options.root) + '/' + relative;
+    const Record recorded = records.value(relative);
+
+    const QFileInfo info(path);
+    if (!info.exists()) {
+        missing.ref();
+        emit problemFound(path, "ファイルがありません");
+        return;
+    }
+
+    RateLimiter::Scope *limit = RateLimiter::instance()->scope(rateScope());
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    QString error;
+    const bool read = PlatformIo::readUncached(path, [&](const char *data, qint64 size) {
+        limit->acquireBytes(size);
+        hash.addData(QByteArrayView(data, size));
+        bytes.fetchAndAddRelaxed(size);
+    }, &error);
+    if (!read) {
+        corrupted.ref();
+        emit problemFound(path, error);
+        return;
+    }
+
+    Record current;
+    current.size = info.size();
+    current.modifiedMs = info.lastModified().toMSecsSinceEpoch();
+    current.hash = hash.result().toHex();
+
+    if (recorded.hash.isEmpty()) {
+        // ハッシュが未記録のファイルは今回の内容を基準にする
+        baselined.ref();
+        appendRecord(relative, current);
+        return;
+    }
+    if (current.hash != recorded.hash || current.size != recorded.size) {
+        corrupted.ref();
+        if (recorded.modifiedMs != 0 && recorded.modifiedMs != current.modifiedMs) {
+            emit problemFound(path, "記録後に変更されています（ハッシュが一致しません）");
+        } else {
+            emit problemFound(path, "ハッシュが一致しません（ビット腐敗の可能性）");
+        }
+        return;
+    }
+    verified.ref();
+    if (recorded.modifiedMs == 0) {
+        // 次回から変更と破損を区別できるよう更新日時も記録する
+        appendRecord(relative, current);
+    }
+}
+
+void ArchiveScrubber::appendRecord(const QString &relativePath, const Record &record)
+{
+    const QByteArray line = relativePath.toUtf8() + '\t' + QByteArray::number(record.size) + '\t'
+                          + QByteArray::number(record.modifiedMs) + '\t' + record.hash + '\n';
+    QMutexLocker locker(&logMutex);
+    log.write(line);
+}
+
+void ArchiveScrubber::markDone(int index)
+{
+    bool checkpointDue = false;
+    int percentage = 0;
+    {
+        QMutexLocker locker(&progressMutex);
+        done[index] = true;
+        while (lowWater < done.size() && done.at(lowWater)) {
+            ++lowWater;
+        }
+        checkpointDue = sinceCheckpoint.elapsed() >= checkpointIntervalMs;
+        if (checkpointDue) {
+            sinceCheckpoint.restart();
+        }
+        percentage = static_cast<int>(qint64(lowWater) * 100 / qMax<qsizetype>(1, paths.size()));
+    }
+    if (checkpointDue) {
+        saveCheckpoint();
+    }
+
+    int previous = lastPercentage.loadRelaxed();
+    while (percentage > previous) {
+        if (lastPercentage.testAndSetRelaxed(previous, percentage)) {
+            emit progressChanged(percentage);
+            break;
+        }
+        previous = lastPercentage.loadRelaxed();
+    }
+}
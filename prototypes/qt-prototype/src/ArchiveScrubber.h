@@ -0,0 +1,100 @@
+#ifndef ARCHIVESCRUBBER_H
+#define ARCHIVESCRUBBER_H
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QStringList>
+#include <QVector>
+
+// 取り込み済みアーカイブの検査（スクラブ）の設定
+struct ScrubOptions
+{
+    QString root;                       // 取り込み済みの出力先フォルダ
+    int workerCount = 4;
+    double megabytesPerSecond = 50;     // 読み込み速度の上限（0は無制限）
+    bool idleIoPriority = true;
+    int maxMinutes = 0;                 // 1回の実行時間の上限（0は最後まで）。続きは次回にチェックポイントから
+};
+
+// 取り込み済みアーカイブの検査
+// 出力先のファイルを並列にキャッシュを通さずに読み直し、記録済みのハッシュ（ジャーナル、
+// または前回の検査で記録したもの）と比較して、ビット腐敗や欠損を報告する。
+// ハッシュが未記録のファイルは初回の検査で記録する。
+// 進み具合は定期的にチェックポイントに保存し、数十TBの検査を何晩にも分けて続けられる。
+// 読み込み速度は速度制限の "scrub" で制限し、設定画面から実行中に変更できる。
+class ArchiveScrubber : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ArchiveScrubber(const ScrubOptions &options, QObject *parent = nullptr);
+    ~ArchiveScrubber();
+
+    static QString rateScope() { return "scrub"; }
+
+    // 検査が一巡するか、時間の上限・キャンセルで中断するまでブロックする
+    bool run(QString *error);
+    void cancel();
+
+    int verifiedCount() const { return verified.loadRelaxed(); }
+    int corruptedCount() const { return corrupted.loadRelaxed(); }
+    int missingCount() const { return missing.loadRelaxed(); }
+    int baselinedCount() const { return baselined.loadRelaxed(); }
+    qint64 bytesRead() const { return bytes.loadRelaxed(); }
+    int totalCount() const { return static_cast<int>(paths.size()); }
+    // 今回の実行で一巡したか（falseなら次回はチェックポイントから続ける）
+    bool passCompleted() const { return completed; }
+
+signals:
+    void progressChanged(int percentage);
+    void problemFound(const QString &filePath, const QString &reason);
+
+private:
+    struct Record
+    {
+        qint64 size = 0;
+        qint64 modifiedMs = 0;          // 0は不明（ジャーナルから読んだ記録）
+        QByteArray hash;                // SHA-256（16進）
+    };
+
+    bool loadRecords(QString *error);
+    void loadCheckpoint();
+    bool saveCheckpoint();
+    void workerLoop();
+    void scrubFile(int index);
+    void appendRecord(const QString &relativePath, const Record &record);
+    void markDone(int index);
+
+    ScrubOptions options;
+    QString logPath;
+    QString checkpointPath;
+
+    QHash<QString, Record> records;     // ルートからの相対パス → 記録（実行中は読むだけ）
+    QStringList paths;                  // 検査する順（相対パスの昇順）
+    QAtomicInt next;
+
+    QMutex progressMutex;
+    QVector<bool> done;
+    int lowWater = 0;                   // ここより前はすべて検査済み
+    QElapsedTimer sinceCheckpoint;
+    QElapsedTimer elapsed;
+
+    QMutex logMutex;
+    QFile log;
+
+    QAtomicInt verified;
+    QAtomicInt corrupted;
+    QAtomicInt missing;
+    QAtomicInt baselined;
+    QAtomicInteger<qint64> bytes;
+    QAtomicInt cancelled;
+    QAtomicInt lastPercentage;
+    bool completed = false;
+};
+
+#endif // ARCHIVESCRUBBER_H
@@ -0,0 +1,149 @@
+#include "ChunkIndex.h"
+#include <QCryptographicHash>
+#include <QDir>
+#include <QReadLocker>
+#include <QStandardPaths>
+#include <QWriteLocker>
+#include <QtEndian>
+
+namespace {
+
+const qsizetype minCapacity = 1024;
+
+// 負荷率は2/3まで（線形探査が長くならないようにする）
+bool withinLoad(qint64 count, qsizetype capacity)
+{
+    return count * 3 <= qint64(capacity) * 2;
+}
+
+} // namespace
+
+ChunkIndex::ChunkIndex(const QString &destinationId)
+{
+    const QByteArray id = QCryptographicHash::hash(destinationId.toUtf8(), QCryptographicHash::Sha1).toHex();
+    const QString directory = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/chunks";
+    QDir().mkpath(directory);
+    path = directory + "/" + QString::fromLatin1(id) + ".idx";
+}
+
+bool ChunkIndex::open(QString *error)
+{
+    QWriteLocker locker(&lock);
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadWrite | QIODevice::Append)) {
+        *error = "チャンクの索引を開けません: " + file.errorString();
+        return false;
+    }
+
+    file.seek(0);
+    const qint64 records = file.size() / recordSize;
+    qsizetype capacity = minCapacity;
+    while (!withinLoad(records, capacity)) {
+        capacity *= 2;
+    }
+    rehash(capacity);
+    QByteArray block;
+    while (true) {
+        // まとめて読み、途中で切れた最後のレコードは無視する
+        block = file.read(recordSize * 4096);
+        if (block.size() < recordSize) {
+            break;
+        }
+        for (qsizetype offset = 0; offset + recordSize <= block.size(); offset += recordSize) {
+            insert(keyOf(block.constData() + offset));
+        }
+    }
+    file.seek(records * recordSize);
+    file.resize(records * recordSize);
+    return true;
+}
+
+bool ChunkIndex::contains(const QByteArray &hash) const
+{
+    if (hash.size() < hashSize) {
+        return false;
+    }
+    const Key key = keyOf(hash.constData());
+    QReadLocker locker(&lock);
+    if (table.isEmpty()) {
+        return false;
+    }
+    const Key &slot = table.at(find(key));
+    return slot.high != 0 || slot.low != 0;
+}
+
+bool ChunkIndex::add(const QVector<Chunk> &chunks)
+{
+    QByteArray data;
+    {
+        QWriteLocker locker(&lock);
+        for (const Chunk &chunk : chunks) {
+            if (chunk.hash.size() < hashSize || !insert(keyOf(chunk.hash.constData()))) {
+                continue;
+            }
+            data.append(chunk.hash);
+            const quint32 size = qToLittleEndian(static_cast<quint32>(chunk.size));
+            data.append(reinterpret_cast<const char *>(&size), sizeof(size));
+        }
+    }
+    if (data.isEmpty()) {
+        return true;
+    }
+    QMutexLocker locker(&fileMutex);
+    return file.write(data) == data.size() && file.flush();
+}
+
+int ChunkIndex::count() const
+{
+    QReadLocker locker(&lock);
+    return static_cast<int>(used);
+}
+
+ChunkIndex::Key ChunkIndex::keyOf(const char *hash)
+{
+    Key key;
+    key.high = qFromUnaligned<quint64>(hash);
+    key.low = qFromUnaligned<quint64>(hash + 8);
+    if (key.high == 0 && key.low == 0) {
+        key.low = 1;        // 空きスロットと区別する（SHA-256の先頭16バイトが0になることは事実上ない）
+    }
+    return key;
+}
+
+qsizetype ChunkIndex::find(const Key &key) const
+{
+    // SHA-256は一様に散らばるため、先頭8バイトをそのままスロットの位置にして線形探査する
+    const qsizetype mask = table.size() - 1;
+    for (qsizetype i = static_cast<qsizetype>(key.high) & mask; ; i = (i + 1) & mask) {
+        const Key &slot = table.at(i);
+        if ((slot.high == key.high && slot.low == key.low) || (slot.high == 0 && slot.low == 0)) {
+            return i;
+        }
+    }
+}
+
+bool ChunkIndex::insert(const Key &key)
+{
+    if (!withinLoad(used + 1, table.size())) {
+        rehash(qMax(minCapacity, table.size() * 2));
+    }
+    Key &slot = table[find(key)];
+    if (slot.high != 0 || slot.low != 0) {
+        return false;
+    }
+    slot = key;
+    ++used;
+    return true;
+}
+
+void ChunkIndex::rehash(qsizetype capacity)
+{
+    QVector<Key> old;
+    old.swap(table);
+    table.resize(capacity);
+    for (const Key &key : old) {
+        if (key.high != 0 || key.low != 0) {
+            table[find(key)] = key;
+        }
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef CHUNKINDEX_H
+#define CHUNKINDEX_H
+
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+#include <QFile>
+#include <QReadWriteLock>
+#include <QMutex>
+
+// 出力先に取り込み済みのチャンク（ContentChunker）の索引
+// 新しいファイルのうち既にあるチャンクの量を求めるのに使う。
+// アプリのデータフォルダに出力先毎の追記形式（SHA-256 32バイト + サイズ4バイト）で保存する。
+// メモリ上ではハッシュの先頭16バイトだけを開番地法の表に持つ（1チャンクあたり16バイト / 負荷率）。
+class ChunkIndex
+{
+public:
+    struct Chunk
+    {
+        QByteArray hash;
+        qint64 size = 0;
+    };
+
+    explicit ChunkIndex(const QString &destinationId);
+
+    bool open(QString *error);
+
+    // 任意のスレッドから呼べる
+    bool contains(const QByteArray &hash) const;
+    bool add(const QVector<Chunk> &chunks);
+
+    int count() const;
+    QString filePath() const { return path; }
+
+private:
+    static const int hashSize = 32;
+    static const int recordSize = hashSize + 4;
+
+    // ハッシュの先頭16バイト（両方0は空きスロット）
+    struct Key
+    {
+        quint64 high = 0;
+        quint64 low = 0;
+    };
+
+    static Key keyOf(const char *hash);
+    qsizetype find(const Key &key) const;      // keyのスロット、なければ入れるべき空きスロット
+    bool insert(const Key &key);                // 新しく加えたらtrue
+    void rehash(qsizetype capacity);
+
+    QString path;
+    QVector<Key> table;                         // 大きさは2の冪
+    qsizetype used = 0;
+    mutable QReadWriteLock lock;
+
+    QMutex fileMutex;
+    QFile file;
+};
+
+#endif // CHUNKINDEX_H
@@ -0,0 +1,227 @@
+#include "ChunkStoreDestination.h"
+#include "ContentChunker.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <memory>
+#include <vector>
+
+namespace {
+
+// レシピの書式: 1行目 "size \t 元のサイズ"、以降 "SHA-256(16進) \t チャンクのサイズ"
+struct Recipe
+{
+    QString path;
+    QByteArray text;
+};
+
+qint64 recipeSize(const QString &path)
+{
+    QFile in(path);
+    if (!in.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+    const QList<QByteArray> fields = in.readLine().trimmed().split('\t');
+    return fields.size() == 2 && fields[0] == "size" ? fields[1].toLongLong() : -1;
+}
+
+} // namespace
+
+// ChunkStoreUnitWriter Implementation
+class ChunkStoreUnitWriter : public UnitWriter
+{
+public:
+    ChunkStoreUnitWriter(ChunkStoreDestination *destination, const UnitPlan &plan)
+        : destination(destination), plan(plan), paths(std::make_shared<UnitPaths>(plan.sources.size()))
+    {
+        // 同じサイズのレシピがあるメンバーは保存済み
+        for (int i = 0; i < plan.sources.size(); ++i) {
+            (*paths)[i] = plan.relativePath(i);
+            const QString path = recipePath(i);
+            skipped.append(recipeSize(path) == plan.sources.at(i).size());
+        }
+    }
+
+    bool wants(int member) const override
+    {
+        return !skipped.at(member);
+    }
+
+    std::shared_ptr<const UnitPaths> destinationPaths() const override
+    {
+        return paths;
+    }
+
+    bool beginFile(int member, QString *) override
+    {
+        current.path = recipePath(member);
+        current.text = "size\t" + QByteArray::number(plan.sources.at(member).size()) + '\n';
+        chunkError.clear();
+        chunker = std::make_unique<ContentChunker>([this](const char *data, qint64 size) {
+            if (!chunkError.isEmpty()) {
+                return;
+            }
+            QByteArray hash;
+            if (destination->storeChunk(data, size, &hash, &chunkError)) {
+                current.text += hash + '\t' + QByteArray::number(size) + '\n';
+            }
+        });
+        return true;
+    }
+
+    bool write(const char *data, qint64 size, QString *error) override
+    {
+        chunker->feed(data, size);
+        if (!chunkError.isEmpty()) {
+            *error = chunkError;
+            return false;
+        }
+        return true;
+    }
+
+    bool endFile(QString *error) override
+    {
+        chunker->finish();
+        chunker.reset();
+        if (!chunkError.isEmpty()) {
+            *error = chunkError;
+            return false;
+        }
+        recipes.push_back(current);
+        return true;
+    }
+
+    bool commit(QString *error) override
+    {
+        // チャンクはすべて保存済みなので、レシピを置けば組の確定になる
+        for (const Recipe &recipe : recipes) {
+            QDir().mkpath(QFileInfo(recipe.path).absolutePath());
+            QSaveFile out(recipe.path);
+            if (!out.open(QIODevice::WriteOnly) || out.write(recipe.text) != recipe.text.size() || !out.commit()) {
+                *error = "レシピを書き込めません: " + recipe.path;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void abort() override
+    {
+        // 書いたチャンクは内容で識別されるため、次回以降の転送でそのまま使える
+        chunker.reset();
+        recipes.clear();
+    }
+
+private:
+    QString recipePath(int member) const
+    {
+        return destination->root + '/' + QString::fromUtf8(plan.relativePath(member)) + ChunkStoreDestination::recipeSuffix();
+    }
+
+    ChunkStoreDestination *destination;
+    UnitPlan plan;
+    QVector<bool> skipped;
+    std::shared_ptr<UnitPaths> paths;
+    std::unique_ptr<ContentChunker> chunker;
+    Recipe current;
+    QString chunkError;
+    std::vector<Recipe> recipes;
+};
+
+// ChunkStoreDestination Implementation
+ChunkStoreDestination::ChunkStoreDestination(const QString &root)
+    : root(QDir::cleanPath(root))
+{
+}
+
+bool ChunkStoreDestination::prepare(QString *error)
+{
+    // チャンクの振り分け先（先頭2桁）を先に作っておく
+    for (int i = 0; i < 256; ++i) {
+        const QString directory = root + "/chunks/" + QString::fromLatin1(QByteArray::number(i, 16).rightJustified(2, '0'));
+        if (!QDir().mkpath(directory)) {
+            *error = "出力先フォルダを作成できません: " + directory;
+            return false;
+        }
+    }
+    return true;
+}
+
+std::unique_ptr<UnitWriter> ChunkStoreDestination::beginUnit(const UnitPlan &plan, QString *)
+{
+    return std::make_unique<ChunkStoreUnitWriter>(this, plan);
+}
+
+bool ChunkStoreDestination::finish(QString *)
+{
+    return true;
+}
+
+bool ChunkStoreDestination::storeChunk(const char *data, qint64 size, QByteArray *hash, QString *error)
+{
+    *hash = ContentChunker::chunkHash(data, size).toHex();
+    const QString path = chunkPath(root, *hash);
+    if (QFileInfo(path).size() == size) {
+        return true;
+    }
+    QSaveFile out(path);
+    if (!out.open(QIODevice::WriteOnly) || out.write(data, size) != size || !out.commit()) {
+        *error = "チャンクを書き込めません: " + path;
+        return false;
+    }
+    return true;
+}
+
+QString ChunkStoreDestination::chunkPath(const QString &storeRoot, const QByteArray &hexHash)
+{
+    return storeRoot + "/chunks/" + QString::fromLatin1(hexHash.left(2)) + '/' + QString::fromLatin1(hexHash);
+}
+
+bool ChunkStoreDestination::restore(const QString &storeRoot, const QString &recipePath, const QString &outputPath,
+                                    QString *error)
+{
+    QFile in(recipePath);
+    if (!in.open(QIODevice::ReadOnly)) {
+        *error = "レシピを開けません: " + recipePath;
+        return false;
+    }
+    const QList<QByteArray> header = in.readLine().trimmed().split('\t');
+    if (header.size() != 2 || header[0] != "size") {
+        *error = "レシピの形式が正しくありません: " + recipePath;
+        return false;
+    }
+
+    QSaveFile out(outputPath);
+    if (!out.open(QIODevice::WriteOnly)) {
+        *error = "出力先を開けません: " + outputPath;
+        return false;
+    }
+    qint64 written = 0;
+    while (!in.atEnd()) {
+        const QList<QByteArray> fields = in.readLine().trimmed().split('\t');
+        if (fields.size() != 2) {
+            continue;
+        }
+        QFile chunk(chunkPath(QDir::cleanPath(storeRoot), fields[0]));
+        if (!chunk.open(QIODevice::ReadOnly)) {
+            *error = "チャンクがありません: " + QString::fromLatin1(fields[0]);
+            out.cancelWriting();
+            return false;
+        }
+        const QByteArray data = chunk.readAll();
+        if (data.size() != fields[1].toLongLong() || ContentChunker::chunkHash(data.constData(), data.size()).toHex() != fields[0]) {
+            *error = "チャンクが壊れています: " + QString::fromLatin1(fields[0]);
+            out.cancelWriting();
+            return false;
+        }
+        out.write(data);
+        written += data.size();
+    }
+    if (written != header[1].toLongLong()) {
+        *error = "レシピのサイズが一致しません: " + recipePath;
+        out.cancelWriting();
+        return false;
+    }
+    return out.commit();
+}
@@ -0,0 +1,37 @@
+#ifndef CHUNKSTOREDESTINATION_H
+#define CHUNKSTOREDESTINATION_H
+
+#include <QString>
+#include <QByteArray>
+#include "TransferDestination.h"
+
+// チャンク単位で重複を除いて保存する出力先（"chunks:<フォルダ>"）
+// ファイルはContentChunkerで分割し、チャンクは <root>/chunks/ab/<SHA-256> に1回だけ保存する。
+// 元のファイルの代わりにチャンクの並びを書いたレシピ（<相対パス>.recipe）を置き、
+// restore()でレシピから元のファイルを組み立て直す。切り取り・書き出し直しの動画は
+// 大半のチャンクが既にあるため、書き込む量も保存する量も小さくなる。
+class ChunkStoreDestination : public TransferDestination
+{
+public:
+    explicit ChunkStoreDestination(const QString &root);
+
+    QString name() const override { return "chunks"; }
+    bool prepare(QString *error) override;
+    std::unique_ptr<UnitWriter> beginUnit(const UnitPlan &plan, QString *error) override;
+    bool finish(QString *error) override;
+
+    static QString recipeSuffix() { return ".recipe"; }
+    // レシピから元のファイルを組み立てる（chunksフォルダはレシピと同じ保存先の直下にあるもの）
+    static bool restore(const QString &storeRoot, const QString &recipePath, const QString &outputPath, QString *error);
+
+private:
+    friend class ChunkStoreUnitWriter;
+
+    // 内容が同じチャンクが既にあれば書かない。hashにはSHA-256（16進）を返す
+    bool storeChunk(const char *data, qint64 size, QByteArray *hash, QString *error);
+    static QString chunkPath(const QString &storeRoot, const QByteArray &hexHash);
+
+    QString root;
+};
+
+#endif // CHUNKSTOREDESTINATION_H
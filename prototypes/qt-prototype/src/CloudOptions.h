@@ -0,0 +1,54 @@
+#ifndef CLOUDOPTIONS_H
+#define CLOUDOPTIONS_H
+
+#include <QString>
+
+// クラウドのフォルダ指定を "/a/b" の形にそろえる（ルートは空）
+inline QString normalizedCloudFolder(QString folder)
+{
+    if (!folder.startsWith('/')) {
+        folder.prepend('/');
+    }
+    while (folder.endsWith('/')) {
+        folder.chop(1);
+    }
+    return folder;
+}
+
+// S3互換ストレージの接続設定
+// 認証情報は環境変数（AWS_ACCESS_KEY_ID / AWS_SECRET_ACCESS_KEY / AWS_SESSION_TOKEN）から読み込み、
+// 設定ファイルや画面には保存しない。
+struct S3Options
+{
+    QString bucket;
+    QString region = "us-east-1";
+    QString endpoint;           // 空ならAWS（仮想ホスト形式）、指定時はパス形式（MinIO等）
+    QString prefix;             // キーの先頭に付ける（"photos/" など）
+    qint64 partSize = 8 * 1024 * 1024;
+    int concurrency = 4;        // 同時にアップロードするパート数
+
+    // 出力先を識別する文字列（マニフェスト・再開情報・取り込み済みファイルの目録で共通）
+    QString destinationId() const { return "s3:" + endpoint + '/' + bucket + '/' + prefix; }
+};
+
+// Dropboxの出力設定（アクセストークンは環境変数 DROPBOX_ACCESS_TOKEN）
+struct DropboxOptions
+{
+    QString folder = "/MediaTransfer";
+    qint64 chunkSize = 8 * 1024 * 1024;     // 4MBの倍数に切り下げる
+    int concurrency = 4;                    // 1ファイルで同時に送るチャンク数
+    int batchSize = 100;                    // まとめて確定するファイル数（最大1000）
+
+    QString destinationId() const { return "dropbox:" + normalizedCloudFolder(folder); }
+};
+
+// OneDriveの出力設定（アクセストークンは環境変数 ONEDRIVE_ACCESS_TOKEN）
+struct OneDriveOptions
+{
+    QString folder = "/MediaTransfer";
+    qint64 chunkSize = 10 * 1024 * 1024;    // 320KiBの倍数に切り下げる（最大60MiB）
+
+    QString destinationId() const { return "onedrive:" + normalizedCloudFolder(folder); }
+};
+
+#endif // CLOUDOPTIONS_H
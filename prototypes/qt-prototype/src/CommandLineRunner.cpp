@@ -0,0 +1,302 @@
+#include "CommandLineRunner.h"
+#include "DurabilityBenchmark.h"
+#include "ArchiveScrubber.h"
+#include "ChunkStoreDestination.h"
+#include "ImportCatalog.h"
+#include "PlaceIndex.h"
+#include "TrigramIndex.h"
+#include "DirectoryScanner.h"
+#include "TransferPipeline.h"
+#include "TransferPlan.h"
+#include "StageTrace.h"
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QMutex>
+#include <QTextStream>
+#include <cstring>
+
+namespace {
+const char *const commandOptions[] = {
+    "--benchmark-durability",
+    "--scrub",
+    "--chunk-restore",
+    "--find",
+    "--import-places",
+    "--plan",
+    "--execute-plan",
+    "--stream",
+};
+}
+
+bool CommandLineRunner::isRequested(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; ++i) {
+        for (const char *option : commandOptions) {
+            // "--scrub <dir>" と "--scrub=<dir>" の両方を受け付ける
+            const size_t length = std::strlen(option);
+            if (std::strncmp(argv[i], option, length) == 0 && (argv[i][length] == '\0' || argv[i][length] == '=')) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+int CommandLineRunner::run(const QStringList &arguments)
+{
+    QTextStream out(stdout);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Media Transfer Tool");
+    parser.addHelpOption();
+    parser.addOption({"benchmark-durability", "書き込み保証方式ごとのコストを計測"});
+    parser.addOption({"bench-dir", "ベンチマークの作業フォルダ", "dir", QDir::tempPath() + "/media-transfer-bench"});
+    parser.addOption({"bench-files", "ベンチマークのファイル数", "count", "500"});
+    parser.addOption({"bench-size", "ベンチマークのファイルサイズ(KB)", "kb", "2048"});
+    parser.addOption({"workers", "並列ワーカー数", "count", "4"});
+    parser.addOption({"scrub", "取り込み済みのフォルダを読み直して記録済みのハッシュと比較", "dir"});
+    parser.addOption({"scrub-mbps", "検査の読み込み速度の上限(MB/s、0は無制限)", "mbps", "50"});
+    parser.addOption({"scrub-minutes", "検査の実行時間の上限(分、0は最後まで)", "minutes", "0"});
+    parser.addOption({"chunk-restore", "チャンク単位の保存先のレシピから元のファイルを組み立てる", "recipe"});
+    parser.addOption({"chunk-store", "レシピのあるチャンク単位の保存先フォルダ", "dir"});
+    parser.addOption({"output", "組み立てたファイルの保存先", "file"});
+    parser.addOption({"find", "取り込み済みのアーカイブ全体からファイル名・フォルダ名を部分一致で検索", "text"});
+    parser.addOption({"fuzzy", "検索で1文字までの違いを許す"});
+    parser.addOption({"import-places", "地名のデータ（GeoNamesのTSV）から場所別フォルダ用の索引を作る", "file"});
+    parser.addOption({"plan", "コピーせずに転送の計画を作ってJSONに保存（引数はソースのファイル・フォルダ）", "file"});
+    parser.addOption({"dest", "計画・ストリーミングの出力先フォルダ", "dir"});
+    parser.addOption({"folder-template", "計画・ストリーミングのフォルダ名のテンプレート", "template", "{year}/{month}/{day}"});
+    parser.addOption({"name-template", "計画・ストリーミングのファイル名のテンプレート", "template", "{name}"});
+    parser.addOption({"execute-plan", "保存した計画をそのまま実行", "file"});
+    parser.addOption({"stream", "一覧を作らずにフォルダの木を走査しながら転送（引数で別のフォルダも追加できる）", "dir"});
+    parser.addOption({"trace", "処理の段階毎の時間をChrome trace形式のJSONに記録（Perfettoなどで開く）", "file"});
+    parser.addPositionalArgument("sources", "計画するファイル・フォルダ", "[sources...]");
+    parser.process(arguments);
+    if (parser.isSet("trace")) {
+        // 書き出しは終了時（main）
+        StageTrace::start(parser.value("trace"));
+    }
+
+    if (parser.isSet("find")) {
+        // 目録に記録した出力先のパスをまとめて索引する
+        QStringList paths;
+        QStringList owners;
+        for (const QString &id : ImportCatalog::destinationIds()) {
+            ImportCatalog catalog(id);
+            QString error;
+            if (!catalog.open(&error)) {
+                out << error << Qt::endl;
+                continue;
+            }
+            for (const QString &path : catalog.destinationPaths()) {
+                paths << path;
+                owners << id;
+            }
+        }
+        TrigramIndex index;
+        index.build(paths);
+        QElapsedTimer timer;
+        timer.start();
+        const QVector<int> hits = index.search(parser.value("find"), parser.isSet("fuzzy") ? 1 : 0);
+        const qint64 elapsedMs = timer.elapsed();
+        for (int hit : hits) {
+            out << owners.at(hit) << '\t' << paths.at(hit) << Qt::endl;
+        }
+        out << QString("%1 / %2 件（検索 %3 ms）").arg(hits.size()).arg(paths.size()).arg(elapsedMs) << Qt::endl;
+        return hits.isEmpty() ? 1 : 0;
+    }
+
+    if (parser.isSet("import-places")) {
+        QElapsedTimer timer;
+        timer.start();
+        int placeCount = 0;
+        QString error;
+        if (!PlaceIndex::compile(parser.value("import-places"), PlaceIndex::defaultIndexPath(), &placeCount, &error)) {
+            out << error << Qt::endl;
+            return 1;
+        }
+        out << QString("%1 件の地名を索引しました（%2 ms）: %3")
+                   .arg(placeCount)
+                   .arg(timer.elapsed())
+                   .arg(PlaceIndex::defaultIndexPath())
+            << Qt::endl;
+        return 0;
+    }
+
+    if (parser.isSet("plan")) {
+        TransferJob job;
+        for (const QString &source : parser.positionalArguments()) {
+            if (!QFileInfo(source).isDir()) {
+                job.files.append(QFileInfo(source).absoluteFilePath());
+                continue;
+            }
+            DirectoryScanner scanner(source);
+            QString error;
+            if (!scanner.scan(&error)) {
+                out << error << Qt::endl;
+                return 1;
+            }
+            job.files.append(scanner.files());
+        }
+        job.options.destinationRoot = parser.value("dest");
+        job.options.folderTemplate = parser.value("folder-template");
+        job.options.fileNameTemplate = parser.value("name-template");
+        if (job.files.isEmpty() || job.options.destinationRoot.isEmpty()) {
+            out << "ソースと --dest を指定してください" << Qt::endl;
+            return 1;
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+        TransferPipeline pipeline(job);
+        TransferPlan plan;
+        QString error;
+        if (!pipeline.plan(&plan, &error) || !plan.save(parser.value("plan"), &error)) {
+            out << error << Qt::endl;
+            return 1;
+        }
+        out << plan.summary() << Qt::endl;
+        out << QString("%1 件のファイルを計画しました（%2 ms）: %3")
+                   .arg(job.files.size())
+                   .arg(timer.elapsed())
+                   .arg(parser.value("plan"))
+            << Qt::endl;
+        return 0;
+    }
+
+    if (parser.isSet("execute-plan")) {
+        TransferPlan plan;
+        QString error;
+        if (!TransferPlan::load(parser.value("execute-plan"), &plan, &error)) {
+            out << error << Qt::endl;
+            return 1;
+        }
+        TransferJob job;
+        job.files = plan.files();
+        job.options.destinations = plan.destinations;
+        job.options.destinationRoot = plan.destinationRoot;
+        job.options.folderTemplate = plan.folderTemplate;
+        job.options.fileNameTemplate = plan.fileNameTemplate;
+        job.plan = std::make_shared<const TransferPlan>(plan);
+
+        TransferPipeline pipeline(job);
+        // 失敗はワーカースレッドから報告される
+        QMutex outMutex;
+        QObject::connect(&pipeline, &TransferPipeline::fileFailed, [&out, &outMutex](const QString &path, const QString &reason) {
+            QMutexLocker locker(&outMutex);
+            out << path << ": " << reason << Qt::endl;
+        });
+        QObject::connect(&pipeline, &TransferPipeline::warningIssued, [&out, &outMutex](const QString &message) {
+            QMutexLocker locker(&outMutex);
+            out << "注意: " << message << Qt::endl;
+        });
+        const bool ok = pipeline.run();
+        out << QString("転送: %1 件完了、%2 件を飛ばし、%3 件失敗（%4 MB）")
+                   .arg(pipeline.completedCount())
+                   .arg(pipeline.skippedCount())
+                   .arg(pipeline.failedCount())
+                   .arg(pipeline.bytesTransferred() / (1024 * 1024))
+            << Qt::endl;
+        return ok ? 0 : 2;
+    }
+
+    if (parser.isSet("stream")) {
+        TransferJob job;
+        job.streamRoots << parser.value("stream") << parser.positionalArguments();
+        job.options.destinationRoot = parser.value("dest");
+        job.options.folderTemplate = parser.value("folder-template");
+        job.options.fileNameTemplate = parser.value("name-template");
+        job.options.workerCount = parser.value("workers").toInt();
+        if (job.options.destinationRoot.isEmpty()) {
+            out << "--dest を指定してください" << Qt::endl;
+            return 1;
+        }
+
+        TransferPipeline pipeline(job);
+        // 進み具合と失敗はワーカースレッドから報告される
+        QMutex outMutex;
+        QElapsedTimer sinceReport;
+        sinceReport.start();
+        QObject::connect(&pipeline, &TransferPipeline::streamProgressChanged,
+                         [&out, &outMutex, &sinceReport](qint64 discovered, qint64 done) {
+            QMutexLocker locker(&outMutex);
+            if (sinceReport.elapsed() >= 1000) {
+                out << QString("発見 %1 件 / 完了 %2 件").arg(discovered).arg(done) << Qt::endl;
+                sinceReport.restart();
+            }
+        });
+        QObject::connect(&pipeline, &TransferPipeline::fileFailed, [&out, &outMutex](const QString &path, const QString &reason) {
+            QMutexLocker locker(&outMutex);
+            out << path << ": " << reason << Qt::endl;
+        });
+        QObject::connect(&pipeline, &TransferPipeline::warningIssued, [&out, &outMutex](const QString &message) {
+            QMutexLocker locker(&outMutex);
+            out << "注意: " << message << Qt::endl;
+        });
+        const bool ok = pipeline.run();
+        out << QString("転送: %1 件完了、%2 件を飛ばし、%3 件失敗（%4 MB）")
+                   .arg(pipeline.completedCount())
+                   .arg(pipeline.skippedCount())
+                   .arg(pipeline.failedCount())
+                   .arg(pipeline.bytesTransferred() / (1024 * 1024))
+            << Qt::endl;
+        return ok ? 0 : 2;
+    }
+
+    if (parser.isSet("chunk-restore")) {
+        QString error;
+        if (!ChunkStoreDestination::restore(parser.value("chunk-store"), parser.value("chunk-restore"),
+                                            parser.value("output"), &error)) {
+            out << error << Qt::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (parser.isSet("scrub")) {
+        ScrubOptions options;
+        options.root = parser.value("scrub");
+        options.workerCount = parser.value("workers").toInt();
+        options.megabytesPerSecond = parser.value("scrub-mbps").toDouble();
+        options.maxMinutes = parser.value("scrub-minutes").toInt();
+
+        ArchiveScrubber scrubber(options);
+        // 問題はワーカースレッドから報告される
+        QMutex outMutex;
+        QObject::connect(&scrubber, &ArchiveScrubber::problemFound, [&out, &outMutex](const QString &path, const QString &reason) {
+            QMutexLocker locker(&outMutex);
+            out << path << ": " << reason << Qt::endl;
+        });
+        QString error;
+        const bool clean = scrubber.run(&error);
+        if (!error.isEmpty()) {
+            out << error << Qt::endl;
+            return 1;
+        }
+        out << QString("検査: %1 件一致、%2 件を新たに記録、%3 件破損、%4 件欠損（%5 MB読み込み）")
+                   .arg(scrubber.verifiedCount())
+                   .arg(scrubber.baselinedCount())
+                   .arg(scrubber.corruptedCount())
+                   .arg(scrubber.missingCount())
+                   .arg(scrubber.bytesRead() / (1024 * 1024))
+            << Qt::endl;
+        if (!scrubber.passCompleted()) {
+            out << "途中で終了しました。次回はチェックポイントから続けます。" << Qt::endl;
+        }
+        return clean ? 0 : 2;
+    }
+
+    if (parser.isSet("benchmark-durability")) {
+        DurabilityBenchmark::Options options;
+        options.workDir = parser.value("bench-dir");
+        options.fileCount = parser.value("bench-files").toInt();
+        options.fileSize = parser.value("bench-size").toLongLong() * 1024;
+        options.workerCount = parser.value("workers").toInt();
+        return DurabilityBenchmark::run(options, out);
+    }
+
+    parser.showHelp(1);
+    return 1;
+}
@@ -0,0 +1,16 @@
+#ifndef COMMANDLINERUNNER_H
+#define COMMANDLINERUNNER_H
+
+#include <QStringList>
+
+// GUIを起動せずに実行するコマンドライン機能
+class CommandLineRunner
+{
+public:
+    // argvにコマンドライン専用のオプションが含まれているか
+    static bool isRequested(int argc, char *argv[]);
+
+    static int run(const QStringList &arguments);
+};
+
+#endif // COMMANDLINERUNNER_H
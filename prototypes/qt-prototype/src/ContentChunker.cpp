@@ -0,0 +1,114 @@
+#include "ContentChunker.h"
+#include <QCryptographicHash>
+#include <QStringList>
+
+namespace {
+
+// ギアハッシュの表（索引と保存済みのチャンクの区切りが変わらないよう、固定の種から作る）
+struct GearTable
+{
+    quint64 values[256];
+
+    GearTable()
+    {
+        quint64 state = 0x6d656469612d6364ULL;
+        for (quint64 &value : values) {
+            // splitmix64
+            quint64 z = (state += 0x9e3779b97f4a7c15ULL);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            value = z ^ (z >> 31);
+        }
+    }
+};
+
+const GearTable &gearTable()
+{
+    static const GearTable table;
+    return table;
+}
+
+// 平均64KB（16ビット）に対し、手前は18ビット、後ろは14ビットの条件（上位ビットほど履歴が長い）
+const quint64 strictMask = ((quint64(1) << 18) - 1) << (64 - 18);
+const quint64 looseMask = ((quint64(1) << 14) - 1) << (64 - 14);
+
+} // namespace
+
+ContentChunker::ContentChunker(const ChunkHandler &handler)
+    : handler(handler)
+{
+    pending.reserve(maxSize);
+}
+
+void ContentChunker::feed(const char *data, qint64 size)
+{
+    while (size > 0) {
+        // pendingは最大サイズまでしか溜めない
+        const qint64 take = qMin(size, maxSize - pending.size());
+        pending.append(data, take);
+        data += take;
+        size -= take;
+
+        qint64 length;
+        while ((length = findBoundary()) > 0) {
+            handler(pending.constData(), length);
+            pending.remove(0, length);
+            scanned = 0;
+            fingerprint = 0;
+        }
+    }
+}
+
+void ContentChunker::finish()
+{
+    if (!pending.isEmpty()) {
+        handler(pending.constData(), pending.size());
+    }
+    pending.clear();
+    scanned = 0;
+    fingerprint = 0;
+}
+
+qint64 ContentChunker::findBoundary()
+{
+    const qint64 available = pending.size();
+    if (available < minSize) {
+        return 0;
+    }
+    const quint64 *gear = gearTable().values;
+    const uchar *bytes = reinterpret_cast<const uchar *>(pending.constData());
+
+    // 最小サイズまではハッシュを計算しない
+    qint64 i = qMax(scanned, minSize);
+    quint64 hash = fingerprint;
+    const qint64 normalEnd = qMin(available, averageSize);
+    for (; i < normalEnd; ++i) {
+        hash = (hash << 1) + gear[bytes[i]];
+        if (!(hash & strictMask)) {
+            return i + 1;
+        }
+    }
+    for (; i < available; ++i) {
+        hash = (hash << 1) + gear[bytes[i]];
+        if (!(hash & looseMask)) {
+            return i + 1;
+        }
+    }
+    if (available >= maxSize) {
+        return maxSize;
+    }
+    scanned = i;
+    fingerprint = hash;
+    return 0;
+}
+
+QByteArray ContentChunker::chunkHash(const char *data, qint64 size)
+{
+    return QCryptographicHash::hash(QByteArrayView(data, size), QCryptographicHash::Sha256);
+}
+
+bool ContentChunker::isVideo(const QString &suffix)
+{
+    static const QStringList suffixes = {"mp4", "mov", "avi", "mkv", "wmv", "mts", "m2ts", "mxf", "m4v"};
+    return suffixes.contains(suffix, Qt::CaseInsensitive);
+}
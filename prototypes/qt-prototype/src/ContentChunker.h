@@ -0,0 +1,43 @@
+#ifndef CONTENTCHUNKER_H
+#define CONTENTCHUNKER_H
+
+#include <QByteArray>
+#include <QString>
+#include <functional>
+
+// 内容に基づくチャンク分割（FastCDC方式）
+// ギアハッシュが条件を満たした位置で区切るため、先頭の切り取りやヘッダーの書き換えで
+// ずれた位置でも同じ内容からは同じチャンクが得られる。最小サイズまではハッシュを計算せず、
+// 平均サイズより手前では厳しい条件、後ろでは緩い条件を使ってサイズのばらつきを抑える。
+// データは任意の大きさで順に与えられ、区切りが確定したチャンクから順に渡す。
+class ContentChunker
+{
+public:
+    using ChunkHandler = std::function<void(const char *data, qint64 size)>;
+
+    static constexpr qint64 minSize = 16 * 1024;
+    static constexpr qint64 averageSize = 64 * 1024;
+    static constexpr qint64 maxSize = 256 * 1024;
+
+    explicit ContentChunker(const ChunkHandler &handler);
+
+    void feed(const char *data, qint64 size);
+    // 残りを最後のチャンクとして渡す
+    void finish();
+
+    // チャンクの識別子（SHA-256）
+    static QByteArray chunkHash(const char *data, qint64 size);
+    // 拡張子（"mp4" など）が動画か
+    static bool isVideo(const QString &suffix);
+
+private:
+    // pending[scanned..] から区切りを探す。見つかればチャンクの長さ、なければ0
+    qint64 findBoundary();
+
+    ChunkHandler handler;
+    QByteArray pending;                 // 区切りが確定していないデータ（最大maxSize）
+    qint64 scanned = 0;
+    quint64 fingerprint = 0;
+};
+
+#endif // CONTENTCHUNKER_H
@@ -0,0 +1,91 @@
+#include "DeviceThroughput.h"
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+namespace {
+
+// 計画時に読む量
+const qint64 probeBytes = 16 * 1024 * 1024;
+const qint64 probeBlockSize = 1024 * 1024;
+
+// 新しい実測値の重み（カードやリーダーの違いで揺れるため前回までと平均する）
+const double recordWeight = 0.5;
+
+QMutex storeMutex;
+
+QString storePath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/throughput.tsv";
+}
+
+// 書式: デバイス \t バイト/秒
+QHash<QString, double> loadStore()
+{
+    QHash<QString, double> values;
+    QFile in(storePath());
+    if (!in.open(QIODevice::ReadOnly)) {
+        return values;
+    }
+    while (!in.atEnd()) {
+        const QList<QByteArray> fields = in.readLine().trimmed().split('\t');
+        if (fields.size() >= 2) {
+            values.insert(QString::fromUtf8(fields[0]), fields[1].toDouble());
+        }
+    }
+    return values;
+}
+
+} // namespace
+
+double DeviceThroughput::bytesPerSecond(const QString &source)
+{
+    QMutexLocker locker(&storeMutex);
+    return loadStore().value(source, 0.0);
+}
+
+void DeviceThroughput::record(const QString &source, double bytesPerSecond)
+{
+    if (bytesPerSecond <= 0) {
+        return;
+    }
+    QMutexLocker locker(&storeMutex);
+    QHash<QString, double> values = loadStore();
+    const double previous = values.value(source, 0.0);
+    values.insert(source, previous > 0 ? previous * (1 - recordWeight) + bytesPerSecond * recordWeight : bytesPerSecond);
+
+    QDir().mkpath(QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation));
+    QSaveFile out(storePath());
+    if (!out.open(QIODevice::WriteOnly)) {
+        return;
+    }
+    for (auto it = values.constBegin(); it != values.constEnd(); ++it) {
+        out.write(it.key().toUtf8() + '\t' + QByteArray::number(it.value(), 'f', 0) + '\n');
+    }
+    out.commit();
+}
+
+double DeviceThroughput::probe(const QString &path)
+{
+    QFile in(path);
+    if (!in.open(QIODevice::ReadOnly)) {
+        return 0;
+    }
+    QByteArray buffer(probeBlockSize, Qt::Uninitialized);
+    QElapsedTimer timer;
+    timer.start();
+    qint64 total = 0;
+    while (total < probeBytes) {
+        const qint64 n = in.read(buffer.data(), buffer.size());
+        if (n <= 0) {
+            break;
+        }
+        total += n;
+    }
+    const qint64 elapsedNs = timer.nsecsElapsed();
+    return total > 0 && elapsedNs > 0 ? total * 1e9 / elapsedNs : 0;
+}
@@ -0,0 +1,19 @@
+#ifndef DEVICETHROUGHPUT_H
+#define DEVICETHROUGHPUT_H
+
+#include <QString>
+
+// ソースのデバイス毎の読み込み速度の実測値（計画の推定時間に使う）
+// 転送の終わりにデバイス毎の速度を記録し、前回までの値と平均してアプリのデータフォルダに保存する。
+class DeviceThroughput
+{
+public:
+    // 記録がなければ0
+    static double bytesPerSecond(const QString &source);
+    static void record(const QString &source, double bytesPerSecond);
+
+    // 計画時の計測: pathの先頭を読んで速度を測る（ページキャッシュにあると速く出る）
+    static double probe(const QString &path);
+};
+
+#endif // DEVICETHROUGHPUT_H
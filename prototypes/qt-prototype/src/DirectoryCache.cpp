@@ -0,0 +1,76 @@
+#include "DirectoryCache.h"
+#include <QDir>
+#include <QFile>
+
+#ifndef Q_OS_WIN
+#include <sys/stat.h>
+#include <cerrno>
+#endif
+
+DirectoryCache::DirectoryCache()
+    : mkdirCalls(0)
+{
+}
+
+bool DirectoryCache::ensure(const QByteArray &dirPath)
+{
+    {
+        QReadLocker locker(&lock);
+        if (created.contains(dirPath)) {
+            return true;
+        }
+    }
+    return create(dirPath, 0);
+}
+
+void DirectoryCache::clear()
+{
+    QWriteLocker locker(&lock);
+    created.clear();
+}
+
+bool DirectoryCache::create(const QByteArray &dirPath, int depth)
+{
+    if (dirPath.isEmpty() || depth > 256) {
+        return false;
+    }
+
+#ifdef Q_OS_WIN
+    Q_UNUSED(depth);
+    mkdirCalls.ref();
+    const bool ok = QDir().mkpath(QFile::decodeName(dirPath));
+#else
+    // まずmkdirを試し、親がない場合だけ親を作成してやり直す
+    mkdirCalls.ref();
+    int result = ::mkdir(dirPath.constData(), 0777);
+    if (result != 0 && errno == ENOENT) {
+        const qsizetype slash = dirPath.lastIndexOf('/');
+        if (slash <= 0) {
+            return false;
+        }
+        const QByteArray parent = dirPath.left(slash);
+        bool parentReady;
+        {
+            QReadLocker locker(&lock);
+            parentReady = created.contains(parent);
+        }
+        if (!parentReady && !create(parent, depth + 1)) {
+            return false;
+        }
+        mkdirCalls.ref();
+        result = ::mkdir(dirPath.constData(), 0777);
+    }
+    bool ok = result == 0;
+    if (!ok && errno == EEXIST) {
+        // 同じ名前のファイルがある場合はディレクトリとして扱わない
+        struct stat info;
+        ok = ::stat(dirPath.constData(), &info) == 0 && S_ISDIR(info.st_mode);
+    }
+#endif
+
+    if (ok) {
+        QWriteLocker locker(&lock);
+        created.insert(dirPath);
+    }
+    return ok;
+}
@@ -0,0 +1,33 @@
+#ifndef DIRECTORYCACHE_H
+#define DIRECTORYCACHE_H
+
+#include <QByteArray>
+#include <QSet>
+#include <QReadWriteLock>
+#include <QAtomicInt>
+
+// 作成済みディレクトリのキャッシュ（複数ワーカーから共有）
+// 同じ日付フォルダへ大量のファイルを書く場合でも、
+// mkdirはディレクトリ毎に1回程度で済み、ファイル毎のstatは発生しない。
+class DirectoryCache
+{
+public:
+    DirectoryCache();
+
+    // dirPath（UTF-8）が存在するようにする。親は必要な場合のみ作成する
+    bool ensure(const QByteArray &dirPath);
+
+    // 作成済みの記録を捨てる（次に使うディレクトリはmkdirで確かめ直す）
+    void clear();
+
+    int mkdirCount() const { return mkdirCalls.loadRelaxed(); }
+
+private:
+    bool create(const QByteArray &dirPath, int depth);
+
+    QReadWriteLock lock;
+    QSet<QByteArray> created;
+    QAtomicInt mkdirCalls;
+};
+
+#endif // DIRECTORYCACHE_H
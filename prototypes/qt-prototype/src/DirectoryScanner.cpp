@@ -0,0 +1,261 @@
+#include "DirectoryScanner.h"
+#include "StageTrace.h"
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QStorageInfo>
+#include <QThread>
+#include <algorithm>
+
+namespace {
+
+const quint32 snapshotMagic = 0x4d545344;   // "MTSD"
+const quint32 snapshotVersion = 1;
+
+// この時間内に更新されたディレクトリは、同じ更新日時のまま更に変わりうるため次回も読み直す
+const qint64 racyWindowMs = 2000;
+
+// NASでは1ディレクトリ毎のstatの往復が支配的なため、同じ深さのディレクトリを並列に調べる
+const int scanThreadCount = 8;
+
+} // namespace
+
+DirectoryScanner::DirectoryScanner(const QString &root)
+    : root(QDir::cleanPath(root))
+    , listed(0)
+    , reused(0)
+{
+    const QByteArray id = QCryptographicHash::hash(this->root.toUtf8(), QCryptographicHash::Sha1).toHex();
+    const QString directory = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/snapshots";
+    QDir().mkpath(directory);
+    snapshotPath = directory + "/" + QString::fromLatin1(id) + ".snap";
+}
+
+bool DirectoryScanner::scan(QString *error)
+{
+    if (!QFileInfo(root).isDir()) {
+        *error = "フォルダがありません: " + root;
+        return false;
+    }
+    // FAT/exFATはファイルを追加してもディレクトリの更新日時が変わらないことがある
+    trustModified = !QStorageInfo(root).fileSystemType().toLower().contains("fat");
+    scanStartMs = QDateTime::currentMSecsSinceEpoch();
+    if (trustModified) {
+        loadSnapshot();
+    }
+
+    QVector<QByteArray> level = {QByteArray()};
+    while (!level.isEmpty()) {
+        QVector<QByteArray> next;
+        scanLevel(level, next);
+        level.swap(next);
+    }
+
+    // 子のハッシュを下から求め直し、内容の変わったディレクトリを数える
+    hashSubtree(QByteArray());
+    previous.clear();
+    if ((changed > 0 || listedCount() > 0) && !saveSnapshot()) {
+        // スナップショットがなくても次回すべてを読み直すだけ
+        *error = "フォルダのスナップショットを保存できません: " + snapshotPath;
+    }
+    return true;
+}
+
+PathTable DirectoryScanner::files() const
+{
+    PathTable out;
+    collectFiles(QByteArray(), out);
+    return out;
+}
+
+bool DirectoryScanner::loadSnapshot()
+{
+    QFile in(snapshotPath);
+    if (!in.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QDataStream stream(&in);
+    quint32 magic = 0;
+    quint32 version = 0;
+    qint32 count = 0;
+    stream >> magic >> version >> count;
+    if (magic != snapshotMagic || version != snapshotVersion || count < 0) {
+        return false;
+    }
+    previous.reserve(count);
+    for (qint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        QByteArray relative;
+        DirectoryEntry entry;
+        qint32 fileCount = 0;
+        qint32 subdirectoryCount = 0;
+        stream >> relative >> entry.modifiedMs >> entry.entryCount >> entry.childHash >> fileCount;
+        entry.files.resize(qMax(0, fileCount));
+        for (FileEntry &file : entry.files) {
+            stream >> file.name >> file.size >> file.modifiedMs;
+        }
+        stream >> subdirectoryCount;
+        entry.subdirectories.resize(qMax(0, subdirectoryCount));
+        for (QByteArray &name : entry.subdirectories) {
+            stream >> name;
+        }
+        previous.insert(relative, entry);
+    }
+    if (stream.status() != QDataStream::Ok) {
+        // 壊れたスナップショットは使わない
+        previous.clear();
+        return false;
+    }
+    return true;
+}
+
+bool DirectoryScanner::saveSnapshot()
+{
+    QSaveFile out(snapshotPath);
+    if (!out.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    QDataStream stream(&out);
+    stream << snapshotMagic << snapshotVersion << static_cast<qint32>(current.size());
+    for (auto it = current.constBegin(); it != current.constEnd(); ++it) {
+        const DirectoryEntry &entry = it.value();
+        stream << it.key() << entry.modifiedMs << entry.entryCount << entry.childHash
+               << static_cast<qint32>(entry.files.size());
+        for (const FileEntry &file : entry.files) {
+            stream << file.name << file.size << file.modifiedMs;
+        }
+        stream << static_cast<qint32>(entry.subdirectories.size());
+        for (const QByteArray &name : entry.subdirectories) {
+            stream << name;
+        }
+    }
+    return stream.status() == QDataStream::Ok && out.commit();
+}
+
+void DirectoryScanner::scanLevel(const QVector<QByteArray> &level, QVector<QByteArray> &next)
+{
+    QAtomicInt index(0);
+    auto work = [&]() {
+        while (true) {
+            const int i = index.fetchAndAddRelaxed(1);
+            if (i >= level.size()) {
+                break;
+            }
+            const QByteArray &relative = level.at(i);
+            DirectoryEntry entry = scanDirectory(relative);
+            QMutexLocker locker(&currentMutex);
+            for (const QByteArray &name : entry.subdirectories) {
+                next.append(childPath(relative, name));
+            }
+            current.insert(relative, entry);
+        }
+    };
+
+    const int threadCount = qMin(scanThreadCount, static_cast<int>(level.size()));
+    if (threadCount <= 1) {
+        work();
+        return;
+    }
+    QVector<QThread *> workers;
+    for (int i = 0; i < threadCount; ++i) {
+        QThread *worker = QThread::create(work);
+        worker->setObjectName(QString("走査 %1").arg(i + 1));
+        workers.append(worker);
+        worker->start();
+    }
+    for (QThread *worker : workers) {
+        worker->wait();
+        delete worker;
+    }
+}
+
+DirectoryScanner::DirectoryEntry DirectoryScanner::scanDirectory(const QByteArray &relative)
+{
+    const QString path = absolutePath(relative);
+    TraceSpan span("scan", path);
+    const qint64 modifiedMs = QFileInfo(path).lastModified().toMSecsSinceEpoch();
+    if (trustModified) {
+        auto it = previous.constFind(relative);
+        if (it != previous.constEnd() && it.value().modifiedMs == modifiedMs) {
+            // 直下のエントリは前回と同じ（子ディレクトリの中身は別に調べる）
+            reused.ref();
+            return it.value();
+        }
+    }
+
+    listed.ref();
+    DirectoryEntry entry;
+    entry.modifiedMs = modifiedMs < scanStartMs - racyWindowMs ? modifiedMs : -1;
+    QDirIterator it(path, QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot | QDir::NoSymLinks);
+    while (it.hasNext()) {
+        it.next();
+        const QFileInfo info = it.fileInfo();
+        ++entry.entryCount;
+        if (info.isDir()) {
+            entry.subdirectories.append(info.fileName().toUtf8());
+        } else {
+            FileEntry file;
+            file.name = info.fileName().toUtf8();
+            file.size = info.size();
+            file.modifiedMs = info.lastModified().toMSecsSinceEpoch();
+            entry.files.append(file);
+        }
+    }
+    std::sort(entry.subdirectories.begin(), entry.subdirectories.end());
+    std::sort(entry.files.begin(), entry.files.end(), [](const FileEntry &a, const FileEntry &b) {
+        return a.name < b.name;
+    });
+    return entry;
+}
+
+QByteArray DirectoryScanner::hashSubtree(const QByteArray &relative)
+{
+    const DirectoryEntry entry = current.value(relative);
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    for (const FileEntry &file : entry.files) {
+        hash.addData(file.name + '\t' + QByteArray::number(file.size) + '\t' + QByteArray::number(file.modifiedMs) + '\n');
+    }
+    for (const QByteArray &name : entry.subdirectories) {
+        hash.addData(name + '/' + hashSubtree(childPath(relative, name)) + '\n');
+    }
+    const QByteArray childHash = hash.result();
+    if (previous.value(relative).childHash != childHash) {
+        ++changed;
+    }
+    current[relative].childHash = childHash;
+    return childHash;
+}
+
+void DirectoryScanner::collectFiles(const QByteArray &relative, PathTable &out) const
+{
+    // ファイルと子ディレクトリを名前順に混ぜて、パスの昇順に並べる
+    const DirectoryEntry entry = current.value(relative);
+    const QString base = absolutePath(relative) + '/';
+    int file = 0;
+    int subdirectory = 0;
+    while (file < entry.files.size() || subdirectory < entry.subdirectories.size()) {
+        if (subdirectory >= entry.subdirectories.size()
+            || (file < entry.files.size() && entry.files.at(file).name < entry.subdirectories.at(subdirectory))) {
+            out.append(base + QString::fromUtf8(entry.files.at(file).name));
+            ++file;
+        } else {
+            collectFiles(childPath(relative, entry.subdirectories.at(subdirectory)), out);
+            ++subdirectory;
+        }
+    }
+}
+
+QString DirectoryScanner::absolutePath(const QByteArray &relative) const
+{
+    return relative.isEmpty() ? root : root + '/' + QString::fromUtf8(relative);
+}
+
+QByteArray DirectoryScanner::childPath(const QByteArray &parent, const QByteArray &name)
+{
+    return parent.isEmpty() ? name : parent + '/' + name;
+}
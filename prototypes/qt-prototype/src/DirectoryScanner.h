@@ -0,0 +1,75 @@
+#ifndef DIRECTORYSCANNER_H
+#define DIRECTORYSCANNER_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QHash>
+#include <QVector>
+#include <QMutex>
+#include <QAtomicInt>
+#include "PathTable.h"
+
+// ドロップされたフォルダの走査
+// ディレクトリ毎の更新日時・エントリ数・子のハッシュをスナップショットとして保存し、
+// 再走査では更新日時の変わったディレクトリだけを読み直す（変わっていなければ前回の一覧を使う）。
+// ファイルの追加・削除・名前の変更はそのディレクトリの更新日時を変えるため、
+// 各ディレクトリのstatだけで変更のない部分木を読み飛ばせる。
+// ディレクトリの更新日時が当てにならないFAT/exFATでは、毎回すべてを読み直す。
+class DirectoryScanner
+{
+public:
+    explicit DirectoryScanner(const QString &root);
+
+    // 走査してスナップショットを更新する
+    bool scan(QString *error);
+
+    // 見つかったファイル（絶対パス、パスの昇順。隠しファイルは除く）
+    PathTable files() const;
+
+    int listedCount() const { return listed.loadRelaxed(); }
+    int reusedCount() const { return reused.loadRelaxed(); }
+    // 前回の走査から内容が変わったディレクトリの数（初回はすべて）
+    int changedCount() const { return changed; }
+
+private:
+    struct FileEntry
+    {
+        QByteArray name;            // UTF-8
+        qint64 size = 0;
+        qint64 modifiedMs = 0;
+    };
+
+    struct DirectoryEntry
+    {
+        qint64 modifiedMs = -1;     // -1は次回必ず読み直す
+        int entryCount = 0;
+        QByteArray childHash;       // ファイルと子ディレクトリのハッシュから求める（部分木の内容を表す）
+        QVector<FileEntry> files;
+        QVector<QByteArray> subdirectories;
+    };
+
+    bool loadSnapshot();
+    bool saveSnapshot();
+    void scanLevel(const QVector<QByteArray> &level, QVector<QByteArray> &next);
+    DirectoryEntry scanDirectory(const QByteArray &relative);
+    QByteArray hashSubtree(const QByteArray &relative);
+    void collectFiles(const QByteArray &relative, PathTable &out) const;
+    QString absolutePath(const QByteArray &relative) const;
+    static QByteArray childPath(const QByteArray &parent, const QByteArray &name);
+
+    QString root;
+    QString snapshotPath;
+    bool trustModified = true;
+    qint64 scanStartMs = 0;
+
+    QHash<QByteArray, DirectoryEntry> previous;     // 前回のスナップショット（ルートからの相対パス → 内容）
+    QMutex currentMutex;
+    QHash<QByteArray, DirectoryEntry> current;
+
+    QAtomicInt listed;
+    QAtomicInt reused;
+    int changed = 0;
+};
+
+#endif // DIRECTORYSCANNER_H
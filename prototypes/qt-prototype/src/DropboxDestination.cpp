@@ -0,0 +1,660 @@
+#include "DropboxDestination.h"
+#include "UploadStateStore.h"
+#include "UploadTracker.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QFile>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+#include <QSet>
+#include <QStringList>
+
+namespace {
+
+const qint64 chunkAlignment = 4 * 1024 * 1024;
+const qint64 contentHashBlockSize = 4 * 1024 * 1024;
+
+// Dropbox-API-ArgヘッダーはASCIIのみのため、非ASCII文字は\uXXXXで表す
+QByteArray headerJson(const QJsonObject &object)
+{
+    const QString json = QString::fromUtf8(QJsonDocument(object).toJson(QJsonDocument::Compact));
+    QByteArray result;
+    result.reserve(json.size());
+    for (const QChar c : json) {
+        if (c.unicode() < 0x80) {
+            result += static_cast<char>(c.unicode());
+        } else {
+            result += "\\u" + QByteArray::number(c.unicode(), 16).rightJustified(4, '0');
+        }
+    }
+    return result;
+}
+
+// Dropboxのcontent_hash（4MBのブロック毎のSHA-256を連結したもののSHA-256）
+QByteArray contentHashOf(const QString &path, const QByteArray &)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    while (!file.atEnd()) {
+        const QByteArray block = file.read(contentHashBlockSize);
+        if (block.isEmpty()) {
+            return QByteArray();
+        }
+        hash.addData(QCryptographicHash::hash(block, QCryptographicHash::Sha256));
+    }
+    return hash.result().toHex();
+}
+
+// 1ファイル分のアップロードセッション（チャンクのアップロードタスクと共有する）
+struct DropboxSession
+{
+    QString path;
+    QString sessionId;
+    qint64 size = 0;
+    QJsonObject state;              // 再開用の記録（done以外）
+
+    QMutex mutex;
+    QSet<qint64> done;              // 送信済みチャンクの先頭オフセット
+    UploadTracker tasks;
+
+    QJsonObject stateWithDone() const
+    {
+        QJsonArray offsets;
+        for (qint64 offset : done) {
+            offsets.append(offset);
+        }
+        QJsonObject result = state;
+        result.insert("done", offsets);
+        return result;
+    }
+};
+
+} // namespace
+
+// DropboxUnitWriter Implementation
+class DropboxUnitWriter : public UnitWriter
+{
+public:
+    DropboxUnitWriter(DropboxDestination *destination, const UnitPlan &plan)
+        : destination(destination), plan(plan)
+    {
+        destination->manifest->claimKeys(plan, &keys, &uploaded);
+        paths = std::make_shared<UnitPaths>(keys);
+    }
+
+    ~DropboxUnitWriter() override
+    {
+        if (session) {
+            session->tasks.wait(nullptr);
+        }
+    }
+
+    bool wants(int member) const override
+    {
+        return !uploaded.at(member);
+    }
+
+    std::shared_ptr<const UnitPaths> destinationPaths() const override
+    {
+        return paths;
+    }
+
+    bool beginFile(int member, QString *error) override
+    {
+        const QFileInfo &source = plan.sources.at(member);
+        key = keys.at(member);
+        currentMember = member;
+        path = destination->options.folder + '/' + QString::fromUtf8(key);
+        size = source.size();
+        modifiedMs = source.lastModified().toMSecsSinceEpoch();
+        offset = 0;
+        buffer.clear();
+        session.reset();
+
+        if (size <= destination->options.chunkSize) {
+            buffer.reserve(size);
+            return true;
+        }
+        buffer.reserve(destination->options.chunkSize);
+        return startSession(source, error);
+    }
+
+    bool write(const char *data, qint64 length, QString *error) override
+    {
+        if (!session) {
+            buffer.append(data, length);
+            return true;
+        }
+
+        const qint64 chunkSize = destination->options.chunkSize;
+        while (length > 0) {
+            const qint64 take = qMin(length, chunkSize - buffer.size());
+            buffer.append(data, take);
+            data += take;
+            length -= take;
+            if (buffer.size() == chunkSize && !dispatchChunk(error)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool endFile(QString *error) override
+    {
+        if (!session) {
+            // 小さなファイルは1回で送ってセッションを閉じる
+            const HttpResponse response = destination->callContent("upload_session/start",
+                                                                   QJsonObject{{"close", true}}, buffer);
+            if (!response.isSuccess()) {
+                *error = DropboxDestination::errorOf(response);
+                return false;
+            }
+            const QString sessionId = QJsonDocument::fromJson(response.body).object().value("session_id").toString();
+            commits.append(commitFor(sessionId, QString()));
+            return true;
+        }
+
+        if (!buffer.isEmpty() && !dispatchChunk(error)) {
+            return false;
+        }
+        if (!session->tasks.wait(error)) {
+            return false;
+        }
+        commits.append(commitFor(session->sessionId, session->path));
+        session.reset();
+        return true;
+    }
+
+    bool commit(QString *error) override
+    {
+        return destination->addToBatch(commits, error);
+    }
+
+    void abort() override
+    {
+        // セッションIDと送信済みチャンクは次回の再開のために残す
+        if (session) {
+            session->tasks.wait(nullptr);
+        }
+        session.reset();
+        QVector<QByteArray> claimed;
+        for (int member = 0; member < keys.size(); ++member) {
+            if (!uploaded.at(member)) {
+                claimed.append(keys.at(member));
+            }
+        }
+        destination->manifest->releaseKeys(claimed);
+    }
+
+private:
+    DropboxCommit commitFor(const QString &sessionId, const QString &stateKey) const
+    {
+        DropboxCommit commit;
+        commit.entry = QJsonObject{
+            {"cursor", QJsonObject{{"session_id", sessionId}, {"offset", size}}},
+            {"commit", QJsonObject{{"path", path}, {"mode", "add"}, {"autorename", false}, {"mute", true}}}
+        };
+        commit.stateKey = stateKey;
+        commit.key = key;
+        commit.size = size;
+        commit.modifiedMs = modifiedMs;
+        commit.plan = plan;
+        commit.member = currentMember;
+        commit.paths = paths;
+        return commit;
+    }
+
+    bool startSession(const QFileInfo &source, QString *error)
+    {
+        session = std::make_shared<DropboxSession>();
+        session->path = path;
+        session->size = size;
+        session->state = QJsonObject{
+            {"source", source.absoluteFilePath()},
+            {"size", size},
+            {"modified", source.lastModified().toMSecsSinceEpoch()},
+            {"chunkSize", destination->options.chunkSize}
+        };
+
+        // 同じファイルのセッションが残っていれば、送信済みのチャンクを飛ばして続きから送る
+        const QJsonObject saved = destination->states->load(path);
+        if (!saved.isEmpty()
+            && saved.value("source") == session->state.value("source")
+            && saved.value("size").toInteger() == size
+            && saved.value("modified").toInteger() == source.lastModified().toMSecsSinceEpoch()
+            && saved.value("chunkSize").toInteger() == destination->options.chunkSize) {
+            session->sessionId = saved.value("sessionId").toString();
+            for (const QJsonValue &value : saved.value("done").toArray()) {
+                session->done.insert(value.toInteger());
+            }
+            session->state.insert("sessionId", session->sessionId);
+            return true;
+        }
+
+        const HttpResponse response = destination->callContent(
+            "upload_session/start", QJsonObject{{"close", false}, {"session_type", "concurrent"}}, QByteArray());
+        if (!response.isSuccess()) {
+            *error = DropboxDestination::errorOf(response);
+            session.reset();
+            return false;
+        }
+        session->sessionId = QJsonDocument::fromJson(response.body).object().value("session_id").toString();
+        session->state.insert("sessionId", session->sessionId);
+        destination->states->save(path, session->state);
+        return true;
+    }
+
+    bool dispatchChunk(QString *error)
+    {
+        const qint64 chunkOffset = offset;
+        QByteArray data = std::move(buffer);
+        buffer = QByteArray();
+        buffer.reserve(destination->options.chunkSize);
+        offset += data.size();
+        const bool last = offset == size;
+
+        {
+            QMutexLocker locker(&session->mutex);
+            if (session->done.contains(chunkOffset)) {
+                return true;
+            }
+        }
+        if (!session->tasks.begin(destination->options.concurrency, error)) {
+            return false;
+        }
+
+        std::shared_ptr<DropboxSession> shared = session;
+        DropboxDestination *owner = destination;
+        owner->chunkPool.start([shared, owner, chunkOffset, data, last]() {
+            const QJsonObject arg{
+                {"cursor", QJsonObject{{"session_id", shared->sessionId}, {"offset", chunkOffset}}},
+                {"close", last}
+            };
+            const HttpResponse response = owner->callContent("upload_session/append_v2", arg, data);
+            if (response.isSuccess()) {
+                QMutexLocker locker(&shared->mutex);
+                shared->done.insert(chunkOffset);
+                owner->states->save(shared->path, shared->stateWithDone());
+            } else if (response.status == 404 || response.body.contains("not_found")) {
+                // セッションが失効した場合は記録を消し、次回は最初から送る
+                owner->states->remove(shared->path);
+            }
+            shared->tasks.end(response.isSuccess() ? QString() : DropboxDestination::errorOf(response));
+        });
+        return true;
+    }
+
+    DropboxDestination *destination;
+    UnitPlan plan;
+    QVector<QByteArray> keys;       // メンバー毎のキー（マニフェストで予約したもの）
+    QVector<bool> uploaded;         // マニフェスト上でアップロード済みのメンバー
+    std::shared_ptr<UnitPaths> paths;
+
+    QByteArray key;
+    int currentMember = -1;
+    QString path;
+    qint64 size = 0;
+    qint64 modifiedMs = 0;
+    qint64 offset = 0;
+    QByteArray buffer;
+    std::shared_ptr<DropboxSession> session;
+
+    QVector<DropboxCommit> commits; // finish_batchに渡す確定待ちのファイル
+};
+
+// DropboxDestination Implementation
+DropboxDestination::DropboxDestination(const DropboxOptions &options)
+    : options(options)
+{
+}
+
+DropboxDestination::~DropboxDestination()
+{
+    chunkPool.waitForDone();
+    if (manifest) {
+        manifest->waitForRefresh(nullptr);
+    }
+}
+
+bool DropboxDestination::prepare(QString *error)
+{
+    const QByteArray token = qgetenv("DROPBOX_ACCESS_TOKEN");
+    if (token.isEmpty()) {
+        *error = "Dropboxのアクセストークンがありません（DROPBOX_ACCESS_TOKEN を設定してください）";
+        return false;
+    }
+    authorization = "Bearer " + token;
+    // 接続先は環境変数で差し替えられる（ローカルのモックサーバー用）
+    apiUrl = qEnvironmentVariable("DROPBOX_API_URL", "https://api.dropboxapi.com");
+    contentUrl = qEnvironmentVariable("DROPBOX_CONTENT_URL", "https://content.dropboxapi.com");
+
+    options.folder = normalizedCloudFolder(options.folder);
+    // 並列追記できるセッションでは、最後以外のチャンクを4MBの倍数にする必要がある
+    options.chunkSize = qMax(chunkAlignment, options.chunkSize / chunkAlignment * chunkAlignment);
+    options.concurrency = qMax(1, options.concurrency);
+    options.batchSize = qBound(1, options.batchSize, 1000);
+
+    const QString destinationId = options.destinationId();
+    states = std::make_unique<UploadStateStore>(UploadStateStore::defaultDirectory(destinationId));
+    manifest = std::make_unique<RemoteManifest>(destinationId);
+    if (!manifest->open()) {
+        *error = "マニフェストを開けません: " + manifest->filePath();
+        return false;
+    }
+    manifest->setSourceHasher(contentHashOf);
+    manifest->refreshIfStale(this, options.concurrency);
+    chunkPool.setMaxThreadCount(options.concurrency);
+    chunkPool.setObjectName("Dropbox アップロード");
+    return true;
+}
+
+std::unique_ptr<UnitWriter> DropboxDestination::beginUnit(const UnitPlan &plan, QString *)
+{
+    return std::make_unique<DropboxUnitWriter>(this, plan);
+}
+
+bool DropboxDestination::checkpoint(QString *error)
+{
+    // 溜めている確定待ちのファイルをバッチの件数に達していなくても確定する
+    chunkPool.waitForDone();
+    QMutexLocker locker(&batchMutex);
+    const QVector<DropboxCommit> ready = batch;
+    batch.clear();
+    locker.unlock();
+    return ready.isEmpty() || finishBatch(ready, 0, error);
+}
+
+bool DropboxDestination::finish(QString *error)
+{
+    bool ok = checkpoint(error);
+    // 一覧の取り直しに失敗しても転送には影響しない（次回また取り直す）
+    manifest->waitForRefresh(nullptr);
+
+    QMutexLocker locker(&failureMutex);
+    if (ok && !backgroundErrors.isEmpty()) {
+        *error = backgroundErrors.join(" / ");
+        ok = false;
+    }
+    backgroundErrors.clear();
+    return ok;
+}
+
+void DropboxDestination::setFailureHandler(const FailureHandler &handler)
+{
+    QMutexLocker locker(&failureMutex);
+    failureHandler = handler;
+}
+
+void DropboxDestination::reportFailure(const QVector<QFileInfo> &sources, const QString &error)
+{
+    QMutexLocker locker(&failureMutex);
+    if (failureHandler) {
+        failureHandler(sources, error);
+    } else {
+        backgroundErrors << error;
+    }
+}
+
+bool DropboxDestination::listLevel(const QByteArray &prefix, QVector<QByteArray> *folders, const Page &page, QString *error)
+{
+    return listFolder(prefix, folders, page, error);
+}
+
+bool DropboxDestination::listAll(const QByteArray &prefix, const Page &page, QString *error)
+{
+    return listFolder(prefix, nullptr, page, error);
+}
+
+HttpResponse DropboxDestination::callContent(const QByteArray &endpoint, const QJsonObject &arg, const QByteArray &data)
+{
+    return HttpClient::sendWithRetry("POST", QUrl(contentUrl + "/2/files/" + QString::fromLatin1(endpoint)),
+                                     {{"Authorization", authorization},
+                                      {"Content-Type", "application/octet-stream"},
+                                      {"Dropbox-API-Arg", headerJson(arg)}},
+                                     data);
+}
+
+bool DropboxDestination::addToBatch(const QVector<DropboxCommit> &commits, QString *error)
+{
+    QMutexLocker locker(&batchMutex);
+    batch += commits;
+    if (batch.size() < options.batchSize) {
+        return true;
+    }
+
+    const QVector<DropboxCommit> ready = batch;
+    batch.clear();
+    locker.unlock();
+
+    return finishBatch(ready, static_cast<int>(commits.size()), error);
+}
+
+bool DropboxDestination::finishBatch(QVector<DropboxCommit> commits, int ownCount, QString *error)
+{
+    QVector<QString> failures(commits.size());
+    QVector<QByteArray> hashes(commits.size());     // 確定できたファイルのcontent_hash
+    QVector<bool> committed(commits.size(), false);
+    QVector<int> todo;
+    for (int i = 0; i < commits.size(); ++i) {
+        todo.append(i);
+    }
+
+    // 名前が使われていたファイルがあれば、その組のファイルをすべて次の連番に付け直し
+    // （確定済みのものは移動する）、もう1回だけ確定する
+    for (int round = 0; round < 2 && !todo.isEmpty(); ++round) {
+        QJsonArray entries;
+        for (int i : todo) {
+            entries.append(commits.at(i).entry);
+        }
+        const QByteArray body = QJsonDocument(QJsonObject{{"entries", entries}}).toJson(QJsonDocument::Compact);
+        const HttpResponse response = HttpClient::sendWithRetry(
+            "POST", QUrl(apiUrl + "/2/files/upload_session/finish_batch_v2"),
+            {{"Authorization", authorization}, {"Content-Type", "application/json"}}, body);
+        if (!response.isSuccess()) {
+            for (int i : todo) {
+                failures[i] = errorOf(response);
+            }
+            break;
+        }
+
+        QSet<const UnitPaths *> conflictingUnits;
+        QSet<int> conflicts;
+        const QJsonArray results = QJsonDocument::fromJson(response.body).object().value("entries").toArray();
+        for (int k = 0; k < todo.size(); ++k) {
+            const int i = todo.at(k);
+            const DropboxCommit &commit = commits.at(i);
+            const QJsonObject result = results.at(k).toObject();
+            if (result.value(".tag").toString() == "success") {
+                failures[i].clear();
+                hashes[i] = result.value("content_hash").toString().toLatin1();
+                committed[i] = true;
+                continue;
+            }
+            const QJsonObject failure = result.value("failure").toObject();
+            failures[i] = pathOf(commit) + ": " + (k < results.size()
+                                                       ? QString::fromUtf8(QJsonDocument(failure).toJson(QJsonDocument::Compact))
+                                                       : QString("結果がありません"));
+            const bool conflict = failure.value(".tag").toString() == "path"
+                && failure.value("path").toObject().value(".tag").toString() == "conflict";
+            if (conflict && round == 0 && commit.paths) {
+                conflictingUnits.insert(commit.paths.get());
+                conflicts.insert(i);
+            }
+        }
+
+        todo.clear();
+        for (const UnitPaths *unit : conflictingUnits) {
+            QVector<int> unitCommits;
+            QVector<int> members;
+            for (int i = 0; i < commits.size(); ++i) {
+                if (commits.at(i).paths.get() == unit && (committed.at(i) || conflicts.contains(i))) {
+                    unitCommits.append(i);
+                    members.append(commits.at(i).member);
+                }
+            }
+            const UnitPlan &plan = commits.at(unitCommits.first()).plan;
+            QVector<QByteArray> keys(plan.sources.size());
+            manifest->claimAgain(plan, members, &keys);
+
+            // 確定済みのファイルを移動できなければ、残りは確定し直さない（組が分かれたことを伝える）
+            bool moved = true;
+            for (int i : unitCommits) {
+                if (committed.at(i)) {
+                    QString moveError;
+                    if (moved && moveFile(pathOf(commits.at(i)), keys.at(commits.at(i).member), &moveError)) {
+                        rename(&commits[i], keys.at(commits.at(i).member));
+                    } else if (moved) {
+                        moved = false;
+                        for (int j : unitCommits) {
+                            if (!committed.at(j)) {
+                                failures[j] += " / 移動できません: " + moveError;
+                            }
+                        }
+                    }
+                }
+            }
+            if (!moved) {
+                continue;
+            }
+            for (int i : unitCommits) {
+                if (!committed.at(i)) {
+                    rename(&commits[i], keys.at(commits.at(i).member));
+                    todo.append(i);
+                }
+            }
+        }
+    }
+
+    // 確定できたファイルだけをマニフェストに記録し、組の一部だけが確定した場合は組が分かれたことを伝える
+    QHash<const UnitPaths *, QStringList> placed;
+    for (int i = 0; i < commits.size(); ++i) {
+        const DropboxCommit &commit = commits.at(i);
+        if (!commit.stateKey.isEmpty()) {
+            states->remove(commit.stateKey);
+        }
+        if (committed.at(i)) {
+            manifest->record(commit.key, commit.size, hashes.at(i), commit.modifiedMs);
+            placed[commit.paths.get()] << pathOf(commit);
+        }
+    }
+    for (int i = 0; i < commits.size(); ++i) {
+        const QStringList unitPlaced = placed.value(commits.at(i).paths.get());
+        if (!failures.at(i).isEmpty() && commits.at(i).paths && !unitPlaced.isEmpty()) {
+            failures[i] = QString("組が分かれました（置いたもの: %1）: %2").arg(unitPlaced.join(", "), failures.at(i));
+        }
+    }
+
+    // 呼び出し元の組の失敗はerrorで返し、他のワーカーの組の失敗はファイル毎に報告する
+    const int ownFrom = static_cast<int>(commits.size()) - ownCount;
+    QStringList ownFailures;
+    for (int i = 0; i < commits.size(); ++i) {
+        if (failures.at(i).isEmpty()) {
+            continue;
+        }
+        if (i >= ownFrom) {
+            ownFailures << failures.at(i);
+        } else {
+            const DropboxCommit &commit = commits.at(i);
+            reportFailure({commit.plan.sources.at(commit.member)}, "Dropboxで確定に失敗しました: " + failures.at(i));
+        }
+    }
+    if (!ownFailures.isEmpty()) {
+        *error = QString("Dropboxで%1件の確定に失敗しました: %2").arg(ownFailures.size()).arg(ownFailures.first());
+        return false;
+    }
+    return true;
+}
+
+bool DropboxDestination::moveFile(const QString &from, const QByteArray &key, QString *error)
+{
+    const QJsonObject arg{{"from_path", from}, {"to_path", options.folder + '/' + QString::fromUtf8(key)},
+                          {"autorename", false}};
+    const HttpResponse response = HttpClient::sendWithRetry(
+        "POST", QUrl(apiUrl + "/2/files/move_v2"),
+        {{"Authorization", authorization}, {"Content-Type", "application/json"}},
+        QJsonDocument(arg).toJson(QJsonDocument::Compact));
+    if (!response.isSuccess()) {
+        *error = errorOf(response);
+        return false;
+    }
+    return true;
+}
+
+void DropboxDestination::rename(DropboxCommit *commit, const QByteArray &key) const
+{
+    commit->key = key;
+    QJsonObject target = commit->entry.value("commit").toObject();
+    target.insert("path", options.folder + '/' + QString::fromUtf8(key));
+    commit->entry.insert("commit", target);
+    (*commit->paths)[commit->member] = key;
+}
+
+QString DropboxDestination::pathOf(const DropboxCommit &commit)
+{
+    return commit.entry.value("commit").toObject().value("path").toString();
+}
+
+bool DropboxDestination::listFolder(const QByteArray &prefix, QVector<QByteArray> *folders, const Page &page, QString *error)
+{
+    // foldersを渡すとprefix直下だけ、渡さなければ配下をすべて列挙する
+    QString folder = options.folder;
+    if (!prefix.isEmpty()) {
+        folder += '/' + QString::fromUtf8(prefix.chopped(1));
+    }
+    QString endpoint = "list_folder";
+    QJsonObject arg{{"path", folder}, {"recursive", folders == nullptr}, {"limit", 2000}};
+    while (true) {
+        const HttpResponse response = HttpClient::sendWithRetry(
+            "POST", QUrl(apiUrl + "/2/files/" + endpoint),
+            {{"Authorization", authorization}, {"Content-Type", "application/json"}},
+            QJsonDocument(arg).toJson(QJsonDocument::Compact));
+        if (response.status == 409 && response.body.contains("not_found")) {
+            return true;        // まだフォルダがない
+        }
+        if (!response.isSuccess()) {
+            *error = errorOf(response);
+            return false;
+        }
+
+        // キーは出力先フォルダからの相対パスで返す
+        const QJsonObject result = QJsonDocument::fromJson(response.body).object();
+        QVector<RemoteObject> objects;
+        for (const QJsonValue &value : result.value("entries").toArray()) {
+            const QJsonObject entry = value.toObject();
+            const QByteArray key = entry.value("path_display").toString().mid(options.folder.size() + 1).toUtf8();
+            const QString tag = entry.value(".tag").toString();
+            if (tag == "file") {
+                RemoteObject object;
+                object.key = key;
+                object.size = entry.value("size").toInteger();
+                object.hash = entry.value("content_hash").toString().toLatin1();
+                objects.append(object);
+            } else if (tag == "folder" && folders) {
+                folders->append(key + '/');
+            }
+        }
+        page(objects);
+        if (!result.value("has_more").toBool()) {
+            return true;
+        }
+        endpoint = "list_folder/continue";
+        arg = QJsonObject{{"cursor", result.value("cursor").toString()}};
+    }
+}
+
+QString DropboxDestination::errorOf(const HttpResponse &response)
+{
+    if (response.status == 0) {
+        return "Dropboxに接続できません: " + response.error;
+    }
+    const QString summary = QJsonDocument::fromJson(response.body).object().value("error_summary").toString();
+    return QString("Dropboxエラー (HTTP %1): %2")
+        .arg(response.status)
+        .arg(summary.isEmpty() ? QString::fromUtf8(response.body.left(200)) : summary);
+}
@@ -0,0 +1,96 @@
+#ifndef DROPBOXDESTINATION_H
+#define DROPBOXDESTINATION_H
+
+#include <QString>
+#include <QByteArray>
+#include <QJsonObject>
+#include <QVector>
+#include <QStringList>
+#include <QMutex>
+#include <QThreadPool>
+#include <memory>
+#include "TransferDestination.h"
+#include "HttpClient.h"
+#include "CloudOptions.h"
+#include "RemoteManifest.h"
+
+class UploadStateStore;
+
+// finish_batchで確定する1ファイル
+struct DropboxCommit
+{
+    QJsonObject entry;
+    QString stateKey;               // 再開用の記録（セッションを使い回さなかった場合は空）
+    QByteArray key;                 // マニフェストのキー
+    qint64 size = 0;
+    qint64 modifiedMs = 0;
+
+    // 失敗の報告と名前の付け直し用
+    UnitPlan plan;
+    int member = -1;
+    std::shared_ptr<UnitPaths> paths;
+};
+
+// Dropboxへの出力（アップロードセッション）
+// 大きなファイルは並列追記できるセッション（session_type: concurrent）を開き、
+// チャンクを同時に送る。セッションIDと送信済みチャンクを記録しておき、中断後は続きから送る。
+// 小さなファイルは1回のリクエストでセッションを閉じ、finish_batchでまとめて確定する。
+// バッチは他のワーカーの組とまとめて確定するため、commit()は自分の組の確定を待たないことがある。
+// 後から確定に失敗したファイルは failureHandler でファイル毎に報告する。
+// 名前はマニフェストにあるものと重ならないよう連番を付け、既存のファイルは上書きしない（mode: add）。
+// 先を越されていた（path/conflict）ファイルがあれば、その組のファイルをすべて次の連番に付け直し、
+// 確定済みのものは移動して1回だけ確定し直す。移動できなければ組が分かれたことを伝える。
+// 同じパス・サイズのファイルがマニフェストにあれば、そのファイルは送らない（一覧から取得したものはcontent_hashも照合する）。
+// アクセストークンは環境変数 DROPBOX_ACCESS_TOKEN から読み込む。
+class DropboxDestination : public TransferDestination, public RemoteLister
+{
+public:
+    explicit DropboxDestination(const DropboxOptions &options);
+    ~DropboxDestination() override;
+
+    QString name() const override { return "dropbox"; }
+    bool prepare(QString *error) override;
+    std::unique_ptr<UnitWriter> beginUnit(const UnitPlan &plan, QString *error) override;
+    bool checkpoint(QString *error) override;
+    bool finish(QString *error) override;
+
+    // マニフェストの一覧の取り直しを待つ（取り直した後の状態から始めたいテスト用）
+    bool waitForRefresh(QString *error) { return manifest->waitForRefresh(error); }
+    void setFailureHandler(const FailureHandler &handler) override;
+
+    bool listLevel(const QByteArray &prefix, QVector<QByteArray> *folders, const Page &page, QString *error) override;
+    bool listAll(const QByteArray &prefix, const Page &page, QString *error) override;
+
+private:
+    friend class DropboxUnitWriter;
+
+    // content系API（本文がファイルデータ、引数はDropbox-API-Argヘッダー）
+    HttpResponse callContent(const QByteArray &endpoint, const QJsonObject &arg, const QByteArray &data);
+    bool addToBatch(const QVector<DropboxCommit> &commits, QString *error);
+    // commitsの最後のownCount件は呼び出し元の組のもので、その失敗はerrorで返す（残りはfailureHandlerへ）
+    bool finishBatch(QVector<DropboxCommit> commits, int ownCount, QString *error);
+    // 確定済みのファイルをkeyの場所へ移動する（上書きはしない）
+    bool moveFile(const QString &from, const QByteArray &key, QString *error);
+    void rename(DropboxCommit *commit, const QByteArray &key) const;
+    static QString pathOf(const DropboxCommit &commit);
+    void reportFailure(const QVector<QFileInfo> &sources, const QString &error);
+    bool listFolder(const QByteArray &prefix, QVector<QByteArray> *folders, const Page &page, QString *error);
+    static QString errorOf(const HttpResponse &response);
+
+    DropboxOptions options;
+    QByteArray authorization;
+    QString apiUrl;
+    QString contentUrl;
+    std::unique_ptr<UploadStateStore> states;
+    std::unique_ptr<RemoteManifest> manifest;
+    QThreadPool chunkPool;
+
+    QMutex batchMutex;
+    QVector<DropboxCommit> batch;
+
+    QMutex failureMutex;
+    FailureHandler failureHandler;
+    QStringList backgroundErrors;   // failureHandlerがない場合はfinish()で返す
+};
+
+#endif // DROPBOXDESTINATION_H
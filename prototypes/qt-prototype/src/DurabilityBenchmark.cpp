@@ -0,0 +1,71 @@
+#include "DurabilityBenchmark.h"
+#include "TransferPipeline.h"
+#include <QDir>
+#include <QFile>
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <QTextStream>
+
+int DurabilityBenchmark::run(const Options &options, QTextStream &out)
+{
+    const QString sourceDir = options.workDir + "/source";
+    if (!QDir().mkpath(sourceDir)) {
+        out << "作業フォルダを作成できません: " << sourceDir << Qt::endl;
+        return 1;
+    }
+
+    // ダミーのソースファイルを生成
+    PathTable files;
+    QByteArray data(options.fileSize, Qt::Uninitialized);
+    QRandomGenerator::global()->fillRange(reinterpret_cast<quint32 *>(data.data()), data.size() / sizeof(quint32));
+    for (int i = 0; i < options.fileCount; ++i) {
+        const QString path = QString("%1/IMG_%2.JPG").arg(sourceDir).arg(i, 5, 10, QChar('0'));
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size()) {
+            out << "ソースファイルを作成できません: " << path << Qt::endl;
+            return 1;
+        }
+        files.append(path);
+    }
+
+    const QList<DurabilityMode> modes = {
+        DurabilityMode::None, DurabilityMode::PerFile, DurabilityMode::Batched, DurabilityMode::SyncFs
+    };
+
+    out << QString("%1 files x %2 KB, %3 workers").arg(options.fileCount).arg(options.fileSize / 1024).arg(options.workerCount) << Qt::endl;
+    out << QString("%1 %2 %3 %4").arg("mode", -10).arg("seconds", 10).arg("files/s", 10).arg("MB/s", 10) << Qt::endl;
+
+    int result = 0;
+    for (DurabilityMode mode : modes) {
+        const QString destination = options.workDir + "/dest-" + durabilityModeName(mode);
+        QDir(destination).removeRecursively();
+
+        TransferJob job;
+        job.files = files;
+        job.options.destinationRoot = destination;
+        job.options.folderTemplate.clear();
+        job.options.workerCount = options.workerCount;
+        job.options.durability.mode = mode;
+
+        TransferPipeline pipeline(job);
+        QElapsedTimer timer;
+        timer.start();
+        const bool ok = pipeline.run();
+        const double seconds = timer.nsecsElapsed() / 1e9;
+
+        out << QString("%1 %2 %3 %4%5")
+                   .arg(durabilityModeName(mode), -10)
+                   .arg(seconds, 10, 'f', 3)
+                   .arg(options.fileCount / seconds, 10, 'f', 1)
+                   .arg(pipeline.bytesTransferred() / (1024.0 * 1024.0) / seconds, 10, 'f', 1)
+                   .arg(ok ? "" : "  (失敗あり)")
+            << Qt::endl;
+        if (!ok) {
+            result = 1;
+        }
+        QDir(destination).removeRecursively();
+    }
+
+    QDir(sourceDir).removeRecursively();
+    return result;
+}
@@ -0,0 +1,24 @@
+#ifndef DURABILITYBENCHMARK_H
+#define DURABILITYBENCHMARK_H
+
+#include <QString>
+
+class QTextStream;
+
+// 書き込み保証方式ごとのコストを計測する
+// workDir以下にダミーのソースファイルを生成し、各方式でパイプラインを実行する。
+class DurabilityBenchmark
+{
+public:
+    struct Options
+    {
+        QString workDir;
+        int fileCount = 500;
+        qint64 fileSize = 2 * 1024 * 1024;
+        int workerCount = 4;
+    };
+
+    static int run(const Options &options, QTextStream &out);
+};
+
+#endif // DURABILITYBENCHMARK_H
@@ -0,0 +1,291 @@
+#include "DurabilityPolicy.h"
+#include "NameRegistry.h"
+#include "PlatformIo.h"
+#include <QAtomicInt>
+#include <QCoreApplication>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+
+namespace {
+
+// 一時ファイル名の通し番号（プロセス内）
+QAtomicInt nextTemporary;
+
+// 名前を付け直す回数の上限（他のプロセスと取り合い続ける場合）
+const int maxRenameAttempts = 100;
+
+} // namespace
+
+QString durabilityModeName(DurabilityMode mode)
+{
+    switch (mode) {
+    case DurabilityMode::None: return "none";
+    case DurabilityMode::PerFile: return "per-file";
+    case DurabilityMode::Batched: return "batched";
+    case DurabilityMode::SyncFs: return "syncfs";
+    }
+    return "batched";
+}
+
+DurabilityMode durabilityModeFromName(const QString &name)
+{
+    if (name == "none") return DurabilityMode::None;
+    if (name == "per-file") return DurabilityMode::PerFile;
+    if (name == "syncfs") return DurabilityMode::SyncFs;
+    return DurabilityMode::Batched;
+}
+
+DurabilityManager::DurabilityManager(const DurabilityOptions &options, const QString &destinationRoot, TransferJournal *journal,
+                                     NameRegistry *names)
+    : options(options)
+    , destinationRoot(destinationRoot)
+    , journal(journal)
+    , names(names)
+    , pendingFiles(0)
+    , pendingBytes(0)
+{
+}
+
+DurabilityManager::~DurabilityManager()
+{
+    checkpoint(nullptr);
+}
+
+QString DurabilityManager::temporaryPathFor(const QString &finalPath)
+{
+    QFileInfo info(finalPath);
+    return QString("%1/.%2.%3-%4.mtpart").arg(info.absolutePath(), info.fileName())
+        .arg(QCoreApplication::applicationPid()).arg(nextTemporary.fetchAndAddRelaxed(1));
+}
+
+bool DurabilityManager::commit(std::vector<StagedFile> files, QString *error)
+{
+    QSet<QString> directories;
+    QVector<JournalEntry> entries;
+
+    switch (options.mode) {
+    case DurabilityMode::None:
+        return publish(files, false, directories, entries, error)
+            && recordInJournal(entries, false, error);
+
+    case DurabilityMode::PerFile:
+        return publish(files, true, directories, entries, error)
+            && syncDirectories(directories, error)
+            && recordInJournal(entries, true, error);
+
+    case DurabilityMode::SyncFs:
+        // すぐに公開し、永続化はチェックポイントのsyncfsに任せる
+        if (!publish(files, false, directories, entries, error)) {
+            return false;
+        }
+        break;
+
+    case DurabilityMode::Batched:
+        break;
+    }
+
+    qint64 bytes = 0;
+    for (const StagedFile &file : files) {
+        bytes += file.entry.size;
+    }
+
+    std::vector<Unit> batch;
+    {
+        QMutexLocker locker(&mutex);
+        pendingFiles += static_cast<int>(files.size());
+        pendingBytes += bytes;
+        pending.push_back(std::move(files));
+        if (pendingFiles < options.checkpointFiles && pendingBytes < options.checkpointBytes) {
+            return true;
+        }
+        batch.swap(pending);
+        pendingFiles = 0;
+        pendingBytes = 0;
+    }
+    return flush(batch, true, error);
+}
+
+bool DurabilityManager::checkpoint(QString *error)
+{
+    std::vector<Unit> batch;
+    {
+        QMutexLocker locker(&mutex);
+        batch.swap(pending);
+        pendingFiles = 0;
+        pendingBytes = 0;
+    }
+    if (batch.empty()) {
+        return true;
+    }
+    return flush(batch, false, error);
+}
+
+void DurabilityManager::setFailureHandler(const TransferDestination::FailureHandler &handler)
+{
+    failureHandler = handler;
+}
+
+bool DurabilityManager::flush(std::vector<Unit> &batch, bool ownsLast, QString *error)
+{
+    QVector<JournalEntry> entries;
+    QVector<QString> unitErrors(static_cast<int>(batch.size()));
+    QString batchError;
+
+    if (options.mode == DurabilityMode::SyncFs) {
+        if (!PlatformIo::syncFileSystem(destinationRoot)) {
+            batchError = QString("syncfsに失敗しました: %1").arg(destinationRoot);
+        }
+        for (const Unit &unit : batch) {
+            for (const StagedFile &file : unit) {
+                entries.append(file.entry);
+            }
+        }
+    } else {
+        // ファイル本体 → rename → 親ディレクトリの順で永続化する
+        QSet<QString> directories;
+        for (size_t i = 0; i < batch.size(); ++i) {
+            publish(batch[i], true, directories, entries, &unitErrors[static_cast<int>(i)]);
+        }
+        syncDirectories(directories, &batchError);
+    }
+    if (batchError.isEmpty()) {
+        recordInJournal(entries, true, &batchError);
+    }
+
+    // 呼び出し元の組（ownsLastなら最後の組）の失敗はerrorで返し、他の呼び出し元の組はfailureHandlerで知らせる
+    bool ok = true;
+    for (size_t i = 0; i < batch.size(); ++i) {
+        const QString unitError = unitErrors.at(static_cast<int>(i)).isEmpty() ? batchError
+                                                                               : unitErrors.at(static_cast<int>(i));
+        if (unitError.isEmpty()) {
+            continue;
+        }
+        if (!failureHandler || (ownsLast && i + 1 == batch.size())) {
+            if (error && ok) *error = unitError;
+            ok = false;
+            continue;
+        }
+        QVector<QFileInfo> sources;
+        for (const StagedFile &file : batch[i]) {
+            sources.append(QFileInfo(file.entry.sourcePath));
+        }
+        failureHandler(sources, unitError);
+    }
+    return ok;
+}
+
+bool DurabilityManager::publish(Unit &files, bool syncFirst, QSet<QString> &directories, QVector<JournalEntry> &entries, QString *error)
+{
+    // 組の途中で失敗した場合、残りの一時ファイルは公開せずに破棄し、公開済みのメンバーも消す
+    // （組の片方だけが最終的な名前で残ると、ジャーナルにない半端な組になり次回に別の連番で取り込まれる）
+    size_t published = 0;
+    bool ok = true;
+    for (size_t i = 0; i < files.size(); ++i) {
+        StagedFile &staged = files[i];
+        if (ok && syncFirst && !PlatformIo::syncFile(staged.file->handle())) {
+            if (error) *error = QString("fsyncに失敗しました: %1").arg(staged.temporaryPath);
+            ok = false;
+        }
+        staged.file->close();
+        if (!ok) {
+            QFile::remove(staged.temporaryPath);
+            continue;
+        }
+        if (!publishFile(files, i, error)) {
+            QFile::remove(staged.temporaryPath);
+            ok = false;
+            continue;
+        }
+        directories.insert(QFileInfo(staged.finalPath).absolutePath());
+        ++published;
+    }
+
+    if (!ok) {
+        for (size_t i = 0; i < published; ++i) {
+            if (!QFile::remove(files[i].finalPath) && error) {
+                *error += QString("（公開済みのファイルを消せませんでした: %1）").arg(files[i].finalPath);
+            }
+        }
+        return false;
+    }
+    for (const StagedFile &staged : files) {
+        entries.append(staged.entry);
+    }
+    return true;
+}
+
+bool DurabilityManager::publishFile(Unit &files, size_t index, QString *error)
+{
+    for (int attempt = 0; attempt < maxRenameAttempts; ++attempt) {
+        const StagedFile &staged = files[index];
+        bool exists = false;
+        if (PlatformIo::renameNoReplace(staged.temporaryPath, staged.finalPath, &exists)) {
+            return true;
+        }
+        if (!exists || !names || staged.base.isEmpty()) {
+            if (error) *error = QString("リネームに失敗しました: %1").arg(staged.finalPath);
+            return false;
+        }
+        // 予約した後に別のプロセスが同じ名前で書き込んだ
+        if (!renumber(files, index, error)) {
+            return false;
+        }
+    }
+    if (error) *error = QString("空いているファイル名が見つかりません: %1").arg(files[index].finalPath);
+    return false;
+}
+
+bool DurabilityManager::renumber(Unit &files, size_t published, QString *error)
+{
+    // 組のメンバーは同じbaseを持つ。使われていた名前は台帳に残したまま次の連番を予約する
+    const QByteArray base = files.front().base;
+    const qsizetype slash = base.lastIndexOf('/');
+    QVector<QByteArray> suffixes;
+    for (const StagedFile &file : files) {
+        suffixes.append(file.suffix);
+    }
+    const int number = names->claimGroup(base.left(slash), base.mid(slash + 1), suffixes);
+    const QByteArray numbered = number > 0 ? base + '_' + QByteArray::number(number) : base;
+    const QByteArray rootPrefix = QFile::encodeName(destinationRoot) + '/';
+
+    for (size_t i = 0; i < files.size(); ++i) {
+        StagedFile &file = files[i];
+        const QByteArray path = numbered + file.suffix;
+        // 公開済みのメンバーも同じ連番に揃える
+        bool exists = false;
+        if (i < published && !PlatformIo::renameNoReplace(file.finalPath, QFile::decodeName(path), &exists)) {
+            if (error) *error = QString("リネームに失敗しました: %1").arg(QFile::decodeName(path));
+            return false;
+        }
+        file.finalPath = QFile::decodeName(path);
+        file.entry.destinationPath = file.finalPath;
+        if (file.paths && file.member >= 0) {
+            (*file.paths)[file.member] = path.startsWith(rootPrefix) ? path.mid(rootPrefix.size()) : path;
+        }
+    }
+    return true;
+}
+
+bool DurabilityManager::syncDirectories(const QSet<QString> &directories, QString *error)
+{
+    for (const QString &dir : directories) {
+        if (!PlatformIo::syncDirectory(dir)) {
+            if (error) *error = QString("ディレクトリの同期に失敗しました: %1").arg(dir);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool DurabilityManager::recordInJournal(const QVector<JournalEntry> &entries, bool sync, QString *error)
+{
+    if (!journal || entries.isEmpty()) {
+        return true;
+    }
+    if (!journal->append(entries) || (sync && !journal->sync())) {
+        if (error) *error = QString("ジャーナルの書き込みに失敗しました: %1").arg(journal->errorString());
+        return false;
+    }
+    return true;
+}
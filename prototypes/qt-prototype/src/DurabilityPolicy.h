@@ -0,0 +1,97 @@
+#ifndef DURABILITYPOLICY_H
+#define DURABILITYPOLICY_H
+
+#include <QString>
+#include <QVector>
+#include <QMutex>
+#include <QSet>
+#include <memory>
+#include <vector>
+#include "TransferJournal.h"
+#include "TransferDestination.h"
+
+class QFile;
+class NameRegistry;
+
+// 書き込み保証の方式
+enum class DurabilityMode {
+    None,       // 一時ファイル→renameのみ（同期なし）
+    PerFile,    // ファイル毎にfsync + 親ディレクトリfsync
+    Batched,    // 複数ファイルをまとめてfsyncし、親ディレクトリは重複を除いて1回ずつ
+    SyncFs      // チェックポイント毎にsyncfsを1回発行
+};
+
+QString durabilityModeName(DurabilityMode mode);
+DurabilityMode durabilityModeFromName(const QString &name);
+
+struct DurabilityOptions
+{
+    DurabilityMode mode = DurabilityMode::Batched;
+    int checkpointFiles = 64;
+    qint64 checkpointBytes = 256LL * 1024 * 1024;
+};
+
+// 書き込み済みで確定待ちの一時ファイル
+struct StagedFile
+{
+    std::unique_ptr<QFile> file;    // 開いたまま渡す（close前にfsyncするため）
+    QString temporaryPath;
+    QString finalPath;
+    JournalEntry entry;
+
+    // 公開時に名前が使われていた場合の付け直し用（finalPath = base [+ "_N"] + suffix）
+    QByteArray base;
+    QByteArray suffix;
+    std::shared_ptr<UnitPaths> paths;   // 付け直した名前を書き戻す組のパス
+    int member = -1;
+};
+
+// 一時ファイルの確定（rename）と同期のタイミングを管理する
+// ジャーナルへの記録は常にデータの永続化後に行うため、
+// クラッシュ時に記録済みなのに欠損しているファイルは発生しない。
+// 公開は既存のファイルを置き換えないrenameで行い、別のプロセスが先に同じ名前を使っていれば
+// namesから組全体の次の連番を予約し直して公開する。
+class DurabilityManager
+{
+public:
+    DurabilityManager(const DurabilityOptions &options, const QString &destinationRoot, TransferJournal *journal,
+                      NameRegistry *names = nullptr);
+    ~DurabilityManager();
+
+    // 書き込み毎に違う一時ファイル名（同じ出力先に書く他のジョブ・プロセスと重ならない）
+    static QString temporaryPathFor(const QString &finalPath);
+
+    // 書き込み済みの一時ファイルの組を確定する
+    // 組はチェックポイントをまたいで分割されず、ジャーナルにもまとめて記録される。
+    bool commit(std::vector<StagedFile> files, QString *error);
+
+    // 保留中のファイルをすべて永続化してジャーナルに記録する
+    bool checkpoint(QString *error);
+
+    // まとめて永続化した他の呼び出し元の組の失敗を知らせる先（なければ永続化を起こした呼び出し元に返す）
+    // 呼び出しの前に設定する
+    void setFailureHandler(const TransferDestination::FailureHandler &handler);
+
+private:
+    using Unit = std::vector<StagedFile>;
+
+    bool flush(std::vector<Unit> &batch, bool ownsLast, QString *error);
+    bool publish(Unit &files, bool syncFirst, QSet<QString> &directories, QVector<JournalEntry> &entries, QString *error);
+    bool publishFile(Unit &files, size_t index, QString *error);
+    bool renumber(Unit &files, size_t published, QString *error);
+    bool syncDirectories(const QSet<QString> &directories, QString *error);
+    bool recordInJournal(const QVector<JournalEntry> &entries, bool sync, QString *error);
+
+    DurabilityOptions options;
+    QString destinationRoot;
+    TransferJournal *journal;
+    NameRegistry *names;
+    TransferDestination::FailureHandler failureHandler;
+
+    QMutex mutex;
+    std::vector<Unit> pending;
+    int pendingFiles;
+    qint64 pendingBytes;
+};
+
+#endif // DURABILITYPOLICY_H
@@ -0,0 +1,483 @@
+#include "EventClusterer.h"
+#include <QDateTime>
+#include <QThread>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+namespace {
+
+// 基数ソートを複数スレッドで行う最小の件数と最大のスレッド数
+const int minKeysPerThread = 32 * 1024;
+const int maxSortThreads = 8;
+
+// 時計のずれの推定で組み合わせる撮影のまとまりの数（枚数の多い順）と、補正する最大のずれ
+const int maxAlignSpans = 64;
+const qint64 maxClockOffsetMs = 24LL * 60 * 60 * 1000;
+
+const quint64 signBit = quint64(1) << 63;
+
+qint64 timeOfKey(quint64 key)
+{
+    return static_cast<qint64>(key ^ signBit);
+}
+
+double logOfGap(quint64 from, quint64 to)
+{
+    return std::log(static_cast<double>(timeOfKey(to) - timeOfKey(from)) + 1000.0);
+}
+
+// 昇順の2つの並びをマージする（同じ日時は既存を先に）
+void mergeSorted(QVector<quint64> &keys, QVector<int> &values,
+                 const QVector<quint64> &addedKeys, const QVector<int> &addedValues)
+{
+    if (addedKeys.isEmpty()) {
+        return;
+    }
+    QVector<quint64> mergedKeys;
+    QVector<int> mergedValues;
+    mergedKeys.reserve(keys.size() + addedKeys.size());
+    mergedValues.reserve(mergedKeys.capacity());
+    qsizetype i = 0;
+    qsizetype j = 0;
+    while (i < keys.size() || j < addedKeys.size()) {
+        if (j == addedKeys.size() || (i < keys.size() && keys.at(i) <= addedKeys.at(j))) {
+            mergedKeys.append(keys.at(i));
+            mergedValues.append(values.at(i));
+            ++i;
+        } else {
+            mergedKeys.append(addedKeys.at(j));
+            mergedValues.append(addedValues.at(j));
+            ++j;
+        }
+    }
+    keys.swap(mergedKeys);
+    values.swap(mergedValues);
+}
+
+void runParallel(int parts, const std::function<void(int)> &work)
+{
+    if (parts == 1) {
+        work(0);
+        return;
+    }
+    QVector<QThread *> workers;
+    for (int i = 0; i < parts; ++i) {
+        QThread *worker = QThread::create(work, i);
+        workers.append(worker);
+        worker->start();
+    }
+    for (QThread *worker : workers) {
+        worker->wait();
+        delete worker;
+    }
+}
+
+} // namespace
+
+EventClusterer::EventClusterer(const EventOptions &options)
+    : options(options)
+{
+}
+
+void EventClusterer::add(const QVector<Item> &newItems)
+{
+    QHash<QString, QVector<int>> addedByCamera;
+    for (const Item &item : newItems) {
+        if (itemByPath.contains(item.path)) {
+            continue;
+        }
+        const int index = static_cast<int>(items.size());
+        items.append(item);
+        itemByPath.insert(item.path, index);
+        addedByCamera[item.camera].append(index);
+    }
+    if (addedByCamera.isEmpty()) {
+        return;
+    }
+
+    // 追加分をカメラ毎に並べ、カメラの並びと撮影のまとまりにマージする
+    for (auto it = addedByCamera.begin(); it != addedByCamera.end(); ++it) {
+        QVector<int> &added = it.value();
+        QVector<quint64> keys;
+        keys.reserve(added.size());
+        for (int index : added) {
+            keys.append(static_cast<quint64>(items.at(index).captureMs) ^ signBit);
+        }
+        radixSort(keys, added);
+        Track &track = tracks[it.key()];
+        track.spans = mergeSpans(track.spans, keys);
+        mergeSorted(track.keys, track.items, keys, added);
+    }
+
+    // 全体の並びに入れるもの: 補正量が変わったカメラの全件と、それ以外のカメラの追加分
+    // （補正量はカメラ毎に一定のため、カメラ内の並びはそのまま使える）
+    const QSet<QString> shifted = estimateClockOffsets();
+    QVector<quint64> movingKeys;
+    QVector<int> movingItems;
+    for (const QString &camera : shifted) {
+        const Track &track = *tracks.constFind(camera);
+        const qint64 offset = offsets.value(camera, 0);
+        QVector<quint64> keys;
+        keys.reserve(track.keys.size());
+        for (quint64 key : track.keys) {
+            keys.append(static_cast<quint64>(timeOfKey(key) + offset) ^ signBit);
+        }
+        mergeSorted(movingKeys, movingItems, keys, track.items);
+    }
+    for (auto it = addedByCamera.constBegin(); it != addedByCamera.constEnd(); ++it) {
+        if (shifted.contains(it.key())) {
+            continue;
+        }
+        QVector<quint64> keys;
+        keys.reserve(it.value().size());
+        for (int index : it.value()) {
+            keys.append(keyOf(index));
+        }
+        mergeSorted(movingKeys, movingItems, keys, it.value());
+    }
+    place(movingKeys, movingItems, shifted);
+}
+
+void EventClusterer::clear()
+{
+    items.clear();
+    itemByPath.clear();
+    tracks.clear();
+    offsets.clear();
+    sortedKeys.clear();
+    sortedItems.clear();
+    gapLogs.clear();
+    boundaries.clear();
+    eventByItem.clear();
+    eventList.clear();
+}
+
+int EventClusterer::eventOf(const QString &path) const
+{
+    const int item = itemByPath.value(path, -1);
+    return item >= 0 ? eventByItem.at(item) : -1;
+}
+
+qint64 EventClusterer::clockOffset(const QString &camera) const
+{
+    return offsets.value(camera, 0);
+}
+
+QString EventClusterer::labelOf(const Event &event)
+{
+    return QDateTime::fromMSecsSinceEpoch(event.startMs).toString("yyyy-MM-dd_HHmm");
+}
+
+void EventClusterer::radixSort(QVector<quint64> &keys, QVector<int> &values)
+{
+    const qsizetype n = keys.size();
+    if (n < 2) {
+        return;
+    }
+
+    // 全件で同じ桁は並べ替えを省く（撮影日時の上位の桁はほぼ同じ）
+    quint64 varying = 0;
+    for (qsizetype i = 1; i < n; ++i) {
+        varying |= keys.at(i) ^ keys.at(0);
+    }
+
+    int parts = 1;
+    while (parts < maxSortThreads && n / (parts * 2) >= minKeysPerThread) {
+        parts *= 2;
+    }
+    QVector<qsizetype> bounds;
+    for (int i = 0; i <= parts; ++i) {
+        bounds.append(n * i / parts);
+    }
+
+    QVector<quint64> keyBuffer(n);
+    QVector<int> valueBuffer(n);
+    quint64 *sourceKeys = keys.data();
+    int *sourceValues = values.data();
+    quint64 *targetKeys = keyBuffer.data();
+    int *targetValues = valueBuffer.data();
+    QVector<qsizetype> offsets(parts * 256);
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        if (((varying >> shift) & 0xff) == 0) {
+            continue;
+        }
+
+        // 範囲毎に桁の出現数を数える
+        QVector<qsizetype> counts(parts * 256, 0);
+        runParallel(parts, [&](int part) {
+            qsizetype *count = counts.data() + part * 256;
+            for (qsizetype i = bounds.at(part); i < bounds.at(part + 1); ++i) {
+                ++count[(sourceKeys[i] >> shift) & 0xff];
+            }
+        });
+
+        // 桁の順、同じ桁は範囲の順に書き込み位置を割り当てる（安定）
+        qsizetype position = 0;
+        for (int digit = 0; digit < 256; ++digit) {
+            for (int part = 0; part < parts; ++part) {
+                offsets[part * 256 + digit] = position;
+                position += counts.at(part * 256 + digit);
+            }
+        }
+
+        runParallel(parts, [&](int part) {
+            qsizetype *offset = offsets.data() + part * 256;
+            for (qsizetype i = bounds.at(part); i < bounds.at(part + 1); ++i) {
+                const qsizetype to = offset[(sourceKeys[i] >> shift) & 0xff]++;
+                targetKeys[to] = sourceKeys[i];
+                targetValues[to] = sourceValues[i];
+            }
+        });
+        std::swap(sourceKeys, targetKeys);
+        std::swap(sourceValues, targetValues);
+    }
+
+    if (sourceKeys != keys.data()) {
+        keys.swap(keyBuffer);
+        values.swap(valueBuffer);
+    }
+}
+
+quint64 EventClusterer::keyOf(int item) const
+{
+    const Item &entry = items.at(item);
+    return static_cast<quint64>(entry.captureMs + offsets.value(entry.camera, 0)) ^ signBit;
+}
+
+QVector<EventClusterer::Span> EventClusterer::mergeSpans(const QVector<Span> &spans, const QVector<quint64> &keys) const
+{
+    // 既存のまとまりと追加の撮影日時を開始の順に並べ、間隔の短いものをつなぐ
+    QVector<Span> merged;
+    merged.reserve(spans.size() + keys.size());
+    auto append = [&](const Span &span) {
+        if (merged.isEmpty() || span.startMs - merged.last().endMs >= options.minGapMs) {
+            merged.append(span);
+        } else {
+            merged.last().endMs = qMax(merged.last().endMs, span.endMs);
+            merged.last().count += span.count;
+        }
+    };
+    qsizetype i = 0;
+    qsizetype j = 0;
+    while (i < spans.size() || j < keys.size()) {
+        if (j == keys.size() || (i < spans.size() && spans.at(i).startMs <= timeOfKey(keys.at(j)))) {
+            append(spans.at(i++));
+        } else {
+            const qint64 time = timeOfKey(keys.at(j++));
+            append({time, time, 1});
+        }
+    }
+    return merged;
+}
+
+QSet<QString> EventClusterer::estimateClockOffsets()
+{
+    QHash<QString, qint64> estimated;
+    if (options.correctClocks && tracks.size() >= 2) {
+        // 最も枚数の多いカメラを基準にする
+        QString reference;
+        qsizetype referenceCount = -1;
+        for (auto it = tracks.constBegin(); it != tracks.constEnd(); ++it) {
+            const qsizetype count = it.value().keys.size();
+            if (count > referenceCount || (count == referenceCount && it.key() < reference)) {
+                reference = it.key();
+                referenceCount = count;
+            }
+        }
+        const QVector<Span> &referenceSpans = tracks.constFind(reference)->spans;
+
+        for (auto it = tracks.constBegin(); it != tracks.constEnd(); ++it) {
+            if (it.key() == reference) {
+                continue;
+            }
+            const QVector<Span> &spans = it.value().spans;
+
+            // ずらした撮影のまとまりのうち、基準のまとまりと重なる数
+            auto support = [&](qint64 offset) {
+                int matched = 0;
+                for (const Span &span : spans) {
+                    const qint64 start = span.startMs + offset - options.minGapMs;
+                    const qint64 end = span.endMs + offset + options.minGapMs;
+                    const auto found = std::lower_bound(referenceSpans.constBegin(), referenceSpans.constEnd(), start,
+                                                        [](const Span &s, qint64 value) { return s.endMs < value; });
+                    if (found != referenceSpans.constEnd() && found->startMs <= end) {
+                        ++matched;
+                    }
+                }
+                return matched;
+            };
+
+            // まとまりの開始を揃えるずれを候補にする
+            auto largest = [](QVector<Span> list) {
+                std::sort(list.begin(), list.end(), [](const Span &a, const Span &b) { return a.count > b.count; });
+                list.resize(qMin<qsizetype>(list.size(), maxAlignSpans));
+                return list;
+            };
+            const QVector<Span> referenceCandidates = largest(referenceSpans);
+            const QVector<Span> candidates = largest(spans);
+
+            qint64 best = 0;
+            int bestSupport = support(0);
+            for (const Span &referenceSpan : referenceCandidates) {
+                for (const Span &span : candidates) {
+                    const qint64 offset = referenceSpan.startMs - span.startMs;
+                    if (offset == 0 || qAbs(offset) > maxClockOffsetMs) {
+                        continue;
+                    }
+                    const int matched = support(offset);
+                    if (matched > bestSupport || (matched == bestSupport && best != 0 && qAbs(offset) < qAbs(best))) {
+                        best = offset;
+                        bestSupport = matched;
+                    }
+                }
+            }
+            // まとまり1つだけの一致ではどこにでも合わせられるため補正しない
+            if (best != 0 && bestSupport >= 2) {
+                estimated.insert(it.key(), best);
+            }
+        }
+    }
+
+    QSet<QString> changed;
+    for (auto it = tracks.constBegin(); it != tracks.constEnd(); ++it) {
+        if (estimated.value(it.key(), 0) != offsets.value(it.key(), 0)) {
+            changed.insert(it.key());
+        }
+    }
+    offsets = estimated;
+    return changed;
+}
+
+void EventClusterer::place(const QVector<quint64> &movingKeys, const QVector<int> &movingItems,
+                           const QSet<QString> &shifted)
+{
+    const qsizetype oldCount = sortedKeys.size();
+    QVector<quint64> keys;
+    QVector<int> values;
+    QVector<double> logs;
+    QVector<bool> cuts;
+    QVector<bool> changedGaps;
+    keys.reserve(oldCount + movingKeys.size());
+    values.reserve(keys.capacity());
+    logs.reserve(keys.capacity());
+    cuts.reserve(keys.capacity());
+    changedGaps.reserve(keys.capacity());
+
+    // 既存の並びで隣り合っていた2つの間隔は対数と区切りをそのまま使う
+    qsizetype previousPosition = -1;
+    qsizetype firstPosition = -1;
+    auto append = [&](quint64 key, int item, qsizetype position) {
+        if (keys.isEmpty()) {
+            firstPosition = position;
+        } else if (position >= 1 && previousPosition == position - 1) {
+            logs.append(gapLogs.at(position - 1));
+            cuts.append(boundaries.at(position - 1));
+            changedGaps.append(false);
+        } else {
+            logs.append(logOfGap(keys.last(), key));
+            cuts.append(false);
+            changedGaps.append(true);
+        }
+        keys.append(key);
+        values.append(item);
+        previousPosition = position;
+    };
+
+    qsizetype i = 0;
+    qsizetype j = 0;
+    for (;;) {
+        while (i < oldCount && !shifted.isEmpty() && shifted.contains(items.at(sortedItems.at(i)).camera)) {
+            ++i;
+        }
+        if (i < oldCount && (j == movingKeys.size() || sortedKeys.at(i) <= movingKeys.at(j))) {
+            append(sortedKeys.at(i), sortedItems.at(i), i);
+            ++i;
+        } else if (j < movingKeys.size()) {
+            append(movingKeys.at(j), movingItems.at(j), -1);
+            ++j;
+        } else {
+            break;
+        }
+    }
+
+    // 先頭・末尾が変わった場合、端の近くは平均を取る範囲が変わる
+    if (!logs.isEmpty()) {
+        if (firstPosition != 0) {
+            changedGaps.first() = true;
+        }
+        if (previousPosition != oldCount - 1) {
+            changedGaps.last() = true;
+        }
+    }
+
+    sortedKeys.swap(keys);
+    sortedItems.swap(values);
+    gapLogs.swap(logs);
+    boundaries.swap(cuts);
+    cluster(changedGaps);
+}
+
+void EventClusterer::cluster(const QVector<bool> &changedGaps)
+{
+    eventList.clear();
+    eventByItem.fill(-1, items.size());
+    const qsizetype n = sortedKeys.size();
+    if (n == 0) {
+        return;
+    }
+    const qsizetype gaps = n - 1;
+
+    // 変わった間隔から前後 window 個以内の区切りを判定し直す
+    QVector<int> reach(gaps + 1, 0);
+    for (qsizetype i = 0; i < gaps; ++i) {
+        if (changedGaps.at(i)) {
+            ++reach[qMax<qsizetype>(0, i - options.window)];
+            --reach[qMin<qsizetype>(gaps, i + options.window + 1)];
+        }
+    }
+
+    // 撮影間隔の対数の累積和（前後 window 個の平均を取るため）
+    QVector<double> prefix(n, 0.0);
+    for (qsizetype i = 0; i < gaps; ++i) {
+        prefix[i + 1] = prefix.at(i) + gapLogs.at(i);
+    }
+
+    const double threshold = std::log(options.gapFactor);
+    int active = 0;
+    for (qsizetype i = 0; i < gaps; ++i) {
+        active += reach.at(i);
+        if (active == 0) {
+            continue;
+        }
+        const qint64 gap = timeOfKey(sortedKeys.at(i + 1)) - timeOfKey(sortedKeys.at(i));
+        const qsizetype low = qMax<qsizetype>(0, i - options.window);
+        const qsizetype high = qMin<qsizetype>(n - 2, i + options.window);
+        const double mean = (prefix.at(high + 1) - prefix.at(low)) / static_cast<double>(high - low + 1);
+        boundaries[i] = gap >= options.maxGapMs || (gap >= options.minGapMs && gapLogs.at(i) >= threshold + mean);
+    }
+
+    Event current;
+    current.startMs = timeOfKey(sortedKeys.at(0));
+    current.first = 0;
+    for (qsizetype i = 0; i < gaps; ++i) {
+        if (boundaries.at(i)) {
+            current.endMs = timeOfKey(sortedKeys.at(i));
+            current.count = static_cast<int>(i + 1 - current.first);
+            eventList.append(current);
+            current.startMs = timeOfKey(sortedKeys.at(i + 1));
+            current.first = static_cast<int>(i + 1);
+        }
+    }
+    current.endMs = timeOfKey(sortedKeys.at(n - 1));
+    current.count = static_cast<int>(n - current.first);
+    eventList.append(current);
+
+    for (int event = 0; event < eventList.size(); ++event) {
+        const Event &e = eventList.at(event);
+        for (int k = e.first; k < e.first + e.count; ++k) {
+            eventByItem[sortedItems.at(k)] = event;
+        }
+    }
+}
@@ -0,0 +1,102 @@
+#ifndef EVENTCLUSTERER_H
+#define EVENTCLUSTERER_H
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QSet>
+#include <QVector>
+
+// イベント分けの設定
+struct EventOptions
+{
+    qint64 minGapMs = 15 * 60 * 1000;       // これより短い間隔では分けない
+    qint64 maxGapMs = 4 * 60 * 60 * 1000;   // これ以上の間隔は必ず分ける
+    double gapFactor = 17;                  // 前後の間隔の（対数の）平均よりこの倍率以上長ければ分ける
+    int window = 10;                        // 平均を取る前後の間隔の数
+    bool correctClocks = true;              // カメラ毎の時計のずれを推定して揃える
+};
+
+// 撮影間隔によるイベント分け
+// 撮影日時を64ビットの基数ソート（複数スレッド）で並べ、前後の撮影間隔に対して長い間隔で区切る。
+// 複数のカメラの時計のずれは、最も枚数の多いカメラを基準に、撮影のまとまりが重なるよう推定して補正する。
+// カメラ毎に撮影日時の並びと撮影のまとまりを持ち、ファイルを追加した場合は追加分だけを並べてマージする。
+// 時計のずれが変わったカメラは、カメラ内の並びのまま全体の並びから抜いてマージし直す。
+// 区切りは、撮影間隔が変わった位置から前後 window 個以内だけを判定し直す。
+class EventClusterer
+{
+public:
+    struct Item
+    {
+        QString path;
+        qint64 captureMs = 0;
+        QString camera;
+    };
+
+    struct Event
+    {
+        qint64 startMs = 0;                 // 補正後の撮影日時
+        qint64 endMs = 0;
+        int first = 0;                      // 並び順での位置
+        int count = 0;
+    };
+
+    explicit EventClusterer(const EventOptions &options = EventOptions());
+
+    // 既にあるパスは無視する
+    void add(const QVector<Item> &items);
+    void clear();
+
+    int size() const { return static_cast<int>(items.size()); }
+    bool contains(const QString &path) const { return itemByPath.contains(path); }
+    const QVector<Event> &events() const { return eventList; }
+    // pathの属するイベントの番号（撮影日時の順、未登録は-1）
+    int eventOf(const QString &path) const;
+    // カメラの時計の補正量（基準のカメラの時刻 - そのカメラの時刻）
+    qint64 clockOffset(const QString &camera) const;
+
+    // フォルダ名に使うイベントの名前（開始日時）
+    static QString labelOf(const Event &event);
+
+    // keysの昇順にvaluesも並べ替える（安定、8ビットずつのLSD基数ソート）
+    static void radixSort(QVector<quint64> &keys, QVector<int> &values);
+
+private:
+    struct Span
+    {
+        qint64 startMs;
+        qint64 endMs;
+        int count;
+    };
+
+    // カメラ毎の補正前の撮影日時の並び
+    struct Track
+    {
+        QVector<quint64> keys;
+        QVector<int> items;
+        QVector<Span> spans;                // 撮影のまとまり（開始の昇順）
+    };
+
+    quint64 keyOf(int item) const;
+    QVector<Span> mergeSpans(const QVector<Span> &spans, const QVector<quint64> &keys) const;
+    // 時計の補正量が変わったカメラを返す
+    QSet<QString> estimateClockOffsets();
+    // movingを全体の並びにマージする（shiftedのカメラは既存の並びから抜く）
+    void place(const QVector<quint64> &movingKeys, const QVector<int> &movingItems, const QSet<QString> &shifted);
+    void cluster(const QVector<bool> &changedGaps);
+
+    EventOptions options;
+    QVector<Item> items;
+    QHash<QString, int> itemByPath;
+    QHash<QString, Track> tracks;
+    QHash<QString, qint64> offsets;
+
+    QVector<quint64> sortedKeys;            // 補正後の撮影日時（符号を反転して符号なしにしたもの）
+    QVector<int> sortedItems;
+    QVector<double> gapLogs;                // 並びで隣り合う撮影間隔の対数
+    QVector<bool> boundaries;               // 間隔の位置で区切るか
+    QVector<int> eventByItem;
+    QVector<Event> eventList;
+};
+
+#endif // EVENTCLUSTERER_H
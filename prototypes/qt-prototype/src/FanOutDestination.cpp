@@ -0,0 +1,535 @@
+#include "FanOutDestination.h"
+#include <QDir>
+#include <QFile>
+#include <QMutexLocker>
+#include <QQueue>
+#include <QTemporaryFile>
+
+namespace {
+
+// 出力先の書き込みスレッドへの指示
+struct SinkItem
+{
+    enum Kind { Begin, Data, End, Commit, Abort };
+
+    Kind kind = Data;
+    int member = -1;
+    QByteArray data;                // メモリ上のデータ（全出力先で共有する）
+    qint64 spillOffset = -1;        // 退避した場合の退避ファイル上の位置
+    qint64 length = 0;
+};
+
+// 1つの組の1つの出力先へのキュー（読み込みスレッドと書き込みスレッドで共有する）
+struct SinkChannel
+{
+    int sink = 0;
+    QString label;
+    std::unique_ptr<UnitWriter> writer;
+    QVector<bool> wanted;           // メンバー毎
+    QVector<QFileInfo> sources;     // この出力先に書き込むメンバー（失敗の報告用）
+
+    QMutex mutex;
+    QWaitCondition changed;
+    QQueue<SinkItem> items;
+    QString error;
+    bool finished = false;
+    bool background = false;        // 呼び出し元は確定を待たずに戻った
+
+    // 退避ファイル（書き込みは読み込みスレッド、読み出しは書き込みスレッド）
+    std::unique_ptr<QTemporaryFile> spill;
+    QFile spillReader;
+    qint64 spillEnd = 0;
+    int spilledPending = 0;
+};
+
+} // namespace
+
+// FanOutUnitWriter Implementation
+class FanOutUnitWriter : public UnitWriter
+{
+public:
+    FanOutUnitWriter(FanOutDestination *destination, std::vector<std::shared_ptr<SinkChannel>> channels,
+                     std::shared_ptr<const UnitPaths> paths)
+        : destination(destination), channels(std::move(channels)), paths(std::move(paths))
+    {
+    }
+
+    ~FanOutUnitWriter() override
+    {
+        if (!closed) {
+            abort();
+        }
+    }
+
+    bool wants(int member) const override
+    {
+        for (const std::shared_ptr<SinkChannel> &channel : channels) {
+            if (channel->wanted.at(member)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 目録に載せるのは最初の出力先のパス
+    std::shared_ptr<const UnitPaths> destinationPaths() const override
+    {
+        return paths;
+    }
+
+    bool beginFile(int member, QString *error) override
+    {
+        current = member;
+        SinkItem item;
+        item.kind = SinkItem::Begin;
+        item.member = member;
+        return broadcast(item, error);
+    }
+
+    bool write(const char *data, qint64 size, QString *error) override
+    {
+        // 読み込みバッファは使い回されるため、1回だけコピーして全出力先で共有する
+        SinkItem item;
+        item.kind = SinkItem::Data;
+        item.data = QByteArray(data, size);
+        return broadcast(item, error);
+    }
+
+    bool endFile(QString *error) override
+    {
+        SinkItem item;
+        item.kind = SinkItem::End;
+        return broadcast(item, error);
+    }
+
+    bool commit(QString *error) override
+    {
+        closed = true;
+        SinkItem item;
+        item.kind = SinkItem::Commit;
+        for (const std::shared_ptr<SinkChannel> &channel : channels) {
+            enqueue(*channel, item);
+        }
+
+        // 退避が有効なら最初の出力先の確定だけを待ち、残りはバックグラウンドで確定する
+        const bool detach = destination->options.spillBytes > 0;
+        QString firstError;
+        for (const std::shared_ptr<SinkChannel> &channel : channels) {
+            QMutexLocker locker(&channel->mutex);
+            if (detach && channel->sink > 0 && !channel->finished) {
+                channel->background = true;
+                continue;
+            }
+            while (!channel->finished) {
+                channel->changed.wait(&channel->mutex);
+            }
+            if (!channel->error.isEmpty() && firstError.isEmpty()) {
+                firstError = channel->error;
+            }
+        }
+        if (!firstError.isEmpty()) {
+            *error = firstError;
+            return false;
+        }
+        return true;
+    }
+
+    void abort() override
+    {
+        closed = true;
+        SinkItem item;
+        item.kind = SinkItem::Abort;
+        for (const std::shared_ptr<SinkChannel> &channel : channels) {
+            QMutexLocker locker(&channel->mutex);
+            // 残っているデータは書き込まずに読み捨てる
+            if (channel->error.isEmpty()) {
+                channel->error = "中止されました";
+            }
+            channel->items.enqueue(item);
+            channel->changed.wakeAll();
+        }
+        for (const std::shared_ptr<SinkChannel> &channel : channels) {
+            QMutexLocker locker(&channel->mutex);
+            while (!channel->finished) {
+                channel->changed.wait(&channel->mutex);
+            }
+        }
+    }
+
+    // 出力先の書き込みスレッド（組毎、出力先毎に1つ）
+    static void drain(FanOutDestination *destination, const std::shared_ptr<SinkChannel> &channel)
+    {
+        QByteArray spillBuffer;
+        while (true) {
+            SinkItem item;
+            bool skip = false;
+            {
+                QMutexLocker locker(&channel->mutex);
+                while (channel->items.isEmpty()) {
+                    channel->changed.wait(&channel->mutex);
+                }
+                item = channel->items.dequeue();
+                skip = !channel->error.isEmpty();
+            }
+
+            QString error;
+            bool ok = true;
+            switch (item.kind) {
+            case SinkItem::Begin:
+                ok = skip || channel->writer->beginFile(item.member, &error);
+                break;
+            case SinkItem::Data:
+                if (item.spillOffset >= 0) {
+                    ok = skip || (readSpill(*channel, item, spillBuffer, &error)
+                                  && channel->writer->write(spillBuffer.constData(), item.length, &error));
+                    QMutexLocker locker(&channel->mutex);
+                    // 退避したデータをすべて書き込んだら、退避ファイルは先頭から使い直す
+                    if (--channel->spilledPending == 0) {
+                        channel->spillEnd = 0;
+                    }
+                    destination->release(item.length, false);
+                } else {
+                    ok = skip || channel->writer->write(item.data.constData(), item.data.size(), &error);
+                    destination->release(item.data.size(), true);
+                }
+                break;
+            case SinkItem::End:
+                ok = skip || channel->writer->endFile(&error);
+                break;
+            case SinkItem::Commit:
+                if (skip) {
+                    channel->writer->abort();
+                } else if (!channel->writer->commit(&error)) {
+                    channel->writer->abort();
+                    ok = false;
+                }
+                finish(destination, channel, ok ? QString() : error);
+                return;
+            case SinkItem::Abort:
+                channel->writer->abort();
+                finish(destination, channel, QString());
+                return;
+            }
+
+            if (!ok) {
+                QMutexLocker locker(&channel->mutex);
+                if (channel->error.isEmpty()) {
+                    channel->error = channel->label + ": " + error;
+                }
+            }
+        }
+    }
+
+private:
+    bool broadcast(const SinkItem &item, QString *error)
+    {
+        QString firstError;
+        int delivered = 0;
+        for (const std::shared_ptr<SinkChannel> &channel : channels) {
+            if (!channel->wanted.at(current)) {
+                continue;
+            }
+            {
+                QMutexLocker locker(&channel->mutex);
+                if (!channel->error.isEmpty()) {
+                    if (firstError.isEmpty()) {
+                        firstError = channel->error;
+                    }
+                    continue;
+                }
+            }
+            if (push(*channel, item)) {
+                ++delivered;
+            }
+        }
+        // 1つでも書き込める出力先があれば続ける（失敗した出力先のエラーは確定時に返す）
+        if (delivered == 0 && !firstError.isEmpty()) {
+            *error = firstError;
+            return false;
+        }
+        return true;
+    }
+
+    bool push(SinkChannel &channel, SinkItem item)
+    {
+        const qint64 size = item.data.size();
+        if (size > 0 && !destination->acquire(size)) {
+            // メモリに溜めきれない分は退避ファイルに書き、書き込みスレッドがそこから読む
+            qint64 offset = 0;
+            {
+                QMutexLocker locker(&channel.mutex);
+                offset = channel.spillEnd;
+                channel.spillEnd += size;
+                ++channel.spilledPending;
+            }
+            QString spillError;
+            if (!writeSpill(channel, offset, item.data, &spillError)) {
+                QMutexLocker locker(&channel.mutex);
+                --channel.spilledPending;
+                channel.error = channel.label + ": " + spillError;
+                destination->release(size, false);
+                return false;
+            }
+            item.spillOffset = offset;
+            item.length = size;
+            item.data = QByteArray();
+        }
+        enqueue(channel, item);
+        return true;
+    }
+
+    static void enqueue(SinkChannel &channel, const SinkItem &item)
+    {
+        QMutexLocker locker(&channel.mutex);
+        channel.items.enqueue(item);
+        channel.changed.wakeAll();
+    }
+
+    bool writeSpill(SinkChannel &channel, qint64 offset, const QByteArray &data, QString *error)
+    {
+        if (!channel.spill) {
+            const QString directory = destination->options.spillDirectory.isEmpty()
+                                    ? QDir::tempPath() : destination->options.spillDirectory;
+            channel.spill = std::make_unique<QTemporaryFile>(directory + "/media-transfer-spill-XXXXXX");
+            if (!channel.spill->open()) {
+                *error = "退避ファイルを作成できません: " + channel.spill->errorString();
+                return false;
+            }
+        }
+        if (!channel.spill->seek(offset) || channel.spill->write(data) != data.size() || !channel.spill->flush()) {
+            *error = "退避ファイルに書き込めません: " + channel.spill->errorString();
+            return false;
+        }
+        return true;
+    }
+
+    static bool readSpill(SinkChannel &channel, const SinkItem &item, QByteArray &buffer, QString *error)
+    {
+        if (!channel.spillReader.isOpen()) {
+            channel.spillReader.setFileName(channel.spill->fileName());
+            if (!channel.spillReader.open(QIODevice::ReadOnly)) {
+                *error = "退避ファイルを開けません: " + channel.spillReader.errorString();
+                return false;
+            }
+        }
+        buffer.resize(item.length);
+        if (!channel.spillReader.seek(item.spillOffset)
+            || channel.spillReader.read(buffer.data(), item.length) != item.length) {
+            *error = "退避ファイルを読み込めません: " + channel.spillReader.errorString();
+            return false;
+        }
+        return true;
+    }
+
+    static void finish(FanOutDestination *destination, const std::shared_ptr<SinkChannel> &channel, const QString &commitError)
+    {
+        QMutexLocker locker(&channel->mutex);
+        if (!commitError.isEmpty() && channel->error.isEmpty()) {
+            channel->error = channel->label + ": " + commitError;
+        }
+        channel->finished = true;
+        channel->changed.wakeAll();
+        const bool report = channel->background && !channel->error.isEmpty();
+        const QString error = channel->error;
+        locker.unlock();
+
+        if (report) {
+            destination->reportFailure(channel->sources, error);
+        }
+    }
+
+    FanOutDestination *destination;
+    std::vector<std::shared_ptr<SinkChannel>> channels;
+    std::shared_ptr<const UnitPaths> paths;
+    int current = -1;
+    bool closed = false;
+};
+
+// FanOutDestination Implementation
+FanOutDestination::FanOutDestination(std::vector<Sink> sinks, const FanOutOptions &options, int workerCount)
+    : sinks(std::move(sinks))
+    , options(options)
+{
+    for (size_t i = 0; i < this->sinks.size(); ++i) {
+        auto pool = std::make_unique<QThreadPool>();
+        pool->setMaxThreadCount(qMax(1, workerCount));
+        pool->setObjectName("書き込み " + this->sinks.at(i).label);
+        sinkPools.push_back(std::move(pool));
+    }
+}
+
+FanOutDestination::~FanOutDestination()
+{
+    for (const std::unique_ptr<QThreadPool> &pool : sinkPools) {
+        pool->waitForDone();
+    }
+}
+
+QString FanOutDestination::name() const
+{
+    QStringList names;
+    for (const Sink &sink : sinks) {
+        names << sink.destination->name();
+    }
+    return names.join('+');
+}
+
+bool FanOutDestination::prepare(QString *error)
+{
+    for (const Sink &sink : sinks) {
+        QString sinkError;
+        if (!sink.destination->prepare(&sinkError)) {
+            *error = sink.label + ": " + sinkError;
+            return false;
+        }
+    }
+    return true;
+}
+
+std::unique_ptr<UnitWriter> FanOutDestination::beginUnit(const UnitPlan &plan, QString *error)
+{
+    std::vector<std::shared_ptr<SinkChannel>> channels;
+    std::shared_ptr<const UnitPaths> paths;
+    QStringList errors;
+    for (size_t i = 0; i < sinks.size(); ++i) {
+        QString sinkError;
+        std::unique_ptr<UnitWriter> writer = sinks[i].destination->beginUnit(plan, &sinkError);
+        if (!writer) {
+            errors << sinks[i].label + ": " + sinkError;
+            continue;
+        }
+        if (!paths) {
+            paths = writer->destinationPaths();
+        }
+
+        auto channel = std::make_shared<SinkChannel>();
+        for (int member = 0; member < plan.sources.size(); ++member) {
+            channel->wanted.append(writer->wants(member));
+            if (channel->wanted.last()) {
+                channel->sources.append(plan.sources.at(member));
+            }
+        }
+        // この出力先で転送済みの組は書き込みスレッドを使わない
+        if (channel->sources.isEmpty()) {
+            continue;
+        }
+        channel->sink = static_cast<int>(i);
+        channel->label = sinks[i].label;
+        channel->writer = std::move(writer);
+        sinkPools[i]->start([this, channel]() { FanOutUnitWriter::drain(this, channel); });
+        channels.push_back(channel);
+    }
+
+    if (!errors.isEmpty()) {
+        if (channels.empty()) {
+            *error = errors.join(" / ");
+            return nullptr;
+        }
+        reportFailure(plan.sources, errors.join(" / "));
+    }
+    return std::make_unique<FanOutUnitWriter>(this, std::move(channels), paths);
+}
+
+bool FanOutDestination::checkpoint(QString *error)
+{
+    // バックグラウンドで書き込んでいる組がすべて確定するのを待ってから、各出力先の区切りを付ける
+    for (const std::unique_ptr<QThreadPool> &pool : sinkPools) {
+        pool->waitForDone();
+    }
+    QStringList errors;
+    for (const Sink &sink : sinks) {
+        QString sinkError;
+        if (!sink.destination->checkpoint(&sinkError)) {
+            errors << sink.label + ": " + sinkError;
+        }
+    }
+    if (!errors.isEmpty()) {
+        *error = errors.join(" / ");
+        return false;
+    }
+    return true;
+}
+
+void FanOutDestination::trim()
+{
+    for (const Sink &sink : sinks) {
+        sink.destination->trim();
+    }
+}
+
+bool FanOutDestination::finish(QString *error)
+{
+    // バックグラウンドで書き込んでいる組がすべて確定するのを待つ
+    for (const std::unique_ptr<QThreadPool> &pool : sinkPools) {
+        pool->waitForDone();
+    }
+
+    QStringList errors;
+    for (const Sink &sink : sinks) {
+        QString sinkError;
+        if (!sink.destination->finish(&sinkError)) {
+            errors << sink.label + ": " + sinkError;
+        }
+    }
+    QMutexLocker locker(&failureMutex);
+    errors += backgroundErrors;
+    backgroundErrors.clear();
+    if (!errors.isEmpty()) {
+        *error = errors.join(" / ");
+        return false;
+    }
+    return true;
+}
+
+bool FanOutDestination::acquire(qint64 size)
+{
+    QMutexLocker locker(&budgetMutex);
+    while (true) {
+        if (memoryInUse == 0 || memoryInUse + size <= options.queueBytes) {
+            memoryInUse += size;
+            return true;
+        }
+        if (spillInUse + size <= options.spillBytes) {
+            spillInUse += size;
+            return false;
+        }
+        // 最も遅い出力先が追いつくまで読み込みを止める
+        budgetChanged.wait(&budgetMutex);
+    }
+}
+
+void FanOutDestination::release(qint64 size, bool inMemory)
+{
+    QMutexLocker locker(&budgetMutex);
+    if (inMemory) {
+        memoryInUse -= size;
+    } else {
+        spillInUse -= size;
+    }
+    budgetChanged.wakeAll();
+}
+
+void FanOutDestination::setFailureHandler(const FailureHandler &handler)
+{
+    {
+        QMutexLocker locker(&failureMutex);
+        failureHandler = handler;
+    }
+    // 出力先自身がバックグラウンドで確定に失敗した分もまとめて報告する
+    for (const Sink &sink : sinks) {
+        const QString label = sink.label;
+        sink.destination->setFailureHandler([this, label](const QVector<QFileInfo> &sources, const QString &error) {
+            reportFailure(sources, label + ": " + error);
+        });
+    }
+}
+
+void FanOutDestination::reportFailure(const QVector<QFileInfo> &sources, const QString &error)
+{
+    QMutexLocker locker(&failureMutex);
+    if (failureHandler) {
+        failureHandler(sources, error);
+    } else {
+        backgroundErrors << error;
+    }
+}
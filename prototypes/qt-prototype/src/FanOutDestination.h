@@ -0,0 +1,73 @@
+#ifndef FANOUTDESTINATION_H
+#define FANOUTDESTINATION_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QFileInfo>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThreadPool>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "TransferDestination.h"
+
+// 複数出力先への同時書き込みの設定
+struct FanOutOptions
+{
+    qint64 queueBytes = 64 * 1024 * 1024;   // 出力先に渡しきれていないデータをメモリに溜める上限（全体）
+    qint64 spillBytes = 0;                  // 溜めきれない分をディスクに退避する上限（0は退避しない）
+    QString spillDirectory;                 // 空の場合はシステムの一時フォルダ
+};
+
+// 複数の出力先への同時書き込み（ローカルのRAIDとクラウド、2台目のディスクなど）
+// ソースは1回だけ読み、読んだバッファを出力先毎のキューで共有して各出力先に渡す。
+// 出力先毎に書き込みスレッドがあり、キューの上限に達すると読み込みが待つため、
+// 全体の速度は最も遅い出力先で決まる。退避を有効にすると、溜めきれない分は
+// ディスクに退避し、組の確定を待つのは最初の出力先だけになる（残りはバックグラウンドで
+// 書き込み、失敗は failureHandler で報告する）。
+// ある出力先で失敗しても他の出力先への書き込みは続け、確定後にその出力先のエラーを返す。
+class FanOutDestination : public TransferDestination
+{
+public:
+    struct Sink
+    {
+        std::unique_ptr<TransferDestination> destination;
+        QString label;                      // エラー表示用（ローカルの場合は出力先フォルダ）
+    };
+    FanOutDestination(std::vector<Sink> sinks, const FanOutOptions &options, int workerCount);
+    ~FanOutDestination() override;
+
+    QString name() const override;
+    bool prepare(QString *error) override;
+    std::unique_ptr<UnitWriter> beginUnit(const UnitPlan &plan, QString *error) override;
+    bool checkpoint(QString *error) override;
+    void trim() override;
+    bool finish(QString *error) override;
+
+    void setFailureHandler(const FailureHandler &handler) override;
+
+private:
+    friend class FanOutUnitWriter;
+
+    // データをメモリに置くか（true）ディスクに退避するか（false）を決め、上限に空きがなければ待つ
+    bool acquire(qint64 size);
+    void release(qint64 size, bool inMemory);
+    void reportFailure(const QVector<QFileInfo> &sources, const QString &error);
+
+    std::vector<Sink> sinks;
+    FanOutOptions options;
+    std::vector<std::unique_ptr<QThreadPool>> sinkPools;   // 出力先毎の書き込みスレッド
+
+    QMutex budgetMutex;
+    QWaitCondition budgetChanged;
+    qint64 memoryInUse = 0;
+    qint64 spillInUse = 0;
+
+    QMutex failureMutex;
+    FailureHandler failureHandler;
+    QStringList backgroundErrors;
+};
+
+#endif // FANOUTDESTINATION_H
@@ -1,6 +1,19 @@
 #include "FileListWidget.h"
+#include "StageTrace.h"
 #include <QMimeDatabase>
 #include <QFileInfo>
+#include <QHash>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QSignalBlocker>
+#include <numeric>
+
+namespace {
+
+// 一覧に並べるウィジェットの上限（残りは件数だけ表示する）
+const int maxVisibleItems = 500;
+
+} // namespace
 
 FileListWidget::FileListWidget(QWidget *parent)
     : QWidget(parent)
@@ -34,6 +47,7 @@ void FileListWidget::setupUI()
     scrollArea->setWidget(scrollWidget);
     
     mainLayout->addWidget(titleLabel);
+    setupFilterBar();
     mainLayout->addWidget(scrollArea);
     
     // 初期スタイル設定
@@ -50,34 +64,244 @@ void FileListWidget::setupUI()
     );
 }
 
-void FileListWidget::setFiles(const QStringList &files)
+void FileListWidget::setupFilterBar()
 {
-    fileList = files;
-    updateFileList();
+    // ファイル名・フォルダ名の部分一致（"C0142" など）
+    searchEdit = new QLineEdit();
+    searchEdit->setPlaceholderText("🔎 ファイル名・フォルダ名で検索");
+    searchEdit->setClearButtonEnabled(true);
+    fuzzyCheck = new QCheckBox("あいまい");
+    fuzzyCheck->setToolTip("1文字までの違いを許します");
+    QHBoxLayout *searchLayout = new QHBoxLayout();
+    searchLayout->addWidget(searchEdit, 1);
+    searchLayout->addWidget(fuzzyCheck);
+    mainLayout->addLayout(searchLayout);
+    
+    typeFilterCombo = new QComboBox();
+    typeFilterCombo->addItem("すべての種類", 0xff);
+    typeFilterCombo->addItem("📸 写真", (1 << MetadataIndex::TypeImage) | (1 << MetadataIndex::TypeRaw));
+    typeFilterCombo->addItem("🎞️ RAW", 1 << MetadataIndex::TypeRaw);
+    typeFilterCombo->addItem("🎬 動画", 1 << MetadataIndex::TypeVideo);
+    
+    cameraFilterCombo = new QComboBox();
+    cameraFilterCombo->addItem("すべてのカメラ", -1);
+    
+    minSizeSpin = new QSpinBox();
+    minSizeSpin->setRange(0, 1024 * 1024);
+    minSizeSpin->setSuffix(" MB以上");
+    
+    dateFilterCheck = new QCheckBox("📅 期間");
+    fromDateEdit = new QDateEdit(QDate::currentDate().addDays(-7));
+    toDateEdit = new QDateEdit(QDate::currentDate());
+    fromDateEdit->setCalendarPopup(true);
+    toDateEdit->setCalendarPopup(true);
+    
+    hideImportedCheck = new QCheckBox("取り込み済みを隠す");
+    
+    sortCombo = new QComboBox();
+    sortCombo->addItem("パス順", MetadataIndex::SortByPath);
+    sortCombo->addItem("撮影日時順", MetadataIndex::SortByCaptureTime);
+    sortCombo->addItem("サイズ順", MetadataIndex::SortBySize);
+    sortCombo->addItem("種類順", MetadataIndex::SortByType);
+    sortCombo->addItem("カメラ順", MetadataIndex::SortByCamera);
+    descendingCheck = new QCheckBox("降順");
+    
+    resultLabel = new QLabel();
+    resultLabel->setStyleSheet("color: #7f8c8d; font-size: 12px;");
+    
+    QHBoxLayout *filterLayout = new QHBoxLayout();
+    filterLayout->addWidget(typeFilterCombo);
+    filterLayout->addWidget(cameraFilterCombo);
+    filterLayout->addWidget(minSizeSpin);
+    filterLayout->addWidget(hideImportedCheck);
+    QHBoxLayout *rangeLayout = new QHBoxLayout();
+    rangeLayout->addWidget(dateFilterCheck);
+    rangeLayout->addWidget(fromDateEdit);
+    rangeLayout->addWidget(new QLabel("〜"));
+    rangeLayout->addWidget(toDateEdit);
+    rangeLayout->addStretch();
+    rangeLayout->addWidget(sortCombo);
+    rangeLayout->addWidget(descendingCheck);
+    mainLayout->addLayout(filterLayout);
+    mainLayout->addLayout(rangeLayout);
+    mainLayout->addWidget(resultLabel);
+    
+    connect(searchEdit, &QLineEdit::textChanged, this, &FileListWidget::applyFilter);
+    connect(fuzzyCheck, &QCheckBox::toggled, this, &FileListWidget::applyFilter);
+    connect(typeFilterCombo, &QComboBox::currentIndexChanged, this, &FileListWidget::applyFilter);
+    connect(cameraFilterCombo, &QComboBox::currentIndexChanged, this, &FileListWidget::applyFilter);
+    connect(minSizeSpin, &QSpinBox::valueChanged, this, &FileListWidget::applyFilter);
+    connect(dateFilterCheck, &QCheckBox::toggled, this, &FileListWidget::applyFilter);
+    connect(fromDateEdit, &QDateEdit::dateChanged, this, &FileListWidget::applyFilter);
+    connect(toDateEdit, &QDateEdit::dateChanged, this, &FileListWidget::applyFilter);
+    connect(hideImportedCheck, &QCheckBox::toggled, this, &FileListWidget::applyFilter);
+    connect(sortCombo, &QComboBox::currentIndexChanged, this, &FileListWidget::applyFilter);
+    connect(descendingCheck, &QCheckBox::toggled, this, &FileListWidget::applyFilter);
+}
+
+void FileListWidget::setFiles(const PathTable &files)
+{
+    TraceSpan span("metadata");
+    // 前回もあったファイルは索引の行を写し、新しいファイルだけstatする
+    MetadataIndex next;
+    QVector<int> addedRows;
+    for (int handle = 0; handle < files.size(); ++handle) {
+        const int row = index.rowOf(files, handle);
+        if (row >= 0) {
+            next.appendFrom(index, row);
+        } else {
+            const QString filePath = files.pathAt(handle);
+            QFileInfo info(filePath);
+            addedRows.append(next.size());
+            next.append(filePath, info.lastModified().toMSecsSinceEpoch(), info.size());
+        }
+    }
+    index = next;
+    searchIndexDirty = true;
+    
+    // 外れたファイルがあればイベント分けをやり直し、追加だけなら追加分を加える
+    if (index.size() - addedRows.size() < events.size()) {
+        events.clear();
+        addedRows.resize(index.size());
+        std::iota(addedRows.begin(), addedRows.end(), 0);
+    }
+    QVector<EventClusterer::Item> items;
+    items.reserve(addedRows.size());
+    for (int row : addedRows) {
+        items.append({index.pathAt(row), index.captureTimeAt(row), index.cameraAt(row)});
+    }
+    events.add(items);
+    updateCameraFilter();
+    applyFilter();
     emit filesChanged(files);
 }
 
 void FileListWidget::clearFiles()
 {
-    fileList.clear();
+    index.clear();
+    events.clear();
+    searchIndexDirty = true;
+    updateCameraFilter();
+    applyFilter();
+    emit filesChanged(PathTable());
+}
+
+void FileListWidget::setImportedFiles(const QVector<int> &handles)
+{
+    for (int row = 0; row < index.size(); ++row) {
+        index.setDedupState(row, MetadataIndex::DedupUnknown);
+    }
+    for (int handle : handles) {
+        index.setDedupState(handle, MetadataIndex::DedupImported);
+    }
+    if (hideImportedCheck->isChecked()) {
+        applyFilter();
+    }
+    for (FileItemWidget *widget : fileItemWidgets) {
+        const int row = index.rowOf(widget->getFilePath());
+        widget->setImported(row >= 0 && index.isImported(row));
+    }
+}
+
+void FileListWidget::updateCameraFilter()
+{
+    const QString current = cameraFilterCombo->currentText();
+    QSignalBlocker blocker(cameraFilterCombo);
+    while (cameraFilterCombo->count() > 1) {
+        cameraFilterCombo->removeItem(1);
+    }
+    const QStringList &cameras = index.cameraNames();
+    for (int i = 0; i < cameras.size(); ++i) {
+        cameraFilterCombo->addItem("📷 " + cameras.at(i), i);
+    }
+    const int selected = cameraFilterCombo->findText(current);
+    cameraFilterCombo->setCurrentIndex(qMax(0, selected));
+}
+
+void FileListWidget::applyFilter()
+{
+    TraceSpan span("filter");
+    QElapsedTimer timer;
+    timer.start();
+    
+    MetadataIndex::Filter filter;
+    filter.typeMask = typeFilterCombo->currentData().toUInt();
+    filter.cameraId = cameraFilterCombo->currentData().toInt();
+    filter.minSize = qint64(minSizeSpin->value()) * 1024 * 1024;
+    filter.hideImported = hideImportedCheck->isChecked();
+    if (dateFilterCheck->isChecked()) {
+        filter.fromMs = fromDateEdit->date().startOfDay().toMSecsSinceEpoch();
+        filter.toMs = toDateEdit->date().addDays(1).startOfDay().toMSecsSinceEpoch() - 1;
+    }
+    QVector<int> rows = index.filter(filter);
+    const QString query = searchEdit->text().trimmed();
+    if (!query.isEmpty()) {
+        if (searchIndexDirty) {
+            QStringList paths;
+            paths.reserve(index.size());
+            for (int row = 0; row < index.size(); ++row) {
+                paths << index.pathAt(row);
+            }
+            searchIndex.build(paths);
+            searchIndexDirty = false;
+        }
+        // どちらも行番号の昇順
+        rows = TrigramIndex::intersect(rows, searchIndex.search(query, fuzzyCheck->isChecked() ? 1 : 0));
+    }
+    index.sort(rows, static_cast<MetadataIndex::SortKey>(sortCombo->currentData().toInt()),
+               descendingCheck->isChecked());
+    
+    visibleFiles.clear();
+    for (int i = 0; i < qMin(maxVisibleItems, static_cast<int>(rows.size())); ++i) {
+        visibleFiles << index.pathAt(rows.at(i));
+    }
     updateFileList();
-    emit filesChanged(QStringList());
+    
+    QString result = QString("%1 / %2 件（%3 ms）").arg(rows.size()).arg(index.size()).arg(timer.elapsed());
+    if (rows.size() > visibleFiles.size()) {
+        result += QString("、先頭の %1 件を表示").arg(visibleFiles.size());
+    }
+    if (!events.events().isEmpty()) {
+        result += QString("、🎉 %1 イベント").arg(events.events().size());
+    }
+    resultLabel->setText(result);
 }
 
 void FileListWidget::updateFileList()
 {
-    // 既存のウィジェットをクリア
+    // 前回と同じファイルのウィジェットはそのまま使い、増減した分だけ作り直す
+    // （フォルダを再走査して数件増えたときや、絞り込みを変えたときに一覧全体を作り直さない）
+    QHash<QString, FileItemWidget *> existing;
     for (FileItemWidget *widget : fileItemWidgets) {
-        widget->deleteLater();
+        existing.insert(widget->getFilePath(), widget);
+    }
+    QSet<QString> wanted(visibleFiles.constBegin(), visibleFiles.constEnd());
+    for (auto it = existing.begin(); it != existing.end();) {
+        if (wanted.contains(it.key())) {
+            ++it;
+            continue;
+        }
+        scrollLayout->removeWidget(it.value());
+        it.value()->deleteLater();
+        it = existing.erase(it);
     }
-    fileItemWidgets.clear();
     
-    // 新しいファイルアイテムを作成
-    for (const QString &filePath : fileList) {
-        FileItemWidget *item = new FileItemWidget(filePath);
-        fileItemWidgets.append(item);
-        scrollLayout->insertWidget(scrollLayout->count() - 1, item);
+    QList<FileItemWidget *> items;
+    items.reserve(visibleFiles.size());
+    for (const QString &filePath : visibleFiles) {
+        FileItemWidget *item = existing.take(filePath);
+        if (item) {
+            // 並べ替えで位置が変わった場合は移す
+            scrollLayout->removeWidget(item);
+        } else {
+            item = new FileItemWidget(filePath);
+            const int row = index.rowOf(filePath);
+            item->setImported(row >= 0 && index.isImported(row));
+        }
+        scrollLayout->insertWidget(static_cast<int>(items.size()), item);
+        items.append(item);
     }
+    fileItemWidgets = items;
 }
 
 QString FileListWidget::formatFileSize(qint64 bytes)
@@ -156,6 +380,15 @@ void FileItemWidget::setupUI()
     );
 }
 
+void FileItemWidget::setImported(bool imported)
+{
+    QFileInfo info(filePath);
+    typeLabel->setText(imported ? "取り込み済み" : info.suffix().toUpper());
+    typeLabel->setStyleSheet(imported ? "color: #95a5a6; font-size: 12px;"
+                                      : "color: #3498db; font-size: 12px; font-weight: bold;");
+    nameLabel->setStyleSheet(imported ? "color: #95a5a6;" : "font-weight: bold; color: #2c3e50;");
+}
+
 QString FileItemWidget::formatFileSize(qint64 bytes)
 {
     if (bytes < 1024) return QString("%1 B").arg(bytes);
@@ -176,5 +409,3 @@ QString FileItemWidget::getFileIcon(const QString &filePath)
     }
     return "📄";
 }
-
-#include "FileListWidget.moc"
\ No newline at end of file
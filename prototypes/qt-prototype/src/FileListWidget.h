@@ -9,9 +9,21 @@
 #include <QFrame>
 #include <QFileInfo>
 #include <QMimeDatabase>
+#include <QSet>
+#include <QComboBox>
+#include <QCheckBox>
+#include <QDateEdit>
+#include <QSpinBox>
+#include <QLineEdit>
+#include "MetadataIndex.h"
+#include "TrigramIndex.h"
+#include "EventClusterer.h"
 
 class FileItemWidget;
 
+// 選択されたファイルの一覧
+// ファイルのメタデータは列指向の索引（MetadataIndex）に持ち、絞り込み・並べ替えの結果のうち
+// 先頭の一定件数だけをFileItemWidgetとして表示する（100万件でも行毎のウィジェットは作らない）。
 class FileListWidget : public QWidget
 {
     Q_OBJECT
@@ -19,14 +31,21 @@ class FileListWidget : public QWidget
 public:
     explicit FileListWidget(QWidget *parent = nullptr);
     
-    void setFiles(const QStringList &files);
+    void setFiles(const PathTable &files);
     void clearFiles();
+    // 取り込み済みのファイル（setFilesの表のハンドル）を薄く表示する
+    void setImportedFiles(const QVector<int> &handles);
     
 signals:
-    void filesChanged(const QStringList &files);
+    void filesChanged(const PathTable &files);
+
+private slots:
+    void applyFilter();
 
 private:
     void setupUI();
+    void setupFilterBar();
+    void updateCameraFilter();
     void updateFileList();
     QString formatFileSize(qint64 bytes);
     QString getFileIcon(const QString &filePath);
@@ -37,7 +56,25 @@ private:
     QWidget *scrollWidget;
     QVBoxLayout *scrollLayout;
     
-    QStringList fileList;
+    // 絞り込み・並べ替え
+    QLineEdit *searchEdit;
+    QCheckBox *fuzzyCheck;
+    QComboBox *typeFilterCombo;
+    QComboBox *cameraFilterCombo;
+    QCheckBox *dateFilterCheck;
+    QDateEdit *fromDateEdit;
+    QDateEdit *toDateEdit;
+    QSpinBox *minSizeSpin;
+    QCheckBox *hideImportedCheck;
+    QComboBox *sortCombo;
+    QCheckBox *descendingCheck;
+    QLabel *resultLabel;
+    
+    MetadataIndex index;                // 行番号はsetFilesの表のハンドルと同じ
+    TrigramIndex searchIndex;           // indexの行番号で引く（最初の検索で作る）
+    bool searchIndexDirty = true;
+    EventClusterer events;              // ファイルの追加だけなら追加分をマージして更新する
+    QStringList visibleFiles;           // 絞り込み・並べ替えの結果のうち表示する分（最大 maxVisibleItems 件）
     QList<FileItemWidget*> fileItemWidgets;
 };
 
@@ -48,6 +85,9 @@ class FileItemWidget : public QFrame
 public:
     explicit FileItemWidget(const QString &filePath, QWidget *parent = nullptr);
     
+    QString getFilePath() const { return filePath; }
+    void setImported(bool imported);
+    
 private:
     void setupUI();
     QString formatFileSize(qint64 bytes);
@@ -0,0 +1,199 @@
+#include "GeoTag.h"
+#include <QFile>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// JPEGのマーカーを探す範囲（Exifは先頭付近にある）
+const int maxJpegSegments = 32;
+
+const quint16 gpsIfdTag = 0x8825;
+const quint16 gpsLatitudeRefTag = 1;
+const quint16 gpsLatitudeTag = 2;
+const quint16 gpsLongitudeRefTag = 3;
+const quint16 gpsLongitudeTag = 4;
+const quint16 rationalType = 5;
+
+bool readAt(QFile &file, qint64 offset, uchar *data, qint64 size)
+{
+    return file.seek(offset) && file.read(reinterpret_cast<char *>(data), size) == size;
+}
+
+// TIFF構造（Exifの中身、TIFF形式のRAW）の読み取り。オフセットはbaseからの相対
+class TiffReader
+{
+public:
+    TiffReader(QFile &file, qint64 base)
+        : file(file), base(base)
+    {
+    }
+
+    bool readHeader(quint32 *firstIfd)
+    {
+        uchar header[8];
+        if (!readAt(file, base, header, sizeof(header))) {
+            return false;
+        }
+        if (header[0] == 'I' && header[1] == 'I') {
+            bigEndian = false;
+        } else if (header[0] == 'M' && header[1] == 'M') {
+            bigEndian = true;
+        } else {
+            return false;
+        }
+        // マジックナンバーは42以外（ORFの"RO"、RW2の0x55など）もあるため確かめない
+        *firstIfd = u32(header + 4);
+        return true;
+    }
+
+    // IFDのエントリからtagの値（4バイトの値またはオフセット）を探す
+    bool find(quint32 ifd, quint16 tag, quint16 *type, quint32 *count, uchar value[4])
+    {
+        uchar countBytes[2];
+        if (!readAt(file, base + ifd, countBytes, sizeof(countBytes))) {
+            return false;
+        }
+        const int entries = u16(countBytes);
+        QByteArray table(entries * 12, Qt::Uninitialized);
+        uchar *p = reinterpret_cast<uchar *>(table.data());
+        if (!readAt(file, base + ifd + 2, p, table.size())) {
+            return false;
+        }
+        for (int i = 0; i < entries; ++i, p += 12) {
+            if (u16(p) == tag) {
+                *type = u16(p + 2);
+                *count = u32(p + 4);
+                memcpy(value, p + 8, 4);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    quint32 offsetOf(const uchar value[4]) const { return u32(value); }
+
+    // 度・分・秒の3つの有理数を度にする
+    bool readDegrees(quint32 offset, double *degrees)
+    {
+        uchar data[24];
+        if (!readAt(file, base + offset, data, sizeof(data))) {
+            return false;
+        }
+        double parts[3];
+        for (int i = 0; i < 3; ++i) {
+            const quint32 denominator = u32(data + i * 8 + 4);
+            if (denominator == 0) {
+                return false;
+            }
+            parts[i] = static_cast<double>(u32(data + i * 8)) / denominator;
+        }
+        *degrees = parts[0] + parts[1] / 60 + parts[2] / 3600;
+        return true;
+    }
+
+private:
+    quint16 u16(const uchar *p) const
+    {
+        return bigEndian ? quint16((p[0] << 8) | p[1]) : quint16((p[1] << 8) | p[0]);
+    }
+
+    quint32 u32(const uchar *p) const
+    {
+        return bigEndian ? (quint32(p[0]) << 24) | (quint32(p[1]) << 16) | (quint32(p[2]) << 8) | p[3]
+                         : (quint32(p[3]) << 24) | (quint32(p[2]) << 16) | (quint32(p[1]) << 8) | p[0];
+    }
+
+    QFile &file;
+    qint64 base;
+    bool bigEndian = false;
+};
+
+// JPEGのAPP1（Exif）の中のTIFFヘッダーの位置
+qint64 findExifInJpeg(QFile &file)
+{
+    qint64 position = 2;
+    for (int i = 0; i < maxJpegSegments; ++i) {
+        uchar marker[4];
+        if (!readAt(file, position, marker, sizeof(marker)) || marker[0] != 0xff) {
+            return -1;
+        }
+        // SOS以降は画像データ
+        if (marker[1] == 0xda || marker[1] == 0xd9) {
+            return -1;
+        }
+        const int length = (marker[2] << 8) | marker[3];
+        if (marker[1] == 0xe1) {
+            uchar signature[6];
+            if (readAt(file, position + 4, signature, sizeof(signature)) && memcmp(signature, "Exif\0\0", 6) == 0) {
+                return position + 10;
+            }
+        }
+        position += 2 + length;
+    }
+    return -1;
+}
+
+} // namespace
+
+namespace GeoTag {
+
+bool read(const QString &path, GeoPoint *point)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    uchar magic[2];
+    if (!readAt(file, 0, magic, sizeof(magic))) {
+        return false;
+    }
+    qint64 base = 0;
+    if (magic[0] == 0xff && magic[1] == 0xd8) {
+        base = findExifInJpeg(file);
+        if (base < 0) {
+            return false;
+        }
+    } else if (!((magic[0] == 'I' && magic[1] == 'I') || (magic[0] == 'M' && magic[1] == 'M'))) {
+        // HEIF等は未対応
+        return false;
+    }
+
+    TiffReader tiff(file, base);
+    quint32 ifd0 = 0;
+    quint16 type = 0;
+    quint32 count = 0;
+    uchar value[4];
+    if (!tiff.readHeader(&ifd0) || !tiff.find(ifd0, gpsIfdTag, &type, &count, value)) {
+        return false;
+    }
+    const quint32 gpsIfd = tiff.offsetOf(value);
+
+    double latitude = 0;
+    double longitude = 0;
+    if (!tiff.find(gpsIfd, gpsLatitudeTag, &type, &count, value) || type != rationalType || count != 3
+        || !tiff.readDegrees(tiff.offsetOf(value), &latitude)) {
+        return false;
+    }
+    if (!tiff.find(gpsIfd, gpsLongitudeTag, &type, &count, value) || type != rationalType || count != 3
+        || !tiff.readDegrees(tiff.offsetOf(value), &longitude)) {
+        return false;
+    }
+    // 参照（N/S、E/W）は値に直接入っている
+    if (tiff.find(gpsIfd, gpsLatitudeRefTag, &type, &count, value) && value[0] == 'S') {
+        latitude = -latitude;
+    }
+    if (tiff.find(gpsIfd, gpsLongitudeRefTag, &type, &count, value) && value[0] == 'W') {
+        longitude = -longitude;
+    }
+
+    // 測位できていないカメラは0/0を書くことがある
+    if (std::abs(latitude) > 90 || std::abs(longitude) > 180 || (latitude == 0 && longitude == 0)) {
+        return false;
+    }
+    point->latitude = latitude;
+    point->longitude = longitude;
+    return true;
+}
+
+} // namespace GeoTag
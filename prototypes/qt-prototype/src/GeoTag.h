@@ -0,0 +1,22 @@
+#ifndef GEOTAG_H
+#define GEOTAG_H
+
+#include <QString>
+
+// 緯度・経度（度）
+struct GeoPoint
+{
+    double latitude = 0;
+    double longitude = 0;
+};
+
+// 写真に記録された撮影位置の読み取り
+namespace GeoTag {
+
+// JPEGのExif（APP1）とTIFF形式のRAW（CR2・NEF・ARW・DNG等）のGPS IFDから緯度・経度を読む。
+// 必要なIFDだけをシークして読むため、ファイル全体は読まない。位置が記録されていなければfalse
+bool read(const QString &path, GeoPoint *point);
+
+} // namespace GeoTag
+
+#endif // GEOTAG_H
@@ -0,0 +1,46 @@
+#include "HttpClient.h"
+#include "HttpTransport.h"
+#include <QThread>
+
+namespace {
+
+const int maxAttempts = 4;
+
+} // namespace
+
+QByteArray HttpResponse::header(const QByteArray &name) const
+{
+    for (const auto &header : headers) {
+        if (header.first.compare(name, Qt::CaseInsensitive) == 0) {
+            return header.second;
+        }
+    }
+    return QByteArray();
+}
+
+HttpResponse HttpClient::send(const QByteArray &method, const QUrl &url, const HttpHeaders &headers, const QByteArray &body)
+{
+    return HttpTransport::instance()->sendAndWait({method, url, headers, body});
+}
+
+bool HttpClient::shouldRetry(const HttpResponse &response, int attempt)
+{
+    const bool retryable = response.status == 0 || response.status == 429 || response.status >= 500;
+    if (!retryable || attempt >= maxAttempts) {
+        return false;
+    }
+    const int retryAfter = response.header("Retry-After").toInt();
+    QThread::msleep(retryAfter > 0 ? qMin(retryAfter, 60) * 1000 : 200 << attempt);
+    return true;
+}
+
+HttpResponse HttpClient::sendWithRetry(const QByteArray &method, const QUrl &url, const HttpHeaders &headers, const QByteArray &body)
+{
+    HttpResponse response;
+    for (int attempt = 1; ; ++attempt) {
+        response = send(method, url, headers, body);
+        if (!shouldRetry(response, attempt)) {
+            return response;
+        }
+    }
+}
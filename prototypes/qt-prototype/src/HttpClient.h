@@ -0,0 +1,37 @@
+#ifndef HTTPCLIENT_H
+#define HTTPCLIENT_H
+
+#include <QString>
+#include <QByteArray>
+#include <QList>
+#include <QPair>
+#include <QUrl>
+
+using HttpHeaders = QList<QPair<QByteArray, QByteArray>>;
+
+struct HttpResponse
+{
+    int status = 0;             // 0は接続エラー
+    QByteArray body;
+    HttpHeaders headers;
+    QString error;
+
+    bool isSuccess() const { return status >= 200 && status < 300; }
+    QByteArray header(const QByteArray &name) const;
+};
+
+// クラウド出力先で共通のHTTP送信
+// 呼び出しはブロックする。通信はHttpTransportの共有接続プールで行う。
+namespace HttpClient {
+
+HttpResponse send(const QByteArray &method, const QUrl &url, const HttpHeaders &headers, const QByteArray &body);
+
+// 接続エラー・5xx・429なら待機（Retry-Afterを優先）してtrueを返す。attemptは1から
+bool shouldRetry(const HttpResponse &response, int attempt);
+
+// ヘッダーが毎回同じリクエスト用（署名し直しが不要なもの）
+HttpResponse sendWithRetry(const QByteArray &method, const QUrl &url, const HttpHeaders &headers, const QByteArray &body);
+
+}
+
+#endif // HTTPCLIENT_H
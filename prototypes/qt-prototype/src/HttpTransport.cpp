@@ -0,0 +1,116 @@
+#include "HttpTransport.h"
+#include "StageTrace.h"
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QSslConfiguration>
+#include <future>
+
+Q_GLOBAL_STATIC(HttpTransport, sharedTransport)
+
+HttpTransport::HttpTransport()
+    : context(new QObject())
+    , manager(new QNetworkAccessManager(context))
+    , maxConcurrent(16)
+{
+    thread.setObjectName("HttpTransport");
+    context->moveToThread(&thread);
+    QObject::connect(&thread, &QThread::finished, context, &QObject::deleteLater);
+    thread.start();
+}
+
+HttpTransport::~HttpTransport()
+{
+    thread.quit();
+    thread.wait();
+}
+
+HttpTransport *HttpTransport::instance()
+{
+    return sharedTransport();
+}
+
+void HttpTransport::send(const HttpRequest &request, Callback callback)
+{
+    QMetaObject::invokeMethod(context, [this, request, callback]() {
+        queue.enqueue({request, callback});
+        startPending();
+    }, Qt::QueuedConnection);
+}
+
+HttpResponse HttpTransport::sendAndWait(const HttpRequest &request)
+{
+    Q_ASSERT(QThread::currentThread() != &thread);
+
+    auto promise = std::make_shared<std::promise<HttpResponse>>();
+    std::future<HttpResponse> result = promise->get_future();
+    send(request, [promise](const HttpResponse &response) { promise->set_value(response); });
+    return result.get();
+}
+
+void HttpTransport::setMaxConcurrentRequests(int count)
+{
+    maxConcurrent.storeRelaxed(qMax(1, count));
+    QMetaObject::invokeMethod(context, [this]() { startPending(); }, Qt::QueuedConnection);
+}
+
+void HttpTransport::startPending()
+{
+    while (running < maxConcurrent.loadRelaxed() && !queue.isEmpty()) {
+        const Pending pending = queue.dequeue();
+
+        QNetworkRequest request(pending.request.url);
+        for (const auto &header : pending.request.headers) {
+            request.setRawHeader(header.first, header.second);
+        }
+        request.setTransferTimeout(60000);
+        request.setAttribute(QNetworkRequest::Http2AllowedAttribute, true);
+        request.setAttribute(QNetworkRequest::HttpPipeliningAllowedAttribute, true);
+        const bool https = pending.request.url.scheme() == "https";
+        const QString origin = pending.request.url.host() + ':' + QString::number(pending.request.url.port(443));
+        if (https) {
+            // セッションチケットを取り出せるようにし、同じホストで前に受け取ったチケットがあれば渡して
+            // 新しい接続でもTLSセッションを再開する
+            QSslConfiguration ssl = QSslConfiguration::defaultConfiguration();
+            ssl.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+            const QByteArray ticket = sessionTickets.value(origin);
+            if (!ticket.isEmpty()) {
+                ssl.setSessionTicket(ticket);
+            }
+            request.setSslConfiguration(ssl);
+        }
+
+        ++running;
+        QNetworkReply *reply = manager->sendCustomRequest(request, pending.request.method, pending.request.body);
+        const Callback callback = pending.callback;
+        // 送信から応答までの区間（同時に送るリクエストは重なる）。本体のあるリクエストはアップロード
+        const qint64 startNs = StageTrace::isEnabled() ? StageTrace::now() : -1;
+        const QByteArray method = pending.request.method;
+        const qint64 bodySize = pending.request.body.size();
+        QObject::connect(reply, &QNetworkReply::finished, context,
+                         [this, reply, callback, startNs, method, bodySize, https, origin]() {
+            if (startNs >= 0) {
+                StageTrace::recordAsync(bodySize > 0 ? "upload" : "http", startNs, StageTrace::now(),
+                                        QString::fromLatin1(method) + ' ' + reply->url().path(), bodySize);
+            }
+            HttpResponse response;
+            response.status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+            response.body = reply->readAll();
+            response.headers = reply->rawHeaderPairs();
+            if (response.status == 0) {
+                response.error = reply->errorString();
+            }
+            if (https) {
+                const QByteArray ticket = reply->sslConfiguration().sessionTicket();
+                if (!ticket.isEmpty()) {
+                    sessionTickets.insert(origin, ticket);
+                }
+            }
+            reply->deleteLater();
+
+            --running;
+            callback(response);
+            startPending();
+        });
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef HTTPTRANSPORT_H
+#define HTTPTRANSPORT_H
+
+#include <QThread>
+#include <QQueue>
+#include <QHash>
+#include <QAtomicInt>
+#include <functional>
+#include "HttpClient.h"
+
+class QObject;
+class QNetworkAccessManager;
+
+struct HttpRequest
+{
+    QByteArray method;
+    QUrl url;
+    HttpHeaders headers;
+    QByteArray body;
+};
+
+// すべてのクラウド出力先で共有する非同期HTTP通信層
+// 専用スレッドの1つのQNetworkAccessManagerにリクエストを集めることで、
+// ホスト毎の接続プール（keep-alive、HTTP/2の多重化、GET/HEADのパイプライン）と
+// TLSセッションの再開を出力先・ワーカーをまたいで共有する。
+// 接続が切れた後の新しい接続でもハンドシェイクを短縮できるよう、ホスト毎に最後のセッションチケットを
+// 覚えておき、次の接続に渡す。
+// 同時に送るリクエスト数は全体で上限を設け、超えた分は順番に待たせる。
+class HttpTransport
+{
+public:
+    using Callback = std::function<void(const HttpResponse &)>;
+
+    HttpTransport();
+    ~HttpTransport();
+
+    static HttpTransport *instance();
+
+    // 任意のスレッドから呼べる。callbackは通信スレッドで呼ばれる
+    void send(const HttpRequest &request, Callback callback);
+
+    // 完了までブロックする（ワーカースレッド用）
+    HttpResponse sendAndWait(const HttpRequest &request);
+
+    void setMaxConcurrentRequests(int count);
+    int maxConcurrentRequests() const { return maxConcurrent.loadRelaxed(); }
+
+private:
+    struct Pending
+    {
+        HttpRequest request;
+        Callback callback;
+    };
+
+    // 以下は通信スレッドでのみ呼ぶ
+    void startPending();
+
+    QThread thread;
+    QObject *context;
+    QNetworkAccessManager *manager;
+    QQueue<Pending> queue;
+    QHash<QString, QByteArray> sessionTickets;     // ホスト:ポート毎の最後のTLSセッションチケット
+    int running = 0;
+    QAtomicInt maxConcurrent;
+};
+
+#endif // HTTPTRANSPORT_H
@@ -0,0 +1,272 @@
+#include "ImportCatalog.h"
+#include "PlatformIo.h"
+#include "StageTrace.h"
+#include "TransferJob.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QMutexLocker>
+#include <QReadLocker>
+#include <QSet>
+#include <QStandardPaths>
+#include <QWriteLocker>
+
+namespace {
+
+// この件数が溜まったらまとめて追記する
+const int flushBatchSize = 256;
+
+struct SharedCatalogs
+{
+    QMutex mutex;
+    QHash<QString, std::weak_ptr<ImportCatalog>> catalogs;
+};
+
+Q_GLOBAL_STATIC(SharedCatalogs, sharedCatalogs)
+
+} // namespace
+
+ImportCatalog::ImportCatalog(const QString &destinationId)
+    : id(destinationId)
+{
+    const QByteArray hash = QCryptographicHash::hash(destinationId.toUtf8(), QCryptographicHash::Sha1).toHex();
+    const QString directory = directoryPath();
+    QDir().mkpath(directory);
+    path = directory + "/" + QString::fromLatin1(hash) + ".tsv";
+}
+
+QString ImportCatalog::directoryPath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/catalog";
+}
+
+QStringList ImportCatalog::destinationIds()
+{
+    // 各目録の先頭行に出力先の組を書いてある
+    QStringList ids;
+    const QDir directory(directoryPath());
+    for (const QString &name : directory.entryList({"*.tsv"}, QDir::Files)) {
+        QFile in(directory.filePath(name));
+        if (!in.open(QIODevice::ReadOnly)) {
+            continue;
+        }
+        const QByteArray header = in.readLine().trimmed();
+        if (header.startsWith("#\t")) {
+            ids << QString::fromUtf8(header.mid(2));
+        }
+    }
+    return ids;
+}
+
+ImportCatalog::~ImportCatalog()
+{
+    flush();
+}
+
+QString ImportCatalog::destinationIdOf(const TransferOptions &options)
+{
+    // 出力先の順序は問わない
+    QStringList ids;
+    for (const QString &spec : options.destinations) {
+        if (spec == "local") {
+            ids << "local:" + QDir::cleanPath(options.destinationRoot);
+        } else if (spec == "s3") {
+            ids << options.s3.destinationId();
+        } else if (spec == "dropbox") {
+            ids << options.dropbox.destinationId();
+        } else if (spec == "onedrive") {
+            ids << options.onedrive.destinationId();
+        } else {
+            ids << spec;
+        }
+    }
+    if (ids.isEmpty()) {
+        ids << "local:" + QDir::cleanPath(options.destinationRoot);
+    }
+    ids.sort();
+    return ids.join('|');
+}
+
+bool ImportCatalog::open(QString *error)
+{
+    QWriteLocker locker(&lock);
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadWrite | QIODevice::Append)) {
+        *error = "取り込み済みファイルの目録を開けません: " + file.errorString();
+        return false;
+    }
+
+    // 先頭行は "#" \t 出力先の組、以降の書式: device \t inode \t size \t mtime \t 部分ハッシュ \t ファイル名 \t 出力先パス
+    if (file.size() == 0) {
+        file.write("#\t" + id.toUtf8() + '\n');
+        file.flush();
+    }
+
+    file.seek(0);
+    while (!file.atEnd()) {
+        const QByteArray line = file.readLine();
+        if (!line.endsWith('\n')) {
+            // 書き込み途中で切れた最後の行
+            break;
+        }
+        const QList<QByteArray> fields = line.chopped(1).split('\t');
+        if (fields.size() < 7) {
+            continue;
+        }
+        Record record;
+        record.device = fields[0].toULongLong();
+        record.inode = fields[1].toULongLong();
+        record.partialHash = fields[4];
+        record.destinationPath = QString::fromUtf8(fields[6]);
+        insert(makeKey(QString::fromUtf8(fields[5]), fields[2].toLongLong(), fields[3].toLongLong()), record);
+    }
+    file.seek(file.size());
+    return true;
+}
+
+std::shared_ptr<ImportCatalog> ImportCatalog::shared(const QString &destinationId, QString *error)
+{
+    SharedCatalogs *registry = sharedCatalogs();
+    QMutexLocker locker(&registry->mutex);
+    std::shared_ptr<ImportCatalog> catalog = registry->catalogs.value(destinationId).lock();
+    if (catalog) {
+        return catalog;
+    }
+    catalog = std::make_shared<ImportCatalog>(destinationId);
+    if (!catalog->open(error)) {
+        return nullptr;
+    }
+    registry->catalogs.insert(destinationId, catalog);
+    return catalog;
+}
+
+QString ImportCatalog::destinationOf(const QFileInfo &source) const
+{
+    QVector<Record> candidates;
+    {
+        QReadLocker locker(&lock);
+        candidates = records.value(makeKey(source.fileName(), source.size(), source.lastModified().toMSecsSinceEpoch()));
+    }
+    if (candidates.isEmpty()) {
+        return QString();
+    }
+
+    quint64 device = 0;
+    quint64 inode = 0;
+    if (PlatformIo::fileIdentity(source.absoluteFilePath(), &device, &inode)) {
+        for (const Record &record : candidates) {
+            if (record.device == device && record.inode == inode) {
+                return record.destinationPath;
+            }
+        }
+    }
+
+    // 名前・サイズ・更新日時は一致するがデバイスIDが違う（再マウントや別のカードリーダー）
+    const QByteArray partialHash = partialHashOf(source.absoluteFilePath());
+    if (partialHash.isEmpty()) {
+        return QString();
+    }
+    for (const Record &record : candidates) {
+        if (record.partialHash == partialHash) {
+            return record.destinationPath;
+        }
+    }
+    return QString();
+}
+
+void ImportCatalog::add(const SourceFingerprint &fingerprint, const QString &fileName, const QString &destinationPath)
+{
+    Record record;
+    record.device = fingerprint.device;
+    record.inode = fingerprint.inode;
+    record.partialHash = fingerprint.partialHash;
+    record.destinationPath = destinationPath;
+    {
+        QWriteLocker locker(&lock);
+        insert(makeKey(fileName, fingerprint.size, fingerprint.modifiedMs), record);
+    }
+
+    const QByteArray line = QByteArray::number(fingerprint.device) + '\t' + QByteArray::number(fingerprint.inode) + '\t'
+                          + QByteArray::number(fingerprint.size) + '\t' + QByteArray::number(fingerprint.modifiedMs)
+                          + '\t' + fingerprint.partialHash + '\t' + fileName.toUtf8() + '\t'
+                          + destinationPath.toUtf8() + '\n';
+    QMutexLocker locker(&fileMutex);
+    pending.append(line);
+    if (++pendingCount >= flushBatchSize) {
+        locker.unlock();
+        flush();
+    }
+}
+
+bool ImportCatalog::flush()
+{
+    // 目録は再取り込みを省くためのもので、失っても出力先のジャーナルで飛ばせるため同期はしない
+    QMutexLocker locker(&fileMutex);
+    if (pending.isEmpty() || !file.isOpen()) {
+        return true;
+    }
+    const bool ok = file.write(pending) == pending.size() && file.flush();
+    pending.clear();
+    pendingCount = 0;
+    return ok;
+}
+
+bool ImportCatalog::fingerprintOf(const QFileInfo &source, SourceFingerprint *fingerprint)
+{
+    TraceSpan span("stat");
+    fingerprint->size = source.size();
+    fingerprint->modifiedMs = source.lastModified().toMSecsSinceEpoch();
+    return PlatformIo::fileIdentity(source.absoluteFilePath(), &fingerprint->device, &fingerprint->inode);
+}
+
+QByteArray ImportCatalog::partialHashOf(const QString &path)
+{
+    TraceSpan span("hash", path);
+    QFile in(path);
+    if (!in.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+    return QCryptographicHash::hash(in.read(partialHashSize), QCryptographicHash::Sha256).toHex();
+}
+
+QStringList ImportCatalog::destinationPaths() const
+{
+    QSet<QString> seen;
+    QStringList paths;
+    QReadLocker locker(&lock);
+    for (const QVector<Record> &list : records) {
+        for (const Record &record : list) {
+            if (!seen.contains(record.destinationPath)) {
+                seen.insert(record.destinationPath);
+                paths << record.destinationPath;
+            }
+        }
+    }
+    paths.sort();
+    return paths;
+}
+
+int ImportCatalog::count() const
+{
+    QReadLocker locker(&lock);
+    return recordCount;
+}
+
+QByteArray ImportCatalog::makeKey(const QString &fileName, qint64 size, qint64 modifiedMs)
+{
+    return fileName.toUtf8() + '\t' + QByteArray::number(size) + '\t' + QByteArray::number(modifiedMs);
+}
+
+void ImportCatalog::insert(const QByteArray &key, const Record &record)
+{
+    QVector<Record> &list = records[key];
+    for (Record &existing : list) {
+        // 同じファイルを取り込み直した場合は新しい記録で置き換える
+        if (existing.device == record.device && existing.inode == record.inode) {
+            existing = record;
+            return;
+        }
+    }
+    list.append(record);
+    ++recordCount;
+}
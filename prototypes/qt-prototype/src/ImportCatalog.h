@@ -0,0 +1,95 @@
+#ifndef IMPORTCATALOG_H
+#define IMPORTCATALOG_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QFileInfo>
+#include <QHash>
+#include <QVector>
+#include <QFile>
+#include <QReadWriteLock>
+#include <QMutex>
+#include <memory>
+
+struct TransferOptions;
+
+// ソースのファイルを識別する情報
+struct SourceFingerprint
+{
+    quint64 device = 0;
+    quint64 inode = 0;
+    qint64 size = 0;
+    qint64 modifiedMs = 0;
+    QByteArray partialHash;         // 先頭64KBのSHA-256（16進）
+};
+
+// 取り込み済みファイルの目録
+// 取り込んだファイルのソースの識別情報と出力先を出力先の組毎に記録し、同じカードを挿し直したときに
+// メタデータだけ（ハッシュの計算も出力先の確認もなし）で取り込み済みと判定する。
+// アプリのデータフォルダに追記形式で保存し、追記はまとめて行う。
+class ImportCatalog
+{
+public:
+    static constexpr qint64 partialHashSize = 64 * 1024;
+
+    explicit ImportCatalog(const QString &destinationId);
+    ~ImportCatalog();
+
+    // 出力先の組を識別する文字列。クラウドはマニフェストと同じ接続先・フォルダまで含めた識別子を使う
+    static QString destinationIdOf(const TransferOptions &options);
+
+    bool open(QString *error);
+
+    // 開いた目録をプロセス内で共有する（同じ出力先の組に同時に取り込むジョブが別々に追記しないように）
+    // 使っているジョブがなくなれば閉じる
+    static std::shared_ptr<ImportCatalog> shared(const QString &destinationId, QString *error);
+
+    // 目録のある出力先の組の一覧（取り込み済みのアーカイブ全体を検索するため）
+    static QStringList destinationIds();
+    QString destinationId() const { return id; }
+    // 記録済みの出力先パス（出力先からの相対パス、重複なし）
+    QStringList destinationPaths() const;
+
+    // 取り込み済みなら出力先パス、未記録なら空文字列（任意のスレッドから呼べる）
+    // デバイスIDとinodeまで一致すれば読まずに判定する。再マウントでデバイスIDが変わった場合だけ
+    // ソースの先頭を読んで部分ハッシュで確かめる。
+    QString destinationOf(const QFileInfo &source) const;
+
+    // 記録はまとめて追記する（flushで残りを書き出す）
+    void add(const SourceFingerprint &fingerprint, const QString &fileName, const QString &destinationPath);
+    bool flush();
+
+    static bool fingerprintOf(const QFileInfo &source, SourceFingerprint *fingerprint);
+    static QByteArray partialHashOf(const QString &path);
+
+    int count() const;
+    QString filePath() const { return path; }
+
+private:
+    struct Record
+    {
+        quint64 device = 0;
+        quint64 inode = 0;
+        QByteArray partialHash;
+        QString destinationPath;
+    };
+
+    static QByteArray makeKey(const QString &fileName, qint64 size, qint64 modifiedMs);
+    void insert(const QByteArray &key, const Record &record);
+
+    static QString directoryPath();
+
+    QString id;
+    QString path;
+    QHash<QByteArray, QVector<Record>> records;     // ファイル名・サイズ・更新日時 → 記録
+    int recordCount = 0;
+    mutable QReadWriteLock lock;
+
+    QMutex fileMutex;
+    QFile file;
+    QByteArray pending;
+    int pendingCount = 0;
+};
+
+#endif // IMPORTCATALOG_H
@@ -0,0 +1,409 @@
+#include "LocalDestination.h"
+#include "TransferJournal.h"
+#include "PlatformIo.h"
+#include "RateLimiter.h"
+#include "StageTrace.h"
+#include <QDir>
+#include <QFile>
+#include <QDateTime>
+#include <QCryptographicHash>
+#include <QHash>
+#include <QMutexLocker>
+
+namespace {
+
+// 同時に読み戻す組の数と、検証待ちにできる組の数（一時ファイルは確定まで開いたまま）
+const int verifyThreads = 4;
+const int verifyBacklog = 16;
+
+struct RootStates
+{
+    QMutex mutex;
+    QHash<QString, std::weak_ptr<LocalRootState>> states;
+};
+
+Q_GLOBAL_STATIC(RootStates, rootStates)
+
+} // namespace
+
+// LocalUnitWriter Implementation
+class LocalUnitWriter : public UnitWriter
+{
+public:
+    LocalUnitWriter(LocalDestination *destination, const UnitPlan &plan, QVector<int> members, QStringList finalPaths,
+                    QByteArray base, std::shared_ptr<UnitPaths> paths)
+        : destination(destination), plan(plan), members(std::move(members)), finalPaths(std::move(finalPaths))
+        , base(std::move(base)), paths(std::move(paths)), hash(QCryptographicHash::Sha256)
+    {
+    }
+
+    ~LocalUnitWriter() override
+    {
+        if (!finished) {
+            abort();
+        }
+    }
+
+    bool wants(int member) const override
+    {
+        return members.contains(member);
+    }
+
+    std::shared_ptr<const UnitPaths> destinationPaths() const override
+    {
+        return paths;
+    }
+
+    bool beginFile(int member, QString *error) override
+    {
+        current = member;
+        currentPath = finalPaths.at(members.indexOf(member));
+        hash.reset();
+        out = std::make_unique<QFile>(DurabilityManager::temporaryPathFor(currentPath));
+        if (!out->open(QIODevice::WriteOnly | QIODevice::NewOnly | QIODevice::Unbuffered)) {
+            *error = out->errorString();
+            out.reset();
+            return false;
+        }
+        return true;
+    }
+
+    bool write(const char *data, qint64 size, QString *error) override
+    {
+        if (out->write(data, size) != size) {
+            *error = out->errorString();
+            return false;
+        }
+        // 検証用のハッシュはソースから読んだデータそのもので計算する
+        if (destination->verify) {
+            hash.addData(QByteArrayView(data, size));
+        }
+        return true;
+    }
+
+    bool endFile(QString *) override
+    {
+        const QFileInfo &source = plan.sources.at(current);
+        StagedFile file;
+        file.temporaryPath = out->fileName();
+        file.finalPath = currentPath;
+        file.entry.sourcePath = source.absoluteFilePath();
+        file.entry.size = source.size();
+        file.entry.modifiedMs = source.lastModified().toMSecsSinceEpoch();
+        file.entry.destinationPath = currentPath;
+        if (destination->verify) {
+            file.entry.hash = hash.result().toHex();
+        }
+        file.base = base;
+        file.suffix = plan.suffixes.at(current);
+        file.paths = paths;
+        file.member = current;
+        file.file = std::move(out);
+        staged.push_back(std::move(file));
+        return true;
+    }
+
+    bool commit(QString *error) override
+    {
+        finished = true;
+        if (destination->verify) {
+            destination->verifyLater(std::move(staged), finalPaths);
+            return true;
+        }
+        return destination->durability->commit(std::move(staged), error);
+    }
+
+    void abort() override
+    {
+        finished = true;
+        if (out) {
+            out->close();
+            QFile::remove(out->fileName());
+            out.reset();
+        }
+        for (StagedFile &written : staged) {
+            written.file->close();
+            QFile::remove(written.temporaryPath);
+        }
+        staged.clear();
+        destination->releaseNames(finalPaths);
+    }
+
+private:
+    LocalDestination *destination;
+    UnitPlan plan;
+    QVector<int> members;
+    QStringList finalPaths;
+    QByteArray base;                // finalPathsの連番とsuffixを除いた部分
+    std::shared_ptr<UnitPaths> paths;
+
+    int current = -1;
+    QString currentPath;
+    std::unique_ptr<QFile> out;
+    std::vector<StagedFile> staged;
+    QCryptographicHash hash;
+    bool finished = false;
+};
+
+// LocalDestination Implementation
+LocalDestination::LocalDestination(const QString &root, const DurabilityOptions &durability, bool resume, bool verify)
+    : root(QDir::cleanPath(root))
+    , rootUtf8(QFile::encodeName(QDir::cleanPath(root)))
+    , durabilityOptions(durability)
+    , resume(resume)
+    , verify(verify)
+    , verifySlots(verifyBacklog)
+{
+    verifyPool.setMaxThreadCount(verifyThreads);
+    verifyPool.setObjectName("検証");
+}
+
+LocalDestination::~LocalDestination()
+{
+    verifyPool.waitForDone();
+    durability.reset();
+}
+
+std::shared_ptr<LocalRootState> LocalDestination::rootStateFor(const QString &root)
+{
+    RootStates *registry = rootStates();
+    QMutexLocker locker(&registry->mutex);
+    std::shared_ptr<LocalRootState> state = registry->states.value(root).lock();
+    if (!state) {
+        state = std::make_shared<LocalRootState>();
+        registry->states.insert(root, state);
+    }
+    return state;
+}
+
+bool LocalDestination::prepare(QString *error)
+{
+    shared = rootStateFor(root);
+    if (!shared->directories.ensure(rootUtf8)) {
+        *error = "出力先フォルダを作成できません";
+        return false;
+    }
+
+    if (resume) {
+        // ジャーナルは同じ出力先に書き込むジョブで1つのファイルハンドルを共有する
+        QMutexLocker locker(&shared->journalMutex);
+        if (!shared->journal) {
+            auto opened = std::make_unique<TransferJournal>(root + "/.media-transfer-journal");
+            if (!opened->open()) {
+                *error = "ジャーナルを開けません: " + opened->errorString();
+                return false;
+            }
+            shared->journal = std::move(opened);
+        }
+        journal = shared->journal.get();
+    }
+    durability = std::make_unique<DurabilityManager>(durabilityOptions, root, journal, &shared->names);
+    durability->setFailureHandler([this](const QVector<QFileInfo> &sources, const QString &error) {
+        reportFailure(sources, error);
+    });
+    return true;
+}
+
+std::unique_ptr<UnitWriter> LocalDestination::beginUnit(const UnitPlan &plan, QString *error)
+{
+    // ジャーナルに記録済みのメンバーは飛ばし、残りだけを1つの組として転送する
+    QVector<int> members;
+    QString existingDestination;
+    int existingMember = -1;
+    auto paths = std::make_shared<UnitPaths>(plan.sources.size());
+    for (int i = 0; i < plan.sources.size(); ++i) {
+        const QFileInfo &source = plan.sources.at(i);
+        const QString destination = journal
+            ? journal->destinationOf(source.absoluteFilePath(), source.size(), source.lastModified().toMSecsSinceEpoch())
+            : QString();
+        if (!destination.isEmpty()) {
+            existingDestination = destination;
+            existingMember = i;
+            (*paths)[i] = relativePathOf(destination);
+            continue;
+        }
+        members.append(i);
+    }
+
+    QStringList finalPaths;
+    QByteArray base;
+    if (!members.isEmpty() && !planPaths(plan, members, existingDestination, existingMember, finalPaths, base, error)) {
+        return nullptr;
+    }
+    for (int i = 0; i < members.size(); ++i) {
+        (*paths)[members.at(i)] = relativePathOf(finalPaths.at(i));
+    }
+    return std::make_unique<LocalUnitWriter>(this, plan, members, finalPaths, base, paths);
+}
+
+bool LocalDestination::checkpoint(QString *error)
+{
+    verifyPool.waitForDone();
+    return !durability || durability->checkpoint(error);
+}
+
+void LocalDestination::trim()
+{
+    // 同じ出力先に書き込んでいる他のジョブがあれば、その予約を失わないよう捨てない
+    if (!shared || shared.use_count() > 1) {
+        return;
+    }
+    shared->names.trim();
+    shared->directories.clear();
+    if (journal) {
+        journal->forgetAppended();
+    }
+}
+
+bool LocalDestination::finish(QString *error)
+{
+    if (!checkpoint(error)) {
+        return false;
+    }
+    QMutexLocker locker(&failureMutex);
+    if (!backgroundErrors.isEmpty()) {
+        *error = backgroundErrors.join(" / ");
+        backgroundErrors.clear();
+        return false;
+    }
+    return true;
+}
+
+void LocalDestination::setFailureHandler(const FailureHandler &handler)
+{
+    QMutexLocker locker(&failureMutex);
+    failureHandler = handler;
+}
+
+void LocalDestination::verifyLater(std::vector<StagedFile> files, const QStringList &finalPaths)
+{
+    verifySlots.acquire();
+    auto unit = std::make_shared<std::vector<StagedFile>>(std::move(files));
+    verifyPool.start([this, unit, finalPaths]() {
+        RateLimiter::instance()->applyIoPriority();
+        QVector<QFileInfo> sources;
+        for (const StagedFile &file : *unit) {
+            sources.append(QFileInfo(file.entry.sourcePath));
+        }
+
+        QString error;
+        bool verified = true;
+        for (const StagedFile &file : *unit) {
+            if (!verifyFile(file, &error)) {
+                verified = false;
+                break;
+            }
+        }
+        if (verified) {
+            if (!durability->commit(std::move(*unit), &error)) {
+                reportFailure(sources, error);
+            }
+        } else {
+            // 一致しなかった組は公開せず、次回の実行でコピーし直す
+            for (StagedFile &file : *unit) {
+                file.file->close();
+                QFile::remove(file.temporaryPath);
+            }
+            releaseNames(finalPaths);
+            reportFailure(sources, error);
+        }
+        verifySlots.release();
+    });
+}
+
+bool LocalDestination::verifyFile(const StagedFile &file, QString *error)
+{
+    TraceSpan span("verify", file.finalPath);
+    QCryptographicHash readBack(QCryptographicHash::Sha256);
+    const bool read = PlatformIo::readUncached(file.temporaryPath, [&readBack, &span](const char *data, qint64 size) {
+        readBack.addData(QByteArrayView(data, size));
+        span.addBytes(size);
+    }, error);
+    if (!read) {
+        return false;
+    }
+    if (readBack.result().toHex() != file.entry.hash) {
+        *error = "検証に失敗しました（書き込んだ内容がソースと一致しません）: " + file.finalPath;
+        return false;
+    }
+    return true;
+}
+
+void LocalDestination::reportFailure(const QVector<QFileInfo> &sources, const QString &error)
+{
+    QMutexLocker locker(&failureMutex);
+    if (failureHandler) {
+        failureHandler(sources, error);
+    } else {
+        backgroundErrors << error;
+    }
+}
+
+bool LocalDestination::planPaths(const UnitPlan &plan, const QVector<int> &members, const QString &existingDestination,
+                                 int existingMember, QStringList &finalPaths, QByteArray &base, QString *error)
+{
+    // 組の一部が取り込み済みなら、その隣に同じ名前で揃える
+    if (!existingDestination.isEmpty()) {
+        const QByteArray existing = QFile::encodeName(existingDestination);
+        const QByteArray &existingSuffix = plan.suffixes.at(existingMember);
+        if (existing.endsWith(existingSuffix)) {
+            const QByteArray existingBase = existing.left(existing.size() - existingSuffix.size());
+            QStringList paths;
+            bool claimed = true;
+            for (int member : members) {
+                const QByteArray candidate = existingBase + plan.suffixes.at(member);
+                if (!shared->names.claimExact(candidate)) {
+                    claimed = false;
+                    break;
+                }
+                paths << QFile::decodeName(candidate);
+            }
+            if (claimed) {
+                finalPaths = paths;
+                base = existingBase;
+                return true;
+            }
+            releaseNames(paths);
+        }
+    }
+
+    QByteArray dir = rootUtf8;
+    if (!plan.relativeDir.isEmpty()) {
+        dir.append('/');
+        dir.append(plan.relativeDir);
+    }
+    if (!shared->directories.ensure(dir)) {
+        *error = "出力先フォルダを作成できません: " + QFile::decodeName(dir);
+        return false;
+    }
+
+    // 組のメンバーが同じ連番になるよう、まとめて名前を予約する
+    QVector<QByteArray> suffixes;
+    for (int member : members) {
+        suffixes.append(plan.suffixes.at(member));
+    }
+    base = dir + '/' + plan.stem;
+    QByteArray path = base;
+    const int number = shared->names.claimGroup(dir, plan.stem, suffixes);
+    if (number > 0) {
+        path.append('_');
+        path.append(QByteArray::number(number));
+    }
+    for (const QByteArray &suffix : suffixes) {
+        finalPaths << QFile::decodeName(path + suffix);
+    }
+    return true;
+}
+
+QByteArray LocalDestination::relativePathOf(const QString &path) const
+{
+    const QByteArray encoded = QFile::encodeName(path);
+    return encoded.startsWith(rootUtf8 + '/') ? encoded.mid(rootUtf8.size() + 1) : encoded;
+}
+
+void LocalDestination::releaseNames(const QStringList &paths)
+{
+    for (const QString &path : paths) {
+        shared->names.release(QFile::encodeName(path));
+    }
+}
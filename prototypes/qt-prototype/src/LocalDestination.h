@@ -0,0 +1,80 @@
+#ifndef LOCALDESTINATION_H
+#define LOCALDESTINATION_H
+
+#include <QString>
+#include <QByteArray>
+#include <QStringList>
+#include <QThreadPool>
+#include <QSemaphore>
+#include <QMutex>
+#include <memory>
+#include "TransferDestination.h"
+#include "DirectoryCache.h"
+#include "NameRegistry.h"
+#include "DurabilityPolicy.h"
+
+class TransferJournal;
+
+// 同じ出力先に同時に書き込むジョブで共有する状態（出力先のフォルダ毎にプロセスで1つ）
+struct LocalRootState
+{
+    DirectoryCache directories;
+    NameRegistry names;
+    QMutex journalMutex;
+    std::unique_ptr<TransferJournal> journal;   // 再開を有効にしたジョブが最初に開く
+};
+
+// ローカルストレージへの出力
+// 一時ファイルに書き込み、DurabilityManagerが組単位で確定する。
+// ファイル名の衝突はNameRegistry、転送済みの判定はジャーナルで行う。台帳とジャーナルは
+// 同じ出力先に書き込む他のジョブと共有し、他のプロセスとの衝突は公開時に名前を付け直して避ける。
+// 検証を有効にすると、コピー中に計算したハッシュと書き込んだ内容をキャッシュを通さずに
+// 読み戻して比較してから確定する。検証はバックグラウンドで行い、その間に次の組をコピーする。
+class LocalDestination : public TransferDestination
+{
+public:
+    LocalDestination(const QString &root, const DurabilityOptions &durability, bool resume, bool verify = false);
+    ~LocalDestination() override;
+
+    QString name() const override { return "local"; }
+    bool prepare(QString *error) override;
+    std::unique_ptr<UnitWriter> beginUnit(const UnitPlan &plan, QString *error) override;
+    bool checkpoint(QString *error) override;
+    void trim() override;
+    bool finish(QString *error) override;
+    void setFailureHandler(const FailureHandler &handler) override;
+
+private:
+    friend class LocalUnitWriter;
+
+    // 出力先のフォルダの共有状態（使っているジョブがなくなれば破棄する）
+    static std::shared_ptr<LocalRootState> rootStateFor(const QString &root);
+
+    bool planPaths(const UnitPlan &plan, const QVector<int> &members, const QString &existingDestination,
+                   int existingMember, QStringList &finalPaths, QByteArray &base, QString *error);
+    void releaseNames(const QStringList &paths);
+    // 出力先の直下からの相対パス（UTF-8）
+    QByteArray relativePathOf(const QString &path) const;
+    // 読み戻して検証してから確定する（検証待ちが上限に達していれば空くまで待つ）
+    void verifyLater(std::vector<StagedFile> files, const QStringList &finalPaths);
+    static bool verifyFile(const StagedFile &file, QString *error);
+    void reportFailure(const QVector<QFileInfo> &sources, const QString &error);
+
+    QString root;
+    QByteArray rootUtf8;
+    DurabilityOptions durabilityOptions;
+    bool resume;
+    bool verify;
+
+    std::shared_ptr<LocalRootState> shared;
+    TransferJournal *journal = nullptr;         // 再開を有効にしていなければnull
+    std::unique_ptr<DurabilityManager> durability;
+
+    QThreadPool verifyPool;
+    QSemaphore verifySlots;
+    QMutex failureMutex;
+    FailureHandler failureHandler;
+    QStringList backgroundErrors;   // 検証・まとめた永続化の失敗（failureHandlerがない場合はfinish()で返す）
+};
+
+#endif // LOCALDESTINATION_H
@@ -1,6 +1,11 @@
 #include "MainWindow.h"
 #include "FileListWidget.h"
 #include "SettingsWidget.h"
+#include "TransferPipeline.h"
+#include "RateLimiter.h"
+#include "ImportCatalog.h"
+#include "DirectoryScanner.h"
+#include "StageTrace.h"
 #include <QApplication>
 #include <QMessageBox>
 #include <QStandardPaths>
@@ -10,8 +15,13 @@
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , centralWidget(nullptr)
-    , isProcessing(false)
-    , processingThread(nullptr)
+    , importedFileCount(0)
+    , importGeneration(0)
+    , dropGeneration(0)
+    , chunkExistingBytes(0)
+    , chunkTotalBytes(0)
+    , planningThread(nullptr)
+    , scrubThread(nullptr)
 {
     setupUI();
     setAcceptDrops(true);
@@ -22,10 +32,21 @@ MainWindow::MainWindow(QWidget *parent)
 
 MainWindow::~MainWindow()
 {
-    if (processingThread && processingThread->isRunning()) {
-        processingThread->quit();
-        processingThread->wait();
+    for (ProcessingThread *thread : processingThreads) {
+        thread->cancel();
     }
+    for (ProcessingThread *thread : processingThreads) {
+        thread->wait();
+    }
+    if (planningThread) {
+        planningThread->wait();
+    }
+    if (scrubThread) {
+        scrubThread->cancel();
+        scrubThread->wait();
+    }
+    // 目録の照合・フォルダの走査を待ってから閉じる（結果はGUIスレッドに届く前に捨てられる）
+    backgroundPool.waitForDone();
 }
 
 void MainWindow::setupUI()
@@ -132,6 +153,34 @@ void MainWindow::setupContentSection()
     processButton->setFixedSize(200, 50);
     processButton->setEnabled(false);
     
+    // コピーせずにジョブ全体を計算し、出力先・衝突・重複・推定時間を確認してから実行する
+    planButton = new QPushButton("📋 計画を作成");
+    planButton->setObjectName("planButton");
+    planButton->setFixedSize(200, 50);
+    planButton->setEnabled(false);
+    
+    openPlanButton = new QPushButton("📂 計画を実行");
+    openPlanButton->setObjectName("openPlanButton");
+    openPlanButton->setFixedSize(200, 50);
+    
+    // 一覧を作らずにフォルダの木を走査しながら転送する（数千万件の移行でもメモリが一定）
+    streamButton = new QPushButton("🌊 フォルダを直接転送");
+    streamButton->setObjectName("streamButton");
+    streamButton->setFixedSize(200, 50);
+    
+    // 取り込み済みの出力先を読み直して記録済みのハッシュと比較する（何晩かに分けて続けられる）
+    scrubButton = new QPushButton("🧹 出力先を検査");
+    scrubButton->setObjectName("scrubButton");
+    scrubButton->setFixedSize(200, 50);
+    
+    QHBoxLayout *buttonLayout = new QHBoxLayout();
+    buttonLayout->setAlignment(Qt::AlignCenter);
+    buttonLayout->addWidget(processButton);
+    buttonLayout->addWidget(planButton);
+    buttonLayout->addWidget(openPlanButton);
+    buttonLayout->addWidget(streamButton);
+    buttonLayout->addWidget(scrubButton);
+    
     progressBar = new QProgressBar();
     progressBar->setObjectName("progressBar");
     progressBar->setVisible(false);
@@ -141,11 +190,21 @@ void MainWindow::setupContentSection()
     progressLabel->setAlignment(Qt::AlignCenter);
     progressLabel->setVisible(false);
     
-    processingLayout->addWidget(processButton, 0, Qt::AlignCenter);
+    scrubLabel = new QLabel();
+    scrubLabel->setObjectName("scrubLabel");
+    scrubLabel->setAlignment(Qt::AlignCenter);
+    scrubLabel->setVisible(false);
+    
+    processingLayout->addLayout(buttonLayout);
     processingLayout->addWidget(progressBar);
     processingLayout->addWidget(progressLabel);
+    processingLayout->addWidget(scrubLabel);
     
     connect(processButton, &QPushButton::clicked, this, &MainWindow::startProcessing);
+    connect(planButton, &QPushButton::clicked, this, &MainWindow::createPlan);
+    connect(openPlanButton, &QPushButton::clicked, this, &MainWindow::openPlan);
+    connect(streamButton, &QPushButton::clicked, this, &MainWindow::startStreaming);
+    connect(scrubButton, &QPushButton::clicked, this, &MainWindow::toggleScrub);
     connect(fileListWidget, &FileListWidget::filesChanged, this, &MainWindow::onFilesChanged);
     
     mainLayout->addWidget(contentFrame);
@@ -179,10 +238,11 @@ void MainWindow::selectFiles()
     );
     
     if (!files.isEmpty()) {
-        selectedFiles = files;
-        fileListWidget->setFiles(files);
+        selectedFiles = PathTable::fromStringList(files);
+        fileListWidget->setFiles(selectedFiles);
         updateFileCount();
         processButton->setEnabled(true);
+        planButton->setEnabled(!planningThread);
     }
 }
 
@@ -192,49 +252,347 @@ void MainWindow::startProcessing()
         QMessageBox::warning(this, "警告", "処理するファイルが選択されていません。");
         return;
     }
-    
-    isProcessing = true;
-    processButton->setEnabled(false);
-    processButton->setText("⏳ 処理中...");
-    progressBar->setVisible(true);
-    progressLabel->setVisible(true);
-    progressBar->setValue(0);
+    startJob(buildJob());
+}
+
+TransferJob MainWindow::buildJob() const
+{
+    // 設定からジョブを組み立てる
+    TransferJob job;
+    job.files = selectedFiles;
+    job.options = buildOptions();
+    return job;
+}
+
+TransferOptions MainWindow::buildOptions() const
+{
+    TransferOptions options;
+    options.destinations = settingsWidget->getDestinations();
+    options.destinationRoot = settingsWidget->getLocalDestinationPath();
+    options.folderTemplate = settingsWidget->getFolderTemplate();
+    options.fileNameTemplate = settingsWidget->getFileNameTemplate();
+    options.duplicateCheck = settingsWidget->getDuplicateCheckEnabled();
+    options.skipImported = settingsWidget->getSkipImportedEnabled();
+    options.similarImageRadius = settingsWidget->getSimilarImageRadius();
+    options.chunkDedup = settingsWidget->getChunkDedupEnabled();
+    options.durability.mode = settingsWidget->getDurabilityMode();
+    options.verify = settingsWidget->getVerifyEnabled();
+    options.s3 = settingsWidget->getS3Options();
+    options.dropbox = settingsWidget->getDropboxOptions();
+    options.onedrive = settingsWidget->getOneDriveOptions();
+    options.fanOut = settingsWidget->getFanOutOptions();
+    return options;
+}
+
+void MainWindow::startJob(const TransferJob &job)
+{
+    // 実行中でも別のジョブを追加できる（ソースのデバイス毎の読み込み数はジョブ間で共有される）
+    if (processingThreads.isEmpty()) {
+        progressBar->setVisible(true);
+        progressLabel->setVisible(true);
+        progressBar->setValue(0);
+        failedFiles.clear();
+        warnings.clear();
+        similarFiles.clear();
+        chunkExistingBytes = 0;
+        chunkTotalBytes = 0;
+    }
+    processButton->setText("➕ 別のジョブを開始");
     
     // 処理スレッドの開始
-    processingThread = new ProcessingThread(selectedFiles, this);
-    connect(processingThread, &ProcessingThread::progressChanged, this, &MainWindow::updateProgress);
-    connect(processingThread, &ProcessingThread::processingFinished, this, &MainWindow::processingFinished);
-    processingThread->start();
+    ProcessingThread *thread = new ProcessingThread(job, this);
+    connect(thread, &ProcessingThread::progressChanged, this, &MainWindow::updateProgress);
+    connect(thread, &ProcessingThread::fileFailed, this, &MainWindow::onFileFailed);
+    connect(thread, &ProcessingThread::warningIssued, this, &MainWindow::onWarning);
+    connect(thread, &ProcessingThread::similarFound, this, &MainWindow::onSimilarFound);
+    connect(thread, &ProcessingThread::chunkDedupReported, this, &MainWindow::onChunkDedupReported);
+    connect(thread, &ProcessingThread::streamProgressChanged, this, &MainWindow::updateStreamProgress);
+    connect(thread, &ProcessingThread::processingFinished, this, &MainWindow::processingFinished);
+    processingThreads.append(thread);
+    if (job.streamRoots.isEmpty()) {
+        jobProgress.insert(thread, 0);
+    } else {
+        streamProgress.insert(thread, QPair<qint64, qint64>(0, 0));
+    }
+    refreshProgress();
+    thread->start();
+}
+
+void MainWindow::createPlan()
+{
+    if (selectedFiles.isEmpty() || planningThread) {
+        return;
+    }
+    planningJob = buildJob();
+    planButton->setEnabled(false);
+    planButton->setText("⏳ 計画を作成中...");
+    planningThread = new PlanningThread(planningJob, this);
+    connect(planningThread, &PlanningThread::planningFinished, this, &MainWindow::planningFinished);
+    planningThread->start();
+}
+
+void MainWindow::planningFinished()
+{
+    PlanningThread *thread = planningThread;
+    planningThread = nullptr;
+    thread->wait();
+    thread->deleteLater();
+    planButton->setText("📋 計画を作成");
+    planButton->setEnabled(!selectedFiles.isEmpty());
+    
+    if (!thread->isPlanned()) {
+        QMessageBox::warning(this, "計画", "計画を作成できませんでした: " + thread->getError());
+        return;
+    }
+    confirmPlan(thread->getPlan(), true);
+}
+
+void MainWindow::openPlan()
+{
+    const QString path = QFileDialog::getOpenFileName(this, "計画を開く", QString(), "転送の計画 (*.json)");
+    if (path.isEmpty()) {
+        return;
+    }
+    TransferPlan plan;
+    QString error;
+    if (!TransferPlan::load(path, &plan, &error)) {
+        QMessageBox::warning(this, "計画", error);
+        return;
+    }
+    planningJob = buildJob();
+    confirmPlan(plan, false);
+}
+
+void MainWindow::confirmPlan(const TransferPlan &plan, bool offerSave)
+{
+    if (plan.isEmpty()) {
+        QMessageBox::information(this, "計画", "転送するファイルがありません。");
+        return;
+    }
+    
+    QMessageBox box(this);
+    box.setWindowTitle("📋 転送の計画");
+    box.setText(plan.summary());
+    QPushButton *executeButton = box.addButton("🚀 計画どおりに実行", QMessageBox::AcceptRole);
+    QPushButton *saveButton = offerSave ? box.addButton("💾 保存...", QMessageBox::ActionRole) : nullptr;
+    box.addButton(QMessageBox::Close);
+    box.exec();
+    
+    if (saveButton && box.clickedButton() == saveButton) {
+        const QString path = QFileDialog::getSaveFileName(this, "計画を保存", "transfer-plan.json", "転送の計画 (*.json)");
+        QString error;
+        if (!path.isEmpty() && !plan.save(path, &error)) {
+            QMessageBox::warning(this, "計画", error);
+        }
+        return;
+    }
+    if (box.clickedButton() != executeButton) {
+        return;
+    }
+    
+    // 出力先・テンプレートは計画の時のもの、それ以外（検証・クラウドの設定など）は現在の設定を使う
+    TransferJob job = planningJob;
+    job.files = plan.files();
+    job.options.destinations = plan.destinations;
+    job.options.destinationRoot = plan.destinationRoot;
+    job.options.folderTemplate = plan.folderTemplate;
+    job.options.fileNameTemplate = plan.fileNameTemplate;
+    job.plan = std::make_shared<const TransferPlan>(plan);
+    startJob(job);
+}
+
+void MainWindow::startStreaming()
+{
+    const QString folder = QFileDialog::getExistingDirectory(this, "転送するフォルダを選択",
+                                                             QStandardPaths::writableLocation(QStandardPaths::PicturesLocation));
+    if (folder.isEmpty()) {
+        return;
+    }
+    TransferJob job = buildJob();
+    job.files.clear();
+    job.streamRoots = QStringList{folder};
+    startJob(job);
+}
+
+void MainWindow::updateStreamProgress(qint64 discovered, qint64 done)
+{
+    ProcessingThread *thread = qobject_cast<ProcessingThread *>(sender());
+    if (thread && streamProgress.contains(thread)) {
+        streamProgress.insert(thread, QPair<qint64, qint64>(discovered, done));
+    }
+    refreshProgress();
 }
 
 void MainWindow::updateProgress(int percentage)
 {
-    progressBar->setValue(percentage);
-    progressLabel->setText(QString("%1% 完了").arg(percentage));
+    ProcessingThread *thread = qobject_cast<ProcessingThread *>(sender());
+    if (thread && jobProgress.contains(thread)) {
+        jobProgress.insert(thread, percentage);
+    }
+    refreshProgress();
+}
+
+void MainWindow::refreshProgress()
+{
+    // 総数の分かるジョブは平均をバーに表示し、ストリーミングのジョブは件数を文字で添える
+    QStringList parts;
+    if (jobProgress.isEmpty()) {
+        // ストリーミングのジョブだけが動いている間はバーを動き続ける表示にする
+        progressBar->setRange(0, 0);
+    } else {
+        int total = 0;
+        for (int progress : jobProgress) {
+            total += progress;
+        }
+        const int average = total / jobProgress.size();
+        progressBar->setRange(0, 100);
+        progressBar->setValue(average);
+        parts << (jobProgress.size() > 1 ? QString("%1% 完了（%2 件のジョブ）").arg(average).arg(jobProgress.size())
+                                         : QString("%1% 完了").arg(average));
+    }
+    for (const QPair<qint64, qint64> &stream : streamProgress) {
+        parts << (stream.first == 0 ? QString("📂 走査を開始しました")
+                                    : QString("発見 %1 件 / 完了 %2 件").arg(stream.first).arg(stream.second));
+    }
+    progressLabel->setText(parts.join(" ・ "));
 }
 
 void MainWindow::processingFinished()
 {
-    isProcessing = false;
+    ProcessingThread *thread = qobject_cast<ProcessingThread *>(sender());
+    if (thread) {
+        processingThreads.removeAll(thread);
+        jobProgress.remove(thread);
+        streamProgress.remove(thread);
+        thread->wait();
+        thread->deleteLater();
+    }
+    if (!processingThreads.isEmpty()) {
+        refreshProgress();
+        return;
+    }
+    
     processButton->setEnabled(true);
     processButton->setText("🚀 処理を開始");
+    progressBar->setRange(0, 100);
     progressBar->setVisible(false);
     progressLabel->setVisible(false);
+    markImportedFiles();
+    updateFileCount();
     
-    QMessageBox::information(this, "完了", "ファイル処理が完了しました！");
+    // 動画の部分的な重複は、取り込み済みの内容と重なった量をまとめて表示する
+    if (chunkTotalBytes > 0) {
+        similarFiles.prepend(QString("動画 %1 MB のうち %2 MB（%3%）が取り込み済みの内容と重複")
+                                 .arg(chunkTotalBytes / (1024 * 1024))
+                                 .arg(chunkExistingBytes / (1024 * 1024))
+                                 .arg(chunkExistingBytes * 100 / chunkTotalBytes));
+    }
     
-    // スレッドのクリーンアップ
-    if (processingThread) {
-        processingThread->deleteLater();
-        processingThread = nullptr;
+    // ジョブ全体への注意は先頭に表示する
+    const QStringList notes = warnings + similarFiles.mid(0, 10);
+    if (failedFiles.isEmpty() && notes.isEmpty()) {
+        QMessageBox::information(this, "完了", "ファイル処理が完了しました！");
+    } else if (failedFiles.isEmpty()) {
+        QMessageBox::information(this, "完了",
+            QString("ファイル処理が完了しました。\n\n%1").arg(notes.join("\n")));
+    } else {
+        QMessageBox::warning(this, "完了",
+            QString("%1 件のファイルを処理できませんでした。\n\n%2")
+                .arg(failedFiles.size())
+                .arg((warnings + failedFiles.mid(0, 10)).join("\n")));
     }
 }
 
-void MainWindow::onFilesChanged(const QStringList &files)
+void MainWindow::toggleScrub()
+{
+    // 実行中なら中断する（進み具合はチェックポイントに保存され、次回はその続きから）
+    if (scrubThread) {
+        scrubThread->cancel();
+        scrubButton->setEnabled(false);
+        return;
+    }
+    
+    ScrubOptions options;
+    options.root = settingsWidget->getLocalDestinationPath();
+    options.megabytesPerSecond = RateLimiter::instance()->limit(ArchiveScrubber::rateScope()).megabytesPerSecond;
+    options.idleIoPriority = true;
+    
+    scrubProblems.clear();
+    scrubButton->setText("⏹ 検査を中断");
+    scrubLabel->setText("🧹 検査中...");
+    scrubLabel->setVisible(true);
+    
+    scrubThread = new ScrubThread(options, this);
+    connect(scrubThread, &ScrubThread::progressChanged, this, &MainWindow::updateScrubProgress);
+    connect(scrubThread, &ScrubThread::problemFound, this, &MainWindow::onScrubProblem);
+    connect(scrubThread, &ScrubThread::scrubFinished, this, &MainWindow::scrubFinished);
+    scrubThread->start();
+}
+
+void MainWindow::updateScrubProgress(int percentage)
+{
+    scrubLabel->setText(QString("🧹 検査中... %1%（問題 %2 件）").arg(percentage).arg(scrubProblems.size()));
+}
+
+void MainWindow::onScrubProblem(const QString &filePath, const QString &reason)
+{
+    scrubProblems << QString("%1: %2").arg(filePath, reason);
+}
+
+void MainWindow::scrubFinished(const QString &summary)
+{
+    scrubThread->wait();
+    scrubThread->deleteLater();
+    scrubThread = nullptr;
+    
+    scrubButton->setEnabled(true);
+    scrubButton->setText("🧹 出力先を検査");
+    scrubLabel->setVisible(false);
+    
+    if (scrubProblems.isEmpty()) {
+        QMessageBox::information(this, "検査完了", summary);
+    } else {
+        QMessageBox::warning(this, "検査完了",
+            QString("%1\n\n%2").arg(summary, scrubProblems.mid(0, 10).join("\n")));
+    }
+}
+
+void MainWindow::onFilesChanged(const PathTable &files)
 {
     selectedFiles = files;
+    markImportedFiles();
     updateFileCount();
     processButton->setEnabled(!files.isEmpty());
+    planButton->setEnabled(!files.isEmpty() && !planningThread);
+}
+
+void MainWindow::onFileFailed(const QString &filePath, const QString &reason)
+{
+    failedFiles << QString("%1: %2").arg(QFileInfo(filePath).fileName(), reason);
+}
+
+void MainWindow::onWarning(const QString &message)
+{
+    if (!warnings.contains(message)) {
+        warnings << message;
+    }
+}
+
+void MainWindow::onSimilarFound(const QString &filePath, const QString &existingPath, int distance)
+{
+    similarFiles << QString("%1 ≒ %2（距離 %3）").arg(QFileInfo(filePath).fileName(), existingPath).arg(distance);
+}
+
+void MainWindow::onChunkDedupReported(const QString &filePath, qint64 existingBytes, qint64 totalBytes)
+{
+    chunkExistingBytes += existingBytes;
+    chunkTotalBytes += totalBytes;
+    // 大半が重複している動画は個別に表示する
+    if (totalBytes > 0 && existingBytes * 2 >= totalBytes) {
+        similarFiles << QString("%1: %2% が取り込み済みの内容と重複")
+                            .arg(QFileInfo(filePath).fileName())
+                            .arg(existingBytes * 100 / totalBytes);
+    }
 }
 
 void MainWindow::updateFileCount()
@@ -243,11 +601,50 @@ void MainWindow::updateFileCount()
         fileCountLabel->setText("ファイルが選択されていません");
         fileCountLabel->setStyleSheet("color: #bdc3c7;");
     } else {
-        fileCountLabel->setText(QString("%1 件のファイルが選択されています").arg(selectedFiles.size()));
+        QString text = QString("%1 件のファイルが選択されています").arg(selectedFiles.size());
+        if (importedFileCount > 0) {
+            text += QString("（%1 件は取り込み済み）").arg(importedFileCount);
+        }
+        fileCountLabel->setText(text);
         fileCountLabel->setStyleSheet("color: #27ae60; font-weight: bold;");
     }
 }
 
+void MainWindow::markImportedFiles()
+{
+    // 目録はメタデータだけで引けるため、カードを挿し直すたびに数万件を照合しても軽い。
+    // 目録は実行中のジョブと同じもの（ImportCatalog::shared）を使い、読み込みと照合はワーカーで行う
+    const int generation = ++importGeneration;
+    if (selectedFiles.isEmpty()) {
+        importedFileCount = 0;
+        fileListWidget->setImportedFiles(QVector<int>());
+        return;
+    }
+    const PathTable files = selectedFiles;
+    const QString destinationId = ImportCatalog::destinationIdOf(buildOptions());
+    backgroundPool.start([this, files, destinationId, generation]() {
+        TraceSpan span("catalog");
+        QVector<int> imported;
+        QString error;
+        const std::shared_ptr<ImportCatalog> catalog = ImportCatalog::shared(destinationId, &error);
+        if (catalog && catalog->count() > 0) {
+            for (int handle = 0; handle < files.size(); ++handle) {
+                if (!catalog->destinationOf(QFileInfo(files.pathAt(handle))).isEmpty()) {
+                    imported.append(handle);
+                }
+            }
+        }
+        QMetaObject::invokeMethod(this, [this, imported, generation]() {
+            if (generation != importGeneration) {
+                return;
+            }
+            importedFileCount = static_cast<int>(imported.size());
+            fileListWidget->setImportedFiles(imported);
+            updateFileCount();
+        }, Qt::QueuedConnection);
+    });
+}
+
 void MainWindow::dragEnterEvent(QDragEnterEvent *event)
 {
     if (event->mimeData()->hasUrls()) {
@@ -257,40 +654,172 @@ void MainWindow::dragEnterEvent(QDragEnterEvent *event)
 
 void MainWindow::dropEvent(QDropEvent *event)
 {
-    QStringList files;
+    QStringList paths;
     foreach (const QUrl &url, event->mimeData()->urls()) {
         if (url.isLocalFile()) {
-            files << url.toLocalFile();
+            paths << url.toLocalFile();
         }
     }
+    if (paths.isEmpty()) {
+        return;
+    }
+
+    // フォルダは前回のスナップショットと比べ、変わったディレクトリだけを読み直す（ワーカーで走査する）
+    const int generation = ++dropGeneration;
+    dropZoneLabel->setText("📂 フォルダを走査中...");
+    backgroundPool.start([this, paths, generation]() {
+        TraceSpan span("drop");
+        PathTable files;
+        int listed = 0;
+        int reused = 0;
+        QStringList errors;
+        for (const QString &path : paths) {
+            if (!QFileInfo(path).isDir()) {
+                files.append(path);
+                continue;
+            }
+            DirectoryScanner scanner(path);
+            QString error;
+            if (!scanner.scan(&error)) {
+                errors << error;
+                continue;
+            }
+            files.append(scanner.files());
+            listed += scanner.listedCount();
+            reused += scanner.reusedCount();
+        }
+        QMetaObject::invokeMethod(this, [this, files, listed, reused, errors, generation]() {
+            if (generation == dropGeneration) {
+                applyDroppedFiles(files, listed, reused, errors);
+            }
+        }, Qt::QueuedConnection);
+    });
+}
+
+void MainWindow::applyDroppedFiles(const PathTable &files, int listed, int reused, const QStringList &errors)
+{
+    dropZoneLabel->setText(listed + reused > 0
+                               ? QString("📂 %1 件のフォルダを走査（%2 件は前回から変更なし）").arg(listed + reused).arg(reused)
+                               : QString("📂 ファイルをドラッグ&ドロップするか、下のボタンをクリック"));
+    if (!errors.isEmpty()) {
+        QMessageBox::warning(this, "警告", errors.join("\n"));
+    }
     
     if (!files.isEmpty()) {
         selectedFiles = files;
         fileListWidget->setFiles(files);
+        markImportedFiles();
         updateFileCount();
         processButton->setEnabled(true);
+        planButton->setEnabled(!planningThread);
     }
 }
 
 // ProcessingThread Implementation
-ProcessingThread::ProcessingThread(const QStringList &files, QObject *parent)
-    : QThread(parent), filesToProcess(files)
+ProcessingThread::ProcessingThread(const TransferJob &job, QObject *parent)
+    : QThread(parent), job(job), pipeline(nullptr), cancelRequested(false)
 {
+    setObjectName("転送ジョブ");
+}
+
+void ProcessingThread::cancel()
+{
+    QMutexLocker locker(&pipelineMutex);
+    cancelRequested = true;
+    if (pipeline) {
+        pipeline->cancel();
+    }
 }
 
 void ProcessingThread::run()
 {
-    int totalFiles = filesToProcess.size();
+    TransferPipeline transfer(job);
+    connect(&transfer, &TransferPipeline::progressChanged, this, &ProcessingThread::progressChanged);
+    connect(&transfer, &TransferPipeline::fileFailed, this, &ProcessingThread::fileFailed);
+    connect(&transfer, &TransferPipeline::warningIssued, this, &ProcessingThread::warningIssued);
+    connect(&transfer, &TransferPipeline::similarFound, this, &ProcessingThread::similarFound);
+    connect(&transfer, &TransferPipeline::chunkDedupReported, this, &ProcessingThread::chunkDedupReported);
+    connect(&transfer, &TransferPipeline::streamProgressChanged, this, &ProcessingThread::streamProgressChanged);
+    
+    {
+        QMutexLocker locker(&pipelineMutex);
+        if (cancelRequested) {
+            transfer.cancel();
+        }
+        pipeline = &transfer;
+    }
+    
+    transfer.run();
     
-    for (int i = 0; i < totalFiles; ++i) {
-        // ファイル処理のシミュレーション
-        QThread::msleep(500);
-        
-        int percentage = ((i + 1) * 100) / totalFiles;
-        emit progressChanged(percentage);
+    {
+        QMutexLocker locker(&pipelineMutex);
+        pipeline = nullptr;
     }
     
     emit processingFinished();
 }
 
-#include "MainWindow.moc"
\ No newline at end of file
+// PlanningThread Implementation
+PlanningThread::PlanningThread(const TransferJob &job, QObject *parent)
+    : QThread(parent), job(job), planned(false)
+{
+    setObjectName("計画");
+}
+
+void PlanningThread::run()
+{
+    TransferPipeline transfer(job);
+    planned = transfer.plan(&plan, &error);
+    emit planningFinished();
+}
+
+// ScrubThread Implementation
+ScrubThread::ScrubThread(const ScrubOptions &options, QObject *parent)
+    : QThread(parent), options(options), scrubber(nullptr), cancelRequested(false)
+{
+}
+
+void ScrubThread::cancel()
+{
+    QMutexLocker locker(&scrubberMutex);
+    cancelRequested = true;
+    if (scrubber) {
+        scrubber->cancel();
+    }
+}
+
+void ScrubThread::run()
+{
+    ArchiveScrubber archive(options);
+    connect(&archive, &ArchiveScrubber::progressChanged, this, &ScrubThread::progressChanged);
+    connect(&archive, &ArchiveScrubber::problemFound, this, &ScrubThread::problemFound);
+    
+    {
+        QMutexLocker locker(&scrubberMutex);
+        if (cancelRequested) {
+            archive.cancel();
+        }
+        scrubber = &archive;
+    }
+    
+    QString error;
+    archive.run(&error);
+    
+    {
+        QMutexLocker locker(&scrubberMutex);
+        scrubber = nullptr;
+    }
+    
+    QString summary = error;
+    if (summary.isEmpty()) {
+        summary = QString("%1 件一致、%2 件を新たに記録、%3 件破損、%4 件欠損")
+                      .arg(archive.verifiedCount())
+                      .arg(archive.baselinedCount())
+                      .arg(archive.corruptedCount())
+                      .arg(archive.missingCount());
+        if (!archive.passCompleted()) {
+            summary += "\n途中で終了しました。次回はチェックポイントから続けます。";
+        }
+    }
+    emit scrubFinished(summary);
+}
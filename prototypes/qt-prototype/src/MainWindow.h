@@ -13,14 +13,23 @@
 #include <QDropEvent>
 #include <QMimeData>
 #include <QThread>
+#include <QThreadPool>
 #include <QTimer>
 #include <QFileInfo>
 #include <QScrollArea>
 #include <QFrame>
+#include <QMutex>
+#include <QHash>
+#include "TransferJob.h"
+#include "TransferPlan.h"
+#include "ArchiveScrubber.h"
 
 class FileListWidget;
 class SettingsWidget;
 class ProcessingThread;
+class PlanningThread;
+class TransferPipeline;
+class ScrubThread;
 
 class MainWindow : public QMainWindow
 {
@@ -33,9 +42,22 @@ public:
 private slots:
     void selectFiles();
     void startProcessing();
+    void createPlan();
+    void planningFinished();
+    void openPlan();
     void updateProgress(int percentage);
+    void startStreaming();
+    void updateStreamProgress(qint64 discovered, qint64 done);
     void processingFinished();
-    void onFilesChanged(const QStringList &files);
+    void onFilesChanged(const PathTable &files);
+    void onFileFailed(const QString &filePath, const QString &reason);
+    void onWarning(const QString &message);
+    void onSimilarFound(const QString &filePath, const QString &existingPath, int distance);
+    void onChunkDedupReported(const QString &filePath, qint64 existingBytes, qint64 totalBytes);
+    void toggleScrub();
+    void updateScrubProgress(int percentage);
+    void onScrubProblem(const QString &filePath, const QString &reason);
+    void scrubFinished(const QString &summary);
 
 protected:
     void dragEnterEvent(QDragEnterEvent *event) override;
@@ -48,6 +70,14 @@ private:
     void setupContentSection();
     void setupFooterSection();
     void updateFileCount();
+    void markImportedFiles();
+    void applyDroppedFiles(const PathTable &files, int listed, int reused, const QStringList &errors);
+    TransferJob buildJob() const;
+    TransferOptions buildOptions() const;
+    void startJob(const TransferJob &job);
+    // 実行中のジョブの進み具合をバーとラベルに表示する
+    void refreshProgress();
+    void confirmPlan(const TransferPlan &plan, bool offerSave);
     
     // UI Components
     QWidget *centralWidget;
@@ -73,17 +103,42 @@ private:
     // Processing
     QFrame *processingFrame;
     QPushButton *processButton;
+    QPushButton *planButton;
+    QPushButton *openPlanButton;
+    QPushButton *streamButton;
+    QPushButton *scrubButton;
     QProgressBar *progressBar;
     QLabel *progressLabel;
+    QLabel *scrubLabel;
     
     // Footer
     QFrame *footerFrame;
     QLabel *footerLabel;
     
     // Data
-    QStringList selectedFiles;
-    bool isProcessing;
-    ProcessingThread *processingThread;
+    PathTable selectedFiles;
+    int importedFileCount;
+    // 目録の照合とドロップしたフォルダの走査はGUIスレッドを止めないようワーカーで行う。
+    // 結果が届いたときに新しい照合・走査が始まっていれば捨てる
+    QThreadPool backgroundPool;
+    int importGeneration;
+    int dropGeneration;
+    QStringList failedFiles;
+    QStringList warnings;               // 同じ注意は1回だけ表示する
+    QStringList similarFiles;
+    qint64 chunkExistingBytes;
+    qint64 chunkTotalBytes;
+    // 実行中のジョブ（複数のカードを別々のジョブで同時に取り込める）
+    QList<ProcessingThread *> processingThreads;
+    QHash<ProcessingThread *, int> jobProgress;
+    // 総数の分からないストリーミングのジョブ（発見した件数・完了した件数）はバーに含めない
+    QHash<ProcessingThread *, QPair<qint64, qint64>> streamProgress;
+    // 転送の計画（ドライラン）
+    PlanningThread *planningThread;
+    TransferJob planningJob;
+    // 出力先の検査（スクラブ）
+    ScrubThread *scrubThread;
+    QStringList scrubProblems;
 };
 
 // 処理用スレッド
@@ -92,17 +147,77 @@ class ProcessingThread : public QThread
     Q_OBJECT
     
 public:
-    ProcessingThread(const QStringList &files, QObject *parent = nullptr);
+    ProcessingThread(const TransferJob &job, QObject *parent = nullptr);
+    
+    void cancel();
     
 protected:
     void run() override;
     
 signals:
     void progressChanged(int percentage);
+    void fileFailed(const QString &filePath, const QString &reason);
+    void warningIssued(const QString &message);
+    void similarFound(const QString &filePath, const QString &existingPath, int distance);
+    void chunkDedupReported(const QString &filePath, qint64 existingBytes, qint64 totalBytes);
+    void streamProgressChanged(qint64 discovered, qint64 done);
     void processingFinished();
     
 private:
-    QStringList filesToProcess;
+    TransferJob job;
+    QMutex pipelineMutex;
+    TransferPipeline *pipeline;
+    bool cancelRequested;
+};
+
+// 転送の計画用スレッド
+class PlanningThread : public QThread
+{
+    Q_OBJECT
+    
+public:
+    PlanningThread(const TransferJob &job, QObject *parent = nullptr);
+    
+    bool isPlanned() const { return planned; }
+    const TransferPlan &getPlan() const { return plan; }
+    QString getError() const { return error; }
+    
+protected:
+    void run() override;
+    
+signals:
+    void planningFinished();
+    
+private:
+    TransferJob job;
+    TransferPlan plan;
+    QString error;
+    bool planned;
+};
+
+// 出力先の検査用スレッド
+class ScrubThread : public QThread
+{
+    Q_OBJECT
+    
+public:
+    ScrubThread(const ScrubOptions &options, QObject *parent = nullptr);
+    
+    void cancel();
+    
+protected:
+    void run() override;
+    
+signals:
+    void progressChanged(int percentage);
+    void problemFound(const QString &filePath, const QString &reason);
+    void scrubFinished(const QString &summary);
+    
+private:
+    ScrubOptions options;
+    QMutex scrubberMutex;
+    ArchiveScrubber *scrubber;
+    bool cancelRequested;
 };
 
 #endif // MAINWINDOW_H
\ No newline at end of file
@@ -0,0 +1,253 @@
+#include "MetadataIndex.h"
+#include <QFileInfo>
+#include <QStorageInfo>
+#include <QThread>
+#include <algorithm>
+
+namespace {
+
+// 1スレッドで並べ替える最小の行数と、並べ替えに使う最大のスレッド数（2のべき乗）
+const int minRowsPerThread = 64 * 1024;
+const int maxSortThreads = 8;
+
+// 絞り込みは判定結果を一旦この行数のバイト列に書き、分岐なしで行番号に詰める
+const int filterBlockSize = 4096;
+
+struct KeyRow
+{
+    qint64 key;
+    int position;       // 並べ替える前のrows内の位置（同じ値の順を保つため）
+};
+
+// 範囲毎に別スレッドで並べ替えてから、隣り合う範囲を順にマージする
+template <typename T, typename Less>
+void parallelSort(QVector<T> &items, Less less)
+{
+    int parts = 1;
+    while (parts < maxSortThreads && items.size() / (parts * 2) >= minRowsPerThread) {
+        parts *= 2;
+    }
+    if (parts == 1) {
+        std::sort(items.begin(), items.end(), less);
+        return;
+    }
+
+    QVector<qsizetype> bounds;
+    for (int i = 0; i <= parts; ++i) {
+        bounds.append(items.size() * i / parts);
+    }
+    QVector<QThread *> workers;
+    for (int i = 0; i < parts; ++i) {
+        QThread *worker = QThread::create([&items, &bounds, less, i]() {
+            std::sort(items.begin() + bounds.at(i), items.begin() + bounds.at(i + 1), less);
+        });
+        workers.append(worker);
+        worker->start();
+    }
+    for (QThread *worker : workers) {
+        worker->wait();
+        delete worker;
+    }
+
+    for (int width = 1; width < parts; width *= 2) {
+        workers.clear();
+        for (int i = 0; i + width < parts; i += width * 2) {
+            const qsizetype first = bounds.at(i);
+            const qsizetype middle = bounds.at(i + width);
+            const qsizetype last = bounds.at(qMin(i + width * 2, parts));
+            QThread *worker = QThread::create([&items, less, first, middle, last]() {
+                std::inplace_merge(items.begin() + first, items.begin() + middle, items.begin() + last, less);
+            });
+            workers.append(worker);
+            worker->start();
+        }
+        for (QThread *worker : workers) {
+            worker->wait();
+            delete worker;
+        }
+    }
+}
+
+} // namespace
+
+void MetadataIndex::append(const QString &path, qint64 captureTime, qint64 size)
+{
+    const int row = paths.append(path);
+    captureMs.append(captureTime);
+    sizes.append(size);
+    types.append(typeOf(QFileInfo(paths.fileNameAt(row)).suffix()));
+    cameraIds.append(static_cast<quint16>(cameraIdFor(row)));
+    ratings.append(0);
+    dedup.append(DedupUnknown);
+}
+
+void MetadataIndex::appendFrom(const MetadataIndex &other, int row)
+{
+    paths.appendFrom(other.paths, row);
+    captureMs.append(other.captureMs.at(row));
+    sizes.append(other.sizes.at(row));
+    types.append(other.types.at(row));
+    // カメラIDは索引毎の辞書の番号なので名前で引き直す
+    const QString &camera = other.cameras.at(other.cameraIds.at(row));
+    int cameraId = static_cast<int>(cameras.indexOf(camera));
+    if (cameraId < 0) {
+        cameraId = static_cast<int>(cameras.size());
+        cameras.append(camera);
+    }
+    cameraIds.append(static_cast<quint16>(cameraId));
+    ratings.append(other.ratings.at(row));
+    dedup.append(other.dedup.at(row));
+}
+
+void MetadataIndex::clear()
+{
+    paths.clear();
+    captureMs.clear();
+    sizes.clear();
+    types.clear();
+    cameraIds.clear();
+    ratings.clear();
+    dedup.clear();
+    cameras.clear();
+    cameraByDirectory.clear();
+}
+
+QVector<int> MetadataIndex::filter(const Filter &filter) const
+{
+    const int count = size();
+    QVector<int> rows(count);
+    int matched = 0;
+
+    const qint64 *capture = captureMs.constData();
+    const qint64 *byteSize = sizes.constData();
+    const quint8 *type = types.constData();
+    const quint16 *camera = cameraIds.constData();
+    const qint8 *rating = ratings.constData();
+    const quint8 *state = dedup.constData();
+
+    const qint64 fromMs = filter.fromMs;
+    const qint64 toMs = filter.toMs;
+    const qint64 minSize = filter.minSize;
+    const qint64 maxSize = filter.maxSize;
+    const quint32 typeMask = filter.typeMask;
+    const quint8 anyCamera = filter.cameraId < 0;
+    const quint16 cameraId = static_cast<quint16>(qMax(0, filter.cameraId));
+    const qint8 minRating = static_cast<qint8>(filter.minRating);
+    const quint8 hideImported = filter.hideImported;
+
+    quint8 keep[filterBlockSize];
+    int *out = rows.data();
+    for (int base = 0; base < count; base += filterBlockSize) {
+        const int n = qMin(filterBlockSize, count - base);
+        // 各条件を0/1のバイトにして論理積を取る（分岐がないため列毎にSIMD化される）
+        for (int i = 0; i < n; ++i) {
+            const int row = base + i;
+            keep[i] = static_cast<quint8>(capture[row] >= fromMs) & static_cast<quint8>(capture[row] <= toMs)
+                    & static_cast<quint8>(byteSize[row] >= minSize) & static_cast<quint8>(byteSize[row] <= maxSize)
+                    & static_cast<quint8>((typeMask >> type[row]) & 1)
+                    & static_cast<quint8>(anyCamera | static_cast<quint8>(camera[row] == cameraId))
+                    & static_cast<quint8>(rating[row] >= minRating)
+                    & static_cast<quint8>((hideImported & static_cast<quint8>(state[row] == DedupImported)) ^ 1);
+        }
+        // 合わない行は次の書き込みで上書きされる
+        for (int i = 0; i < n; ++i) {
+            out[matched] = base + i;
+            matched += keep[i];
+        }
+    }
+    rows.resize(matched);
+    return rows;
+}
+
+void MetadataIndex::sort(QVector<int> &rows, SortKey key, bool descending) const
+{
+    // 同じ値の行は元のrowsでの位置で比べ、並列のマージでも元の順を保つ
+    const QVector<int> input = rows;
+    if (key == SortByPath) {
+        const PathOrder names(paths);
+        QVector<int> positions(input.size());
+        for (qsizetype i = 0; i < positions.size(); ++i) {
+            positions[i] = static_cast<int>(i);
+        }
+        parallelSort(positions, [&names, &input, descending](int a, int b) {
+            const int order = names.compare(input.at(a), input.at(b));
+            return order != 0 ? (descending ? order > 0 : order < 0) : a < b;
+        });
+        for (qsizetype i = 0; i < positions.size(); ++i) {
+            rows[i] = input.at(positions.at(i));
+        }
+        return;
+    }
+
+    // 比較する値を行番号と並べた配列にして、並べ替え中に列を飛び飛びに読まないようにする
+    QVector<KeyRow> keyed(rows.size());
+    for (qsizetype i = 0; i < rows.size(); ++i) {
+        const int row = rows.at(i);
+        qint64 value = 0;
+        switch (key) {
+        case SortByCaptureTime:
+            value = captureMs.at(row);
+            break;
+        case SortBySize:
+            value = sizes.at(row);
+            break;
+        case SortByType:
+            value = types.at(row);
+            break;
+        case SortByCamera:
+            value = cameraIds.at(row);
+            break;
+        case SortByPath:
+            break;
+        }
+        keyed[i] = {value, static_cast<int>(i)};
+    }
+    parallelSort(keyed, [descending](const KeyRow &a, const KeyRow &b) {
+        if (a.key != b.key) {
+            return descending ? a.key > b.key : a.key < b.key;
+        }
+        return a.position < b.position;
+    });
+    for (qsizetype i = 0; i < keyed.size(); ++i) {
+        rows[i] = input.at(keyed.at(i).position);
+    }
+}
+
+MetadataIndex::FileType MetadataIndex::typeOf(const QString &suffix)
+{
+    static const QStringList images = {"jpg", "jpeg", "png", "gif", "heic", "heif", "webp", "tif", "tiff", "bmp"};
+    static const QStringList raws = {"cr2", "cr3", "nef", "arw", "raf", "orf", "rw2", "dng", "pef", "srw"};
+    static const QStringList videos = {"mp4", "mov", "avi", "mkv", "wmv", "mts", "m2ts", "3gp"};
+    static const QStringList sidecars = {"xmp", "thm", "lrv", "aae"};
+    if (images.contains(suffix, Qt::CaseInsensitive)) {
+        return TypeImage;
+    }
+    if (raws.contains(suffix, Qt::CaseInsensitive)) {
+        return TypeRaw;
+    }
+    if (videos.contains(suffix, Qt::CaseInsensitive)) {
+        return TypeVideo;
+    }
+    if (sidecars.contains(suffix, Qt::CaseInsensitive)) {
+        return TypeSidecar;
+    }
+    return TypeOther;
+}
+
+int MetadataIndex::cameraIdFor(int row)
+{
+    // ディレクトリ毎にデバイス名を引き、同じ名前には同じIDを振る
+    const quint32 directory = paths.directoryAt(row);
+    auto it = cameraByDirectory.constFind(directory);
+    if (it != cameraByDirectory.constEnd()) {
+        return it.value();
+    }
+    const QString name = QStorageInfo(QFileInfo(paths.pathAt(row)).absolutePath()).displayName();
+    int id = static_cast<int>(cameras.indexOf(name));
+    if (id < 0) {
+        id = static_cast<int>(cameras.size());
+        cameras.append(name);
+    }
+    cameraByDirectory.insert(directory, id);
+    return id;
+}
@@ -0,0 +1,96 @@
+#ifndef METADATAINDEX_H
+#define METADATAINDEX_H
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QVector>
+#include <limits>
+#include "PathTable.h"
+
+// 選択したファイルのメタデータの列指向の索引（ファイル一覧の絞り込み・並べ替え用）
+// 撮影日時・サイズ・種類・カメラ・評価・重複の状態を列毎の配列に持ち、
+// 絞り込みは分岐のない列の走査（コンパイラがSIMD化する）、並べ替えは複数スレッドで行う。
+// 撮影日時はEXIF解析が未実装のため更新日時、カメラはソースのデバイス名で代用する。
+class MetadataIndex
+{
+public:
+    enum FileType : quint8 {
+        TypeImage = 0,
+        TypeRaw,
+        TypeVideo,
+        TypeSidecar,
+        TypeOther,
+    };
+
+    enum DedupState : quint8 {
+        DedupUnknown = 0,
+        DedupImported,                  // 取り込み済みファイルの目録にある
+    };
+
+    enum SortKey {
+        SortByPath = 0,
+        SortByCaptureTime,
+        SortBySize,
+        SortByType,
+        SortByCamera,
+    };
+
+    struct Filter
+    {
+        qint64 fromMs = std::numeric_limits<qint64>::min();
+        qint64 toMs = std::numeric_limits<qint64>::max();
+        qint64 minSize = 0;
+        qint64 maxSize = std::numeric_limits<qint64>::max();
+        quint32 typeMask = 0xff;        // 1 << FileType の組み合わせ
+        int cameraId = -1;              // -1はすべて
+        int minRating = 0;
+        bool hideImported = false;
+    };
+
+    // 行を追加する（パスの重複は呼び出し側で除く）
+    void append(const QString &path, qint64 captureMs, qint64 size);
+    // 既存の索引の行をそのまま写す（再走査で残ったファイルのstatを省く）
+    void appendFrom(const MetadataIndex &other, int row);
+    void clear();
+
+    int size() const { return static_cast<int>(paths.size()); }
+    int rowOf(const QString &path) const { return paths.indexOf(path); }
+    int rowOf(const PathTable &files, int handle) const { return paths.indexOf(files, handle); }
+    QString pathAt(int row) const { return paths.pathAt(row); }
+    // 行番号をハンドルとするパスの表
+    const PathTable &pathTable() const { return paths; }
+    qint64 captureTimeAt(int row) const { return captureMs.at(row); }
+    qint64 sizeAt(int row) const { return sizes.at(row); }
+    const QString &cameraAt(int row) const { return cameras.at(cameraIds.at(row)); }
+    const QStringList &cameraNames() const { return cameras; }
+
+    void setDedupState(int row, DedupState state) { dedup[row] = state; }
+    bool isImported(int row) const { return dedup.at(row) == DedupImported; }
+    void setRating(int row, int rating) { ratings[row] = static_cast<qint8>(rating); }
+
+    // 条件に合う行（行番号の昇順）
+    QVector<int> filter(const Filter &filter) const;
+    // rowsをkeyの順に並べ替える（同じ値の行は元の順を保つ）
+    void sort(QVector<int> &rows, SortKey key, bool descending) const;
+
+    static FileType typeOf(const QString &suffix);
+
+private:
+    int cameraIdFor(int row);
+
+    PathTable paths;
+
+    // 列（行番号で揃えた並列の配列）
+    QVector<qint64> captureMs;
+    QVector<qint64> sizes;
+    QVector<quint8> types;
+    QVector<quint16> cameraIds;
+    QVector<qint8> ratings;
+    QVector<quint8> dedup;
+
+    QStringList cameras;                // カメラID → 名前
+    QHash<quint32, int> cameraByDirectory;   // PathTableのディレクトリの番号 → カメラID
+};
+
+#endif // METADATAINDEX_H
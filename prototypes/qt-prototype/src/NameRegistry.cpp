@@ -0,0 +1,138 @@
+#include "NameRegistry.h"
+#include <QDirIterator>
+#include <QFile>
+
+NameRegistry::NameRegistry(bool scanExisting)
+    : scanExisting(scanExisting)
+{
+}
+
+NameRegistry::~NameRegistry()
+{
+    qDeleteAll(directories);
+}
+
+int NameRegistry::claimGroup(const QByteArray &dirPath, const QByteArray &stem, const QVector<QByteArray> &suffixes)
+{
+    Directory *dir = directoryFor(dirPath);
+    const QByteArray stemKey = makeKey(stem.constData(), stem.size());
+
+    // 連番は元のstem毎に記憶して続きから試すため、同名が何千件あってもO(1)
+    QMutexLocker locker(&dir->mutex);
+    auto isFree = [dir](const QByteArray &candidateStem, const QVector<QByteArray> &suffixes) {
+        for (const QByteArray &suffix : suffixes) {
+            const QByteArray name = candidateStem + suffix;
+            if (dir->taken.contains(makeKey(name.constData(), name.size()))) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    int number = 0;
+    QByteArray candidate = stem;
+    if (!isFree(candidate, suffixes)) {
+        int &suffix = dir->nextSuffix[stemKey];
+        do {
+            ++suffix;
+            candidate = stem + '_' + QByteArray::number(suffix);
+        } while (!isFree(candidate, suffixes));
+        number = suffix;
+    }
+
+    for (const QByteArray &suffix : suffixes) {
+        const QByteArray name = candidate + suffix;
+        dir->taken.insert(makeKey(name.constData(), name.size()));
+    }
+    return number;
+}
+
+bool NameRegistry::claimExact(const QByteArray &path)
+{
+    const qsizetype slash = path.lastIndexOf('/');
+    if (slash <= 0) {
+        return false;
+    }
+    Directory *dir = directoryFor(path.left(slash));
+    const QByteArray key = makeKey(path.constData() + slash + 1, path.size() - slash - 1);
+
+    QMutexLocker locker(&dir->mutex);
+    if (dir->taken.contains(key)) {
+        return false;
+    }
+    dir->taken.insert(key);
+    return true;
+}
+
+void NameRegistry::release(const QByteArray &path)
+{
+    const qsizetype slash = path.lastIndexOf('/');
+    if (slash <= 0) {
+        return;
+    }
+    Directory *dir = directoryFor(path.left(slash));
+    QMutexLocker locker(&dir->mutex);
+    dir->taken.remove(makeKey(path.constData() + slash + 1, path.size() - slash - 1));
+}
+
+void NameRegistry::trim()
+{
+    QWriteLocker locker(&lock);
+    for (auto it = directories.begin(); it != directories.end();) {
+        Directory *dir = it.value();
+        if (dir->used.fetchAndStoreRelaxed(0)) {
+            ++it;
+        } else {
+            delete dir;
+            it = directories.erase(it);
+        }
+    }
+}
+
+NameRegistry::Directory *NameRegistry::directoryFor(const QByteArray &dirPath)
+{
+    {
+        QReadLocker locker(&lock);
+        Directory *dir = directories.value(dirPath, nullptr);
+        if (dir) {
+            dir->used.storeRelaxed(1);
+            return dir;
+        }
+    }
+
+    QWriteLocker locker(&lock);
+    Directory *&dir = directories[dirPath];
+    if (dir) {
+        dir->used.storeRelaxed(1);
+        return dir;
+    }
+    dir = new Directory;
+    dir->used.storeRelaxed(1);
+
+    // 既存のエントリで台帳を初期化する（ディレクトリ毎に1回だけ）
+    QMutexLocker dirLocker(&dir->mutex);
+    locker.unlock();
+    if (!scanExisting) {
+        return dir;
+    }
+    QDirIterator it(QFile::decodeName(dirPath), QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System);
+    while (it.hasNext()) {
+        it.next();
+        const QByteArray name = QFile::encodeName(it.fileName());
+        if (name.endsWith(".mtpart")) {
+            continue;
+        }
+        dir->taken.insert(makeKey(name.constData(), name.size()));
+    }
+    return dir;
+}
+
+QByteArray NameRegistry::makeKey(const char *name, qsizetype length)
+{
+#if defined(Q_OS_WIN) || defined(Q_OS_MACOS)
+    // 大文字小文字を区別しないファイルシステムでは小文字に揃えて比較
+    return QByteArray(name, length).toLower();
+#else
+    return QByteArray(name, length);
+#endif
+}
@@ -0,0 +1,54 @@
+#ifndef NAMEREGISTRY_H
+#define NAMEREGISTRY_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QSet>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QVector>
+#include <QAtomicInt>
+#include <memory>
+
+// 出力先ディレクトリ毎のファイル名台帳（複数ワーカーから共有）
+// 初回アクセス時にディレクトリを1回だけ走査し、以降はメモリ上で
+// 衝突しない名前を払い出す。同名ファイルが何千件あっても
+// 「存在確認→_1, _2…」のstatループは発生しない。
+class NameRegistry
+{
+public:
+    // scanExistingがfalseなら既存のエントリを走査しない（計画で組同士の衝突だけを調べる場合）
+    explicit NameRegistry(bool scanExisting = true);
+    ~NameRegistry();
+
+    // stem+各suffixの名前を同じ連番（"stem_N.ext"）でまとめて予約し、付けた連番を返す（0は連番なし）
+    int claimGroup(const QByteArray &dirPath, const QByteArray &stem, const QVector<QByteArray> &suffixes);
+
+    // pathのファイル名をそのまま予約する。使用済みならfalse
+    bool claimExact(const QByteArray &path);
+
+    // 確定に失敗したファイル名を台帳から外す
+    void release(const QByteArray &path);
+
+    // 前回のtrim()から使っていないディレクトリの台帳を捨てる（次に使うときに走査し直す）
+    // 予約したファイル名がすべて確定・解放された後（書き込みが止まっている間）にだけ呼ぶ
+    void trim();
+
+private:
+    struct Directory
+    {
+        QMutex mutex;
+        QSet<QByteArray> taken;
+        QHash<QByteArray, int> nextSuffix;  // 元のstem → 最後に払い出した連番
+        QAtomicInt used;                    // 前回のtrim()から使ったか
+    };
+
+    Directory *directoryFor(const QByteArray &dirPath);
+    static QByteArray makeKey(const char *name, qsizetype length);
+
+    bool scanExisting;
+    QReadWriteLock lock;
+    QHash<QByteArray, Directory *> directories;
+};
+
+#endif // NAMEREGISTRY_H
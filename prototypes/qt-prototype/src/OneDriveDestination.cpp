@@ -0,0 +1,453 @@
+#include "OneDriveDestination.h"
+#include "UploadStateStore.h"
+#include "UploadTracker.h"
+#include <QDateTime>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+namespace {
+
+const qint64 fragmentAlignment = 320 * 1024;
+const qint64 maxFragmentSize = 60 * 1024 * 1024;
+const qint64 simpleUploadLimit = 4 * 1024 * 1024;
+
+// conflictBehavior: fail で同じ名前のアイテムがあった
+const int conflictStatus = 409;
+
+// 名前を付け直す回数の上限
+const int maxConflictRetries = 10;
+
+// 1ファイル分のアップロードセッション（チャンクのアップロードタスクと共有する）
+// チャンクは1つずつ順番に送るため、tasks.wait()の後はロックなしで参照できる。
+struct OneDriveSession
+{
+    QByteArray key;
+    QString path;
+    qint64 modifiedMs = 0;
+    QByteArray uploadUrl;
+    qint64 size = 0;
+    QJsonObject state;
+    bool completed = false;
+    UploadTracker tasks;
+};
+
+} // namespace
+
+// OneDriveUnitWriter Implementation
+class OneDriveUnitWriter : public UnitWriter
+{
+public:
+    OneDriveUnitWriter(OneDriveDestination *destination, const UnitPlan &plan)
+        : destination(destination), plan(plan)
+    {
+        destination->manifest->claimKeys(plan, &keys, &uploaded);
+        paths = std::make_shared<UnitPaths>(keys);
+    }
+
+    ~OneDriveUnitWriter() override
+    {
+        if (session) {
+            session->tasks.wait(nullptr);
+        }
+    }
+
+    bool wants(int member) const override
+    {
+        return !uploaded.at(member);
+    }
+
+    std::shared_ptr<const UnitPaths> destinationPaths() const override
+    {
+        return paths;
+    }
+
+    bool beginFile(int member, QString *error) override
+    {
+        const QFileInfo &source = plan.sources.at(member);
+        currentMember = member;
+        key = keys.at(member);
+        path = destination->options.folder + '/' + QString::fromUtf8(key);
+        size = source.size();
+        modifiedMs = source.lastModified().toMSecsSinceEpoch();
+        streamOffset = 0;
+        sendOffset = 0;
+        buffer.clear();
+        session.reset();
+
+        if (size <= simpleUploadLimit) {
+            buffer.reserve(size);
+            return true;
+        }
+        buffer.reserve(destination->options.chunkSize);
+        return startSession(source, error);
+    }
+
+    bool write(const char *data, qint64 length, QString *error) override
+    {
+        if (!session) {
+            buffer.append(data, length);
+            return true;
+        }
+
+        // 再開時、サーバーが受け取り済みの範囲は読み飛ばす
+        if (streamOffset < sendOffset) {
+            const qint64 skip = qMin(length, sendOffset - streamOffset);
+            streamOffset += skip;
+            data += skip;
+            length -= skip;
+        }
+        streamOffset += length;
+
+        const qint64 chunkSize = destination->options.chunkSize;
+        while (length > 0) {
+            const qint64 take = qMin(length, chunkSize - buffer.size());
+            buffer.append(data, take);
+            data += take;
+            length -= take;
+            if (buffer.size() == chunkSize && !dispatchChunk(error)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool endFile(QString *error) override
+    {
+        if (!session) {
+            // 小さなファイルは組の確定まで公開しない
+            smallFiles.append(SmallFile{currentMember, std::move(buffer)});
+            buffer = QByteArray();
+            return true;
+        }
+
+        if (!buffer.isEmpty() && !dispatchChunk(error)) {
+            return false;
+        }
+        if (!session->tasks.wait(error)) {
+            return false;
+        }
+        if (!session->completed) {
+            *error = "OneDriveのアップロードが完了していません";
+            return false;
+        }
+        session.reset();
+        return true;
+    }
+
+    bool commit(QString *error) override
+    {
+        for (int i = 0; i < smallFiles.size(); ++i) {
+            const SmallFile &file = smallFiles.at(i);
+            const QFileInfo &source = plan.sources.at(file.member);
+            for (int attempt = 0; ; ++attempt) {
+                const QString target = destination->options.folder + '/' + QString::fromUtf8(keys.at(file.member));
+                const HttpResponse response = HttpClient::sendWithRetry(
+                    "PUT", destination->itemUrl(target, "content?@microsoft.graph.conflictBehavior=fail"),
+                    {{"Authorization", destination->authorization}, {"Content-Type", "application/octet-stream"}},
+                    file.data);
+                if (response.isSuccess()) {
+                    destination->recordUploaded(keys.at(file.member), source.size(),
+                                                source.lastModified().toMSecsSinceEpoch(), response.body);
+                    break;
+                }
+                if (response.status != conflictStatus || attempt == maxConflictRetries) {
+                    *error = OneDriveDestination::errorOf(response);
+                    return false;
+                }
+                // マニフェストになかったファイルに先を越された。まだ置いていないメンバーを次の連番に付け直す
+                QVector<int> remaining;
+                for (int j = i; j < smallFiles.size(); ++j) {
+                    remaining.append(smallFiles.at(j).member);
+                }
+                claimAgain(remaining);
+            }
+        }
+        smallFiles.clear();
+        return true;
+    }
+
+    void abort() override
+    {
+        // アップロードURLは次回の再開のために残す
+        if (session) {
+            session->tasks.wait(nullptr);
+        }
+        session.reset();
+        smallFiles.clear();
+        QVector<QByteArray> claimed;
+        for (int member = 0; member < keys.size(); ++member) {
+            if (!uploaded.at(member)) {
+                claimed.append(keys.at(member));
+            }
+        }
+        destination->manifest->releaseKeys(claimed);
+    }
+
+private:
+    // 先を越された名前の代わりに、membersを次の連番で予約し直す
+    void claimAgain(const QVector<int> &members)
+    {
+        destination->manifest->claimAgain(plan, members, &keys);
+        for (int member : members) {
+            (*paths)[member] = keys.at(member);
+        }
+    }
+
+    bool startSession(const QFileInfo &source, QString *error)
+    {
+        session = std::make_shared<OneDriveSession>();
+        session->key = key;
+        session->path = path;
+        session->size = size;
+        session->modifiedMs = modifiedMs;
+        session->state = QJsonObject{
+            {"source", source.absoluteFilePath()},
+            {"size", size},
+            {"modified", source.lastModified().toMSecsSinceEpoch()}
+        };
+
+        // 同じファイルのセッションが残っていれば、サーバーが次に期待する位置から送る
+        const QJsonObject saved = destination->states->load(path);
+        if (!saved.isEmpty()
+            && saved.value("source") == session->state.value("source")
+            && saved.value("size").toInteger() == size
+            && saved.value("modified").toInteger() == source.lastModified().toMSecsSinceEpoch()) {
+            const QByteArray uploadUrl = saved.value("uploadUrl").toString().toUtf8();
+            const HttpResponse status = HttpClient::sendWithRetry("GET", QUrl::fromEncoded(uploadUrl), {}, QByteArray());
+            const QJsonArray ranges = QJsonDocument::fromJson(status.body).object().value("nextExpectedRanges").toArray();
+            if (status.isSuccess() && !ranges.isEmpty()) {
+                session->uploadUrl = uploadUrl;
+                session->state.insert("uploadUrl", QString::fromUtf8(uploadUrl));
+                sendOffset = ranges.first().toString().section('-', 0, 0).toLongLong();
+                return true;
+            }
+            destination->states->remove(path);
+        }
+
+        const QByteArray body = QJsonDocument(QJsonObject{
+            {"item", QJsonObject{{"@microsoft.graph.conflictBehavior", "fail"}}}
+        }).toJson(QJsonDocument::Compact);
+        HttpResponse response;
+        for (int attempt = 0; ; ++attempt) {
+            response = HttpClient::sendWithRetry(
+                "POST", destination->itemUrl(path, "createUploadSession"),
+                {{"Authorization", destination->authorization}, {"Content-Type", "application/json"}}, body);
+            if (response.status != conflictStatus || attempt == maxConflictRetries) {
+                break;
+            }
+            // 名前が使われていた。まだ置いていないメンバー（確定待ちの小さなファイルを含む）を次の連番に付け直す
+            QVector<int> remaining;
+            for (const SmallFile &file : smallFiles) {
+                remaining.append(file.member);
+            }
+            for (int member = currentMember; member < plan.sources.size(); ++member) {
+                if (!uploaded.at(member)) {
+                    remaining.append(member);
+                }
+            }
+            claimAgain(remaining);
+            key = keys.at(currentMember);
+            path = destination->options.folder + '/' + QString::fromUtf8(key);
+            session->key = key;
+            session->path = path;
+        }
+        if (!response.isSuccess()) {
+            *error = OneDriveDestination::errorOf(response);
+            session.reset();
+            return false;
+        }
+        session->uploadUrl = QJsonDocument::fromJson(response.body).object().value("uploadUrl").toString().toUtf8();
+        session->state.insert("uploadUrl", QString::fromUtf8(session->uploadUrl));
+        destination->states->save(path, session->state);
+        return true;
+    }
+
+    bool dispatchChunk(QString *error)
+    {
+        const qint64 chunkOffset = sendOffset;
+        QByteArray data = std::move(buffer);
+        buffer = QByteArray();
+        buffer.reserve(destination->options.chunkSize);
+        sendOffset += data.size();
+
+        // チャンクは順番に送る。送信中に次のチャンクを読み込めるよう、待つのは1つ前の完了のみ
+        if (!session->tasks.begin(1, error)) {
+            return false;
+        }
+
+        std::shared_ptr<OneDriveSession> shared = session;
+        OneDriveDestination *owner = destination;
+        owner->chunkPool.start([shared, owner, chunkOffset, data]() {
+            const QByteArray range = "bytes " + QByteArray::number(chunkOffset) + '-'
+                                   + QByteArray::number(chunkOffset + data.size() - 1) + '/'
+                                   + QByteArray::number(shared->size);
+            // アップロードURLには認証情報が含まれるため、Authorizationは付けない
+            const HttpResponse response = HttpClient::sendWithRetry("PUT", QUrl::fromEncoded(shared->uploadUrl),
+                                                                    {{"Content-Range", range}}, data);
+            if (response.status == 200 || response.status == 201) {
+                shared->completed = true;
+                owner->states->remove(shared->path);
+                owner->recordUploaded(shared->key, shared->size, shared->modifiedMs, response.body);
+            } else if (response.status == 202) {
+                QJsonObject state = shared->state;
+                state.insert("offset", chunkOffset + data.size());
+                owner->states->save(shared->path, state);
+            }
+            shared->tasks.end(response.isSuccess() ? QString() : OneDriveDestination::errorOf(response));
+        });
+        return true;
+    }
+
+    OneDriveDestination *destination;
+    // 組の確定まで送らずに持っておく小さなファイル
+    struct SmallFile
+    {
+        int member;
+        QByteArray data;
+    };
+
+    UnitPlan plan;
+    QVector<QByteArray> keys;       // メンバー毎のキー（マニフェストで予約したもの）
+    QVector<bool> uploaded;         // マニフェスト上でアップロード済みのメンバー
+    std::shared_ptr<UnitPaths> paths;
+
+    int currentMember = -1;
+    QByteArray key;
+    QString path;
+    qint64 size = 0;
+    qint64 modifiedMs = 0;
+    qint64 streamOffset = 0;        // パイプラインから受け取った位置
+    qint64 sendOffset = 0;          // 次に送るチャンクの先頭
+    QByteArray buffer;
+    std::shared_ptr<OneDriveSession> session;
+    QVector<SmallFile> smallFiles;
+};
+
+// OneDriveDestination Implementation
+OneDriveDestination::OneDriveDestination(const OneDriveOptions &options)
+    : options(options)
+{
+    chunkPool.setObjectName("OneDrive アップロード");
+}
+
+OneDriveDestination::~OneDriveDestination()
+{
+    chunkPool.waitForDone();
+    if (manifest) {
+        manifest->waitForRefresh(nullptr);
+    }
+}
+
+bool OneDriveDestination::prepare(QString *error)
+{
+    const QByteArray token = qgetenv("ONEDRIVE_ACCESS_TOKEN");
+    if (token.isEmpty()) {
+        *error = "OneDriveのアクセストークンがありません（ONEDRIVE_ACCESS_TOKEN を設定してください）";
+        return false;
+    }
+    authorization = "Bearer " + token;
+    // 接続先は環境変数で差し替えられる（ローカルのモックサーバー用）
+    graphUrl = qEnvironmentVariable("ONEDRIVE_GRAPH_URL", "https://graph.microsoft.com/v1.0");
+
+    options.folder = normalizedCloudFolder(options.folder);
+    // 最後以外のチャンクは320KiBの倍数にする必要がある
+    options.chunkSize = qBound(fragmentAlignment, options.chunkSize / fragmentAlignment * fragmentAlignment,
+                               maxFragmentSize / fragmentAlignment * fragmentAlignment);
+
+    const QString destinationId = options.destinationId();
+    states = std::make_unique<UploadStateStore>(UploadStateStore::defaultDirectory(destinationId));
+    manifest = std::make_unique<RemoteManifest>(destinationId);
+    if (!manifest->open()) {
+        *error = "マニフェストを開けません: " + manifest->filePath();
+        return false;
+    }
+    manifest->refreshIfStale(this, 4);
+    return true;
+}
+
+std::unique_ptr<UnitWriter> OneDriveDestination::beginUnit(const UnitPlan &plan, QString *)
+{
+    return std::make_unique<OneDriveUnitWriter>(this, plan);
+}
+
+bool OneDriveDestination::finish(QString *)
+{
+    chunkPool.waitForDone();
+    // 一覧の取り直しに失敗しても転送には影響しない（次回また取り直す）
+    manifest->waitForRefresh(nullptr);
+    return true;
+}
+
+bool OneDriveDestination::listLevel(const QByteArray &prefix, QVector<QByteArray> *folders, const Page &page, QString *error)
+{
+    // フォルダの子要素をページ（@odata.nextLink）単位で取得する
+    const QString folder = options.folder + (prefix.isEmpty() ? QString() : '/' + QString::fromUtf8(prefix.chopped(1)));
+    QUrl url = folder.isEmpty() ? QUrl(graphUrl + "/me/drive/root/children") : itemUrl(folder, "children");
+    url.setQuery("$top=1000&$select=name,size,file,folder");
+    while (url.isValid()) {
+        const HttpResponse response = HttpClient::sendWithRetry("GET", url, {{"Authorization", authorization}}, QByteArray());
+        if (response.status == 404) {
+            return true;        // まだフォルダがない
+        }
+        if (!response.isSuccess()) {
+            *error = errorOf(response);
+            return false;
+        }
+
+        const QJsonObject result = QJsonDocument::fromJson(response.body).object();
+        QVector<RemoteObject> objects;
+        for (const QJsonValue &value : result.value("value").toArray()) {
+            const QJsonObject item = value.toObject();
+            const QByteArray key = prefix + item.value("name").toString().toUtf8();
+            if (item.contains("folder")) {
+                folders->append(key + '/');
+            } else if (item.contains("file")) {
+                RemoteObject object;
+                object.key = key;
+                object.size = item.value("size").toInteger();
+                object.hash = item.value("file").toObject().value("hashes").toObject().value("quickXorHash").toString().toLatin1();
+                objects.append(object);
+            }
+        }
+        page(objects);
+        url = QUrl(result.value("@odata.nextLink").toString());
+    }
+    return true;
+}
+
+bool OneDriveDestination::listAll(const QByteArray &prefix, const Page &page, QString *error)
+{
+    // Graphには任意のフォルダ以下を再帰的に列挙するAPIがないため、フォルダを順にたどる
+    QVector<QByteArray> pending = {prefix};
+    while (!pending.isEmpty()) {
+        const QByteArray folder = pending.takeLast();
+        if (!listLevel(folder, &pending, page, error)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void OneDriveDestination::recordUploaded(const QByteArray &key, qint64 size, qint64 modifiedMs, const QByteArray &item)
+{
+    const QJsonObject hashes = QJsonDocument::fromJson(item).object().value("file").toObject().value("hashes").toObject();
+    manifest->record(key, size, hashes.value("quickXorHash").toString().toLatin1(), modifiedMs);
+}
+
+QUrl OneDriveDestination::itemUrl(const QString &path, const QString &action) const
+{
+    return QUrl::fromEncoded(graphUrl.toUtf8() + "/me/drive/root:" + QUrl::toPercentEncoding(path, "/")
+                             + ":/" + action.toLatin1());
+}
+
+QString OneDriveDestination::errorOf(const HttpResponse &response)
+{
+    if (response.status == 0) {
+        return "OneDriveに接続できません: " + response.error;
+    }
+    const QJsonObject error = QJsonDocument::fromJson(response.body).object().value("error").toObject();
+    return QString("OneDriveエラー (HTTP %1): %2 %3")
+        .arg(response.status)
+        .arg(error.value("code").toString(), error.value("message").toString());
+}
@@ -0,0 +1,56 @@
+#ifndef ONEDRIVEDESTINATION_H
+#define ONEDRIVEDESTINATION_H
+
+#include <QString>
+#include <QByteArray>
+#include <QThreadPool>
+#include <memory>
+#include "TransferDestination.h"
+#include "HttpClient.h"
+#include "CloudOptions.h"
+#include "RemoteManifest.h"
+
+class UploadStateStore;
+
+// OneDriveへの出力（Microsoft Graphのアップロードセッション）
+// セッションのチャンクは順番に送る必要があるため、1つ前のチャンクを送っている間に
+// 次のチャンクを読み込む。アップロードURLを記録しておき、中断後はサーバーが受け取った
+// 位置（nextExpectedRanges）から続きを送る。4MB以下のファイルは組の確定（commit）で1回のPUTで送る。
+// 名前はマニフェストにあるものと重ならないよう連番を付け、既存のファイルは置き換えない
+// （conflictBehavior: fail）。先を越されていたら、まだ置いていないメンバーを次の連番に付け直す。
+// 同じパス・サイズのファイルを自分で送った記録がマニフェストにあれば、そのファイルは送らない。
+// 一覧から取得しただけのもの（quickXorHashは照合しない）は同じ内容とはみなさない。
+// アクセストークンは環境変数 ONEDRIVE_ACCESS_TOKEN から読み込む。
+class OneDriveDestination : public TransferDestination, public RemoteLister
+{
+public:
+    explicit OneDriveDestination(const OneDriveOptions &options);
+    ~OneDriveDestination() override;
+
+    QString name() const override { return "onedrive"; }
+    bool prepare(QString *error) override;
+    std::unique_ptr<UnitWriter> beginUnit(const UnitPlan &plan, QString *error) override;
+    bool finish(QString *error) override;
+
+    // マニフェストの一覧の取り直しを待つ（取り直した後の状態から始めたいテスト用）
+    bool waitForRefresh(QString *error) { return manifest->waitForRefresh(error); }
+
+    bool listLevel(const QByteArray &prefix, QVector<QByteArray> *folders, const Page &page, QString *error) override;
+    bool listAll(const QByteArray &prefix, const Page &page, QString *error) override;
+
+private:
+    friend class OneDriveUnitWriter;
+
+    QUrl itemUrl(const QString &path, const QString &action) const;
+    void recordUploaded(const QByteArray &key, qint64 size, qint64 modifiedMs, const QByteArray &item);
+    static QString errorOf(const HttpResponse &response);
+
+    OneDriveOptions options;
+    QByteArray authorization;
+    QString graphUrl;
+    std::unique_ptr<UploadStateStore> states;
+    std::unique_ptr<RemoteManifest> manifest;
+    QThreadPool chunkPool;
+};
+
+#endif // ONEDRIVEDESTINATION_H
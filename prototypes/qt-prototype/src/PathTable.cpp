@@ -0,0 +1,395 @@
+#include "PathTable.h"
+#include <QReadWriteLock>
+#include <cstring>
+
+namespace {
+
+// ディレクトリの構成要素のトライ木（プロセス全体で共有し、節点は消さない）
+// 節点0が根で、"/a/b" は根 → "" → "a" → "b" の節点になる
+class PrefixTrie
+{
+public:
+    PrefixTrie()
+    {
+        nodes.append({0, 0, 0});
+    }
+
+    quint32 intern(const QByteArray &directory)
+    {
+        quint32 node = 0;
+        qsizetype start = 0;
+        while (true) {
+            qsizetype end = directory.indexOf('/', start);
+            if (end < 0) {
+                end = directory.size();
+            }
+            node = child(node, directory.constData() + start, static_cast<int>(end - start));
+            if (end >= directory.size()) {
+                return node;
+            }
+            start = end + 1;
+        }
+    }
+
+    // 登録済みのディレクトリの節点（なければ0。節点は増やさない）
+    quint32 find(const QByteArray &directory) const
+    {
+        QReadLocker locker(&lock);
+        quint32 node = 0;
+        qsizetype start = 0;
+        while (true) {
+            qsizetype end = directory.indexOf('/', start);
+            if (end < 0) {
+                end = directory.size();
+            }
+            QByteArray key(reinterpret_cast<const char *>(&node), sizeof(node));
+            key.append(directory.constData() + start, end - start);
+            const auto it = children.constFind(key);
+            if (it == children.constEnd()) {
+                return 0;
+            }
+            node = it.value();
+            if (end >= directory.size()) {
+                return node;
+            }
+            start = end + 1;
+        }
+    }
+
+    QByteArray pathOf(quint32 node) const
+    {
+        QReadLocker locker(&lock);
+        QVector<quint32> chain;
+        for (; node != 0; node = nodes.at(node).parent) {
+            chain.append(node);
+        }
+        QByteArray path;
+        for (qsizetype i = chain.size() - 1; i >= 0; --i) {
+            const Node &part = nodes.at(chain.at(i));
+            path.append(names.constData() + part.nameOffset, part.nameLength);
+            if (i > 0) {
+                path.append('/');
+            }
+        }
+        return path;
+    }
+
+    int size() const
+    {
+        QReadLocker locker(&lock);
+        return static_cast<int>(nodes.size());
+    }
+
+private:
+    struct Node
+    {
+        quint32 parent;
+        quint32 nameOffset;
+        quint32 nameLength;
+    };
+
+    quint32 child(quint32 parent, const char *name, int length)
+    {
+        // 親の番号と名前を並べたものを子の索引のキーにする
+        QByteArray key(reinterpret_cast<const char *>(&parent), sizeof(parent));
+        key.append(name, length);
+        {
+            QReadLocker locker(&lock);
+            const auto it = children.constFind(key);
+            if (it != children.constEnd()) {
+                return it.value();
+            }
+        }
+        QWriteLocker locker(&lock);
+        const auto it = children.constFind(key);
+        if (it != children.constEnd()) {
+            return it.value();
+        }
+        const quint32 node = static_cast<quint32>(nodes.size());
+        nodes.append({parent, static_cast<quint32>(names.size()), static_cast<quint32>(length)});
+        names.append(name, length);
+        children.insert(key, node);
+        return node;
+    }
+
+    mutable QReadWriteLock lock;
+    QVector<Node> nodes;
+    QByteArray names;
+    QHash<QByteArray, quint32> children;
+};
+
+Q_GLOBAL_STATIC(PrefixTrie, sharedTrie)
+
+// ハッシュ表の使用率の上限（これを超えたら倍にする）
+const int maxLoadPercent = 50;
+const int minSlotCount = 64;
+
+int compareBytes(const char *a, int aLength, const char *b, int bLength)
+{
+    const int order = std::memcmp(a, b, static_cast<size_t>(qMin(aLength, bLength)));
+    return order != 0 ? order : aLength - bLength;
+}
+
+} // namespace
+
+// PathTable Implementation
+int PathTable::append(const QString &path)
+{
+    const qsizetype slash = path.lastIndexOf('/');
+    quint32 directory = 0;
+    if (slash >= 0) {
+        if (lastDirectory.isNull() || lastDirectory.size() != slash || !path.startsWith(lastDirectory)) {
+            lastDirectory = path.left(slash);
+            lastDirectoryId = sharedTrie()->intern(lastDirectory.toUtf8());
+        }
+        directory = lastDirectoryId;
+    }
+    const QByteArray name = path.mid(slash + 1).toUtf8();
+    return appendRecord(directory, name.constData(), static_cast<int>(name.size()));
+}
+
+int PathTable::appendFrom(const PathTable &other, int handle)
+{
+    const Record &record = other.records.at(handle);
+    return appendRecord(record.directory, other.names.constData() + record.nameOffset,
+                        static_cast<int>(record.nameLength));
+}
+
+void PathTable::append(const PathTable &other)
+{
+    reserve(size() + other.size());
+    for (int handle = 0; handle < other.size(); ++handle) {
+        appendFrom(other, handle);
+    }
+}
+
+void PathTable::reserve(int count)
+{
+    records.reserve(count);
+    const qint64 wanted = qint64(count) * 100 / maxLoadPercent;
+    if (wanted > buckets.size()) {
+        int capacity = minSlotCount;
+        while (capacity < wanted) {
+            capacity *= 2;
+        }
+        rehash(capacity);
+    }
+}
+
+void PathTable::clear()
+{
+    records.clear();
+    names.clear();
+    buckets.clear();
+    lastDirectory.clear();
+    lastDirectoryId = 0;
+}
+
+QString PathTable::pathAt(int handle) const
+{
+    return QString::fromUtf8(utf8PathAt(handle));
+}
+
+QByteArray PathTable::utf8PathAt(int handle) const
+{
+    const Record &record = records.at(handle);
+    QByteArray path;
+    if (record.directory != 0) {
+        path = sharedTrie()->pathOf(record.directory);
+        path.append('/');
+    }
+    path.append(names.constData() + record.nameOffset, record.nameLength);
+    return path;
+}
+
+QString PathTable::fileNameAt(int handle) const
+{
+    const Record &record = records.at(handle);
+    return QString::fromUtf8(names.constData() + record.nameOffset, record.nameLength);
+}
+
+QByteArray PathTable::utf8FileNameAt(int handle) const
+{
+    const Record &record = records.at(handle);
+    return QByteArray(names.constData() + record.nameOffset, record.nameLength);
+}
+
+QString PathTable::directoryPathAt(int handle) const
+{
+    return QString::fromUtf8(directoryPath(records.at(handle).directory));
+}
+
+int PathTable::indexOf(const QString &path) const
+{
+    if (buckets.isEmpty()) {
+        return -1;
+    }
+    // 検索ではトライ木に節点を増やさない（登録されていないディレクトリのパスは表にない）
+    const qsizetype slash = path.lastIndexOf('/');
+    quint32 directory = 0;
+    if (slash >= 0) {
+        directory = sharedTrie()->find(path.left(slash).toUtf8());
+        if (directory == 0) {
+            return -1;
+        }
+    }
+    const QByteArray name = path.mid(slash + 1).toUtf8();
+    return find(directory, name.constData(), static_cast<int>(name.size()));
+}
+
+int PathTable::indexOf(const PathTable &other, int handle) const
+{
+    if (buckets.isEmpty()) {
+        return -1;
+    }
+    const Record &record = other.records.at(handle);
+    return find(record.directory, other.names.constData() + record.nameOffset, static_cast<int>(record.nameLength));
+}
+
+QStringList PathTable::toStringList() const
+{
+    QStringList paths;
+    paths.reserve(size());
+    for (int handle = 0; handle < size(); ++handle) {
+        paths << pathAt(handle);
+    }
+    return paths;
+}
+
+PathTable PathTable::fromStringList(const QStringList &paths)
+{
+    PathTable table;
+    table.reserve(static_cast<int>(paths.size()));
+    for (const QString &path : paths) {
+        table.append(path);
+    }
+    return table;
+}
+
+QByteArray PathTable::directoryPath(quint32 directory)
+{
+    return directory == 0 ? QByteArray() : sharedTrie()->pathOf(directory);
+}
+
+int PathTable::directoryNodeCount()
+{
+    return sharedTrie()->size();
+}
+
+int PathTable::appendRecord(quint32 directory, const char *name, int length)
+{
+    const int handle = size();
+    records.append({directory, static_cast<quint32>(names.size()), static_cast<quint32>(length)});
+    names.append(name, length);
+    if (qint64(records.size()) * 100 > qint64(buckets.size()) * maxLoadPercent) {
+        rehash(qMax(minSlotCount, static_cast<int>(buckets.size()) * 2));
+    } else if (find(directory, name, length) < 0) {
+        insertSlot(handle);
+    }
+    return handle;
+}
+
+int PathTable::find(quint32 directory, const char *name, int length) const
+{
+    const size_t mask = static_cast<size_t>(buckets.size() - 1);
+    for (size_t i = hashOf(directory, name, length) & mask;; i = (i + 1) & mask) {
+        const int handle = buckets.at(static_cast<qsizetype>(i));
+        if (handle < 0) {
+            return -1;
+        }
+        const Record &record = records.at(handle);
+        if (record.directory == directory && record.nameLength == static_cast<quint32>(length)
+            && std::memcmp(names.constData() + record.nameOffset, name, static_cast<size_t>(length)) == 0) {
+            return handle;
+        }
+    }
+}
+
+void PathTable::insertSlot(int handle)
+{
+    const Record &record = records.at(handle);
+    const size_t mask = static_cast<size_t>(buckets.size() - 1);
+    size_t i = hashOf(record.directory, names.constData() + record.nameOffset, static_cast<int>(record.nameLength)) & mask;
+    while (buckets.at(static_cast<qsizetype>(i)) >= 0) {
+        i = (i + 1) & mask;
+    }
+    buckets[static_cast<qsizetype>(i)] = handle;
+}
+
+void PathTable::rehash(int capacity)
+{
+    // 同じパスは最初の行だけを登録する
+    buckets.fill(-1, capacity);
+    for (int handle = 0; handle < size(); ++handle) {
+        const Record &record = records.at(handle);
+        if (find(record.directory, names.constData() + record.nameOffset, static_cast<int>(record.nameLength)) < 0) {
+            insertSlot(handle);
+        }
+    }
+}
+
+size_t PathTable::hashOf(quint32 directory, const char *name, int length)
+{
+    return qHashBits(name, static_cast<size_t>(length), directory);
+}
+
+// PathOrder Implementation
+PathOrder::PathOrder(const PathTable &table)
+    : table(table)
+{
+    for (int handle = 0; handle < table.size(); ++handle) {
+        const quint32 directory = table.directoryAt(handle);
+        if (!directories.contains(directory)) {
+            QByteArray path = PathTable::directoryPath(directory);
+            if (directory != 0) {
+                path.append('/');
+            }
+            directories.insert(directory, path);
+        }
+    }
+}
+
+int PathOrder::compare(int a, int b) const
+{
+    const PathTable::Record &first = table.records.at(a);
+    const PathTable::Record &second = table.records.at(b);
+    const char *names = table.names.constData();
+    if (first.directory == second.directory) {
+        return compareBytes(names + first.nameOffset, static_cast<int>(first.nameLength),
+                            names + second.nameOffset, static_cast<int>(second.nameLength));
+    }
+    // 「ディレクトリ/」とファイル名をつなげた列として比べる
+    const QByteArray &firstDirectory = *directories.constFind(first.directory);
+    const QByteArray &secondDirectory = *directories.constFind(second.directory);
+    const char *firstParts[2] = {firstDirectory.constData(), names + first.nameOffset};
+    const int firstLengths[2] = {static_cast<int>(firstDirectory.size()), static_cast<int>(first.nameLength)};
+    const char *secondParts[2] = {secondDirectory.constData(), names + second.nameOffset};
+    const int secondLengths[2] = {static_cast<int>(secondDirectory.size()), static_cast<int>(second.nameLength)};
+    int i = 0;
+    int j = 0;
+    int x = 0;
+    int y = 0;
+    while (i < 2 && j < 2) {
+        if (x == firstLengths[i]) {
+            ++i;
+            x = 0;
+            continue;
+        }
+        if (y == secondLengths[j]) {
+            ++j;
+            y = 0;
+            continue;
+        }
+        const uchar c = static_cast<uchar>(firstParts[i][x]);
+        const uchar d = static_cast<uchar>(secondParts[j][y]);
+        if (c != d) {
+            return c < d ? -1 : 1;
+        }
+        ++x;
+        ++y;
+    }
+    // 残りのある方が長い
+    const bool firstLeft = i < 2 && (x < firstLengths[i] || (i == 0 && firstLengths[1] > 0));
+    const bool secondLeft = j < 2 && (y < secondLengths[j] || (j == 0 && secondLengths[1] > 0));
+    return firstLeft == secondLeft ? 0 : (firstLeft ? 1 : -1);
+}
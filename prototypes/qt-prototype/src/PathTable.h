@@ -0,0 +1,91 @@
+#ifndef PATHTABLE_H
+#define PATHTABLE_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QHash>
+#include <QVector>
+
+// ジョブのファイルのパスの表（ファイル毎の文字列を持たない）
+// ディレクトリのパスはプロセス全体で共有するトライ木に構成要素毎に一度だけ登録し、
+// 表にはファイル毎に「ディレクトリの番号・UTF-8のファイル名の位置と長さ」の12バイトだけを
+// 1つの配列に持つ（ファイル名は1つのバイト列に詰める）。各部はファイルを行番号（ハンドル）で扱い、
+// パスの文字列は使う時に組み立てる。中身はQtの暗黙の共有のため、ジョブのコピーは安い。
+class PathTable
+{
+public:
+    // パスを追加してハンドル（0からの連番）を返す。同じパスも別の行として追加する
+    int append(const QString &path);
+    // 別の表の行を写す（文字列に戻さない）
+    int appendFrom(const PathTable &other, int handle);
+    void append(const PathTable &other);
+    void reserve(int count);
+    void clear();
+
+    int size() const { return static_cast<int>(records.size()); }
+    bool isEmpty() const { return records.isEmpty(); }
+
+    QString pathAt(int handle) const;
+    QByteArray utf8PathAt(int handle) const;
+    QString fileNameAt(int handle) const;
+    QByteArray utf8FileNameAt(int handle) const;
+    // ディレクトリの番号（同じ番号なら同じディレクトリ。0はディレクトリなし）
+    quint32 directoryAt(int handle) const { return records.at(handle).directory; }
+    QString directoryPathAt(int handle) const;
+
+    // 最初に追加した同じパスのハンドル（なければ-1）
+    int indexOf(const QString &path) const;
+    bool contains(const QString &path) const { return indexOf(path) >= 0; }
+    // 別の表の行と同じパスのハンドル（文字列を組み立てずに引く）
+    int indexOf(const PathTable &other, int handle) const;
+
+    QStringList toStringList() const;
+    static PathTable fromStringList(const QStringList &paths);
+
+    // ディレクトリの番号のパス（UTF-8、末尾の'/'なし）
+    static QByteArray directoryPath(quint32 directory);
+    // 共有のトライ木に登録したディレクトリの構成要素の数
+    static int directoryNodeCount();
+
+private:
+    friend class PathOrder;
+
+    struct Record
+    {
+        quint32 directory;      // トライ木の節点（0はディレクトリなし）
+        quint32 nameOffset;     // names内の位置
+        quint32 nameLength;
+    };
+
+    int appendRecord(quint32 directory, const char *name, int length);
+    int find(quint32 directory, const char *name, int length) const;
+    void insertSlot(int handle);
+    void rehash(int capacity);
+    static size_t hashOf(quint32 directory, const char *name, int length);
+
+    QVector<Record> records;
+    QByteArray names;
+    QVector<int> buckets;       // 開番地法のハッシュ表（-1は空き）。要素数は2のべき乗
+
+    // 同じディレクトリのファイルは続けて追加されることが多いため、直前のディレクトリを覚えておく
+    QString lastDirectory;
+    quint32 lastDirectoryId = 0;
+};
+
+// パスのバイト順の比較（並べ替え用）
+// 比べる行のディレクトリのパスを一度だけ組み立てて持ち、比較中はトライ木を引かない
+class PathOrder
+{
+public:
+    explicit PathOrder(const PathTable &table);
+
+    int compare(int a, int b) const;
+    bool lessThan(int a, int b) const { return compare(a, b) < 0; }
+
+private:
+    const PathTable &table;
+    QHash<quint32, QByteArray> directories;
+};
+
+#endif // PATHTABLE_H
@@ -0,0 +1,174 @@
+#include "PathTemplate.h"
+
+namespace {
+
+void appendNumber(QByteArray &out, qint64 value, int width)
+{
+    char digits[24];
+    int length = 0;
+    do {
+        digits[length++] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value > 0 && length < 20);
+    while (length < width && length < 20) {
+        digits[length++] = '0';
+    }
+
+    char text[24];
+    for (int i = 0; i < length; ++i) {
+        text[i] = digits[length - 1 - i];
+    }
+    out.append(text, length);
+}
+
+// パス区切りなどファイル名に使えない文字を'_'に置き換えて追記
+void appendSanitized(QByteArray &out, QByteArrayView value)
+{
+    const qsizetype start = out.size();
+    out.append(value.data(), value.size());
+    char *p = out.data() + start;
+    for (qsizetype i = 0; i < value.size(); ++i) {
+        switch (p[i]) {
+        case '/': case '\\': case ':': case '*': case '?': case '"': case '<': case '>': case '|':
+            p[i] = '_';
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void appendField(QByteArray &out, QByteArrayView value)
+{
+    if (value.isEmpty()) {
+        out.append("Unknown", 7);
+        return;
+    }
+    appendSanitized(out, value);
+}
+
+} // namespace
+
+PathTemplate::PathTemplate()
+{
+}
+
+PathTemplate::PathTemplate(const QString &pattern, Kind kind)
+    : source(pattern)
+    , kind(kind)
+{
+    compile();
+}
+
+void PathTemplate::compile()
+{
+    const QByteArray pattern = source.toUtf8();
+    qsizetype pos = 0;
+
+    while (pos < pattern.size()) {
+        const qsizetype open = pattern.indexOf('{', pos);
+        if (open < 0) {
+            if (!addLiteral(pattern.mid(pos))) {
+                return;
+            }
+            break;
+        }
+        if (open > pos && !addLiteral(pattern.mid(pos, open - pos))) {
+            return;
+        }
+        const qsizetype close = pattern.indexOf('}', open);
+        if (close < 0) {
+            error = QString("'}' がありません: %1").arg(source);
+            program.clear();
+            return;
+        }
+
+        QByteArray token = pattern.mid(open + 1, close - open - 1);
+        int width = 0;
+        const qsizetype colon = token.indexOf(':');
+        if (colon >= 0) {
+            width = qBound(0, token.mid(colon + 1).toInt(), 20);
+            token.truncate(colon);
+        }
+
+        Instruction instruction{Op::Literal, static_cast<quint8>(width), 0, 0};
+        if (token == "year") instruction.op = Op::Year;
+        else if (token == "month") instruction.op = Op::Month;
+        else if (token == "day") instruction.op = Op::Day;
+        else if (token == "hour") instruction.op = Op::Hour;
+        else if (token == "minute") instruction.op = Op::Minute;
+        else if (token == "second") instruction.op = Op::Second;
+        else if (token == "date") instruction.op = Op::Date;
+        else if (token == "time") instruction.op = Op::Time;
+        else if (token == "camera") instruction.op = Op::Camera;
+        else if (token == "device") instruction.op = Op::Device;
+        else if (token == "event") instruction.op = Op::Event;
+        else if (token == "place") instruction.op = Op::Place;
+        else if (token == "name") instruction.op = Op::Name;
+        else if (token == "ext") instruction.op = Op::Extension;
+        else if (token == "sequence") {
+            instruction.op = Op::Sequence;
+            if (width == 0) instruction.width = 4;
+        } else {
+            error = QString("不明なトークンです: {%1}").arg(QString::fromUtf8(token));
+            program.clear();
+            return;
+        }
+        program.append(instruction);
+        pos = close + 1;
+    }
+}
+
+bool PathTemplate::addLiteral(const QByteArray &text)
+{
+    // ファイル名でパス区切りや親フォルダを指せると、名前台帳のフォルダの外に置かれてしまう
+    if (kind == Kind::FileName && (text.contains('/') || text.contains('\\') || text.contains(".."))) {
+        error = QString("ファイル名に '/'、'\\'、'..' は使えません: %1").arg(source);
+        program.clear();
+        return false;
+    }
+
+    // 連続するリテラルは1命令にまとめる
+    if (!program.isEmpty() && program.last().op == Op::Literal
+        && program.last().offset + program.last().length == literals.size()) {
+        program.last().length += static_cast<int>(text.size());
+    } else {
+        program.append(Instruction{Op::Literal, 0, static_cast<int>(literals.size()), static_cast<int>(text.size())});
+    }
+    literals.append(text);
+    return true;
+}
+
+void PathTemplate::render(const PathFields &fields, QByteArray &out) const
+{
+    for (const Instruction &instruction : program) {
+        switch (instruction.op) {
+        case Op::Literal:
+            out.append(literals.constData() + instruction.offset, instruction.length);
+            break;
+        case Op::Year: appendNumber(out, fields.year, 4); break;
+        case Op::Month: appendNumber(out, fields.month, 2); break;
+        case Op::Day: appendNumber(out, fields.day, 2); break;
+        case Op::Hour: appendNumber(out, fields.hour, 2); break;
+        case Op::Minute: appendNumber(out, fields.minute, 2); break;
+        case Op::Second: appendNumber(out, fields.second, 2); break;
+        case Op::Date:
+            appendNumber(out, fields.year, 4);
+            appendNumber(out, fields.month, 2);
+            appendNumber(out, fields.day, 2);
+            break;
+        case Op::Time:
+            appendNumber(out, fields.hour, 2);
+            appendNumber(out, fields.minute, 2);
+            appendNumber(out, fields.second, 2);
+            break;
+        case Op::Camera: appendField(out, fields.camera); break;
+        case Op::Device: appendField(out, fields.device); break;
+        case Op::Event: appendField(out, fields.event); break;
+        case Op::Place: appendField(out, fields.place); break;
+        case Op::Name: appendField(out, fields.name); break;
+        case Op::Extension: appendSanitized(out, fields.extension); break;
+        case Op::Sequence: appendNumber(out, fields.sequence, instruction.width); break;
+        }
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef PATHTEMPLATE_H
+#define PATHTEMPLATE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QVector>
+
+// テンプレート展開に使う1ファイル分の値（文字列はUTF-8）
+struct PathFields
+{
+    int year = 0;
+    int month = 0;
+    int day = 0;
+    int hour = 0;
+    int minute = 0;
+    int second = 0;
+    qint64 sequence = 0;
+    QByteArrayView name;        // 拡張子を除いた元のファイル名
+    QByteArrayView extension;   // 先頭のドットを除いた拡張子
+    QByteArrayView camera;
+    QByteArrayView device;
+    QByteArrayView event;       // 撮影間隔で分けたイベントの名前
+    QByteArrayView place;       // 撮影位置の地名（なければ座標）
+};
+
+// フォルダ/ファイル名テンプレート
+// "{year}/{month}/{day}" や "{date}_{time}_{camera}_{sequence}" を一度だけ命令列に変換し、
+// ファイル毎の展開は呼び出し側のバッファへの追記のみで行う。
+//
+// 使用できるトークン:
+//   {year} {month} {day} {hour} {minute} {second}
+//   {date} = yyyyMMdd, {time} = HHmmss
+//   {camera} {device} {name} {ext}
+//   {event} = 撮影間隔で分けたイベント（開始日時 yyyy-MM-dd_HHmm）
+//   {place} = 撮影位置に最も近い地名（オフラインの索引、近くになければ座標）
+//   {sequence} / {sequence:N}（N桁ゼロ埋め、既定4桁）
+// ファイル名テンプレート（Kind::FileName）のリテラルには '/'、'\\'、".." を書けない（コンパイル時にエラー）。
+class PathTemplate
+{
+public:
+    enum class Kind { Folder, FileName };
+
+    PathTemplate();
+    explicit PathTemplate(const QString &pattern, Kind kind = Kind::Folder);
+
+    bool isValid() const { return error.isEmpty(); }
+    bool isEmpty() const { return program.isEmpty(); }
+    QString errorString() const { return error; }
+    QString pattern() const { return source; }
+
+    // outの末尾に展開結果を追記する
+    void render(const PathFields &fields, QByteArray &out) const;
+
+private:
+    enum class Op : quint8 {
+        Literal, Year, Month, Day, Hour, Minute, Second,
+        Date, Time, Camera, Device, Event, Place, Name, Extension, Sequence
+    };
+
+    struct Instruction
+    {
+        Op op;
+        quint8 width;
+        int offset;     // Literal: literals内の位置
+        int length;
+    };
+
+    void compile();
+    bool addLiteral(const QByteArray &text);
+
+    QString source;
+    Kind kind = Kind::Folder;
+    QVector<Instruction> program;
+    QByteArray literals;
+    QString error;
+};
+
+#endif // PATHTEMPLATE_H
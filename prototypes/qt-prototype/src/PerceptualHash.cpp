@@ -0,0 +1,156 @@
+#include "PerceptualHash.h"
+#include "StageTrace.h"
+#include <QImage>
+#include <QImageReader>
+#include <QStringList>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PERCEPTUALHASH_SSE2
+#endif
+
+namespace {
+
+const int dctSize = 32;
+const int lowFrequencies = 8;
+
+// DCT-IIの係数のうち低周波の8つ。[n][k]の順に並べ、内側のループが連続したfloat 8個になるようにする
+struct DctTable
+{
+    alignas(32) float coefficients[dctSize][lowFrequencies];
+
+    DctTable()
+    {
+        const double pi = 3.14159265358979323846;
+        for (int n = 0; n < dctSize; ++n) {
+            for (int k = 0; k < lowFrequencies; ++k) {
+                coefficients[n][k] = static_cast<float>(std::cos(pi * (2 * n + 1) * k / (2.0 * dctSize)));
+            }
+        }
+    }
+};
+
+const DctTable &dctTable()
+{
+    static const DctTable table;
+    return table;
+}
+
+} // namespace
+
+quint64 PerceptualHash::differenceHash(const uchar *luma)
+{
+    quint64 hash = 0;
+#ifdef PERCEPTUALHASH_SSE2
+    // 2行ずつ、左の8画素と右隣の8画素を16バイトにまとめて比較する（符号なし比較は最上位ビットを反転して行う）
+    const __m128i flip = _mm_set1_epi8(static_cast<char>(0x80));
+    for (int row = 0; row < 8; row += 2) {
+        const uchar *first = luma + row * 9;
+        const uchar *second = first + 9;
+        const __m128i left = _mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(first)),
+                                                _mm_loadl_epi64(reinterpret_cast<const __m128i *>(second)));
+        const __m128i right = _mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(first + 1)),
+                                                 _mm_loadl_epi64(reinterpret_cast<const __m128i *>(second + 1)));
+        const __m128i greater = _mm_cmpgt_epi8(_mm_xor_si128(left, flip), _mm_xor_si128(right, flip));
+        hash |= static_cast<quint64>(static_cast<quint16>(_mm_movemask_epi8(greater))) << (row * 8);
+    }
+#else
+    for (int row = 0; row < 8; ++row) {
+        const uchar *line = luma + row * 9;
+        for (int x = 0; x < 8; ++x) {
+            if (line[x] > line[x + 1]) {
+                hash |= quint64(1) << (row * 8 + x);
+            }
+        }
+    }
+#endif
+    return hash;
+}
+
+quint64 PerceptualHash::dctHash(const uchar *luma)
+{
+    const DctTable &table = dctTable();
+
+    // 行方向: 各行の低周波8成分（内側のループはコンパイラがSIMD化する）
+    alignas(32) float rows[dctSize][lowFrequencies];
+    for (int y = 0; y < dctSize; ++y) {
+        alignas(32) float acc[lowFrequencies] = {};
+        const uchar *line = luma + y * dctSize;
+        for (int n = 0; n < dctSize; ++n) {
+            const float value = line[n];
+            for (int k = 0; k < lowFrequencies; ++k) {
+                acc[k] += table.coefficients[n][k] * value;
+            }
+        }
+        std::memcpy(rows[y], acc, sizeof(acc));
+    }
+
+    // 列方向: 低周波8x8だけを求める
+    alignas(32) float coefficients[lowFrequencies][lowFrequencies] = {};
+    for (int y = 0; y < dctSize; ++y) {
+        for (int u = 0; u < lowFrequencies; ++u) {
+            const float weight = table.coefficients[y][u];
+            for (int v = 0; v < lowFrequencies; ++v) {
+                coefficients[u][v] += weight * rows[y][v];
+            }
+        }
+    }
+
+    // 直流成分を除いた63成分の中央値との大小
+    std::array<float, 63> ac;
+    std::copy(&coefficients[0][0] + 1, &coefficients[0][0] + 64, ac.begin());
+    std::nth_element(ac.begin(), ac.begin() + 31, ac.end());
+    const float median = ac[31];
+
+    quint64 hash = 0;
+    const float *flat = &coefficients[0][0];
+    for (int i = 0; i < 64; ++i) {
+        if (flat[i] > median) {
+            hash |= quint64(1) << i;
+        }
+    }
+    return hash;
+}
+
+bool PerceptualHash::isSupported(const QString &suffix)
+{
+    static const QStringList suffixes = {"jpg", "jpeg", "png", "heic", "heif", "webp", "tif", "tiff", "bmp", "gif"};
+    return suffixes.contains(suffix, Qt::CaseInsensitive);
+}
+
+bool PerceptualHash::fromFile(const QString &path, PerceptualHash *hash)
+{
+    TraceSpan span("hash", path);
+    QImageReader reader(path);
+    reader.setAutoTransform(true);
+    // 縮小デコードに対応した形式（JPEGなど）は32x32近くまで縮めて読む
+    if (reader.size().isValid()) {
+        reader.setScaledSize(QSize(dctSize, dctSize));
+    }
+    QImage image = reader.read();
+    if (image.isNull()) {
+        return false;
+    }
+    image = image.convertToFormat(QImage::Format_Grayscale8);
+    if (image.size() != QSize(dctSize, dctSize)) {
+        image = image.scaled(dctSize, dctSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+    const QImage small = image.scaled(9, 8, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+
+    uchar dct[dctSize * dctSize];
+    for (int y = 0; y < dctSize; ++y) {
+        std::memcpy(dct + y * dctSize, image.constScanLine(y), dctSize);
+    }
+    uchar difference[9 * 8];
+    for (int y = 0; y < 8; ++y) {
+        std::memcpy(difference + y * 9, small.constScanLine(y), 9);
+    }
+
+    hash->dHash = differenceHash(difference);
+    hash->pHash = dctHash(dct);
+    return true;
+}
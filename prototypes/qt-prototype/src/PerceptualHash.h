@@ -0,0 +1,29 @@
+#ifndef PERCEPTUALHASH_H
+#define PERCEPTUALHASH_H
+
+#include <QString>
+#include <QtGlobal>
+#include <QtAlgorithms>
+
+// 画像の知覚ハッシュ（類似画像の検出用）
+// dHashは9x8の輝度の隣り合う画素の大小、pHashは32x32の輝度のDCTの低周波8x8と中央値の大小。
+// どちらも64ビットで、ハミング距離が小さいほど似ている。
+struct PerceptualHash
+{
+    quint64 dHash = 0;
+    quint64 pHash = 0;
+
+    // 画像を縮小デコードして計算する（JPEGは縮小したままデコードされるため全画素は展開しない）
+    static bool fromFile(const QString &path, PerceptualHash *hash);
+    // 拡張子（"jpg" など、大文字小文字は区別しない）が静止画か
+    static bool isSupported(const QString &suffix);
+
+    // 9x8の輝度（行優先、1行9画素）
+    static quint64 differenceHash(const uchar *luma);
+    // 32x32の輝度（行優先）
+    static quint64 dctHash(const uchar *luma);
+
+    static int distance(quint64 a, quint64 b) { return qPopulationCount(a ^ b); }
+};
+
+#endif // PERCEPTUALHASH_H
@@ -0,0 +1,331 @@
+#include "PlaceIndex.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QFileInfo>
+#include <QHash>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+namespace {
+
+const char indexMagic[8] = {'M', 'T', 'P', 'L', 'A', 'C', 'E', '1'};
+const qint64 headerSize = 16;   // マジック・地名数・地名の文字列の長さ
+const double earthRadiusKm = 6371.0;
+const double degreesToRadians = 3.14159265358979323846 / 180.0;
+
+void toUnitVector(double latitude, double longitude, float *position)
+{
+    const double lat = latitude * degreesToRadians;
+    const double lon = longitude * degreesToRadians;
+    position[0] = static_cast<float>(std::cos(lat) * std::cos(lon));
+    position[1] = static_cast<float>(std::cos(lat) * std::sin(lon));
+    position[2] = static_cast<float>(std::sin(lat));
+}
+
+// 地表の距離と単位球上の弦の長さの変換
+double chordOf(double distanceKm)
+{
+    return 2.0 * std::sin(qMin(distanceKm / earthRadiusKm, 3.14159265358979323846) / 2.0);
+}
+
+double distanceOfChord(double chord)
+{
+    return 2.0 * std::asin(qMin(chord / 2.0, 1.0)) * earthRadiusKm;
+}
+
+float squaredDistance(const float *a, const float *b)
+{
+    const float dx = a[0] - b[0];
+    const float dy = a[1] - b[1];
+    const float dz = a[2] - b[2];
+    return dx * dx + dy * dy + dz * dz;
+}
+
+struct PlaceRecord
+{
+    float position[3];
+    quint32 nameOffset;
+};
+
+// [low, high) の中央値を中央に置き、左右を次の軸で再帰的に分ける
+void buildTree(QVector<PlaceRecord> &records, int low, int high, int axis)
+{
+    if (high - low <= 1) {
+        return;
+    }
+    const int middle = low + (high - low) / 2;
+    std::nth_element(records.begin() + low, records.begin() + middle, records.begin() + high,
+                     [axis](const PlaceRecord &a, const PlaceRecord &b) { return a.position[axis] < b.position[axis]; });
+    buildTree(records, low, middle, (axis + 1) % 3);
+    buildTree(records, middle + 1, high, (axis + 1) % 3);
+}
+
+int findRoot(QVector<int> &parents, int i)
+{
+    while (parents.at(i) != i) {
+        parents[i] = parents.at(parents.at(i));
+        i = parents.at(i);
+    }
+    return i;
+}
+
+} // namespace
+
+QString PlaceIndex::defaultIndexPath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/places/places.kdt";
+}
+
+QString PlaceIndex::bundledDatasetPath()
+{
+    return QCoreApplication::applicationDirPath() + "/places.tsv";
+}
+
+bool PlaceIndex::open(QString *error)
+{
+    const QString indexPath = defaultIndexPath();
+    const QFileInfo dataset(bundledDatasetPath());
+    const QFileInfo index(indexPath);
+    // 同梱のデータが更新されていれば作り直す
+    if (!index.exists() || (dataset.exists() && dataset.lastModified() > index.lastModified())) {
+        if (!dataset.exists()) {
+            *error = "地名のデータがありません: " + dataset.filePath();
+            return false;
+        }
+        int placeCount = 0;
+        if (!compile(dataset.filePath(), indexPath, &placeCount, error)) {
+            return false;
+        }
+    }
+    return openFile(indexPath, error);
+}
+
+bool PlaceIndex::openFile(const QString &indexPath, QString *error)
+{
+    file.close();
+    nodes = nullptr;
+    names = nullptr;
+    count = 0;
+    namesSize = 0;
+
+    file.setFileName(indexPath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        *error = "地名の索引を開けません: " + file.errorString();
+        return false;
+    }
+    const qint64 size = file.size();
+    const uchar *data = size >= headerSize ? file.map(0, size) : nullptr;
+    if (!data || memcmp(data, indexMagic, sizeof(indexMagic)) != 0) {
+        *error = "地名の索引が壊れています: " + indexPath;
+        file.close();
+        return false;
+    }
+    memcpy(&count, data + 8, sizeof(count));
+    memcpy(&namesSize, data + 12, sizeof(namesSize));
+    if (headerSize + qint64(count) * qint64(sizeof(Node)) + namesSize != size) {
+        *error = "地名の索引が壊れています: " + indexPath;
+        file.close();
+        count = 0;
+        namesSize = 0;
+        return false;
+    }
+    nodes = reinterpret_cast<const Node *>(data + headerSize);
+    names = reinterpret_cast<const char *>(data + headerSize + qint64(count) * sizeof(Node));
+    return true;
+}
+
+bool PlaceIndex::compile(const QString &datasetPath, const QString &indexPath, int *placeCount, QString *error)
+{
+    QFile in(datasetPath);
+    if (!in.open(QIODevice::ReadOnly)) {
+        *error = "地名のデータを開けません: " + in.errorString();
+        return false;
+    }
+
+    QVector<PlaceRecord> records;
+    QByteArray namePool;
+    QHash<QByteArray, quint32> nameOffsets;
+    while (!in.atEnd()) {
+        const QByteArray line = in.readLine().trimmed();
+        if (line.isEmpty() || line.startsWith('#')) {
+            continue;
+        }
+        // GeoNames: id \t 名前 \t ASCII名 \t 別名 \t 緯度 \t 経度 \t ...、または 名前 \t 緯度 \t 経度
+        const QList<QByteArray> fields = line.split('\t');
+        QByteArray name;
+        bool latitudeOk = false;
+        bool longitudeOk = false;
+        double latitude = 0;
+        double longitude = 0;
+        if (fields.size() >= 9) {
+            name = fields[1];
+            latitude = fields[4].toDouble(&latitudeOk);
+            longitude = fields[5].toDouble(&longitudeOk);
+        } else if (fields.size() >= 3) {
+            name = fields[0];
+            latitude = fields[1].toDouble(&latitudeOk);
+            longitude = fields[2].toDouble(&longitudeOk);
+        }
+        if (name.isEmpty() || !latitudeOk || !longitudeOk) {
+            continue;
+        }
+
+        auto it = nameOffsets.constFind(name);
+        if (it == nameOffsets.constEnd()) {
+            it = nameOffsets.insert(name, static_cast<quint32>(namePool.size()));
+            namePool.append(name);
+            namePool.append('\0');
+        }
+        PlaceRecord record;
+        toUnitVector(latitude, longitude, record.position);
+        record.nameOffset = it.value();
+        records.append(record);
+    }
+    if (records.isEmpty()) {
+        *error = "地名のデータに有効な行がありません: " + datasetPath;
+        return false;
+    }
+    buildTree(records, 0, static_cast<int>(records.size()), 0);
+
+    QDir().mkpath(QFileInfo(indexPath).absolutePath());
+    QSaveFile out(indexPath);
+    if (!out.open(QIODevice::WriteOnly)) {
+        *error = "地名の索引を作成できません: " + out.errorString();
+        return false;
+    }
+    // 同じ環境でメモリマップして読むため、値はそのままのバイト順で書く
+    const quint32 recordCount = static_cast<quint32>(records.size());
+    const quint32 poolSize = static_cast<quint32>(namePool.size());
+    out.write(indexMagic, sizeof(indexMagic));
+    out.write(reinterpret_cast<const char *>(&recordCount), sizeof(recordCount));
+    out.write(reinterpret_cast<const char *>(&poolSize), sizeof(poolSize));
+    static_assert(sizeof(PlaceRecord) == sizeof(Node), "地名の索引の書式");
+    out.write(reinterpret_cast<const char *>(records.constData()), records.size() * sizeof(PlaceRecord));
+    out.write(namePool);
+    if (!out.commit()) {
+        *error = "地名の索引を保存できません: " + out.errorString();
+        return false;
+    }
+    *placeCount = static_cast<int>(recordCount);
+    return true;
+}
+
+QString PlaceIndex::nearest(const GeoPoint &point, double maxDistanceKm, double *distanceKm) const
+{
+    if (count == 0) {
+        return QString();
+    }
+    float target[3];
+    toUnitVector(point.latitude, point.longitude, target);
+    const float maxChord = static_cast<float>(chordOf(maxDistanceKm));
+    qint64 best = -1;
+    float bestDistance = maxChord * maxChord;
+    search(0, count, 0, target, &best, &bestDistance);
+    if (best < 0) {
+        return QString();
+    }
+    if (distanceKm) {
+        *distanceKm = distanceOfChord(std::sqrt(bestDistance));
+    }
+    const quint32 offset = nodes[best].nameOffset;
+    return offset < namesSize ? QString::fromUtf8(names + offset) : QString();
+}
+
+void PlaceIndex::search(quint32 low, quint32 high, int axis, const float *target, qint64 *best,
+                        float *bestDistance) const
+{
+    while (low < high) {
+        const quint32 middle = low + (high - low) / 2;
+        const Node &node = nodes[middle];
+        const float distance = squaredDistance(node.position, target);
+        if (distance < *bestDistance) {
+            *bestDistance = distance;
+            *best = middle;
+        }
+        // 近い側を先に調べ、遠い側は分割面までの距離が最良より近い場合だけ調べる
+        const float difference = target[axis] - node.position[axis];
+        const int next = (axis + 1) % 3;
+        if (difference < 0) {
+            search(low, middle, next, target, best, bestDistance);
+            if (difference * difference >= *bestDistance) {
+                return;
+            }
+            low = middle + 1;
+        } else {
+            search(middle + 1, high, next, target, best, bestDistance);
+            if (difference * difference >= *bestDistance) {
+                return;
+            }
+            high = middle;
+        }
+        axis = next;
+    }
+}
+
+QVector<int> PlaceIndex::cluster(const QVector<GeoPoint> &points, double radiusKm)
+{
+    // 弦の長さを一辺とする3次元の格子に入れ、隣り合う27個の格子の中だけを比べる
+    const double cell = chordOf(radiusKm);
+    const float radius = static_cast<float>(cell * cell);
+    QVector<float> positions(points.size() * 3);
+    QHash<quint64, QVector<int>> grid;
+    auto keyOf = [](qint64 x, qint64 y, qint64 z) {
+        return (quint64(x & 0x1fffff) << 42) | (quint64(y & 0x1fffff) << 21) | quint64(z & 0x1fffff);
+    };
+    QVector<qint64> cells(points.size() * 3);
+    for (int i = 0; i < points.size(); ++i) {
+        float *position = positions.data() + i * 3;
+        toUnitVector(points.at(i).latitude, points.at(i).longitude, position);
+        for (int axis = 0; axis < 3; ++axis) {
+            cells[i * 3 + axis] = static_cast<qint64>(std::floor(position[axis] / cell));
+        }
+        grid[keyOf(cells.at(i * 3), cells.at(i * 3 + 1), cells.at(i * 3 + 2))].append(i);
+    }
+
+    QVector<int> parents(points.size());
+    std::iota(parents.begin(), parents.end(), 0);
+    for (int i = 0; i < points.size(); ++i) {
+        for (int dx = -1; dx <= 1; ++dx) {
+            for (int dy = -1; dy <= 1; ++dy) {
+                for (int dz = -1; dz <= 1; ++dz) {
+                    const auto it = grid.constFind(keyOf(cells.at(i * 3) + dx, cells.at(i * 3 + 1) + dy,
+                                                         cells.at(i * 3 + 2) + dz));
+                    if (it == grid.constEnd()) {
+                        continue;
+                    }
+                    for (int j : it.value()) {
+                        if (j > i && squaredDistance(positions.constData() + i * 3, positions.constData() + j * 3) <= radius) {
+                            parents[findRoot(parents, j)] = findRoot(parents, i);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // まとまりの番号を最初に現れた順に振る
+    QVector<int> clusters(points.size());
+    QHash<int, int> numbers;
+    for (int i = 0; i < points.size(); ++i) {
+        const int root = findRoot(parents, i);
+        auto it = numbers.constFind(root);
+        if (it == numbers.constEnd()) {
+            it = numbers.insert(root, static_cast<int>(numbers.size()));
+        }
+        clusters[i] = it.value();
+    }
+    return clusters;
+}
+
+QString PlaceIndex::coordinateLabel(const GeoPoint &point)
+{
+    return QString("%1%2_%3%4")
+        .arg(std::abs(point.latitude), 0, 'f', 3)
+        .arg(point.latitude < 0 ? 'S' : 'N')
+        .arg(std::abs(point.longitude), 0, 'f', 3)
+        .arg(point.longitude < 0 ? 'W' : 'E');
+}
@@ -0,0 +1,56 @@
+#ifndef PLACEINDEX_H
+#define PLACEINDEX_H
+
+#include <QString>
+#include <QFile>
+#include <QVector>
+#include "GeoTag.h"
+
+// オフラインの地名の索引（撮影位置から最も近い地名を引く）
+// 地名のデータ（GeoNamesのcities500.txt等、または "名前 \t 緯度 \t 経度" のTSV）を一度だけ
+// 単位球上の3次元座標の暗黙のk-d木（中央値を配列の中央に置き、ポインタを持たない）に変換して
+// アプリのデータフォルダに保存し、以降はメモリマップして引く。ネットワークは使わない。
+class PlaceIndex
+{
+public:
+    PlaceIndex() = default;
+    PlaceIndex(const PlaceIndex &) = delete;
+    PlaceIndex &operator=(const PlaceIndex &) = delete;
+
+    // 既定の索引を開く（まだなければアプリに同梱の places.tsv から作る）
+    bool open(QString *error);
+    bool openFile(const QString &indexPath, QString *error);
+
+    // 地名のデータから索引を作る
+    static bool compile(const QString &datasetPath, const QString &indexPath, int *placeCount, QString *error);
+    static QString defaultIndexPath();
+    static QString bundledDatasetPath();
+
+    int size() const { return static_cast<int>(count); }
+
+    // maxDistanceKm以内で最も近い地名（なければ空）
+    QString nearest(const GeoPoint &point, double maxDistanceKm, double *distanceKm = nullptr) const;
+
+    // 地名のない撮影位置のまとめ方: radiusKm以内の位置を連鎖的に同じまとまりにする
+    // 位置毎のまとまりの番号（0から）を返す
+    static QVector<int> cluster(const QVector<GeoPoint> &points, double radiusKm);
+    // 地名のない位置のフォルダ名（"35.681N_139.767E" など）
+    static QString coordinateLabel(const GeoPoint &point);
+
+private:
+    struct Node
+    {
+        float position[3];      // 単位球上の座標
+        quint32 nameOffset;     // names内の位置（NUL終端のUTF-8）
+    };
+
+    void search(quint32 low, quint32 high, int axis, const float *target, qint64 *best, float *bestDistance) const;
+
+    QFile file;
+    const Node *nodes = nullptr;
+    const char *names = nullptr;
+    quint32 count = 0;
+    quint32 namesSize = 0;
+};
+
+#endif // PLACEINDEX_H
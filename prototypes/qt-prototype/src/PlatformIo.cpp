@@ -0,0 +1,296 @@
+#include "PlatformIo.h"
+#include "StageTrace.h"
+#include <QFile>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstdio>
+#endif
+
+#if defined(Q_OS_LINUX)
+#include <sys/syscall.h>
+#elif defined(Q_OS_MACOS)
+#include <sys/resource.h>
+#include <sys/mman.h>
+#endif
+
+namespace PlatformIo {
+
+bool syncFile(int fd)
+{
+    TraceSpan span("fsync");
+#if defined(Q_OS_WIN)
+    return FlushFileBuffers(reinterpret_cast<HANDLE>(_get_osfhandle(fd))) != 0;
+#elif defined(Q_OS_MACOS)
+    // macOSのfsyncはドライブキャッシュまでは保証しない
+    return ::fcntl(fd, F_FULLFSYNC) == 0 || ::fsync(fd) == 0;
+#elif defined(Q_OS_LINUX)
+    return ::fdatasync(fd) == 0;
+#else
+    return ::fsync(fd) == 0;
+#endif
+}
+
+bool syncDirectory(const QString &dirPath)
+{
+    TraceSpan span("fsync", dirPath);
+#ifdef Q_OS_WIN
+    // Windowsではディレクトリのfsyncは不要（MoveFileExのWRITE_THROUGHで担保）
+    Q_UNUSED(dirPath);
+    return true;
+#else
+    int fd = ::open(QFile::encodeName(dirPath).constData(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+#endif
+}
+
+bool syncFileSystem(const QString &path)
+{
+    TraceSpan span("fsync", path);
+#if defined(Q_OS_LINUX)
+    int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = ::syncfs(fd) == 0;
+    ::close(fd);
+    return ok;
+#elif defined(Q_OS_WIN)
+    // ボリューム単位の同期は管理者権限が必要なため行わない
+    Q_UNUSED(path);
+    return true;
+#else
+    Q_UNUSED(path);
+    ::sync();
+    return true;
+#endif
+}
+
+bool renameOverwrite(const QString &from, const QString &to)
+{
+#ifdef Q_OS_WIN
+    return MoveFileExW(reinterpret_cast<const wchar_t *>(from.utf16()),
+                       reinterpret_cast<const wchar_t *>(to.utf16()),
+                       MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return ::rename(QFile::encodeName(from).constData(), QFile::encodeName(to).constData()) == 0;
+#endif
+}
+
+bool renameNoReplace(const QString &from, const QString &to, bool *exists)
+{
+    *exists = false;
+#if defined(Q_OS_WIN)
+    if (MoveFileExW(reinterpret_cast<const wchar_t *>(from.utf16()),
+                    reinterpret_cast<const wchar_t *>(to.utf16()), MOVEFILE_WRITE_THROUGH)) {
+        return true;
+    }
+    const DWORD code = GetLastError();
+    *exists = code == ERROR_ALREADY_EXISTS || code == ERROR_FILE_EXISTS;
+    return false;
+#else
+    const QByteArray source = QFile::encodeName(from);
+    const QByteArray target = QFile::encodeName(to);
+#if defined(Q_OS_MACOS)
+    if (::renamex_np(source.constData(), target.constData(), RENAME_EXCL) == 0) {
+        return true;
+    }
+    if (errno != ENOTSUP) {
+        *exists = errno == EEXIST;
+        return false;
+    }
+#elif defined(Q_OS_LINUX) && defined(SYS_renameat2)
+    const unsigned int renameNoReplaceFlag = 1;     // RENAME_NOREPLACE
+    if (::syscall(SYS_renameat2, AT_FDCWD, source.constData(), AT_FDCWD, target.constData(), renameNoReplaceFlag) == 0) {
+        return true;
+    }
+    if (errno != EINVAL && errno != ENOSYS) {
+        *exists = errno == EEXIST;
+        return false;
+    }
+#endif
+    // 置き換えなしのrenameがなければ、ハードリンクを作ってから元の名前を消す（linkは既存の名前を置き換えない）
+    if (::link(source.constData(), target.constData()) == 0) {
+        ::unlink(source.constData());
+        return true;
+    }
+    if (errno == EEXIST) {
+        *exists = true;
+        return false;
+    }
+    // ハードリンクも使えないファイルシステム（FAT系など）では、確かめてからrenameする
+    struct stat info;
+    if (::lstat(target.constData(), &info) == 0) {
+        *exists = true;
+        return false;
+    }
+    return ::rename(source.constData(), target.constData()) == 0;
+#endif
+}
+
+bool readUncached(const QString &path, const std::function<void(const char *data, qint64 size)> &consume,
+                  QString *error)
+{
+    // 直接I/Oはバッファ・長さともにセクタ境界に揃える必要がある
+    const quintptr alignment = 4096;
+    const qint64 chunkSize = 1024 * 1024;
+    QByteArray storage(chunkSize + alignment, Qt::Uninitialized);
+    char *buffer = reinterpret_cast<char *>((reinterpret_cast<quintptr>(storage.data()) + alignment - 1) & ~(alignment - 1));
+
+#if defined(Q_OS_WIN)
+    // キャッシュに残っている未書き込みのデータはNO_BUFFERINGの読み込み前に書き出される
+    HANDLE handle = CreateFileW(reinterpret_cast<const wchar_t *>(path.utf16()), GENERIC_READ,
+                                FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING,
+                                FILE_FLAG_NO_BUFFERING | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        *error = "検証用に開けません: " + path;
+        return false;
+    }
+    bool ok = true;
+    while (true) {
+        DWORD n = 0;
+        if (!ReadFile(handle, buffer, static_cast<DWORD>(chunkSize), &n, nullptr)) {
+            ok = false;
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+        consume(buffer, n);
+    }
+    CloseHandle(handle);
+    if (!ok) {
+        *error = "検証用の読み込みに失敗しました: " + path;
+    }
+    return ok;
+#else
+    const QByteArray name = QFile::encodeName(path);
+#if defined(Q_OS_LINUX)
+    // O_DIRECTの読み込みは、対象範囲の未書き込みのページを先に書き出してからデバイスを読む
+    int fd = ::open(name.constData(), O_RDONLY | O_DIRECT);
+    if (fd < 0 && errno == EINVAL) {
+        fd = ::open(name.constData(), O_RDONLY);
+        if (fd >= 0) {
+            ::fdatasync(fd);
+            ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        }
+    }
+#else
+    int fd = ::open(name.constData(), O_RDONLY);
+#endif
+    if (fd < 0) {
+        *error = "検証用に開けません: " + path;
+        return false;
+    }
+#if defined(Q_OS_MACOS)
+    // F_NOCACHEはキャッシュ済みのページを捨てないため、同期してから無効化する
+    ::fsync(fd);
+    struct stat info;
+    if (::fstat(fd, &info) == 0 && info.st_size > 0) {
+        void *mapped = ::mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapped != MAP_FAILED) {
+            ::msync(mapped, info.st_size, MS_INVALIDATE);
+            ::munmap(mapped, info.st_size);
+        }
+    }
+    ::fcntl(fd, F_NOCACHE, 1);
+#endif
+    bool ok = true;
+    while (true) {
+        const ssize_t n = ::read(fd, buffer, chunkSize);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ok = false;
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+        consume(buffer, n);
+    }
+    ::close(fd);
+    if (!ok) {
+        *error = "検証用の読み込みに失敗しました: " + path;
+    }
+    return ok;
+#endif
+}
+
+bool setIdleIoPriority(bool idle)
+{
+#if defined(Q_OS_LINUX)
+    // glibcにラッパーがないためsyscallで呼ぶ（who=0は呼び出し元スレッド）
+    // アイドルにする前の優先度を覚えておき、戻すときはそれに戻す（未設定ならクラスなし=CPUのnice値に従う）
+    const int whoProcess = 1;
+    const int classShift = 13;
+    const int classIdle = 3;
+    thread_local int previous = 0;
+    if (idle) {
+        const int current = static_cast<int>(::syscall(SYS_ioprio_get, whoProcess, 0));
+        if (current >= 0 && current >> classShift != classIdle) {
+            previous = current;
+        }
+    }
+    return ::syscall(SYS_ioprio_set, whoProcess, 0, idle ? (classIdle << classShift) : previous) == 0;
+#elif defined(Q_OS_MACOS)
+    thread_local int previous = IOPOL_DEFAULT;
+    if (idle) {
+        const int current = ::getiopolicy_np(IOPOL_TYPE_DISK, IOPOL_SCOPE_THREAD);
+        if (current >= 0 && current != IOPOL_THROTTLE) {
+            previous = current;
+        }
+    }
+    return ::setiopolicy_np(IOPOL_TYPE_DISK, IOPOL_SCOPE_THREAD, idle ? IOPOL_THROTTLE : previous) == 0;
+#elif defined(Q_OS_WIN)
+    // バックグラウンドモードではI/O優先度も下がる
+    return SetThreadPriority(GetCurrentThread(), idle ? THREAD_MODE_BACKGROUND_BEGIN : THREAD_MODE_BACKGROUND_END) != 0;
+#else
+    Q_UNUSED(idle);
+    return false;
+#endif
+}
+
+bool fileIdentity(const QString &path, quint64 *device, quint64 *inode)
+{
+#if defined(Q_OS_WIN)
+    // ボリュームのシリアル番号とファイルインデックス
+    HANDLE handle = CreateFileW(reinterpret_cast<const wchar_t *>(path.utf16()), 0,
+                                FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+                                FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    BY_HANDLE_FILE_INFORMATION info;
+    const bool ok = GetFileInformationByHandle(handle, &info) != 0;
+    CloseHandle(handle);
+    if (!ok) {
+        return false;
+    }
+    *device = info.dwVolumeSerialNumber;
+    *inode = (quint64(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+    return true;
+#else
+    struct stat st;
+    if (::stat(QFile::encodeName(path).constData(), &st) != 0) {
+        return false;
+    }
+    *device = static_cast<quint64>(st.st_dev);
+    *inode = static_cast<quint64>(st.st_ino);
+    return true;
+#endif
+}
+
+} // namespace PlatformIo
@@ -0,0 +1,41 @@
+#ifndef PLATFORMIO_H
+#define PLATFORMIO_H
+
+#include <QString>
+#include <functional>
+
+// OS依存のファイルI/Oヘルパー
+namespace PlatformIo {
+
+// ファイル内容をストレージまで書き出す
+bool syncFile(int fd);
+
+// ディレクトリエントリ（rename結果）を永続化する
+bool syncDirectory(const QString &dirPath);
+
+// pathを含むファイルシステム全体を同期する（Linuxではsyncfs）
+bool syncFileSystem(const QString &path);
+
+// toが存在していても置き換えるアトミックなrename
+bool renameOverwrite(const QString &from, const QString &to);
+
+// toが存在すれば置き換えずに失敗するrename（*existsをtrueにする）
+// Linuxはrenameat2(RENAME_NOREPLACE)、使えないファイルシステムではlink+unlink、
+// macOSはrenamex_np(RENAME_EXCL)、WindowsはMoveFileExを置き換えなしで使う。
+bool renameNoReplace(const QString &from, const QString &to, bool *exists);
+
+// ページキャッシュを通さずにファイル全体を読み、読んだ順にconsumeへ渡す（書き込み後の検証用）
+// Linux/WindowsはO_DIRECT/FILE_FLAG_NO_BUFFERING、macOSは同期とキャッシュの無効化の後にF_NOCACHEで読む。
+// O_DIRECTを使えないファイルシステムでは、同期してキャッシュを捨ててから通常の読み込みにする。
+bool readUncached(const QString &path, const std::function<void(const char *data, qint64 size)> &consume,
+                  QString *error);
+
+// 呼び出し元スレッドのI/O優先度をアイドル（他のI/Oがないときだけ読み書きする）にする、または戻す
+bool setIdleIoPriority(bool idle);
+
+// ファイルを識別するデバイスID（WindowsはボリュームのシリアルNo.）とinode（ファイルインデックス）
+bool fileIdentity(const QString &path, quint64 *device, quint64 *inode);
+
+} // namespace PlatformIo
+
+#endif // PLATFORMIO_H
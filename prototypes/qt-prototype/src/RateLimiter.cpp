@@ -0,0 +1,100 @@
+#include "RateLimiter.h"
+#include "PlatformIo.h"
+#include <QMutexLocker>
+#include <QThread>
+
+Q_GLOBAL_STATIC(RateLimiter, sharedLimiter)
+
+// TokenBucket Implementation
+TokenBucket::TokenBucket()
+{
+    clock.start();
+}
+
+void TokenBucket::setRate(double value)
+{
+    QMutexLocker locker(&mutex);
+    refill();
+    perSecond = qMax(0.0, value);
+    // バーストは1秒分まで
+    tokens = qMin(tokens, perSecond);
+}
+
+double TokenBucket::rate() const
+{
+    QMutexLocker locker(&mutex);
+    return perSecond;
+}
+
+void TokenBucket::refill()
+{
+    const qint64 now = clock.nsecsElapsed();
+    tokens = qMin(perSecond, tokens + perSecond * (now - lastNs) / 1e9);
+    lastNs = now;
+}
+
+void TokenBucket::acquire(qint64 amount)
+{
+    QMutexLocker locker(&mutex);
+    while (perSecond > 0) {
+        refill();
+        if (tokens >= 0) {
+            tokens -= amount;
+            return;
+        }
+        // 速度の変更に気付けるよう、時間を区切って待つ
+        const qint64 waitMs = qBound<qint64>(1, static_cast<qint64>(-tokens / perSecond * 1000) + 1, 100);
+        locker.unlock();
+        QThread::msleep(waitMs);
+        locker.relock();
+    }
+}
+
+// RateLimiter Implementation
+RateLimiter *RateLimiter::instance()
+{
+    return sharedLimiter();
+}
+
+RateLimiter::Scope *RateLimiter::scope(const QString &name)
+{
+    QMutexLocker locker(&mutex);
+    std::shared_ptr<Scope> &entry = scopes[name];
+    if (!entry) {
+        entry = std::make_shared<Scope>();
+    }
+    return entry.get();
+}
+
+void RateLimiter::setLimit(const QString &name, const RateLimit &limit)
+{
+    Scope *target = scope(name);
+    target->bytesBucket.setRate(limit.megabytesPerSecond * 1024 * 1024);
+    target->operationsBucket.setRate(limit.operationsPerSecond);
+}
+
+RateLimit RateLimiter::limit(const QString &name)
+{
+    Scope *target = scope(name);
+    RateLimit limit;
+    limit.megabytesPerSecond = target->bytesBucket.rate() / (1024 * 1024);
+    limit.operationsPerSecond = target->operationsBucket.rate();
+    return limit;
+}
+
+void RateLimiter::setIdleIoPriority(bool idle)
+{
+    idleIo.storeRelaxed(idle ? 1 : 0);
+}
+
+void RateLimiter::applyIoPriority()
+{
+    // スレッド毎に最後に設定した値を覚えておく（-1は未設定）
+    thread_local int applied = -1;
+    const int wanted = idleIo.loadRelaxed();
+    if (applied == wanted || (applied < 0 && wanted == 0)) {
+        return;
+    }
+    PlatformIo::setIdleIoPriority(wanted != 0);
+    applied = wanted;
+}
@@ -0,0 +1,81 @@
+#ifndef RATELIMITER_H
+#define RATELIMITER_H
+
+#include <QString>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <QAtomicInt>
+#include <QHash>
+#include <memory>
+
+// 1秒あたりの量を制限するトークンバケット（rateが0なら無制限）
+// 残量が足りなくても0以上なら先に通して借りを作り、次の呼び出しが返済を待つ。
+// 大きなチャンクでもバースト分を超えて待たされ続けることはない。
+class TokenBucket
+{
+public:
+    TokenBucket();
+
+    // 任意のスレッドから呼べる。待っている呼び出しにもすぐ反映される
+    void setRate(double perSecond);
+    double rate() const;
+
+    void acquire(qint64 amount);
+
+private:
+    void refill();
+
+    mutable QMutex mutex;
+    double perSecond = 0;
+    double tokens = 0;
+    QElapsedTimer clock;
+    qint64 lastNs = 0;
+};
+
+// 転送速度の上限（0は無制限）
+struct RateLimit
+{
+    double megabytesPerSecond = 0;
+    double operationsPerSecond = 0;     // ファイル数/秒
+};
+
+// プロセス全体の速度制限
+// "global"（全出力先の合計）と出力先名（"local", "s3" など）毎にバケットを持つ。
+// 設定画面から実行中に変更でき、動いているジョブにもそのまま反映される。
+class RateLimiter
+{
+public:
+    class Scope
+    {
+    public:
+        void acquireBytes(qint64 bytes) { bytesBucket.acquire(bytes); }
+        void acquireOperation() { operationsBucket.acquire(1); }
+
+    private:
+        friend class RateLimiter;
+        TokenBucket bytesBucket;
+        TokenBucket operationsBucket;
+    };
+
+    static RateLimiter *instance();
+
+    // 返すポインタはプロセス終了まで有効
+    Scope *scope(const QString &name);
+    static QString globalScope() { return "global"; }
+
+    void setLimit(const QString &name, const RateLimit &limit);
+    RateLimit limit(const QString &name);
+
+    // アイドルI/O優先度で転送するか
+    void setIdleIoPriority(bool idle);
+    bool idleIoPriority() const { return idleIo.loadRelaxed() != 0; }
+    // 呼び出し元スレッドのI/O優先度を現在の設定に合わせる（変わったときだけシステムコールする）
+    void applyIoPriority();
+
+private:
+    QMutex mutex;
+    QHash<QString, std::shared_ptr<Scope>> scopes;
+    QAtomicInt idleIo;
+};
+
+#endif // RATELIMITER_H
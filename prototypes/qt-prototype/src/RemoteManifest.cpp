@@ -0,0 +1,350 @@
+#include "RemoteManifest.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QReadLocker>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThread>
+#include <QThreadPool>
+#include <QWriteLocker>
+
+namespace {
+
+const QByteArray refreshedTag = "#refreshed";
+
+// 一覧の並列化のためにフォルダを掘り下げる最大の深さ
+const int maxSplitDepth = 3;
+
+} // namespace
+
+RemoteManifest::RemoteManifest(const QString &destinationId, int refreshDays)
+    : refreshDays(refreshDays)
+{
+    const QByteArray id = QCryptographicHash::hash(destinationId.toUtf8(), QCryptographicHash::Sha1).toHex();
+    const QString directory = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/manifests";
+    QDir().mkpath(directory);
+    path = directory + '/' + QString::fromLatin1(id) + ".tsv";
+}
+
+RemoteManifest::~RemoteManifest()
+{
+    waitForRefresh(nullptr);
+}
+
+bool RemoteManifest::open()
+{
+    // 1行1オブジェクト（key TAB size TAB hash TAB 元ファイルの更新日時）。後の行が優先される
+    QFile file(path);
+    if (file.open(QIODevice::ReadOnly)) {
+        QWriteLocker locker(&lock);
+        while (!file.atEnd()) {
+            const QByteArray line = file.readLine().chopped(1);
+            const QList<QByteArray> fields = line.split('\t');
+            if (fields.size() == 2 && fields.at(0) == refreshedTag) {
+                lastRefreshMs = fields.at(1).toLongLong();
+                continue;
+            }
+            if (fields.size() != 4) {
+                continue;       // 書き込み途中で終わった行
+            }
+            Entry entry;
+            entry.size = fields.at(1).toLongLong();
+            entry.hash = fields.at(2);
+            entry.sourceModifiedMs = fields.at(3).toLongLong();
+            entries.insert(QByteArray::fromPercentEncoding(fields.at(0)), entry);
+        }
+        file.close();
+    }
+
+    log.setFileName(path);
+    return log.open(QIODevice::WriteOnly | QIODevice::Append);
+}
+
+bool RemoteManifest::contains(const QByteArray &key, const QFileInfo &source) const
+{
+    Entry entry;
+    {
+        QReadLocker locker(&lock);
+        auto it = entries.constFind(key);
+        if (it == entries.constEnd() || it->size != source.size()) {
+            return false;
+        }
+        entry = *it;
+    }
+    if (entry.sourceModifiedMs != 0) {
+        return entry.sourceModifiedMs == source.lastModified().toMSecsSinceEpoch();
+    }
+    // 一覧から取得したものは元ファイルが分からないため、内容のハッシュが一致するときだけ同じとみなす
+    if (!sourceHasher || entry.hash.isEmpty()) {
+        return false;
+    }
+    const QByteArray hash = sourceHasher(source.absoluteFilePath(), entry.hash);
+    return !hash.isEmpty() && hash == entry.hash;
+}
+
+void RemoteManifest::claimKeys(const UnitPlan &plan, QVector<QByteArray> *keys, QVector<bool> *uploaded)
+{
+    keys->fill(QByteArray(), plan.sources.size());
+    uploaded->fill(false, plan.sources.size());
+    QVector<int> members;
+    for (int member = 0; member < plan.sources.size(); ++member) {
+        const QByteArray key = uploadedKeyOf(plan, member);
+        if (key.isEmpty()) {
+            members.append(member);
+            continue;
+        }
+        (*keys)[member] = key;
+        (*uploaded)[member] = true;
+    }
+    if (!members.isEmpty()) {
+        claimGroup(plan, members, keys);
+    }
+}
+
+void RemoteManifest::claimAgain(const UnitPlan &plan, const QVector<int> &members, QVector<QByteArray> *keys)
+{
+    claimGroup(plan, members, keys);
+}
+
+void RemoteManifest::releaseKeys(const QVector<QByteArray> &keys)
+{
+    for (const QByteArray &key : keys) {
+        if (!key.isEmpty()) {
+            names.release("./" + key);
+        }
+    }
+}
+
+bool RemoteManifest::exists(const QByteArray &key) const
+{
+    QReadLocker locker(&lock);
+    return entries.contains(key);
+}
+
+QByteArray RemoteManifest::uploadedKeyOf(const UnitPlan &plan, int member) const
+{
+    // 連番は前から順に付くため、記録のない名前に行き当たったらそれ以降は探さない
+    const QFileInfo &source = plan.sources.at(member);
+    const QByteArray prefix = plan.relativeDir.isEmpty() ? QByteArray() : plan.relativeDir + '/';
+    for (int number = 0; ; ++number) {
+        const QByteArray key = prefix + plan.stem + (number > 0 ? '_' + QByteArray::number(number) : QByteArray())
+                             + plan.suffixes.at(member);
+        if (contains(key, source)) {
+            return key;
+        }
+        if (!exists(key)) {
+            return QByteArray();
+        }
+    }
+}
+
+void RemoteManifest::claimGroup(const UnitPlan &plan, const QVector<int> &members, QVector<QByteArray> *keys)
+{
+    const QByteArray dir = plan.relativeDir.isEmpty() ? QByteArray(".") : "./" + plan.relativeDir;
+    const QByteArray prefix = plan.relativeDir.isEmpty() ? QByteArray() : plan.relativeDir + '/';
+    QVector<QByteArray> suffixes;
+    for (int member : members) {
+        suffixes.append(plan.suffixes.at(member));
+    }
+    // 一覧にある名前は予約したまま次の連番を試す（同じstemの連番は台帳が続きから払い出す）
+    while (true) {
+        const int number = names.claimGroup(dir, plan.stem, suffixes);
+        const QByteArray stem = number > 0 ? plan.stem + '_' + QByteArray::number(number) : plan.stem;
+        bool free = true;
+        for (const QByteArray &suffix : suffixes) {
+            if (exists(prefix + stem + suffix)) {
+                free = false;
+                break;
+            }
+        }
+        if (free) {
+            for (int member : members) {
+                (*keys)[member] = prefix + stem + plan.suffixes.at(member);
+            }
+            return;
+        }
+    }
+}
+
+void RemoteManifest::record(const QByteArray &key, qint64 size, const QByteArray &hash, qint64 sourceModifiedMs)
+{
+    Entry entry;
+    entry.size = size;
+    entry.hash = hash;
+    entry.sourceModifiedMs = sourceModifiedMs;
+    {
+        QWriteLocker locker(&lock);
+        entries.insert(key, entry);
+        if (refreshing.loadRelaxed()) {
+            recordedDuringRefresh.insert(key);
+        }
+    }
+
+    QMutexLocker locker(&logMutex);
+    log.write(escape(key) + '\t' + QByteArray::number(size) + '\t' + hash + '\t'
+              + QByteArray::number(sourceModifiedMs) + '\n');
+    log.flush();
+}
+
+void RemoteManifest::refreshIfStale(RemoteLister *lister, int parallelism)
+{
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    if (refreshThread || now - lastRefreshMs < qint64(refreshDays) * 24 * 60 * 60 * 1000) {
+        return;
+    }
+    refreshing.storeRelaxed(1);
+    refreshError.clear();
+    refreshThread = QThread::create([this, lister, parallelism]() { refresh(lister, parallelism); });
+    refreshThread->start(QThread::LowPriority);
+}
+
+bool RemoteManifest::waitForRefresh(QString *error)
+{
+    if (!refreshThread) {
+        return true;
+    }
+    refreshThread->wait();
+    delete refreshThread;
+    refreshThread = nullptr;
+    if (!refreshError.isEmpty() && error) {
+        *error = refreshError;
+    }
+    return refreshError.isEmpty();
+}
+
+int RemoteManifest::count() const
+{
+    QReadLocker locker(&lock);
+    return entries.size();
+}
+
+void RemoteManifest::refresh(RemoteLister *lister, int parallelism)
+{
+    const qint64 startedMs = QDateTime::currentMSecsSinceEpoch();
+    QMutex resultMutex;
+    QVector<RemoteObject> listed;
+    QString firstError;
+    const RemoteLister::Page collect = [&](const QVector<RemoteObject> &page) {
+        QMutexLocker locker(&resultMutex);
+        listed += page;
+    };
+
+    // 並列に一覧を取れるよう、フォルダが十分な数になるまで階層を掘り下げる
+    QVector<QByteArray> folders = {QByteArray()};
+    for (int depth = 0; depth < maxSplitDepth && !folders.isEmpty() && folders.size() < parallelism; ++depth) {
+        QVector<QByteArray> children;
+        for (const QByteArray &folder : folders) {
+            QVector<QByteArray> found;
+            if (!lister->listLevel(folder, &found, collect, &firstError)) {
+                break;
+            }
+            children += found;
+        }
+        folders = children;
+        if (!firstError.isEmpty()) {
+            break;
+        }
+    }
+
+    if (firstError.isEmpty()) {
+        QThreadPool pool;
+        pool.setMaxThreadCount(qMax(1, parallelism));
+        for (const QByteArray &folder : folders) {
+            pool.start([&, folder]() {
+                QString error;
+                if (!lister->listAll(folder, collect, &error)) {
+                    QMutexLocker locker(&resultMutex);
+                    if (firstError.isEmpty()) {
+                        firstError = error;
+                    }
+                }
+            });
+        }
+        pool.waitForDone();
+    }
+
+    if (!firstError.isEmpty()) {
+        // 不完全な一覧では置き換えない（次回また取り直す）
+        QWriteLocker locker(&lock);
+        recordedDuringRefresh.clear();
+        refreshing.storeRelaxed(0);
+        refreshError = "リモートの一覧を取得できません: " + firstError;
+        return;
+    }
+
+    {
+        QWriteLocker locker(&lock);
+        QHash<QByteArray, Entry> fresh;
+        fresh.reserve(listed.size());
+        for (const RemoteObject &object : listed) {
+            Entry entry;
+            entry.size = object.size;
+            entry.hash = object.hash;
+            // 内容が変わっていなければ、自分でアップロードしたときの元ファイルの情報を引き継ぐ
+            auto previous = entries.constFind(object.key);
+            if (previous != entries.constEnd() && previous->size == object.size && previous->hash == object.hash) {
+                entry.sourceModifiedMs = previous->sourceModifiedMs;
+            }
+            fresh.insert(object.key, entry);
+        }
+        // 一覧の取得中にアップロードしたものは一覧に含まれないことがある
+        for (const QByteArray &key : recordedDuringRefresh) {
+            auto recorded = entries.constFind(key);
+            if (recorded != entries.constEnd()) {
+                fresh.insert(key, *recorded);
+            }
+        }
+        entries.swap(fresh);
+        recordedDuringRefresh.clear();
+        refreshing.storeRelaxed(0);
+    }
+
+    if (!rewrite(startedMs)) {
+        refreshError = "マニフェストを保存できません: " + path;
+    }
+}
+
+bool RemoteManifest::rewrite(qint64 refreshedMs)
+{
+    // 追記で肥大化したファイルを現在の内容だけで書き直す
+    QMutexLocker logLocker(&logMutex);
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    file.write(refreshedTag + '\t' + QByteArray::number(refreshedMs) + '\n');
+    {
+        QReadLocker locker(&lock);
+        for (auto it = entries.constBegin(); it != entries.constEnd(); ++it) {
+            file.write(escape(it.key()) + '\t' + QByteArray::number(it->size) + '\t' + it->hash + '\t'
+                       + QByteArray::number(it->sourceModifiedMs) + '\n');
+        }
+    }
+    if (!file.commit()) {
+        return false;
+    }
+
+    lastRefreshMs = refreshedMs;
+    log.close();
+    return log.open(QIODevice::WriteOnly | QIODevice::Append);
+}
+
+QByteArray RemoteManifest::escape(const QByteArray &key)
+{
+    // 区切り文字と'%'だけをパーセントエンコードする
+    QByteArray escaped;
+    escaped.reserve(key.size());
+    for (const char c : key) {
+        switch (c) {
+        case '%': escaped += "%25"; break;
+        case '\t': escaped += "%09"; break;
+        case '\n': escaped += "%0A"; break;
+        case '\r': escaped += "%0D"; break;
+        default: escaped += c; break;
+        }
+    }
+    return escaped;
+}
@@ -0,0 +1,117 @@
+#ifndef REMOTEMANIFEST_H
+#define REMOTEMANIFEST_H
+
+#include <QString>
+#include <QByteArray>
+#include <QHash>
+#include <QSet>
+#include <QVector>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QAtomicInt>
+#include <functional>
+#include "NameRegistry.h"
+#include "TransferDestination.h"
+
+class QThread;
+
+// クラウド上の1オブジェクト（keyは出力先フォルダ・プレフィックスからの相対パス、UTF-8）
+struct RemoteObject
+{
+    QByteArray key;
+    qint64 size = -1;
+    QByteArray hash;            // 出力先のハッシュ（S3: ETag、Dropbox: content_hash、OneDrive: quickXorHash）
+};
+
+// クラウド出力先のオブジェクト一覧の取得（マニフェストの再取得に使う）
+// 複数のスレッドから同時に呼ばれる。
+class RemoteLister
+{
+public:
+    using Page = std::function<void(const QVector<RemoteObject> &)>;
+
+    virtual ~RemoteLister() = default;
+
+    // prefix（空はルート、それ以外は末尾'/'付き）直下のフォルダとオブジェクトを列挙する
+    virtual bool listLevel(const QByteArray &prefix, QVector<QByteArray> *folders, const Page &page, QString *error) = 0;
+
+    // prefix以下のすべてのオブジェクトをページ単位で列挙する
+    virtual bool listAll(const QByteArray &prefix, const Page &page, QString *error) = 0;
+};
+
+// クラウド出力先のオブジェクト一覧のローカルキャッシュ
+// アップロードのたびに追記形式で記録し、転送前の存在確認はHEADやLISTを発行せずにこれで行う。
+// 一覧の取り直しは期限（既定7日）が過ぎたときだけ、フォルダ単位に分けて並列に
+// バックグラウンドで行う。
+// アップロード先の名前もこの一覧を台帳にして決め、既存のオブジェクトを上書きしない。
+class RemoteManifest
+{
+public:
+    explicit RemoteManifest(const QString &destinationId, int refreshDays = 7);
+    ~RemoteManifest();
+
+    bool open();
+
+    // 出力先と同じ方式で元ファイル（path）のハッシュを求める。remoteHashと比べられない形式なら空を返す
+    using SourceHasher = std::function<QByteArray(const QString &path, const QByteArray &remoteHash)>;
+    void setSourceHasher(const SourceHasher &hasher) { sourceHasher = hasher; }
+
+    // keyが同じサイズで存在し、sourceと同じ内容ならtrue。自分でアップロードしたものは元ファイルの更新日時を、
+    // 一覧から取得したものはハッシュを照合する（比べられなければ同じ内容とはみなさない）
+    bool contains(const QByteArray &key, const QFileInfo &source) const;
+    void record(const QByteArray &key, qint64 size, const QByteArray &hash, qint64 sourceModifiedMs);
+
+    // 組の各メンバーのキーを決める（keys・uploadedはメンバー毎）
+    // 同じ元ファイルのオブジェクトが連番付きの名前も含めて記録されていれば転送済みとしてそのキーを返す。
+    // 残りのメンバーには、一覧にあるオブジェクトとも同時に転送中の組とも重ならない同じ連番
+    // （"stem_N.ext"）のキーを予約する
+    void claimKeys(const UnitPlan &plan, QVector<QByteArray> *keys, QVector<bool> *uploaded);
+    // 一覧になかったオブジェクトに先を越された（条件付きの書き込みが失敗した）場合に、
+    // membersのキーを次の連番で予約し直す。使われていた名前は予約したままにする
+    void claimAgain(const UnitPlan &plan, const QVector<int> &members, QVector<QByteArray> *keys);
+    // 書き込まずに終えた組のキーの予約を外す
+    void releaseKeys(const QVector<QByteArray> &keys);
+
+    // 期限が過ぎていれば一覧の取り直しをバックグラウンドで始める
+    void refreshIfStale(RemoteLister *lister, int parallelism);
+    bool waitForRefresh(QString *error);
+
+    int count() const;
+    QString filePath() const { return path; }
+
+private:
+    struct Entry
+    {
+        qint64 size = 0;
+        QByteArray hash;
+        qint64 sourceModifiedMs = 0;    // 0は一覧から取得したもの（元ファイル不明）
+    };
+
+    bool exists(const QByteArray &key) const;
+    QByteArray uploadedKeyOf(const UnitPlan &plan, int member) const;
+    void claimGroup(const UnitPlan &plan, const QVector<int> &members, QVector<QByteArray> *keys);
+    void refresh(RemoteLister *lister, int parallelism);
+    bool rewrite(qint64 refreshedMs);
+    static QByteArray escape(const QByteArray &key);
+
+    QString path;
+    int refreshDays;
+    SourceHasher sourceHasher;
+    qint64 lastRefreshMs = 0;
+
+    mutable QReadWriteLock lock;
+    QHash<QByteArray, Entry> entries;
+    QSet<QByteArray> recordedDuringRefresh;
+    NameRegistry names{false};      // 転送中の組が予約したキー（"./" + key）
+
+    QMutex logMutex;
+    QFile log;
+
+    QThread *refreshThread = nullptr;
+    QString refreshError;
+    QAtomicInt refreshing;
+};
+
+#endif // REMOTEMANIFEST_H
@@ -0,0 +1,346 @@
+#include "S3Client.h"
+#include <QCryptographicHash>
+#include <QMessageAuthenticationCode>
+#include <QDateTime>
+#include <QUrl>
+#include <QXmlStreamReader>
+#include <algorithm>
+
+namespace {
+
+// 条件付きの書き込みで同じキーのオブジェクトがあった
+const int preconditionFailed = 412;
+
+QByteArray sha256Hex(const QByteArray &data)
+{
+    return QCryptographicHash::hash(data, QCryptographicHash::Sha256).toHex();
+}
+
+QByteArray xmlValue(const QByteArray &xml, const QByteArray &tag)
+{
+    const QByteArray open = '<' + tag + '>';
+    const qsizetype begin = xml.indexOf(open);
+    if (begin < 0) {
+        return QByteArray();
+    }
+    const qsizetype end = xml.indexOf("</" + tag + '>', begin);
+    return end < 0 ? QByteArray() : xml.mid(begin + open.size(), end - begin - open.size());
+}
+
+} // namespace
+
+S3Credentials S3Credentials::fromEnvironment()
+{
+    S3Credentials credentials;
+    credentials.accessKey = qgetenv("AWS_ACCESS_KEY_ID");
+    credentials.secretKey = qgetenv("AWS_SECRET_ACCESS_KEY");
+    credentials.sessionToken = qgetenv("AWS_SESSION_TOKEN");
+    return credentials;
+}
+
+S3Client::S3Client(const S3Options &options, const S3Credentials &credentials)
+    : options(options)
+    , credentials(credentials)
+{
+    if (options.endpoint.isEmpty()) {
+        scheme = "https";
+        host = options.bucket.toUtf8() + ".s3." + options.region.toUtf8() + ".amazonaws.com";
+    } else {
+        const QUrl endpoint(options.endpoint);
+        scheme = endpoint.scheme().toUtf8();
+        host = endpoint.host().toUtf8();
+        if (endpoint.port() != -1) {
+            host += ':' + QByteArray::number(endpoint.port());
+        }
+        pathPrefix = '/' + uriEncode(options.bucket.toUtf8(), false);
+    }
+}
+
+bool S3Client::putObject(const QByteArray &key, const QByteArray &data, QString *error, QByteArray *etag, bool *exists)
+{
+    const QByteArray digest = QCryptographicHash::hash(data, QCryptographicHash::Sha256);
+    const HttpResponse response = send("PUT", objectUri(key), {}, data, digest.toHex(),
+                                   {{"if-none-match", "*"}, {"x-amz-checksum-sha256", digest.toBase64()}});
+    if (exists) {
+        *exists = response.status == preconditionFailed;
+    }
+    if (!check(response, error)) {
+        return false;
+    }
+    if (etag) {
+        *etag = response.header("ETag");
+    }
+    return true;
+}
+
+bool S3Client::deleteObject(const QByteArray &key, QString *error)
+{
+    const HttpResponse response = send("DELETE", objectUri(key), {}, QByteArray(), sha256Hex(QByteArray()), {});
+    return check(response, error);
+}
+
+bool S3Client::createMultipartUpload(const QByteArray &key, QByteArray *uploadId, QString *error)
+{
+    const HttpResponse response = send("POST", objectUri(key), {{"uploads", QByteArray()}}, QByteArray(), sha256Hex(QByteArray()),
+                                   {{"x-amz-checksum-algorithm", "SHA256"}});
+    if (!check(response, error)) {
+        return false;
+    }
+    *uploadId = xmlValue(response.body, "UploadId");
+    if (uploadId->isEmpty()) {
+        *error = "UploadIdを取得できません";
+        return false;
+    }
+    return true;
+}
+
+bool S3Client::uploadPart(const QByteArray &key, const QByteArray &uploadId, int partNumber,
+                          const QByteArray &data, const QByteArray &sha256, QByteArray *etag, QString *error)
+{
+    const HttpResponse response = send("PUT", objectUri(key), {{"partNumber", QByteArray::number(partNumber)}, {"uploadId", uploadId}},
+                                   data, sha256.toHex(), {{"x-amz-checksum-sha256", sha256.toBase64()}});
+    if (!check(response, error)) {
+        return false;
+    }
+    *etag = response.header("ETag");
+    return true;
+}
+
+bool S3Client::completeMultipartUpload(const QByteArray &key, const QByteArray &uploadId,
+                                       const QVector<S3Part> &parts, QString *error, QByteArray *etag, bool *exists)
+{
+    QByteArray body = "<CompleteMultipartUpload>";
+    for (const S3Part &part : parts) {
+        body += "<Part><PartNumber>" + QByteArray::number(part.number) + "</PartNumber>"
+              + "<ETag>" + part.etag + "</ETag>"
+              + "<ChecksumSHA256>" + part.checksum + "</ChecksumSHA256></Part>";
+    }
+    body += "</CompleteMultipartUpload>";
+
+    const HttpResponse response = send("POST", objectUri(key), {{"uploadId", uploadId}}, body, sha256Hex(body),
+                                   {{"content-type", "application/xml"}, {"if-none-match", "*"}});
+    if (exists) {
+        *exists = response.status == preconditionFailed;
+    }
+    if (!check(response, error)) {
+        return false;
+    }
+    if (etag) {
+        *etag = xmlValue(response.body, "ETag").replace("&quot;", "\"");
+    }
+    return true;
+}
+
+bool S3Client::listParts(const QByteArray &key, const QByteArray &uploadId, QVector<S3Part> *parts, QString *error)
+{
+    parts->clear();
+    QByteArray marker;
+    while (true) {
+        QueryList query = {{"uploadId", uploadId}};
+        if (!marker.isEmpty()) {
+            query.append({"part-number-marker", marker});
+        }
+        const HttpResponse response = send("GET", objectUri(key), query, QByteArray(), sha256Hex(QByteArray()), {});
+        if (!check(response, error)) {
+            return false;
+        }
+
+        QXmlStreamReader xml(response.body);
+        S3Part part;
+        bool truncated = false;
+        while (!xml.atEnd()) {
+            xml.readNext();
+            if (xml.isStartElement()) {
+                const QStringView name = xml.name();
+                if (name == u"Part") {
+                    part = S3Part();
+                } else if (name == u"PartNumber") {
+                    part.number = xml.readElementText().toInt();
+                } else if (name == u"ETag") {
+                    part.etag = xml.readElementText().toUtf8();
+                } else if (name == u"ChecksumSHA256") {
+                    part.checksum = xml.readElementText().toUtf8();
+                } else if (name == u"IsTruncated") {
+                    truncated = xml.readElementText() == u"true";
+                } else if (name == u"NextPartNumberMarker") {
+                    marker = xml.readElementText().toUtf8();
+                }
+            } else if (xml.isEndElement() && xml.name() == u"Part") {
+                parts->append(part);
+            }
+        }
+        if (!truncated || marker.isEmpty()) {
+            return true;
+        }
+    }
+}
+
+bool S3Client::abortMultipartUpload(const QByteArray &key, const QByteArray &uploadId, QString *error)
+{
+    const HttpResponse response = send("DELETE", objectUri(key), {{"uploadId", uploadId}}, QByteArray(), sha256Hex(QByteArray()), {});
+    return check(response, error);
+}
+
+QByteArray S3Client::objectUri(const QByteArray &key) const
+{
+    return pathPrefix + '/' + uriEncode(options.prefix.toUtf8() + key, true);
+}
+
+bool S3Client::listObjects(const QByteArray &prefix, QVector<QByteArray> *folders,
+                           const RemoteLister::Page &page, QString *error)
+{
+    const QByteArray fullPrefix = options.prefix.toUtf8() + prefix;
+    QByteArray token;
+    while (true) {
+        QueryList query = {{"list-type", "2"}, {"prefix", fullPrefix}, {"max-keys", "1000"}};
+        if (folders) {
+            query.append({"delimiter", QByteArray("/")});
+        }
+        if (!token.isEmpty()) {
+            query.append({"continuation-token", token});
+        }
+        const HttpResponse response = send("GET", pathPrefix + '/', query, QByteArray(), sha256Hex(QByteArray()), {});
+        if (!check(response, error)) {
+            return false;
+        }
+
+        // キーはprefixを除いた相対パスで返す
+        QXmlStreamReader xml(response.body);
+        QVector<RemoteObject> objects;
+        RemoteObject object;
+        bool truncated = false;
+        token.clear();
+        while (!xml.atEnd()) {
+            xml.readNext();
+            if (xml.isStartElement()) {
+                const QStringView name = xml.name();
+                if (name == u"Contents") {
+                    object = RemoteObject();
+                } else if (name == u"Key") {
+                    object.key = xml.readElementText().toUtf8().mid(options.prefix.toUtf8().size());
+                } else if (name == u"Size") {
+                    object.size = xml.readElementText().toLongLong();
+                } else if (name == u"ETag") {
+                    object.hash = xml.readElementText().toUtf8();
+                } else if (name == u"Prefix" && folders) {
+                    const QByteArray folder = xml.readElementText().toUtf8();
+                    if (folder != fullPrefix) {
+                        folders->append(folder.mid(options.prefix.toUtf8().size()));
+                    }
+                } else if (name == u"IsTruncated") {
+                    truncated = xml.readElementText() == u"true";
+                } else if (name == u"NextContinuationToken") {
+                    token = xml.readElementText().toUtf8();
+                }
+            } else if (xml.isEndElement() && xml.name() == u"Contents") {
+                objects.append(object);
+            }
+        }
+        page(objects);
+        if (!truncated || token.isEmpty()) {
+            return true;
+        }
+    }
+}
+
+HttpResponse S3Client::send(const QByteArray &method, const QByteArray &canonicalUri, const QueryList &query,
+                            const QByteArray &body, const QByteArray &payloadHash, const HttpHeaders &extraHeaders)
+{
+    QueryList sortedQuery = query;
+    std::sort(sortedQuery.begin(), sortedQuery.end());
+    QByteArray canonicalQuery;
+    for (const auto &item : sortedQuery) {
+        if (!canonicalQuery.isEmpty()) {
+            canonicalQuery += '&';
+        }
+        canonicalQuery += uriEncode(item.first, false) + '=' + uriEncode(item.second, false);
+    }
+    const QUrl url = QUrl::fromEncoded(scheme + "://" + host + canonicalUri
+                                       + (canonicalQuery.isEmpty() ? QByteArray() : '?' + canonicalQuery));
+
+    // 再試行のたびに署名し直す（x-amz-dateが変わるため）
+    HttpResponse response;
+    for (int attempt = 1; ; ++attempt) {
+        const QDateTime now = QDateTime::currentDateTimeUtc();
+        const QByteArray amzDate = now.toString("yyyyMMdd'T'HHmmss'Z'").toLatin1();
+        const QByteArray date = amzDate.left(8);
+
+        HttpHeaders headers = extraHeaders;
+        headers.append({"host", host});
+        headers.append({"x-amz-content-sha256", payloadHash});
+        headers.append({"x-amz-date", amzDate});
+        if (!credentials.sessionToken.isEmpty()) {
+            headers.append({"x-amz-security-token", credentials.sessionToken});
+        }
+        std::sort(headers.begin(), headers.end());
+
+        QByteArray canonicalHeaders;
+        QByteArray signedHeaders;
+        for (const auto &header : headers) {
+            canonicalHeaders += header.first + ':' + header.second.trimmed() + '\n';
+            signedHeaders += (signedHeaders.isEmpty() ? QByteArray() : QByteArray(";")) + header.first;
+        }
+
+        const QByteArray canonicalRequest = method + '\n' + canonicalUri + '\n' + canonicalQuery + '\n'
+                                          + canonicalHeaders + '\n' + signedHeaders + '\n' + payloadHash;
+        const QByteArray scope = date + '/' + options.region.toUtf8() + "/s3/aws4_request";
+        const QByteArray stringToSign = "AWS4-HMAC-SHA256\n" + amzDate + '\n' + scope + '\n' + sha256Hex(canonicalRequest);
+
+        QByteArray signingKey = hmac("AWS4" + credentials.secretKey, date);
+        signingKey = hmac(signingKey, options.region.toUtf8());
+        signingKey = hmac(signingKey, "s3");
+        signingKey = hmac(signingKey, "aws4_request");
+        const QByteArray signature = hmac(signingKey, stringToSign).toHex();
+
+        // hostはQNetworkAccessManagerがURLから付ける
+        headers.removeIf([](const QPair<QByteArray, QByteArray> &header) { return header.first == "host"; });
+        headers.append({"Authorization", "AWS4-HMAC-SHA256 Credential=" + credentials.accessKey + '/' + scope
+                                         + ", SignedHeaders=" + signedHeaders + ", Signature=" + signature});
+
+        response = HttpClient::send(method, url, headers, body);
+        if (!HttpClient::shouldRetry(response, attempt)) {
+            return response;
+        }
+    }
+}
+
+bool S3Client::check(const HttpResponse &response, QString *error) const
+{
+    // CompleteMultipartUploadは200のままエラー本文を返すことがある
+    if (response.status >= 200 && response.status < 300 && !response.body.contains("<Error>")) {
+        return true;
+    }
+    if (response.status == 0) {
+        *error = "S3に接続できません: " + response.error;
+    } else {
+        *error = QString("S3エラー (HTTP %1): %2 %3")
+                     .arg(response.status)
+                     .arg(QString::fromUtf8(xmlValue(response.body, "Code")),
+                          QString::fromUtf8(xmlValue(response.body, "Message")));
+    }
+    return false;
+}
+
+QByteArray S3Client::uriEncode(const QByteArray &value, bool keepSlash)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    QByteArray encoded;
+    encoded.reserve(value.size() * 3);
+    for (const char c : value) {
+        const uchar u = static_cast<uchar>(c);
+        if ((u >= 'A' && u <= 'Z') || (u >= 'a' && u <= 'z') || (u >= '0' && u <= '9')
+            || u == '-' || u == '_' || u == '.' || u == '~' || (keepSlash && u == '/')) {
+            encoded += c;
+        } else {
+            encoded += '%';
+            encoded += hex[u >> 4];
+            encoded += hex[u & 0x0F];
+        }
+    }
+    return encoded;
+}
+
+QByteArray S3Client::hmac(const QByteArray &key, const QByteArray &message)
+{
+    return QMessageAuthenticationCode::hash(message, key, QCryptographicHash::Sha256);
+}
@@ -0,0 +1,75 @@
+#ifndef S3CLIENT_H
+#define S3CLIENT_H
+
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+#include <QPair>
+#include <QList>
+#include "HttpClient.h"
+#include "CloudOptions.h"
+#include "RemoteManifest.h"
+
+struct S3Credentials
+{
+    QByteArray accessKey;
+    QByteArray secretKey;
+    QByteArray sessionToken;
+
+    bool isValid() const { return !accessKey.isEmpty() && !secretKey.isEmpty(); }
+    static S3Credentials fromEnvironment();
+};
+
+// マルチパートアップロードの1パート
+struct S3Part
+{
+    int number = 0;
+    QByteArray etag;
+    QByteArray checksum;        // SHA-256（Base64）
+};
+
+// S3 REST APIの最小限のクライアント（署名バージョン4）
+// 呼び出しはブロックする。通信はHttpClientを使う。
+class S3Client
+{
+public:
+    S3Client(const S3Options &options, const S3Credentials &credentials);
+
+    // keyはUTF-8（prefixを含まない）
+    // 作成・完了は同じキーのオブジェクトがない場合だけ行い（If-None-Match: *）、あれば*existsをtrueにして失敗する
+    bool putObject(const QByteArray &key, const QByteArray &data, QString *error, QByteArray *etag = nullptr,
+                   bool *exists = nullptr);
+    bool deleteObject(const QByteArray &key, QString *error);
+    bool createMultipartUpload(const QByteArray &key, QByteArray *uploadId, QString *error);
+    bool uploadPart(const QByteArray &key, const QByteArray &uploadId, int partNumber,
+                    const QByteArray &data, const QByteArray &sha256, QByteArray *etag, QString *error);
+    bool completeMultipartUpload(const QByteArray &key, const QByteArray &uploadId,
+                                 const QVector<S3Part> &parts, QString *error, QByteArray *etag = nullptr,
+                                 bool *exists = nullptr);
+    // アップロード済みのパート一覧。アップロードが存在しなければfalse
+    bool listParts(const QByteArray &key, const QByteArray &uploadId, QVector<S3Part> *parts, QString *error);
+    bool abortMultipartUpload(const QByteArray &key, const QByteArray &uploadId, QString *error);
+    // prefix以下のオブジェクトをページ（最大1000件）単位で列挙する（ListObjectsV2）
+    // foldersを渡すとprefix直下だけを列挙し、サブフォルダ（末尾'/'付き）を返す
+    bool listObjects(const QByteArray &prefix, QVector<QByteArray> *folders,
+                     const RemoteLister::Page &page, QString *error);
+
+private:
+    using QueryList = QList<QPair<QByteArray, QByteArray>>;
+
+    QByteArray objectUri(const QByteArray &key) const;
+    HttpResponse send(const QByteArray &method, const QByteArray &canonicalUri, const QueryList &query,
+                      const QByteArray &body, const QByteArray &payloadHash, const HttpHeaders &extraHeaders);
+    bool check(const HttpResponse &response, QString *error) const;
+
+    static QByteArray uriEncode(const QByteArray &value, bool keepSlash);
+    static QByteArray hmac(const QByteArray &key, const QByteArray &message);
+
+    S3Options options;
+    S3Credentials credentials;
+    QByteArray scheme;
+    QByteArray host;
+    QByteArray pathPrefix;      // パス形式の場合 "/bucket"
+};
+
+#endif // S3CLIENT_H
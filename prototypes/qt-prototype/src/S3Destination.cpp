@@ -0,0 +1,477 @@
+#include "S3Destination.h"
+#include "UploadStateStore.h"
+#include "UploadTracker.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QMap>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QStringList>
+
+namespace {
+
+// 1ファイル分のマルチパートアップロード（パートのアップロードタスクと共有する）
+struct MultipartUpload
+{
+    QByteArray key;
+    QByteArray uploadId;
+    QJsonObject state;              // 再開用の記録（parts以外）
+
+    QMutex mutex;
+    QMap<int, S3Part> parts;        // 完了済みパート
+    UploadTracker tasks;
+
+    QJsonObject stateWithParts() const
+    {
+        QJsonArray list;
+        for (const S3Part &part : parts) {
+            list.append(QJsonObject{
+                {"n", part.number},
+                {"etag", QString::fromUtf8(part.etag)},
+                {"sha256", QString::fromLatin1(part.checksum)}
+            });
+        }
+        QJsonObject result = state;
+        result.insert("parts", list);
+        return result;
+    }
+};
+
+// 1回のPutObjectで置いたオブジェクトのETagは内容のMD5（マルチパートの "…-パート数" とは比べられない）
+QByteArray etagOf(const QString &path, const QByteArray &remoteHash)
+{
+    if (remoteHash.contains('-')) {
+        return QByteArray();
+    }
+    QFile file(path);
+    QCryptographicHash md5(QCryptographicHash::Md5);
+    if (!file.open(QIODevice::ReadOnly) || !md5.addData(&file)) {
+        return QByteArray();
+    }
+    const QByteArray hex = md5.result().toHex();
+    return remoteHash.startsWith('"') ? '"' + hex + '"' : hex;
+}
+
+} // namespace
+
+// S3UnitWriter Implementation
+class S3UnitWriter : public UnitWriter
+{
+public:
+    S3UnitWriter(S3Destination *destination, const UnitPlan &plan)
+        : destination(destination), plan(plan)
+    {
+        destination->manifest->claimKeys(plan, &keys, &uploaded);
+        paths = std::make_shared<UnitPaths>(keys);
+    }
+
+    ~S3UnitWriter() override
+    {
+        if (!finished) {
+            abort();
+        }
+    }
+
+    bool wants(int member) const override
+    {
+        return !uploaded.at(member);
+    }
+
+    std::shared_ptr<const UnitPaths> destinationPaths() const override
+    {
+        return paths;
+    }
+
+    bool beginFile(int member, QString *error) override
+    {
+        const QFileInfo &source = plan.sources.at(member);
+        key = keys.at(member);
+        current = source;
+        currentMember = member;
+        buffer.clear();
+        nextPart = 0;
+        upload.reset();
+
+        // パート数の上限（10000）を超えないよう、大きなファイルではパートを大きくする
+        const qint64 mb = 1024 * 1024;
+        partSize = qMax(destination->options.partSize, (source.size() / 10000 + mb) / mb * mb);
+        if (source.size() <= destination->options.partSize) {
+            buffer.reserve(source.size());
+            return true;
+        }
+        buffer.reserve(partSize);
+        return startMultipart(source, error);
+    }
+
+    bool write(const char *data, qint64 size, QString *error) override
+    {
+        if (!upload) {
+            buffer.append(data, size);
+            return true;
+        }
+
+        while (size > 0) {
+            const qint64 take = qMin(size, partSize - buffer.size());
+            buffer.append(data, take);
+            data += take;
+            size -= take;
+            if (buffer.size() == partSize && !dispatchPart(error)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool endFile(QString *error) override
+    {
+        if (!upload) {
+            // 小さなファイルは組の確定まで公開しない
+            smallObjects.append(SmallObject{currentMember, std::move(buffer)});
+            buffer = QByteArray();
+            return true;
+        }
+
+        if ((!buffer.isEmpty() || nextPart == 0) && !dispatchPart(error)) {
+            return false;
+        }
+        if (!upload->tasks.wait(error)) {
+            return false;
+        }
+
+        QMutexLocker locker(&upload->mutex);
+        if (upload->parts.size() < nextPart) {
+            *error = "アップロードされていないパートがあります";
+            return false;
+        }
+        pending.append(upload);
+        upload.reset();
+        return true;
+    }
+
+    bool commit(QString *error) override
+    {
+        finished = true;
+        // 組のファイルを送り終えてから、まとめてマルチパートアップロードを完了させ、小さなファイルを置く。
+        // マルチパートはパートが作成時のキーに結び付いていて付け直せないため先に完了させる
+        QVector<QByteArray> placed;     // 付け直せない（置き終えた）キー
+        for (const std::shared_ptr<MultipartUpload> &completed : pending) {
+            QVector<S3Part> parts;
+            for (const S3Part &part : completed->parts) {
+                parts.append(part);
+            }
+            QByteArray etag;
+            bool exists = false;
+            if (!destination->client->completeMultipartUpload(completed->key, completed->uploadId, parts, error, &etag,
+                                                              &exists)) {
+                if (exists) {
+                    // 次回は別の連番で送り直す
+                    *error = "同じ名前のオブジェクトが先に作られました: " + QString::fromUtf8(completed->key);
+                }
+                return failCommit(placed, error);
+            }
+            placed.append(completed->key);
+            destination->states->remove(QString::fromUtf8(completed->key));
+            destination->manifest->record(completed->key, completed->state.value("size").toInteger(), etag,
+                                          completed->state.value("modified").toInteger());
+        }
+        pending.clear();
+
+        QVector<QByteArray> etags(smallObjects.size());
+        while (true) {
+            int count = 0;
+            bool exists = false;
+            while (count < smallObjects.size()) {
+                const SmallObject &object = smallObjects.at(count);
+                if (!destination->client->putObject(keys.at(object.member), object.data, error, &etags[count], &exists)) {
+                    break;
+                }
+                ++count;
+            }
+            if (count == smallObjects.size()) {
+                break;
+            }
+            if (!exists || !placed.isEmpty()) {
+                if (exists) {
+                    *error = "同じ名前のオブジェクトが先に作られました: "
+                           + QString::fromUtf8(keys.at(smallObjects.at(count).member));
+                }
+                for (int i = 0; i < count; ++i) {
+                    placed.append(recordSmallObject(i, etags.at(i)));
+                }
+                return failCommit(placed, error);
+            }
+
+            // 一覧になかったオブジェクトに先を越された。この回に置いたファイルを消し、
+            // 組のメンバーをすべて次の連番に付け直して置き直す
+            QVector<int> members;
+            for (int i = 0; i < smallObjects.size(); ++i) {
+                const QByteArray &key = keys.at(smallObjects.at(i).member);
+                if (i < count && !destination->client->deleteObject(key, error)) {
+                    placed.append(recordSmallObject(i, etags.at(i)));
+                }
+                members.append(smallObjects.at(i).member);
+            }
+            if (!placed.isEmpty()) {
+                return failCommit(placed, error);
+            }
+            destination->manifest->claimAgain(plan, members, &keys);
+            for (int member : members) {
+                (*paths)[member] = keys.at(member);
+            }
+        }
+        for (int i = 0; i < smallObjects.size(); ++i) {
+            recordSmallObject(i, etags.at(i));
+        }
+        smallObjects.clear();
+        return true;
+    }
+
+    void abort() override
+    {
+        // UploadIdと完了済みパートは次回の再開のために残す
+        finished = true;
+        waitForParts();
+        upload.reset();
+        pending.clear();
+        smallObjects.clear();
+        QVector<QByteArray> claimed;
+        for (int member = 0; member < keys.size(); ++member) {
+            if (!uploaded.at(member)) {
+                claimed.append(keys.at(member));
+            }
+        }
+        destination->manifest->releaseKeys(claimed);
+    }
+
+private:
+    // 確定の失敗。置かなかったキーの予約を外し、組の一部を置いた後なら組が分かれたことを伝える
+    bool failCommit(const QVector<QByteArray> &placed, QString *error)
+    {
+        QVector<QByteArray> unplaced;
+        for (int member = 0; member < keys.size(); ++member) {
+            if (!uploaded.at(member) && !placed.contains(keys.at(member))) {
+                unplaced.append(keys.at(member));
+            }
+        }
+        destination->manifest->releaseKeys(unplaced);
+
+        if (!placed.isEmpty()) {
+            QStringList keys;
+            for (const QByteArray &key : placed) {
+                keys << QString::fromUtf8(key);
+            }
+            *error = QString("組が分かれました（置いたもの: %1）: %2").arg(keys.join(", "), *error);
+        }
+        return false;
+    }
+
+    QByteArray recordSmallObject(int index, const QByteArray &etag)
+    {
+        const int member = smallObjects.at(index).member;
+        const QFileInfo &source = plan.sources.at(member);
+        destination->manifest->record(keys.at(member), source.size(), etag, source.lastModified().toMSecsSinceEpoch());
+        return keys.at(member);
+    }
+
+    bool startMultipart(const QFileInfo &source, QString *error)
+    {
+        upload = std::make_shared<MultipartUpload>();
+        upload->key = key;
+        upload->state = QJsonObject{
+            {"source", source.absoluteFilePath()},
+            {"size", source.size()},
+            {"modified", source.lastModified().toMSecsSinceEpoch()},
+            {"partSize", partSize}
+        };
+
+        // 同じファイルの未完了アップロードが残っていれば、サーバー側に残っているパートを引き継ぐ
+        const QString stateKey = QString::fromUtf8(key);
+        const QJsonObject saved = destination->states->load(stateKey);
+        const bool sameSource = !saved.isEmpty()
+            && saved.value("source") == upload->state.value("source")
+            && saved.value("size").toInteger() == source.size()
+            && saved.value("modified").toInteger() == source.lastModified().toMSecsSinceEpoch()
+            && saved.value("partSize").toInteger() == partSize;
+        if (sameSource) {
+            const QByteArray uploadId = saved.value("uploadId").toString().toUtf8();
+            QVector<S3Part> remote;
+            QString listError;
+            if (destination->client->listParts(key, uploadId, &remote, &listError)) {
+                QMap<int, QByteArray> remoteTags;
+                for (const S3Part &part : remote) {
+                    remoteTags.insert(part.number, part.etag);
+                }
+                for (const QJsonValue &value : saved.value("parts").toArray()) {
+                    const QJsonObject object = value.toObject();
+                    S3Part part;
+                    part.number = object.value("n").toInt();
+                    part.etag = object.value("etag").toString().toUtf8();
+                    part.checksum = object.value("sha256").toString().toLatin1();
+                    if (remoteTags.value(part.number) == part.etag) {
+                        upload->parts.insert(part.number, part);
+                    }
+                }
+                upload->uploadId = uploadId;
+                upload->state.insert("uploadId", QString::fromUtf8(uploadId));
+                return true;
+            }
+        }
+
+        if (!destination->client->createMultipartUpload(key, &upload->uploadId, error)) {
+            upload.reset();
+            return false;
+        }
+        upload->state.insert("uploadId", QString::fromUtf8(upload->uploadId));
+        destination->states->save(stateKey, upload->state);
+        return true;
+    }
+
+    bool dispatchPart(QString *error)
+    {
+        const int number = ++nextPart;
+        QByteArray data = std::move(buffer);
+        buffer = QByteArray();
+        buffer.reserve(partSize);
+
+        const QByteArray digest = QCryptographicHash::hash(data, QCryptographicHash::Sha256);
+        const QByteArray checksum = digest.toBase64();
+
+        {
+            // 再開時、同じ内容のパートが既にあれば送らない
+            QMutexLocker locker(&upload->mutex);
+            auto existing = upload->parts.constFind(number);
+            if (existing != upload->parts.constEnd() && existing->checksum == checksum) {
+                return true;
+            }
+            upload->parts.remove(number);
+        }
+        if (!upload->tasks.begin(destination->options.concurrency, error)) {
+            return false;
+        }
+
+        std::shared_ptr<MultipartUpload> shared = upload;
+        S3Destination *owner = destination;
+        owner->partPool.start([shared, owner, number, data, digest, checksum]() {
+            S3Part part;
+            part.number = number;
+            part.checksum = checksum;
+            QString partError;
+            const bool ok = owner->client->uploadPart(shared->key, shared->uploadId, number, data, digest,
+                                                      &part.etag, &partError);
+
+            if (ok) {
+                QMutexLocker partLocker(&shared->mutex);
+                shared->parts.insert(number, part);
+                owner->states->save(QString::fromUtf8(shared->key), shared->stateWithParts());
+            }
+            shared->tasks.end(ok ? QString() : QString("パート%1: %2").arg(number).arg(partError));
+        });
+        return true;
+    }
+
+    void waitForParts()
+    {
+        if (upload) {
+            upload->tasks.wait(nullptr);
+        }
+    }
+
+    // 組の確定まで送らずに持っておく小さなファイル
+    struct SmallObject
+    {
+        int member;
+        QByteArray data;
+    };
+
+    S3Destination *destination;
+    UnitPlan plan;
+    QVector<QByteArray> keys;       // メンバー毎のキー（マニフェストで予約したもの）
+    QVector<bool> uploaded;         // マニフェスト上でアップロード済みのメンバー
+    std::shared_ptr<UnitPaths> paths;
+    bool finished = false;
+
+    QByteArray key;
+    QFileInfo current;
+    int currentMember = -1;
+    QByteArray buffer;
+    qint64 partSize = 0;
+    int nextPart = 0;
+    std::shared_ptr<MultipartUpload> upload;
+    QVector<std::shared_ptr<MultipartUpload>> pending;
+    QVector<SmallObject> smallObjects;
+};
+
+// S3Destination Implementation
+S3Destination::S3Destination(const S3Options &options)
+    : options(options)
+{
+}
+
+S3Destination::~S3Destination()
+{
+    partPool.waitForDone();
+    if (manifest) {
+        manifest->waitForRefresh(nullptr);
+    }
+}
+
+bool S3Destination::prepare(QString *error)
+{
+    if (options.bucket.isEmpty()) {
+        *error = "S3のバケット名が設定されていません";
+        return false;
+    }
+    const S3Credentials credentials = S3Credentials::fromEnvironment();
+    if (!credentials.isValid()) {
+        *error = "S3の認証情報がありません（AWS_ACCESS_KEY_ID / AWS_SECRET_ACCESS_KEY を設定してください）";
+        return false;
+    }
+    // S3の最小パートサイズは5MB
+    options.partSize = qMax<qint64>(options.partSize, 5 * 1024 * 1024);
+    options.concurrency = qMax(1, options.concurrency);
+
+    client = std::make_unique<S3Client>(options, credentials);
+    const QString destinationId = options.destinationId();
+    states = std::make_unique<UploadStateStore>(UploadStateStore::defaultDirectory(destinationId));
+    manifest = std::make_unique<RemoteManifest>(destinationId);
+    if (!manifest->open()) {
+        *error = "マニフェストを開けません: " + manifest->filePath();
+        return false;
+    }
+    manifest->setSourceHasher(etagOf);
+    manifest->refreshIfStale(this, options.concurrency);
+
+    partPool.setMaxThreadCount(options.concurrency);
+    partPool.setObjectName("S3 アップロード");
+    return true;
+}
+
+std::unique_ptr<UnitWriter> S3Destination::beginUnit(const UnitPlan &plan, QString *)
+{
+    return std::make_unique<S3UnitWriter>(this, plan);
+}
+
+bool S3Destination::finish(QString *error)
+{
+    // パートの失敗は各組がendFile()かabort()で待って受け取っているため、ここでは残ったタスクを待つだけ
+    partPool.waitForDone();
+    QString refreshError;
+    if (!manifest->waitForRefresh(&refreshError)) {
+        *error = "S3の一覧を取り直せませんでした: " + refreshError;
+        return false;
+    }
+    return true;
+}
+
+bool S3Destination::listLevel(const QByteArray &prefix, QVector<QByteArray> *folders, const Page &page, QString *error)
+{
+    return client->listObjects(prefix, folders, page, error);
+}
+
+bool S3Destination::listAll(const QByteArray &prefix, const Page &page, QString *error)
+{
+    return client->listObjects(prefix, nullptr, page, error);
+}
@@ -0,0 +1,51 @@
+#ifndef S3DESTINATION_H
+#define S3DESTINATION_H
+
+#include <QString>
+#include <QByteArray>
+#include <QThreadPool>
+#include <memory>
+#include "TransferDestination.h"
+#include "S3Client.h"
+#include "RemoteManifest.h"
+
+class UploadStateStore;
+
+// Amazon S3（およびS3互換ストレージ）への出力
+// partSizeを超えるファイルはマルチパートアップロードで送り、読み込みと並行して
+// 最大concurrency個のパートを同時にアップロードする。各パートにはSHA-256チェックサムを付け、
+// UploadIdと完了済みパートを記録しておくことで、中断後は未完了のパートだけを送り直す。
+// partSize以下のファイルは組の確定まで持っておき、commit()でまとめて置く。
+// キーは "prefix + フォルダ/ファイル名" で、マニフェストにある名前とは重ならないよう連番を付ける。
+// 作成は同じキーのオブジェクトがない場合だけ行い（If-None-Match）、先を越されたら
+// 組のメンバーをすべて次の連番に付け直して置き直す。マルチパートは付け直せないため、
+// 置いた後に組の残りが置けなければ組が分かれたことをエラーで伝える。
+// 同じキー・サイズのオブジェクトがマニフェストにあれば、そのファイルは送らない（一覧から取得したものはETagのMD5も照合する）。
+class S3Destination : public TransferDestination, public RemoteLister
+{
+public:
+    explicit S3Destination(const S3Options &options);
+    ~S3Destination() override;
+
+    QString name() const override { return "s3"; }
+    bool prepare(QString *error) override;
+    std::unique_ptr<UnitWriter> beginUnit(const UnitPlan &plan, QString *error) override;
+    bool finish(QString *error) override;
+
+    // マニフェストの一覧の取り直しを待つ（取り直した後の状態から始めたいテスト用）
+    bool waitForRefresh(QString *error) { return manifest->waitForRefresh(error); }
+
+    bool listLevel(const QByteArray &prefix, QVector<QByteArray> *folders, const Page &page, QString *error) override;
+    bool listAll(const QByteArray &prefix, const Page &page, QString *error) override;
+
+private:
+    friend class S3UnitWriter;
+
+    S3Options options;
+    std::unique_ptr<S3Client> client;
+    std::unique_ptr<UploadStateStore> states;
+    std::unique_ptr<RemoteManifest> manifest;
+    QThreadPool partPool;
+};
+
+#endif // S3DESTINATION_H
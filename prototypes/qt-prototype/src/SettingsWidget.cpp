@@ -1,4 +1,9 @@
 #include "SettingsWidget.h"
+#include "RateLimiter.h"
+#include "ArchiveScrubber.h"
+#include <QFileDialog>
+#include <QSignalBlocker>
+#include <QStandardPaths>
 
 SettingsWidget::SettingsWidget(QWidget *parent)
     : QWidget(parent)
@@ -14,6 +19,8 @@ void SettingsWidget::setupUI()
     
     setupDestinationGroup();
     setupRulesGroup();
+    setupDurabilityGroup();
+    setupRateLimitGroup();
     
     // 情報表示ラベル
     infoLabel = new QLabel("設定を選択してください");
@@ -32,9 +39,10 @@ void SettingsWidget::setupUI()
     mainLayout->addStretch();
     
     // 初期設定
-    localRadio->setChecked(true);
+    localCheck->setChecked(true);
     dateFolderCheck->setChecked(true);
     duplicateCheck->setChecked(true);
+    skipImportedCheck->setChecked(true);
     
     // 全体のスタイル設定
     setStyleSheet(
@@ -72,21 +80,106 @@ void SettingsWidget::setupDestinationGroup()
     QVBoxLayout *destLayout = new QVBoxLayout(destinationGroup);
     destLayout->setSpacing(8);
     
-    localRadio = new QRadioButton("💻 ローカルストレージ");
-    dropboxRadio = new QRadioButton("☁️ Dropbox");
-    onedriveRadio = new QRadioButton("☁️ OneDrive");
-    s3Radio = new QRadioButton("🪣 Amazon S3");
+    // 複数選択すると、ソースを1回だけ読んで全出力先に書き込む
+    localCheck = new QCheckBox("💻 ローカルストレージ");
+    secondDiskCheck = new QCheckBox("💽 2台目のディスク");
+    dropboxCheck = new QCheckBox("☁️ Dropbox");
+    onedriveCheck = new QCheckBox("☁️ OneDrive");
+    s3Check = new QCheckBox("🪣 Amazon S3");
     
-    destLayout->addWidget(localRadio);
-    destLayout->addWidget(dropboxRadio);
-    destLayout->addWidget(onedriveRadio);
-    destLayout->addWidget(s3Radio);
+    destLayout->addWidget(localCheck);
+    
+    // ローカル出力先フォルダ
+    QHBoxLayout *pathLayout = new QHBoxLayout();
+    localPathEdit = new QLineEdit(QStandardPaths::writableLocation(QStandardPaths::PicturesLocation) + "/MediaTransfer");
+    browseButton = new QPushButton("参照");
+    pathLayout->addWidget(localPathEdit, 1);
+    pathLayout->addWidget(browseButton);
+    destLayout->addLayout(pathLayout);
+    
+    // 2台目のディスクの出力先フォルダ
+    destLayout->addWidget(secondDiskCheck);
+    secondDiskSettings = new QWidget();
+    QVBoxLayout *secondDiskLayout = new QVBoxLayout(secondDiskSettings);
+    secondDiskLayout->setContentsMargins(0, 0, 0, 0);
+    QHBoxLayout *secondPathLayout = new QHBoxLayout();
+    secondPathEdit = new QLineEdit();
+    secondPathEdit->setPlaceholderText("2台目のディスクの出力先フォルダ");
+    QPushButton *secondBrowseButton = new QPushButton("参照");
+    secondPathLayout->addWidget(secondPathEdit, 1);
+    secondPathLayout->addWidget(secondBrowseButton);
+    // チャンク単位で重複を除いて保存する（元のファイルの代わりにレシピを置く）
+    secondChunkCheck = new QCheckBox("🧩 チャンク単位で重複を除いて保存");
+    secondDiskLayout->addLayout(secondPathLayout);
+    secondDiskLayout->addWidget(secondChunkCheck);
+    secondDiskSettings->setVisible(false);
+    destLayout->addWidget(secondDiskSettings);
+    
+    destLayout->addWidget(dropboxCheck);
+    destLayout->addWidget(onedriveCheck);
+    destLayout->addWidget(s3Check);
+    
+    // Dropbox/OneDriveの保存先フォルダ（アクセストークンは環境変数から読み込む）
+    cloudFolderEdit = new QLineEdit("/MediaTransfer");
+    cloudFolderEdit->setPlaceholderText("クラウドの保存先フォルダ");
+    cloudFolderEdit->setVisible(false);
+    destLayout->addWidget(cloudFolderEdit);
+    
+    // S3の接続先（エンドポイントを指定するとMinIO等のS3互換ストレージに送る）
+    s3Settings = new QWidget();
+    QVBoxLayout *s3Layout = new QVBoxLayout(s3Settings);
+    s3Layout->setContentsMargins(0, 0, 0, 0);
+    s3BucketEdit = new QLineEdit();
+    s3BucketEdit->setPlaceholderText("バケット名");
+    s3RegionEdit = new QLineEdit("us-east-1");
+    s3RegionEdit->setPlaceholderText("リージョン");
+    s3EndpointEdit = new QLineEdit();
+    s3EndpointEdit->setPlaceholderText("エンドポイント（省略時はAWS）例: http://localhost:9000");
+    s3PrefixEdit = new QLineEdit();
+    s3PrefixEdit->setPlaceholderText("キーのプレフィックス（任意）");
+    s3Layout->addWidget(s3BucketEdit);
+    s3Layout->addWidget(s3RegionEdit);
+    s3Layout->addWidget(s3EndpointEdit);
+    s3Layout->addWidget(s3PrefixEdit);
+    
+    QHBoxLayout *uploadLayout = new QHBoxLayout();
+    s3PartSizeSpin = new QSpinBox();
+    s3PartSizeSpin->setRange(5, 512);
+    s3PartSizeSpin->setValue(8);
+    s3PartSizeSpin->setSuffix(" MB");
+    s3ConcurrencySpin = new QSpinBox();
+    s3ConcurrencySpin->setRange(1, 32);
+    s3ConcurrencySpin->setValue(4);
+    uploadLayout->addWidget(new QLabel("パート"));
+    uploadLayout->addWidget(s3PartSizeSpin);
+    uploadLayout->addWidget(new QLabel("同時"));
+    uploadLayout->addWidget(s3ConcurrencySpin);
+    s3Layout->addLayout(uploadLayout);
+    s3Settings->setVisible(false);
+    destLayout->addWidget(s3Settings);
+    
+    // 複数出力先の場合、遅い出力先の分をディスクに退避して他の出力先を待たせない
+    fanOutSettings = new QWidget();
+    QHBoxLayout *spillLayout = new QHBoxLayout(fanOutSettings);
+    spillLayout->setContentsMargins(0, 0, 0, 0);
+    spillCheck = new QCheckBox("🐢 遅い出力先の分を一時退避");
+    spillSizeSpin = new QSpinBox();
+    spillSizeSpin->setRange(1, 1024);
+    spillSizeSpin->setValue(8);
+    spillSizeSpin->setSuffix(" GB");
+    spillLayout->addWidget(spillCheck, 1);
+    spillLayout->addWidget(spillSizeSpin);
+    fanOutSettings->setVisible(false);
+    destLayout->addWidget(fanOutSettings);
     
     // シグナル接続
-    connect(localRadio, &QRadioButton::toggled, this, &SettingsWidget::onDestinationChanged);
-    connect(dropboxRadio, &QRadioButton::toggled, this, &SettingsWidget::onDestinationChanged);
-    connect(onedriveRadio, &QRadioButton::toggled, this, &SettingsWidget::onDestinationChanged);
-    connect(s3Radio, &QRadioButton::toggled, this, &SettingsWidget::onDestinationChanged);
+    connect(localCheck, &QCheckBox::toggled, this, &SettingsWidget::onDestinationChanged);
+    connect(secondDiskCheck, &QCheckBox::toggled, this, &SettingsWidget::onDestinationChanged);
+    connect(dropboxCheck, &QCheckBox::toggled, this, &SettingsWidget::onDestinationChanged);
+    connect(onedriveCheck, &QCheckBox::toggled, this, &SettingsWidget::onDestinationChanged);
+    connect(s3Check, &QCheckBox::toggled, this, &SettingsWidget::onDestinationChanged);
+    connect(browseButton, &QPushButton::clicked, this, &SettingsWidget::browseLocalDestination);
+    connect(secondBrowseButton, &QPushButton::clicked, this, &SettingsWidget::browseSecondDestination);
     
     mainLayout->addWidget(destinationGroup);
 }
@@ -101,27 +194,159 @@ void SettingsWidget::setupRulesGroup()
     
     dateFolderCheck = new QCheckBox("📅 日付別フォルダ作成");
     deviceFolderCheck = new QCheckBox("📱 デバイス別フォルダ作成");
+    // 撮影間隔でイベントに分け、日付の代わりにイベント毎のフォルダにする
+    eventFolderCheck = new QCheckBox("🎉 イベント別フォルダ作成（撮影間隔）");
+    eventFolderCheck->setToolTip("前後の撮影間隔より長い空白で区切り、カメラ毎の時計のずれも補正します");
+    // GPSの位置をアプリに同梱の地名データで引く（ネットワークは使わない）
+    placeFolderCheck = new QCheckBox("📍 場所別フォルダ作成（GPS）");
+    placeFolderCheck->setToolTip("近くに地名がない場合は撮影位置のまとまりの座標をフォルダ名にします");
     duplicateCheck = new QCheckBox("🔍 重複ファイル検出");
     
     rulesLayout->addWidget(dateFolderCheck);
     rulesLayout->addWidget(deviceFolderCheck);
+    rulesLayout->addWidget(eventFolderCheck);
+    rulesLayout->addWidget(placeFolderCheck);
     rulesLayout->addWidget(duplicateCheck);
     
+    // 取り込み済みファイルの目録にあるファイルは、カードを挿し直しても読まずに飛ばす
+    skipImportedCheck = new QCheckBox("⏭️ 取り込み済みのファイルを飛ばす");
+    rulesLayout->addWidget(skipImportedCheck);
+    
+    // 動画をチャンクに分割し、切り取り・書き出し直しで取り込み済みの内容と重なる量を報告する
+    chunkDedupCheck = new QCheckBox("🎞️ 動画の部分的な重複を集計");
+    rulesLayout->addWidget(chunkDedupCheck);
+    
+    // 類似画像の検出（知覚ハッシュのハミング距離が閾値以下なら報告）
+    similarCheck = new QCheckBox("🖼️ 類似画像の検出");
+    similarRadiusSpin = new QSpinBox();
+    similarRadiusSpin->setRange(1, 20);
+    similarRadiusSpin->setValue(8);
+    similarRadiusSpin->setPrefix("距離 ≤ ");
+    similarRadiusSpin->setToolTip("小さいほど厳しく判定します（64ビット中の異なるビット数）");
+    QHBoxLayout *similarLayout = new QHBoxLayout();
+    similarLayout->addWidget(similarCheck, 1);
+    similarLayout->addWidget(similarRadiusSpin);
+    rulesLayout->addLayout(similarLayout);
+    
+    // ファイル名テンプレート（{date}_{time}_{camera}_{sequence} など）
+    fileNameTemplateEdit = new QLineEdit("{name}");
+    fileNameTemplateEdit->setPlaceholderText("{date}_{time}_{camera}_{sequence}");
+    fileNameTemplateEdit->setToolTip("使用可能: {year} {month} {day} {date} {time} {camera} {device} {event} {place} {name} {sequence}");
+    rulesLayout->addWidget(new QLabel("📝 ファイル名"));
+    rulesLayout->addWidget(fileNameTemplateEdit);
+    
     // シグナル接続
     connect(dateFolderCheck, &QCheckBox::toggled, this, &SettingsWidget::onRuleChanged);
     connect(deviceFolderCheck, &QCheckBox::toggled, this, &SettingsWidget::onRuleChanged);
+    connect(eventFolderCheck, &QCheckBox::toggled, this, &SettingsWidget::onRuleChanged);
+    connect(placeFolderCheck, &QCheckBox::toggled, this, &SettingsWidget::onRuleChanged);
     connect(duplicateCheck, &QCheckBox::toggled, this, &SettingsWidget::onRuleChanged);
+    connect(skipImportedCheck, &QCheckBox::toggled, this, &SettingsWidget::onRuleChanged);
+    connect(similarCheck, &QCheckBox::toggled, this, &SettingsWidget::onRuleChanged);
+    connect(chunkDedupCheck, &QCheckBox::toggled, this, &SettingsWidget::onRuleChanged);
+    connect(fileNameTemplateEdit, &QLineEdit::editingFinished, this, &SettingsWidget::onRuleChanged);
     
     mainLayout->addWidget(rulesGroup);
 }
 
-QString SettingsWidget::getDestination() const
+void SettingsWidget::setupDurabilityGroup()
+{
+    durabilityGroup = new QGroupBox("💾 書き込み保証");
+    durabilityGroup->setObjectName("durabilityGroup");
+    
+    QVBoxLayout *durabilityLayout = new QVBoxLayout(durabilityGroup);
+    durabilityLayout->setSpacing(8);
+    
+    durabilityCombo = new QComboBox();
+    durabilityCombo->addItem("まとめてfsync（推奨）", durabilityModeName(DurabilityMode::Batched));
+    durabilityCombo->addItem("チェックポイント毎にsyncfs", durabilityModeName(DurabilityMode::SyncFs));
+    durabilityCombo->addItem("ファイル毎にfsync", durabilityModeName(DurabilityMode::PerFile));
+    durabilityCombo->addItem("同期しない", durabilityModeName(DurabilityMode::None));
+    
+    // 書き込んだ内容をキャッシュを通さずに読み戻し、コピー中のハッシュと比較する
+    verifyCheck = new QCheckBox("🔎 コピー後に読み戻して検証");
+    
+    durabilityLayout->addWidget(durabilityCombo);
+    durabilityLayout->addWidget(verifyCheck);
+    
+    connect(durabilityCombo, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &SettingsWidget::onRuleChanged);
+    connect(verifyCheck, &QCheckBox::toggled, this, &SettingsWidget::onRuleChanged);
+    
+    mainLayout->addWidget(durabilityGroup);
+}
+
+void SettingsWidget::setupRateLimitGroup()
+{
+    rateLimitGroup = new QGroupBox("🚦 速度制限");
+    rateLimitGroup->setObjectName("rateLimitGroup");
+    
+    QVBoxLayout *rateLayout = new QVBoxLayout(rateLimitGroup);
+    rateLayout->setSpacing(8);
+    
+    // 対象（全体の合計または出力先毎）を選んで上限を設定する。0は無制限
+    rateScopeCombo = new QComboBox();
+    rateScopeCombo->addItem("全体", RateLimiter::globalScope());
+    rateScopeCombo->addItem("ローカル", "local");
+    rateScopeCombo->addItem("Dropbox", "dropbox");
+    rateScopeCombo->addItem("OneDrive", "onedrive");
+    rateScopeCombo->addItem("Amazon S3", "s3");
+    rateScopeCombo->addItem("出力先の検査", ArchiveScrubber::rateScope());
+    
+    rateBandwidthSpin = new QSpinBox();
+    rateBandwidthSpin->setRange(0, 100000);
+    rateBandwidthSpin->setSuffix(" MB/s");
+    rateBandwidthSpin->setSpecialValueText("無制限");
+    
+    rateOperationsSpin = new QSpinBox();
+    rateOperationsSpin->setRange(0, 100000);
+    rateOperationsSpin->setSuffix(" ファイル/s");
+    rateOperationsSpin->setSpecialValueText("無制限");
+    
+    QHBoxLayout *spinLayout = new QHBoxLayout();
+    spinLayout->addWidget(rateBandwidthSpin);
+    spinLayout->addWidget(rateOperationsSpin);
+    
+    idleIoCheck = new QCheckBox("💤 他のディスク操作を優先（アイドルI/O）");
+    idleIoCheck->setChecked(RateLimiter::instance()->idleIoPriority());
+    
+    rateLayout->addWidget(rateScopeCombo);
+    rateLayout->addLayout(spinLayout);
+    rateLayout->addWidget(idleIoCheck);
+    
+    connect(rateScopeCombo, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &SettingsWidget::onRateScopeChanged);
+    connect(rateBandwidthSpin, QOverload<int>::of(&QSpinBox::valueChanged), this, &SettingsWidget::onRateLimitChanged);
+    connect(rateOperationsSpin, QOverload<int>::of(&QSpinBox::valueChanged), this, &SettingsWidget::onRateLimitChanged);
+    connect(idleIoCheck, &QCheckBox::toggled, this, &SettingsWidget::onIdleIoChanged);
+    
+    onRateScopeChanged();
+    mainLayout->addWidget(rateLimitGroup);
+}
+
+QStringList SettingsWidget::getDestinations() const
 {
-    if (localRadio->isChecked()) return "local";
-    if (dropboxRadio->isChecked()) return "dropbox";
-    if (onedriveRadio->isChecked()) return "onedrive";
-    if (s3Radio->isChecked()) return "s3";
-    return "local";
+    QStringList destinations;
+    if (localCheck->isChecked()) destinations << "local";
+    if (secondDiskCheck->isChecked() && !secondPathEdit->text().trimmed().isEmpty()) {
+        destinations << (secondChunkCheck->isChecked() ? "chunks:" : "local:") + secondPathEdit->text().trimmed();
+    }
+    if (dropboxCheck->isChecked()) destinations << "dropbox";
+    if (onedriveCheck->isChecked()) destinations << "onedrive";
+    if (s3Check->isChecked()) destinations << "s3";
+    return destinations;
+}
+
+QString SettingsWidget::getLocalDestinationPath() const
+{
+    return localPathEdit->text();
+}
+
+FanOutOptions SettingsWidget::getFanOutOptions() const
+{
+    FanOutOptions options;
+    if (spillCheck->isChecked()) {
+        options.spillBytes = static_cast<qint64>(spillSizeSpin->value()) * 1024 * 1024 * 1024;
+    }
+    return options;
 }
 
 bool SettingsWidget::getDateFolderEnabled() const
@@ -134,27 +359,160 @@ bool SettingsWidget::getDeviceFolderEnabled() const
     return deviceFolderCheck->isChecked();
 }
 
+bool SettingsWidget::getEventFolderEnabled() const
+{
+    return eventFolderCheck->isChecked();
+}
+
+bool SettingsWidget::getPlaceFolderEnabled() const
+{
+    return placeFolderCheck->isChecked();
+}
+
 bool SettingsWidget::getDuplicateCheckEnabled() const
 {
     return duplicateCheck->isChecked();
 }
 
+bool SettingsWidget::getSkipImportedEnabled() const
+{
+    return skipImportedCheck->isChecked();
+}
+
+bool SettingsWidget::getChunkDedupEnabled() const
+{
+    return chunkDedupCheck->isChecked();
+}
+
+int SettingsWidget::getSimilarImageRadius() const
+{
+    return similarCheck->isChecked() ? similarRadiusSpin->value() : 0;
+}
+
+QString SettingsWidget::getFolderTemplate() const
+{
+    QStringList parts;
+    // イベント名は開始日時を含むため、日付別と併用する場合は年のフォルダの下に置く
+    if (getEventFolderEnabled()) {
+        parts << (getDateFolderEnabled() ? "{year}/{event}" : "{event}");
+    } else if (getDateFolderEnabled()) {
+        parts << "{year}/{month}/{day}";
+    }
+    if (getPlaceFolderEnabled()) parts << "{place}";
+    if (getDeviceFolderEnabled()) parts << "{device}";
+    return parts.join("/");
+}
+
+QString SettingsWidget::getFileNameTemplate() const
+{
+    QString pattern = fileNameTemplateEdit->text().trimmed();
+    return pattern.isEmpty() ? QString("{name}") : pattern;
+}
+
+DurabilityMode SettingsWidget::getDurabilityMode() const
+{
+    return durabilityModeFromName(durabilityCombo->currentData().toString());
+}
+
+bool SettingsWidget::getVerifyEnabled() const
+{
+    return verifyCheck->isChecked();
+}
+
+S3Options SettingsWidget::getS3Options() const
+{
+    S3Options options;
+    options.bucket = s3BucketEdit->text().trimmed();
+    options.region = s3RegionEdit->text().trimmed();
+    options.endpoint = s3EndpointEdit->text().trimmed();
+    options.prefix = s3PrefixEdit->text().trimmed();
+    options.partSize = static_cast<qint64>(s3PartSizeSpin->value()) * 1024 * 1024;
+    options.concurrency = s3ConcurrencySpin->value();
+    return options;
+}
+
+DropboxOptions SettingsWidget::getDropboxOptions() const
+{
+    DropboxOptions options;
+    options.folder = cloudFolderEdit->text().trimmed();
+    return options;
+}
+
+OneDriveOptions SettingsWidget::getOneDriveOptions() const
+{
+    OneDriveOptions options;
+    options.folder = cloudFolderEdit->text().trimmed();
+    return options;
+}
+
+void SettingsWidget::browseLocalDestination()
+{
+    QString dir = QFileDialog::getExistingDirectory(this, "出力先フォルダを選択", localPathEdit->text());
+    if (!dir.isEmpty()) {
+        localPathEdit->setText(dir);
+        emit settingsChanged();
+    }
+}
+
+void SettingsWidget::browseSecondDestination()
+{
+    QString dir = QFileDialog::getExistingDirectory(this, "2台目の出力先フォルダを選択", secondPathEdit->text());
+    if (!dir.isEmpty()) {
+        secondPathEdit->setText(dir);
+        emit settingsChanged();
+    }
+}
+
 void SettingsWidget::onDestinationChanged()
 {
-    QString destination = getDestination();
-    QString info = "出力先: ";
-    
-    if (destination == "local") {
-        info += "ローカルストレージ";
-    } else if (destination == "dropbox") {
-        info += "Dropbox クラウド";
-    } else if (destination == "onedrive") {
-        info += "OneDrive クラウド";
-    } else if (destination == "s3") {
-        info += "Amazon S3";
+    // 出力先は最低1つ必要
+    if (!localCheck->isChecked() && !secondDiskCheck->isChecked() && !dropboxCheck->isChecked()
+        && !onedriveCheck->isChecked() && !s3Check->isChecked()) {
+        localCheck->setChecked(true);
+        return;
     }
     
-    infoLabel->setText(info);
+    localPathEdit->setVisible(localCheck->isChecked());
+    browseButton->setVisible(localCheck->isChecked());
+    secondDiskSettings->setVisible(secondDiskCheck->isChecked());
+    cloudFolderEdit->setVisible(dropboxCheck->isChecked() || onedriveCheck->isChecked());
+    s3Settings->setVisible(s3Check->isChecked());
+    
+    QStringList names;
+    if (localCheck->isChecked()) names << "ローカルストレージ";
+    if (secondDiskCheck->isChecked()) names << "2台目のディスク";
+    if (dropboxCheck->isChecked()) names << "Dropbox クラウド";
+    if (onedriveCheck->isChecked()) names << "OneDrive クラウド";
+    if (s3Check->isChecked()) names << "Amazon S3";
+    fanOutSettings->setVisible(names.size() > 1);
+    
+    infoLabel->setText("出力先: " + names.join(" + "));
+    emit settingsChanged();
+}
+
+void SettingsWidget::onRateScopeChanged()
+{
+    // 選んだ対象の現在の上限を表示する（変更として反映しないようシグナルを止める）
+    const RateLimit limit = RateLimiter::instance()->limit(rateScopeCombo->currentData().toString());
+    const QSignalBlocker bandwidthBlocker(rateBandwidthSpin);
+    const QSignalBlocker operationsBlocker(rateOperationsSpin);
+    rateBandwidthSpin->setValue(qRound(limit.megabytesPerSecond));
+    rateOperationsSpin->setValue(qRound(limit.operationsPerSecond));
+}
+
+void SettingsWidget::onRateLimitChanged()
+{
+    // 実行中のジョブもRateLimiterのバケットを参照しているため、再起動せずに反映される
+    RateLimit limit;
+    limit.megabytesPerSecond = rateBandwidthSpin->value();
+    limit.operationsPerSecond = rateOperationsSpin->value();
+    RateLimiter::instance()->setLimit(rateScopeCombo->currentData().toString(), limit);
+    emit settingsChanged();
+}
+
+void SettingsWidget::onIdleIoChanged(bool idle)
+{
+    RateLimiter::instance()->setIdleIoPriority(idle);
     emit settingsChanged();
 }
 
@@ -164,9 +522,15 @@ void SettingsWidget::onRuleChanged()
     
     if (getDateFolderEnabled()) rules << "日付別フォルダ";
     if (getDeviceFolderEnabled()) rules << "デバイス別フォルダ";
+    if (getEventFolderEnabled()) rules << "イベント別フォルダ";
+    if (getPlaceFolderEnabled()) rules << "場所別フォルダ";
     if (getDuplicateCheckEnabled()) rules << "重複検出";
+    if (getSkipImportedEnabled()) rules << "取り込み済みをスキップ";
+    if (getVerifyEnabled()) rules << "読み戻し検証";
+    if (getSimilarImageRadius() > 0) rules << "類似画像検出";
+    if (getChunkDedupEnabled()) rules << "動画の部分重複集計";
     
-    QString info = "出力先: " + getDestination();
+    QString info = "出力先: " + getDestinations().join(" + ");
     if (!rules.isEmpty()) {
         info += "\n適用ルール: " + rules.join(", ");
     }
@@ -174,5 +538,3 @@ void SettingsWidget::onRuleChanged()
     infoLabel->setText(info);
     emit settingsChanged();
 }
-
-#include "SettingsWidget.moc"
\ No newline at end of file
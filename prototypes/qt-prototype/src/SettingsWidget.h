@@ -9,6 +9,13 @@
 #include <QCheckBox>
 #include <QLabel>
 #include <QFrame>
+#include <QLineEdit>
+#include <QPushButton>
+#include <QComboBox>
+#include <QSpinBox>
+#include "DurabilityPolicy.h"
+#include "CloudOptions.h"
+#include "FanOutDestination.h"
 
 class SettingsWidget : public QWidget
 {
@@ -18,10 +25,24 @@ public:
     explicit SettingsWidget(QWidget *parent = nullptr);
     
     // 設定値の取得
-    QString getDestination() const;
+    QStringList getDestinations() const;
+    QString getLocalDestinationPath() const;
+    FanOutOptions getFanOutOptions() const;
     bool getDateFolderEnabled() const;
     bool getDeviceFolderEnabled() const;
+    bool getEventFolderEnabled() const;
+    bool getPlaceFolderEnabled() const;
     bool getDuplicateCheckEnabled() const;
+    bool getSkipImportedEnabled() const;
+    int getSimilarImageRadius() const;
+    bool getChunkDedupEnabled() const;
+    QString getFolderTemplate() const;
+    QString getFileNameTemplate() const;
+    DurabilityMode getDurabilityMode() const;
+    bool getVerifyEnabled() const;
+    S3Options getS3Options() const;
+    DropboxOptions getDropboxOptions() const;
+    OneDriveOptions getOneDriveOptions() const;
 
 signals:
     void settingsChanged();
@@ -29,26 +50,75 @@ signals:
 private slots:
     void onDestinationChanged();
     void onRuleChanged();
+    void browseLocalDestination();
+    void browseSecondDestination();
+    void onRateScopeChanged();
+    void onRateLimitChanged();
+    void onIdleIoChanged(bool idle);
 
 private:
     void setupUI();
     void setupDestinationGroup();
     void setupRulesGroup();
+    void setupDurabilityGroup();
+    void setupRateLimitGroup();
     
     QVBoxLayout *mainLayout;
     
     // 出力先設定
     QGroupBox *destinationGroup;
-    QRadioButton *localRadio;
-    QRadioButton *dropboxRadio;
-    QRadioButton *onedriveRadio;
-    QRadioButton *s3Radio;
+    QCheckBox *localCheck;
+    QCheckBox *secondDiskCheck;
+    QCheckBox *dropboxCheck;
+    QCheckBox *onedriveCheck;
+    QCheckBox *s3Check;
+    QLineEdit *localPathEdit;
+    QPushButton *browseButton;
+    QWidget *secondDiskSettings;
+    QLineEdit *secondPathEdit;
+    QCheckBox *secondChunkCheck;
+    
+    // 複数出力先の設定（遅い出力先の分をディスクに退避）
+    QWidget *fanOutSettings;
+    QCheckBox *spillCheck;
+    QSpinBox *spillSizeSpin;
+    
+    // Dropbox/OneDriveの保存先フォルダ
+    QLineEdit *cloudFolderEdit;
+    
+    // S3設定（認証情報は環境変数から読み込む）
+    QWidget *s3Settings;
+    QLineEdit *s3BucketEdit;
+    QLineEdit *s3RegionEdit;
+    QLineEdit *s3EndpointEdit;
+    QLineEdit *s3PrefixEdit;
+    QSpinBox *s3PartSizeSpin;
+    QSpinBox *s3ConcurrencySpin;
     
     // 整理ルール設定
     QGroupBox *rulesGroup;
     QCheckBox *dateFolderCheck;
     QCheckBox *deviceFolderCheck;
+    QCheckBox *eventFolderCheck;
+    QCheckBox *placeFolderCheck;
     QCheckBox *duplicateCheck;
+    QCheckBox *skipImportedCheck;
+    QCheckBox *chunkDedupCheck;
+    QCheckBox *similarCheck;
+    QSpinBox *similarRadiusSpin;
+    QLineEdit *fileNameTemplateEdit;
+    
+    // 書き込み保証設定
+    QGroupBox *durabilityGroup;
+    QComboBox *durabilityCombo;
+    QCheckBox *verifyCheck;
+    
+    // 速度制限（実行中のジョブにもすぐ反映する）
+    QGroupBox *rateLimitGroup;
+    QComboBox *rateScopeCombo;
+    QSpinBox *rateBandwidthSpin;
+    QSpinBox *rateOperationsSpin;
+    QCheckBox *idleIoCheck;
     
     // 情報表示
     QLabel *infoLabel;
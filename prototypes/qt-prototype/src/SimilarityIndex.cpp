@@ -0,0 +1,118 @@
+#include "SimilarityIndex.h"
+#include <QCryptographicHash>
+#include <QDir>
+#include <QReadLocker>
+#include <QStandardPaths>
+#include <QWriteLocker>
+
+SimilarityIndex::SimilarityIndex(const QString &destinationId)
+{
+    const QByteArray id = QCryptographicHash::hash(destinationId.toUtf8(), QCryptographicHash::Sha1).toHex();
+    const QString directory = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/similarity";
+    QDir().mkpath(directory);
+    path = directory + "/" + QString::fromLatin1(id) + ".tsv";
+}
+
+bool SimilarityIndex::open(QString *error)
+{
+    QWriteLocker locker(&lock);
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadWrite | QIODevice::Append)) {
+        *error = "類似画像の索引を開けません: " + file.errorString();
+        return false;
+    }
+
+    // 書式: pHash \t dHash \t path（16進）
+    file.seek(0);
+    while (!file.atEnd()) {
+        const QList<QByteArray> fields = file.readLine().trimmed().split('\t');
+        if (fields.size() < 3) {
+            continue;
+        }
+        PerceptualHash hash;
+        hash.pHash = fields[0].toULongLong(nullptr, 16);
+        hash.dHash = fields[1].toULongLong(nullptr, 16);
+        itemPaths.append(QString::fromUtf8(fields[2]));
+        insert(hash, static_cast<int>(itemPaths.size()) - 1);
+    }
+    file.seek(file.size());
+    return true;
+}
+
+QVector<SimilarityIndex::Match> SimilarityIndex::find(const PerceptualHash &hash, int radius) const
+{
+    QVector<Match> matches;
+    QReadLocker locker(&lock);
+    if (nodes.isEmpty()) {
+        return matches;
+    }
+
+    QVector<int> stack;
+    stack.append(0);
+    while (!stack.isEmpty()) {
+        const Node &node = nodes.at(stack.takeLast());
+        const int distance = PerceptualHash::distance(node.pHash, hash.pHash);
+        if (distance <= radius && PerceptualHash::distance(node.dHash, hash.dHash) <= radius) {
+            matches.append({itemPaths.at(node.item), distance});
+        }
+        // 三角不等式により、距離が範囲外の辺の先には半径内のものはない
+        for (int child = node.firstChild; child >= 0; child = nodes.at(child).nextSibling) {
+            const int edge = nodes.at(child).distance;
+            if (edge >= distance - radius && edge <= distance + radius) {
+                stack.append(child);
+            }
+        }
+    }
+    return matches;
+}
+
+bool SimilarityIndex::add(const PerceptualHash &hash, const QString &itemPath)
+{
+    {
+        QWriteLocker locker(&lock);
+        itemPaths.append(itemPath);
+        insert(hash, static_cast<int>(itemPaths.size()) - 1);
+    }
+
+    const QByteArray line = QByteArray::number(hash.pHash, 16) + '\t' + QByteArray::number(hash.dHash, 16) + '\t'
+                          + itemPath.toUtf8() + '\n';
+    QMutexLocker locker(&fileMutex);
+    return file.write(line) == line.size() && file.flush();
+}
+
+int SimilarityIndex::count() const
+{
+    QReadLocker locker(&lock);
+    return static_cast<int>(itemPaths.size());
+}
+
+void SimilarityIndex::insert(const PerceptualHash &hash, int item)
+{
+    Node added;
+    added.pHash = hash.pHash;
+    added.dHash = hash.dHash;
+    added.item = item;
+    if (nodes.isEmpty()) {
+        nodes.append(added);
+        return;
+    }
+
+    // 根から、同じ距離の辺がある限りたどる
+    int current = 0;
+    while (true) {
+        const int distance = PerceptualHash::distance(nodes.at(current).pHash, hash.pHash);
+        int child = nodes.at(current).firstChild;
+        while (child >= 0 && nodes.at(child).distance != distance) {
+            child = nodes.at(child).nextSibling;
+        }
+        if (child < 0) {
+            added.distance = distance;
+            added.nextSibling = nodes.at(current).firstChild;
+            const int index = static_cast<int>(nodes.size());
+            nodes.append(added);
+            nodes[current].firstChild = index;
+            return;
+        }
+        current = child;
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef SIMILARITYINDEX_H
+#define SIMILARITYINDEX_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QFile>
+#include <QReadWriteLock>
+#include <QMutex>
+#include "PerceptualHash.h"
+
+// 知覚ハッシュの索引（BK木）
+// ハミング距離は三角不等式を満たすため、半径r以内の検索では親との距離がdの子のうち
+// [d-r, d+r] の辺の先だけをたどればよく、百万枚規模でも全件と比較せずに済む。
+// 木はpHashで作り、候補はdHashの距離でも絞り込む。
+// 取り込んだ画像は出力先毎のファイルに追記し、開くときに読み込んで木を作り直す。
+class SimilarityIndex
+{
+public:
+    struct Match
+    {
+        QString path;
+        int distance = 0;               // pHashのハミング距離
+    };
+
+    // destinationIdは出力先を区別する文字列（ローカルなら出力先フォルダ）
+    explicit SimilarityIndex(const QString &destinationId);
+
+    bool open(QString *error);
+
+    // 任意のスレッドから呼べる
+    QVector<Match> find(const PerceptualHash &hash, int radius) const;
+    bool add(const PerceptualHash &hash, const QString &path);
+
+    int count() const;
+    QString filePath() const { return path; }
+
+private:
+    struct Node
+    {
+        quint64 pHash = 0;
+        quint64 dHash = 0;
+        int item = 0;                   // itemPathsの位置
+        int distance = 0;               // 親との距離
+        int firstChild = -1;
+        int nextSibling = -1;
+    };
+
+    void insert(const PerceptualHash &hash, int item);
+
+    QString path;
+    QVector<Node> nodes;                // nodes[0]が根
+    QStringList itemPaths;
+    mutable QReadWriteLock lock;
+
+    QMutex fileMutex;
+    QFile file;
+};
+
+#endif // SIMILARITYINDEX_H
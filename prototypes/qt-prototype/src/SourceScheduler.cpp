@@ -0,0 +1,115 @@
+#include "SourceScheduler.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <QStorageInfo>
+#include <QWaitCondition>
+
+namespace {
+
+// デバイス毎の読み込み中の組の数（プロセス全体で共有する）
+struct ReaderSlots
+{
+    QMutex mutex;
+    QWaitCondition changed;
+    QHash<QString, int> inFlight;
+};
+
+Q_GLOBAL_STATIC(ReaderSlots, readerSlots)
+
+} // namespace
+
+SourceScheduler::SourceScheduler(int readersPerSource)
+    : readersPerSource(qMax(1, readersPerSource))
+{
+}
+
+SourceScheduler::~SourceScheduler()
+{
+    // 読み込み中のまま終わった組の分を返す
+    QMutexLocker locker(&readerSlots()->mutex);
+    for (auto it = unitSource.constBegin(); it != unitSource.constEnd(); ++it) {
+        readerSlots()->inFlight[sources.at(it.value()).device] -= 1;
+    }
+    readerSlots()->changed.wakeAll();
+}
+
+void SourceScheduler::addUnit(const QString &source, int unitIndex)
+{
+    auto it = sourceIndex.constFind(source);
+    int index = 0;
+    if (it == sourceIndex.constEnd()) {
+        index = sources.size();
+        Source added;
+        added.device = source;
+        sources.append(added);
+        sourceIndex.insert(source, index);
+    } else {
+        index = it.value();
+    }
+    sources[index].units.append(unitIndex);
+    ++remaining;
+}
+
+void SourceScheduler::setWeight(const QString &source, int weight)
+{
+    auto it = sourceIndex.constFind(source);
+    if (it != sourceIndex.constEnd()) {
+        sources[it.value()].weight = qMax(1, weight);
+    }
+}
+
+int SourceScheduler::take(const QAtomicInt &cancelled)
+{
+    ReaderSlots *readers = readerSlots();
+    QMutexLocker locker(&readers->mutex);
+    while (remaining > 0 && !cancelled.loadRelaxed()) {
+        // 上限に空きがあるソースのうち、読んだ量÷重みが最も小さいものを選ぶ
+        int best = -1;
+        for (int i = 0; i < sources.size(); ++i) {
+            const int candidate = (cursor + i) % sources.size();
+            const Source &source = sources.at(candidate);
+            if (source.next >= source.units.size() || readers->inFlight.value(source.device) >= readersPerSource) {
+                continue;
+            }
+            if (best < 0 || source.servedBytes * sources.at(best).weight < sources.at(best).servedBytes * source.weight) {
+                best = candidate;
+            }
+        }
+
+        if (best >= 0) {
+            Source &source = sources[best];
+            const int unit = source.units.at(source.next++);
+            --remaining;
+            readers->inFlight[source.device] += 1;
+            unitSource.insert(unit, best);
+            cursor = (best + 1) % sources.size();
+            return unit;
+        }
+        // キャンセルに気付けるよう、時間を区切って待つ
+        readers->changed.wait(&readers->mutex, 100);
+    }
+    return -1;
+}
+
+void SourceScheduler::done(int unitIndex, qint64 bytesRead)
+{
+    ReaderSlots *readers = readerSlots();
+    QMutexLocker locker(&readers->mutex);
+    auto it = unitSource.find(unitIndex);
+    if (it == unitSource.end()) {
+        return;
+    }
+    Source &source = sources[it.value()];
+    // 小さなファイルばかりのソースも進むよう、組毎に最低限の量を数える
+    source.servedBytes += qMax<qint64>(bytesRead, 64 * 1024);
+    readers->inFlight[source.device] -= 1;
+    unitSource.erase(it);
+    readers->changed.wakeAll();
+}
+
+QString SourceScheduler::sourceOf(const QString &directory)
+{
+    const QStorageInfo storage(directory);
+    const QByteArray device = storage.device();
+    return device.isEmpty() ? storage.rootPath() : QString::fromLocal8Bit(device);
+}
@@ -0,0 +1,50 @@
+#ifndef SOURCESCHEDULER_H
+#define SOURCESCHEDULER_H
+
+#include <QString>
+#include <QHash>
+#include <QVector>
+#include <QAtomicInt>
+
+// 複数のソース（カードリーダー等のデバイス）からの読み込みの割り振り
+// 組をソース毎のキューに分け、ワーカーが次に読む組を重み付き公平キューイングで選ぶ。
+// 読んだバイト数÷重みが最も小さいソースを優先するため、速いカードが遅いカードに
+// 待たされることはなく、遅いカードが後回しにされ続けることもない。
+// ソース毎の同時読み込み数はプロセス全体で制限し、同時に動く複数のジョブで共有する。
+class SourceScheduler
+{
+public:
+    explicit SourceScheduler(int readersPerSource);
+    ~SourceScheduler();
+
+    void addUnit(const QString &source, int unitIndex);
+    void setWeight(const QString &source, int weight);
+    int sourceCount() const { return sources.size(); }
+
+    // 次に読む組を返す（残りがなければ-1）。どのソースも読み込み数の上限に達していれば空くまで待つ
+    int take(const QAtomicInt &cancelled);
+    // 組の読み込みが終わったら、読んだバイト数とともに呼ぶ
+    void done(int unitIndex, qint64 bytesRead);
+
+    // ファイルが置かれているデバイスの識別子
+    static QString sourceOf(const QString &directory);
+
+private:
+    struct Source
+    {
+        QString device;
+        int weight = 1;
+        QVector<int> units;
+        int next = 0;
+        qint64 servedBytes = 0;
+    };
+
+    int readersPerSource;
+    QVector<Source> sources;
+    QHash<QString, int> sourceIndex;
+    QHash<int, int> unitSource;     // 読み込み中の組 → ソース
+    int remaining = 0;
+    int cursor = 0;                 // 同じ優先度のソースを順に選ぶための位置
+};
+
+#endif // SOURCESCHEDULER_H
@@ -0,0 +1,269 @@
+#include "StageTrace.h"
+#include <QAtomicInteger>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QSaveFile>
+#include <QTemporaryFile>
+#include <QThread>
+#include <memory>
+#include <vector>
+
+namespace {
+
+// スレッド毎のバッファに入れる区間の数（一杯になったら一時ファイルに書き出して空ける）
+const int blockEvents = 1024;
+
+// この大きさごとにファイルへ書き出す
+const int writeChunkBytes = 1024 * 1024;
+
+struct Event
+{
+    const char *stage;
+    qint64 startNs;
+    qint64 endNs;
+    qint64 bytes;
+    QString detail;
+    quint64 asyncId;        // 0はスレッドの区間
+};
+
+// 書くのは持ち主のスレッドだけ。件数を公開（release）してから読む側に見える
+// 件数を0に戻すのはレジストリのロックを持っている間だけ
+struct ThreadBuffer
+{
+    int threadId = 0;
+    QString name;
+    QByteArray ids;         // ",\"pid\":…,\"tid\":…"
+    Event events[blockEvents];
+    QAtomicInt count;
+};
+
+// スレッドのバッファの一覧（登録はスレッド毎に一度だけなのでロックしてよい）
+struct TraceRegistry
+{
+    ThreadBuffer *registerThread()
+    {
+        QMutexLocker locker(&mutex);
+        auto buffer = std::make_unique<ThreadBuffer>();
+        buffer->threadId = static_cast<int>(buffers.size()) + 1;
+        const QString objectName = QThread::currentThread()->objectName();
+        buffer->name = objectName.isEmpty() ? QString("スレッド %1").arg(buffer->threadId) : objectName;
+        buffer->ids = ",\"pid\":" + QByteArray::number(QCoreApplication::applicationPid())
+                      + ",\"tid\":" + QByteArray::number(buffer->threadId);
+        buffers.push_back(std::move(buffer));
+        return buffers.back().get();
+    }
+
+    QMutex mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    QString path;
+    QElapsedTimer clock;
+    QAtomicInteger<quint64> nextAsyncId;
+    // 一杯になったバッファの区間を書き出す先（finish() でトレースのファイルに写す）
+    std::unique_ptr<QTemporaryFile> spill;
+    bool spillFailed = false;
+};
+
+Q_GLOBAL_STATIC(TraceRegistry, registry)
+
+thread_local ThreadBuffer *currentBuffer = nullptr;
+
+void appendString(QByteArray &json, const QByteArray &utf8)
+{
+    static const char hex[] = "0123456789abcdef";
+    json += '"';
+    for (const char c : utf8) {
+        const uchar u = static_cast<uchar>(c);
+        if (c == '"' || c == '\\') {
+            json += '\\';
+            json += c;
+        } else if (u < 0x20) {
+            json += "\\u00";
+            json += hex[u >> 4];
+            json += hex[u & 0xf];
+        } else {
+            json += c;
+        }
+    }
+    json += '"';
+}
+
+// ナノ秒をトレースの単位（マイクロ秒）にする
+QByteArray microseconds(qint64 ns)
+{
+    return QByteArray::number(ns / 1000.0, 'f', 3);
+}
+
+void appendHeader(QByteArray &json, const Event &event, const char *phase, qint64 ts, const QByteArray &ids)
+{
+    json += "{\"name\":";
+    appendString(json, event.stage);
+    json += ",\"cat\":\"";
+    json += event.asyncId ? "async" : "stage";
+    json += "\",\"ph\":\"";
+    json += phase;
+    json += "\",\"ts\":" + microseconds(ts) + ids;
+}
+
+void appendArgs(QByteArray &json, const Event &event)
+{
+    json += ",\"args\":{";
+    bool first = true;
+    if (!event.detail.isEmpty()) {
+        json += "\"path\":";
+        appendString(json, event.detail.toUtf8());
+        first = false;
+    }
+    if (event.bytes > 0) {
+        json += first ? "" : ",";
+        json += "\"bytes\":" + QByteArray::number(event.bytes);
+    }
+    json += "}}";
+}
+
+// 要素はそれぞれ前に区切り（",\n"）を付ける。配列の最初の要素はメタデータで、区切りを付けない
+void appendEvent(QByteArray &json, const Event &event, const QByteArray &ids)
+{
+    json += ",\n";
+    if (event.asyncId == 0) {
+        appendHeader(json, event, "X", event.startNs, ids);
+        json += ",\"dur\":" + microseconds(event.endNs - event.startNs);
+        appendArgs(json, event);
+        return;
+    }
+    // スレッドをまたぐ区間は開始と終了の組にする（同じスレッドの区間と重なってもよい）
+    const QByteArray asyncIds = ids + ",\"id\":" + QByteArray::number(event.asyncId);
+    appendHeader(json, event, "b", event.startNs, asyncIds);
+    appendArgs(json, event);
+    json += ",\n";
+    appendHeader(json, event, "e", event.endNs, asyncIds);
+    json += "}";
+}
+
+// 一杯になったバッファを一時ファイルに書き出して空ける（持ち主のスレッドから呼ぶ）
+// 組み立てはロックの外で行い、書き出しと件数を0に戻すのはロックの中で行う。記録を止めた後なら捨てる
+void flushBuffer(ThreadBuffer *buffer)
+{
+    QByteArray json;
+    for (int i = 0; i < blockEvents; ++i) {
+        appendEvent(json, buffer->events[i], buffer->ids);
+    }
+    TraceRegistry *trace = registry();
+    QMutexLocker locker(&trace->mutex);
+    if (trace->spill && trace->spill->write(json) != json.size()) {
+        trace->spillFailed = true;
+    }
+    buffer->count.storeRelease(0);
+}
+
+void append(const char *stage, qint64 startNs, qint64 endNs, const QString &detail, qint64 bytes, quint64 asyncId)
+{
+    if (!currentBuffer) {
+        currentBuffer = registry()->registerThread();
+    }
+    int count = currentBuffer->count.loadRelaxed();
+    if (count == blockEvents) {
+        flushBuffer(currentBuffer);
+        count = 0;
+    }
+    currentBuffer->events[count] = {stage, startNs, endNs, bytes, detail, asyncId};
+    currentBuffer->count.storeRelease(count + 1);
+}
+
+} // namespace
+
+std::atomic<bool> StageTrace::enabled{false};
+
+void StageTrace::start(const QString &path)
+{
+    TraceRegistry *trace = registry();
+    QMutexLocker locker(&trace->mutex);
+    trace->path = path;
+    if (!enabled.load()) {
+        trace->spill = std::make_unique<QTemporaryFile>();
+        trace->spillFailed = !trace->spill->open();
+        if (trace->spillFailed) {
+            trace->spill.reset();
+        }
+        trace->clock.start();
+        enabled.store(true);
+    }
+}
+
+void StageTrace::startFromEnvironment()
+{
+    const QString path = qEnvironmentVariable("MEDIA_TRANSFER_TRACE");
+    if (!path.isEmpty()) {
+        start(path);
+    }
+}
+
+bool StageTrace::finish(QString *error)
+{
+    if (!enabled.exchange(false)) {
+        return true;
+    }
+    TraceRegistry *trace = registry();
+    QMutexLocker locker(&trace->mutex);
+    std::unique_ptr<QTemporaryFile> spill = std::move(trace->spill);
+    if (trace->spillFailed) {
+        *error = "トレースの一時ファイルに書き込めません";
+        return false;
+    }
+    QSaveFile out(trace->path);
+    if (!out.open(QIODevice::WriteOnly)) {
+        *error = "トレースを保存できません: " + trace->path;
+        return false;
+    }
+
+    const QByteArray pid = QByteArray::number(QCoreApplication::applicationPid());
+    QByteArray json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    json += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" + pid + ",\"args\":{\"name\":";
+    appendString(json, QCoreApplication::applicationName().toUtf8());
+    json += "}}";
+    out.write(json);
+    json.clear();
+
+    // 途中で書き出した区間を写す
+    spill->seek(0);
+    while (!spill->atEnd()) {
+        out.write(spill->read(writeChunkBytes));
+    }
+
+    // 動いているスレッドが書き足していても、公開済みの件数までを読む
+    for (const auto &buffer : trace->buffers) {
+        json += ",\n{\"name\":\"thread_name\",\"ph\":\"M\"" + buffer->ids + ",\"args\":{\"name\":";
+        appendString(json, buffer->name.toUtf8());
+        json += "}}";
+        const int count = buffer->count.loadAcquire();
+        for (int i = 0; i < count; ++i) {
+            appendEvent(json, buffer->events[i], buffer->ids);
+        }
+        if (json.size() >= writeChunkBytes) {
+            out.write(json);
+            json.clear();
+        }
+    }
+    json += "\n]}\n";
+    out.write(json);
+    if (!out.commit()) {
+        *error = "トレースを保存できません: " + trace->path;
+        return false;
+    }
+    return true;
+}
+
+qint64 StageTrace::now()
+{
+    return registry()->clock.nsecsElapsed();
+}
+
+void StageTrace::record(const char *stage, qint64 startNs, qint64 endNs, const QString &detail, qint64 bytes)
+{
+    append(stage, startNs, endNs, detail, bytes, 0);
+}
+
+void StageTrace::recordAsync(const char *stage, qint64 startNs, qint64 endNs, const QString &detail, qint64 bytes)
+{
+    append(stage, startNs, endNs, detail, bytes, registry()->nextAsyncId.fetchAndAddRelaxed(1) + 1);
+}
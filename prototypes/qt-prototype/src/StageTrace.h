@@ -0,0 +1,75 @@
+#ifndef STAGETRACE_H
+#define STAGETRACE_H
+
+#include <QString>
+#include <atomic>
+
+// ファイル毎の処理の段階（走査・stat・ハッシュ・読み込み・書き込み・fsync・検証・アップロードなど）の
+// 時間を記録し、Chrome trace形式のJSONに書き出す（chrome://tracing や Perfetto で開ける）。
+// 各スレッドは自分専用のバッファに追記するだけでロックを取らない。バッファが一杯になったときだけ
+// ロックを取って一時ファイルに書き出すため、長いジョブでもメモリはスレッド毎のバッファの分で済む。
+// 記録していない間のコストは TraceSpan の生成時にフラグを1回読むだけ。記録はプロセスで1回（起動から終了まで）。
+// トレースの行はスレッド毎で、名前はQThreadのobjectNameを使う。
+class StageTrace
+{
+public:
+    // 記録を始める（終了時に finish() でpathに書き出す）
+    static void start(const QString &path);
+    // 環境変数 MEDIA_TRANSFER_TRACE にファイルが指定されていれば記録を始める
+    static void startFromEnvironment();
+    // 記録を止めてファイルに書き出す。記録していなければ何もしない
+    static bool finish(QString *error);
+
+    static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+    // 記録の開始からの経過時間（ナノ秒）
+    static qint64 now();
+
+    // 呼び出したスレッドの区間として記録する
+    static void record(const char *stage, qint64 startNs, qint64 endNs, const QString &detail, qint64 bytes);
+    // スレッドをまたぐ区間（HTTPのリクエストなど、重なり合うもの）を記録する
+    static void recordAsync(const char *stage, qint64 startNs, qint64 endNs, const QString &detail, qint64 bytes);
+
+private:
+    static std::atomic<bool> enabled;
+};
+
+// スコープの間を1つの段階として記録する
+// 段階の名前は文字列リテラルを渡す（ポインタのまま保持する）
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char *stage)
+        : stage(StageTrace::isEnabled() ? stage : nullptr)
+        , startNs(this->stage ? StageTrace::now() : 0)
+    {
+    }
+    TraceSpan(const char *stage, const QString &detail)
+        : TraceSpan(stage)
+    {
+        if (this->stage) {
+            this->detail = detail;
+        }
+    }
+    ~TraceSpan()
+    {
+        if (stage) {
+            StageTrace::record(stage, startNs, StageTrace::now(), detail, bytes);
+        }
+    }
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+    // 記録中か（詳細を組み立てるのにコストがかかる場合に確かめる）
+    bool isActive() const { return stage != nullptr; }
+    void setDetail(const QString &text) { detail = text; }
+    void addBytes(qint64 count) { bytes += count; }
+
+private:
+    const char *stage;
+    qint64 startNs;
+    qint64 bytes = 0;
+    QString detail;
+};
+
+#endif // STAGETRACE_H
@@ -0,0 +1,148 @@
+#include "StreamingScanner.h"
+#include "StageTrace.h"
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QThread>
+#include <algorithm>
+
+namespace {
+
+// 関連ファイルをまとめる単位（"IMG_0001.JPG.xmp" → "img_0001"）
+QString stemOf(const QString &fileName)
+{
+    const qsizetype dot = fileName.indexOf('.', 1);
+    return (dot < 0 ? fileName : fileName.left(dot)).toLower();
+}
+
+} // namespace
+
+StreamingScanner::StreamingScanner(const QStringList &roots, int windowFiles, int queueWindows)
+    : roots(roots)
+    , windowFiles(qMax(1, windowFiles))
+    , queueWindows(qMax(1, queueWindows))
+{
+}
+
+StreamingScanner::~StreamingScanner()
+{
+    cancel();
+    if (thread) {
+        thread->wait();
+        delete thread;
+    }
+}
+
+void StreamingScanner::start()
+{
+    thread = QThread::create([this]() { scan(); });
+    thread->setObjectName("走査");
+    thread->start();
+}
+
+void StreamingScanner::cancel()
+{
+    QMutexLocker locker(&mutex);
+    cancelled = true;
+    notFull.wakeAll();
+    notEmpty.wakeAll();
+}
+
+bool StreamingScanner::next(PathTable *result)
+{
+    QMutexLocker locker(&mutex);
+    while (queue.isEmpty() && !finished && !cancelled) {
+        notEmpty.wait(&mutex);
+    }
+    if (queue.isEmpty() || cancelled) {
+        return false;
+    }
+    *result = queue.dequeue();
+    notFull.wakeAll();
+    return true;
+}
+
+void StreamingScanner::scan()
+{
+    // 深さ優先に名前順で読む（保留するのは各階層の未読の兄弟ディレクトリだけ）
+    QStringList pending;
+    for (qsizetype i = roots.size() - 1; i >= 0; --i) {
+        pending.append(QFileInfo(roots.at(i)).absoluteFilePath());
+    }
+    while (!pending.isEmpty()) {
+        QStringList subdirectories;
+        scanDirectory(pending.takeLast(), subdirectories);
+        if (!push()) {
+            break;
+        }
+        for (qsizetype i = subdirectories.size() - 1; i >= 0; --i) {
+            pending.append(subdirectories.at(i));
+        }
+    }
+
+    QMutexLocker locker(&mutex);
+    if (!window.isEmpty() && !cancelled) {
+        queue.enqueue(window);
+    }
+    window.clear();
+    finished = true;
+    notEmpty.wakeAll();
+}
+
+void StreamingScanner::scanDirectory(const QString &path, QStringList &subdirectories)
+{
+    TraceSpan span("scan", path);
+    QStringList files;
+    QDirIterator it(path, QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot | QDir::NoSymLinks);
+    while (it.hasNext()) {
+        it.next();
+        const QFileInfo info = it.fileInfo();
+        if (info.isDir()) {
+            subdirectories.append(info.absoluteFilePath());
+        } else {
+            files.append(info.fileName());
+        }
+    }
+    std::sort(subdirectories.begin(), subdirectories.end());
+    // 大文字小文字を区別せずに並べ、関連ファイルを隣り合わせにする
+    std::sort(files.begin(), files.end(), [](const QString &a, const QString &b) {
+        const int order = a.compare(b, Qt::CaseInsensitive);
+        return order != 0 ? order < 0 : a < b;
+    });
+
+    const QString base = path + '/';
+    lastStem.clear();
+    for (const QString &fileName : files) {
+        // 窓が一杯でも、同じ名前の関連ファイルが続く間は分けない
+        const QString stem = stemOf(fileName);
+        if (window.size() >= windowFiles && stem != lastStem && !push()) {
+            return;
+        }
+        window.append(base + fileName);
+        lastStem = stem;
+        discovered.ref();
+    }
+}
+
+bool StreamingScanner::push()
+{
+    if (window.size() < windowFiles) {
+        QMutexLocker locker(&mutex);
+        return !cancelled;
+    }
+    QMutexLocker locker(&mutex);
+    if (queue.size() >= queueWindows) {
+        // 転送を待っている時間（背圧）は走査と分けて記録する
+        TraceSpan span("backpressure");
+        while (queue.size() >= queueWindows && !cancelled) {
+            notFull.wait(&mutex);
+        }
+    }
+    if (cancelled) {
+        return false;
+    }
+    queue.enqueue(window);
+    window.clear();
+    notEmpty.wakeAll();
+    return true;
+}
@@ -0,0 +1,62 @@
+#ifndef STREAMINGSCANNER_H
+#define STREAMINGSCANNER_H
+
+#include <QString>
+#include <QStringList>
+#include <QQueue>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInteger>
+#include "PathTable.h"
+
+class QThread;
+
+// ファイルの一覧を作らずにフォルダの木を転送するための走査（ストリーミング）
+// 別スレッドでディレクトリを深さ優先に1つずつ読み、一定件数ずつの窓（PathTable）に分けて
+// 上限のあるキューに入れる。キューが一杯なら転送が追いつくまで走査を止める（背圧）ため、
+// 走査と転送待ちのファイルの一覧は「窓の件数×キューの長さ」と1つのディレクトリのエントリ分で済む。
+// 窓の区切りでは出力先のtrim()で、次の窓で使わない出力先のファイル名の台帳・作成済みのディレクトリ・
+// このジョブで追記したジャーナルの記録をメモリから捨てる。
+// 取り込み済みの目録とクラウドの一覧（マニフェスト）は窓をまたいだ重複の判定に使うため捨てない。
+// これらは出力先のアーカイブ全体の大きさに比例する。
+// 関連ファイル（同じファイル名の RAW+JPEG・サイドカー）は同じ窓に入るよう、名前の区切りで分ける。
+class StreamingScanner
+{
+public:
+    StreamingScanner(const QStringList &roots, int windowFiles, int queueWindows);
+    ~StreamingScanner();
+    StreamingScanner(const StreamingScanner &) = delete;
+    StreamingScanner &operator=(const StreamingScanner &) = delete;
+
+    void start();
+    void cancel();
+
+    // 次の窓を取り出す（キューが空なら走査を待つ）。走査が終わって残りがなければfalse
+    bool next(PathTable *window);
+
+    // これまでに見つけたファイルの数
+    qint64 discoveredCount() const { return discovered.loadRelaxed(); }
+
+private:
+    void scan();
+    void scanDirectory(const QString &path, QStringList &subdirectories);
+    bool push();
+
+    QStringList roots;
+    int windowFiles;
+    int queueWindows;
+    QThread *thread = nullptr;
+
+    QMutex mutex;
+    QWaitCondition notFull;
+    QWaitCondition notEmpty;
+    QQueue<PathTable> queue;
+    bool finished = false;
+    bool cancelled = false;
+
+    PathTable window;                   // 走査スレッドが組み立て中の窓
+    QString lastStem;                   // 窓の最後のファイルの名前（拡張子を除く、小文字）
+    QAtomicInteger<qint64> discovered;
+};
+
+#endif // STREAMINGSCANNER_H
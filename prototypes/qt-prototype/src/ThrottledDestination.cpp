@@ -0,0 +1,53 @@
+#include "ThrottledDestination.h"
+
+namespace {
+
+class ThrottledUnitWriter : public UnitWriter
+{
+public:
+    ThrottledUnitWriter(std::unique_ptr<UnitWriter> inner, RateLimiter::Scope *scope)
+        : inner(std::move(inner)), scope(scope)
+    {
+    }
+
+    bool wants(int member) const override { return inner->wants(member); }
+    std::shared_ptr<const UnitPaths> destinationPaths() const override { return inner->destinationPaths(); }
+
+    bool beginFile(int member, QString *error) override
+    {
+        RateLimiter::instance()->applyIoPriority();
+        scope->acquireOperation();
+        return inner->beginFile(member, error);
+    }
+
+    bool write(const char *data, qint64 size, QString *error) override
+    {
+        scope->acquireBytes(size);
+        return inner->write(data, size, error);
+    }
+
+    bool endFile(QString *error) override { return inner->endFile(error); }
+    bool commit(QString *error) override { return inner->commit(error); }
+    void abort() override { inner->abort(); }
+
+private:
+    std::unique_ptr<UnitWriter> inner;
+    RateLimiter::Scope *scope;
+};
+
+} // namespace
+
+ThrottledDestination::ThrottledDestination(std::unique_ptr<TransferDestination> inner)
+    : inner(std::move(inner))
+    , scope(RateLimiter::instance()->scope(this->inner->name()))
+{
+}
+
+std::unique_ptr<UnitWriter> ThrottledDestination::beginUnit(const UnitPlan &plan, QString *error)
+{
+    std::unique_ptr<UnitWriter> writer = inner->beginUnit(plan, error);
+    if (!writer) {
+        return nullptr;
+    }
+    return std::make_unique<ThrottledUnitWriter>(std::move(writer), scope);
+}
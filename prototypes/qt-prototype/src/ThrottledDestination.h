@@ -0,0 +1,28 @@
+#ifndef THROTTLEDDESTINATION_H
+#define THROTTLEDDESTINATION_H
+
+#include "TransferDestination.h"
+#include "RateLimiter.h"
+
+// 出力先毎の速度制限
+// 書き込みの前に出力先名のバケット（RateLimiter）から取り、上限を超える分は待たせる。
+// ファイル毎に呼び出し元スレッドのI/O優先度も設定に合わせる。
+class ThrottledDestination : public TransferDestination
+{
+public:
+    explicit ThrottledDestination(std::unique_ptr<TransferDestination> inner);
+
+    QString name() const override { return inner->name(); }
+    bool prepare(QString *error) override { return inner->prepare(error); }
+    std::unique_ptr<UnitWriter> beginUnit(const UnitPlan &plan, QString *error) override;
+    bool checkpoint(QString *error) override { return inner->checkpoint(error); }
+    void trim() override { inner->trim(); }
+    bool finish(QString *error) override { return inner->finish(error); }
+    void setFailureHandler(const FailureHandler &handler) override { inner->setFailureHandler(handler); }
+
+private:
+    std::unique_ptr<TransferDestination> inner;
+    RateLimiter::Scope *scope;
+};
+
+#endif // THROTTLEDDESTINATION_H
@@ -0,0 +1,86 @@
+#ifndef TRANSFERDESTINATION_H
+#define TRANSFERDESTINATION_H
+
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+#include <QFileInfo>
+#include <functional>
+#include <memory>
+
+// 1つの転送単位（TransferUnit）を出力先に書き出すための情報
+// フォルダ・ファイル名はテンプレート展開済みで、出力先に依存しない相対表現（UTF-8）。
+struct UnitPlan
+{
+    QByteArray relativeDir;         // 空の場合は出力先の直下
+    QByteArray stem;
+    QVector<QByteArray> suffixes;   // メンバー毎（".JPG", ".JPG.xmp" など）
+    QVector<QFileInfo> sources;     // メンバー毎
+
+    // 出力先の直下からの相対パス（"relativeDir/stem+suffix"）
+    QByteArray relativePath(int member) const
+    {
+        const QByteArray name = stem + suffixes.at(member);
+        return relativeDir.isEmpty() ? name : relativeDir + '/' + name;
+    }
+};
+
+// 組の各メンバーを実際に置いた出力先のパス（出力先の直下からの相対、UTF-8。メンバー毎）
+// 名前の衝突で連番を付けた場合や転送済みのメンバーは UnitPlan::relativePath() と違う。
+// 確定時に付け直すことがあるため、出力先の checkpoint() か finish() の後に読む。置き場所のないメンバーは空
+using UnitPaths = QVector<QByteArray>;
+
+// 1つの転送単位の書き込み
+// パイプラインは wants() が true のメンバーだけを beginFile → write → endFile の順に渡し、
+// 最後に commit() か abort() を呼ぶ。
+class UnitWriter
+{
+public:
+    virtual ~UnitWriter() = default;
+
+    // falseのメンバーは転送済み（スキップ）
+    virtual bool wants(int member) const = 0;
+
+    // 書き込んだ（転送済みのメンバーは既にある）パス。UnitWriterより長く保持してよい
+    virtual std::shared_ptr<const UnitPaths> destinationPaths() const = 0;
+
+    virtual bool beginFile(int member, QString *error) = 0;
+    virtual bool write(const char *data, qint64 size, QString *error) = 0;
+    virtual bool endFile(QString *error) = 0;
+
+    virtual bool commit(QString *error) = 0;
+    virtual void abort() = 0;
+};
+
+// 出力先（ローカル、クラウド）
+class TransferDestination
+{
+public:
+    using FailureHandler = std::function<void(const QVector<QFileInfo> &sources, const QString &error)>;
+
+    virtual ~TransferDestination() = default;
+
+    virtual QString name() const = 0;
+
+    // ジョブ開始時に1回呼ばれる
+    virtual bool prepare(QString *error) = 0;
+
+    // 複数のワーカースレッドから同時に呼ばれる
+    virtual std::unique_ptr<UnitWriter> beginUnit(const UnitPlan &plan, QString *error) = 0;
+
+    // それまでにcommit()した組の確定・永続化を済ませる（ジョブの途中の区切りで、書き込みが止まっている間に呼ばれる）
+    // 確定に失敗した組はfailureHandlerに報告してから戻る
+    virtual bool checkpoint(QString *error) { Q_UNUSED(error); return true; }
+
+    // checkpoint()の後、次の組を書く前に呼ばれる（ストリーミングの窓の区切り）
+    // 次の窓で要らない台帳・キャッシュを捨て、ジョブの間にメモリが増え続けないようにする
+    virtual void trim() {}
+
+    // ジョブ終了時に1回呼ばれる（保留中の確定など）
+    virtual bool finish(QString *error) = 0;
+
+    // 組の確定をバックグラウンドで行う出力先は、commit()がtrueを返した後の失敗をここに報告する
+    virtual void setFailureHandler(const FailureHandler &handler) { Q_UNUSED(handler); }
+};
+
+#endif // TRANSFERDESTINATION_H
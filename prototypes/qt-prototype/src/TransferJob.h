@@ -0,0 +1,55 @@
+#ifndef TRANSFERJOB_H
+#define TRANSFERJOB_H
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <memory>
+#include "DurabilityPolicy.h"
+#include "CloudOptions.h"
+#include "FanOutDestination.h"
+#include "TransferPlan.h"
+#include "PathTable.h"
+
+// 転送処理の設定
+struct TransferOptions
+{
+    // "local"（destinationRoot）/ "local:<フォルダ>" / "chunks:<フォルダ>" / "dropbox" / "onedrive" / "s3"
+    // 複数指定するとソースを1回だけ読んで全出力先に書き込む
+    QStringList destinations = {"local"};
+    QString destinationRoot;
+    QString folderTemplate = "{year}/{month}/{day}";
+    QString fileNameTemplate = "{name}";     // 拡張子は元ファイルのものを付加
+    bool duplicateCheck = true;
+    bool skipImported = true;               // 取り込み済みファイルの目録に記録済みのファイルを読まずに飛ばす
+    bool chunkDedup = false;                // 動画をチャンクに分割し、取り込み済みの内容との重複を報告する
+    int similarImageRadius = 0;             // 類似画像の検出（知覚ハッシュのハミング距離、0は無効）
+
+    int workerCount = 4;
+    int readersPerSource = 2;               // ソース（デバイス）毎の同時読み込み数
+    QHash<QString, int> sourceWeights;      // デバイス → 重み（既定は1）
+    qint64 chunkSize = 1024 * 1024;
+    bool resume = true;
+    DurabilityOptions durability;
+    bool verify = false;                    // ローカル出力先に書いた内容を読み戻して検証する
+    S3Options s3;
+    DropboxOptions dropbox;
+    OneDriveOptions onedrive;
+    int maxHttpRequests = 16;               // クラウド出力先の同時リクエスト数（全体）
+    FanOutOptions fanOut;
+    int streamWindowFiles = 4096;           // ストリーミングで一度に組分け・転送するファイル数
+    int streamQueueWindows = 2;             // 走査が先に用意しておく窓の数（これを超えると走査を止める）
+};
+
+// 1回の「処理を開始」に対応するジョブ
+struct TransferJob
+{
+    PathTable files;                    // 各部はファイルをこの表のハンドルで扱う
+    // 空でなければ一覧を作らずにこれらのフォルダを走査しながら転送する（filesは使わない）
+    QStringList streamRoots;
+    TransferOptions options;
+    // 計画を実行する場合はfilesがplan->files()と同じ並び（テンプレートの展開や判定はしない）
+    std::shared_ptr<const TransferPlan> plan;
+};
+
+#endif // TRANSFERJOB_H
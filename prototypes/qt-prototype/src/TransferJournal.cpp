@@ -0,0 +1,123 @@
+#include "TransferJournal.h"
+#include "PlatformIo.h"
+#include <QMutexLocker>
+
+TransferJournal::TransferJournal(const QString &filePath)
+    : path(filePath), file(filePath)
+{
+}
+
+bool TransferJournal::open()
+{
+    QMutexLocker locker(&mutex);
+
+    if (!file.open(QIODevice::ReadWrite | QIODevice::Append)) {
+        return false;
+    }
+
+    // 既存の記録を読み込む（書式: source \t size \t mtime \t destination [\t sha256]）
+    file.seek(0);
+    JournalEntry entry;
+    while (!file.atEnd()) {
+        if (parseLine(file.readLine(), entry)) {
+            completed.insert(makeKey(entry.sourcePath, entry.size, entry.modifiedMs), entry.destinationPath);
+        }
+    }
+    file.seek(file.size());
+    return true;
+}
+
+bool TransferJournal::contains(const QString &sourcePath, qint64 size, qint64 modifiedMs) const
+{
+    QMutexLocker locker(&mutex);
+    return completed.contains(makeKey(sourcePath, size, modifiedMs));
+}
+
+QString TransferJournal::destinationOf(const QString &sourcePath, qint64 size, qint64 modifiedMs) const
+{
+    QMutexLocker locker(&mutex);
+    return completed.value(makeKey(sourcePath, size, modifiedMs));
+}
+
+bool TransferJournal::append(const QVector<JournalEntry> &entries)
+{
+    QByteArray data;
+    for (const JournalEntry &entry : entries) {
+        data += entry.sourcePath.toUtf8() + '\t'
+              + QByteArray::number(entry.size) + '\t'
+              + QByteArray::number(entry.modifiedMs) + '\t'
+              + entry.destinationPath.toUtf8();
+        if (!entry.hash.isEmpty()) {
+            data += '\t' + entry.hash;
+        }
+        data += '\n';
+    }
+
+    QMutexLocker locker(&mutex);
+    if (file.write(data) != data.size() || !file.flush()) {
+        return false;
+    }
+    for (const JournalEntry &entry : entries) {
+        const QString key = makeKey(entry.sourcePath, entry.size, entry.modifiedMs);
+        if (!completed.contains(key)) {
+            appendedKeys.append(key);
+        }
+        completed.insert(key, entry.destinationPath);
+    }
+    return true;
+}
+
+void TransferJournal::forgetAppended()
+{
+    QMutexLocker locker(&mutex);
+    for (const QString &key : appendedKeys) {
+        completed.remove(key);
+    }
+    appendedKeys.clear();
+}
+
+bool TransferJournal::sync()
+{
+    QMutexLocker locker(&mutex);
+    return PlatformIo::syncFile(file.handle());
+}
+
+QString TransferJournal::errorString() const
+{
+    QMutexLocker locker(&mutex);
+    return file.errorString();
+}
+
+bool TransferJournal::readEntries(const QString &filePath, const std::function<void(const JournalEntry &)> &visit)
+{
+    QFile in(filePath);
+    if (!in.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    JournalEntry entry;
+    while (!in.atEnd()) {
+        if (parseLine(in.readLine(), entry)) {
+            visit(entry);
+        }
+    }
+    return true;
+}
+
+bool TransferJournal::parseLine(const QByteArray &line, JournalEntry &entry)
+{
+    const QList<QByteArray> fields = line.trimmed().split('\t');
+    if (fields.size() < 4) {
+        return false;
+    }
+    entry.sourcePath = QString::fromUtf8(fields[0]);
+    entry.size = fields[1].toLongLong();
+    entry.modifiedMs = fields[2].toLongLong();
+    entry.destinationPath = QString::fromUtf8(fields[3]);
+    entry.hash = fields.value(4);
+    return true;
+}
+
+QString TransferJournal::makeKey(const QString &sourcePath, qint64 size, qint64 modifiedMs)
+{
+    return sourcePath + QLatin1Char('|') + QString::number(size) + QLatin1Char('|') + QString::number(modifiedMs);
+}
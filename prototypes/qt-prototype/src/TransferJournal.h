@@ -0,0 +1,57 @@
+#ifndef TRANSFERJOURNAL_H
+#define TRANSFERJOURNAL_H
+
+#include <QString>
+#include <QHash>
+#include <QStringList>
+#include <QVector>
+#include <QFile>
+#include <QMutex>
+#include <functional>
+
+// 永続化済みとして記録する1ファイル分の情報
+struct JournalEntry
+{
+    QString sourcePath;
+    qint64 size = 0;
+    qint64 modifiedMs = 0;
+    QString destinationPath;
+    QByteArray hash;                // 内容のSHA-256（16進、検証を有効にしたときのみ）
+};
+
+// 再開用ジャーナル
+// 出力先に追記形式で保存し、記録済みのファイルは再実行時にスキップする。
+// 記録はDurabilityManagerがデータの永続化を確認した後にのみ行われる。
+class TransferJournal
+{
+public:
+    explicit TransferJournal(const QString &filePath);
+
+    bool open();
+    bool contains(const QString &sourcePath, qint64 size, qint64 modifiedMs) const;
+    // 記録済みなら出力先パス、未記録なら空文字列
+    QString destinationOf(const QString &sourcePath, qint64 size, qint64 modifiedMs) const;
+    bool append(const QVector<JournalEntry> &entries);
+    // このジョブで追記した記録をメモリから外す（ファイルには残る）
+    // ストリーミングでは同じソースを二度読まないため、開いたときに読んだ記録だけで再開の判定ができる
+    void forgetAppended();
+    bool sync();
+
+    QString filePath() const { return path; }
+
+    // ジャーナルファイルの記録を順に読む（開いていないジャーナルも読める）
+    static bool readEntries(const QString &filePath, const std::function<void(const JournalEntry &)> &visit);
+    QString errorString() const;
+
+private:
+    static bool parseLine(const QByteArray &line, JournalEntry &entry);
+    static QString makeKey(const QString &sourcePath, qint64 size, qint64 modifiedMs);
+
+    QString path;
+    QFile file;
+    QHash<QString, QString> completed;  // キー → 出力先パス
+    QStringList appendedKeys;           // 開いた後に追記した記録のキー
+    mutable QMutex mutex;
+};
+
+#endif // TRANSFERJOURNAL_H
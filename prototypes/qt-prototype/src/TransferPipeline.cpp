@@ -0,0 +1,1053 @@
+#include "TransferPipeline.h"
+#include "LocalDestination.h"
+#include "S3Destination.h"
+#include "DropboxDestination.h"
+#include "OneDriveDestination.h"
+#include "ThrottledDestination.h"
+#include "ChunkStoreDestination.h"
+#include "ContentChunker.h"
+#include "EventClusterer.h"
+#include "DeviceThroughput.h"
+#include "NameRegistry.h"
+#include "PlaceIndex.h"
+#include "RateLimiter.h"
+#include "HttpTransport.h"
+#include "TransferUnit.h"
+#include "StageTrace.h"
+#include <QCryptographicHash>
+#include <QFile>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QStorageInfo>
+#include <QThread>
+#include <QVector>
+#include <algorithm>
+#include <functional>
+
+namespace {
+
+// 撮影位置からこの距離以内の地名を使い、なければこの半径で連なる位置をまとめる
+const double placeRadiusKm = 10.0;
+const double unnamedClusterRadiusKm = 1.0;
+
+// ストリーミングで進み具合を知らせる間隔（ファイル数）
+const int streamProgressStep = 256;
+
+// デバイスの速度を記録する最小の転送量
+const qint64 minThroughputSample = 64 * 1024 * 1024;
+
+// 0からcount-1までを複数スレッドで分けて処理する
+void forEachParallel(int count, const std::function<void(int)> &work)
+{
+    const int parts = qBound(1, QThread::idealThreadCount(), qMax(1, count));
+    if (parts == 1) {
+        for (int i = 0; i < count; ++i) {
+            work(i);
+        }
+        return;
+    }
+    QVector<QThread *> workers;
+    for (int part = 0; part < parts; ++part) {
+        const int first = static_cast<int>(qint64(count) * part / parts);
+        const int last = static_cast<int>(qint64(count) * (part + 1) / parts);
+        QThread *worker = QThread::create([&work, first, last]() {
+            for (int i = first; i < last; ++i) {
+                work(i);
+            }
+        });
+        worker->setObjectName(QString("計画 %1").arg(part + 1));
+        workers.append(worker);
+        worker->start();
+    }
+    for (QThread *worker : workers) {
+        worker->wait();
+        delete worker;
+    }
+}
+
+} // namespace
+
+TransferPipeline::TransferPipeline(const TransferJob &job, QObject *parent)
+    : QObject(parent)
+    , job(job)
+    , folderTemplate(job.options.folderTemplate)
+    , fileNameTemplate(job.options.fileNameTemplate, PathTemplate::Kind::FileName)
+    , completed(0)
+    , failed(0)
+    , skipped(0)
+    , lastPercentage(-1)
+    , bytes(0)
+    , cancelled(0)
+{
+    const QString patterns = folderTemplate.pattern() + '\n' + fileNameTemplate.pattern();
+    needsDeviceName = patterns.contains("{device}") || patterns.contains("{camera}");
+}
+
+TransferPipeline::~TransferPipeline()
+{
+}
+
+bool TransferPipeline::run()
+{
+    const TransferOptions &options = job.options;
+    const bool streaming = !job.streamRoots.isEmpty();
+    if (job.files.isEmpty() && !streaming) {
+        return true;
+    }
+    TraceSpan span("transfer");
+
+    if (!folderTemplate.isValid() || !fileNameTemplate.isValid()) {
+        emit fileFailed(options.destinationRoot,
+                        folderTemplate.isValid() ? fileNameTemplate.errorString() : folderTemplate.errorString());
+        return false;
+    }
+
+    // ストリーミングでは組もソースもまだ分からないため、ワーカー数は設定から決める
+    int workerCount = qMax(options.workerCount, options.readersPerSource);
+    if (!streaming) {
+        buildUnits();
+        workerCount = scheduleUnits();
+    }
+    sourceStats.clear();
+    jobTimer.start();
+
+    std::vector<FanOutDestination::Sink> sinks;
+    bool cloud = false;
+    for (const QString &spec : options.destinations) {
+        sinks.push_back(createDestination(spec));
+        cloud = cloud || sinks.back().destination->name() != "local";
+    }
+    if (sinks.empty()) {
+        sinks.push_back(createDestination("local"));
+    }
+    QString target;
+    if (sinks.size() == 1) {
+        target = sinks.front().label;
+        destination = std::move(sinks.front().destination);
+    } else {
+        destination = std::make_unique<FanOutDestination>(std::move(sinks), options.fanOut, workerCount);
+        target = destination->name();
+    }
+    // バックグラウンドで確定した出力先の失敗もファイル毎に報告する
+    destination->setFailureHandler([this](const QVector<QFileInfo> &sources, const QString &error) {
+        failUnit(sources, error);
+    });
+    if (cloud) {
+        HttpTransport::instance()->setMaxConcurrentRequests(options.maxHttpRequests);
+    }
+    QString error;
+    if (!destination->prepare(&error)) {
+        emit fileFailed(target, error);
+        return false;
+    }
+    catalog = ImportCatalog::shared(ImportCatalog::destinationIdOf(options), &error);
+    if (!catalog) {
+        // 目録がなくても出力先のジャーナルで転送済みのファイルは飛ばせる
+        emit fileFailed(target, error);
+    }
+    if (options.chunkDedup) {
+        chunks = std::make_unique<ChunkIndex>(target);
+        if (!chunks->open(&error)) {
+            emit fileFailed(target, error);
+            chunks.reset();
+        }
+    }
+    if (options.similarImageRadius > 0) {
+        similarity = std::make_unique<SimilarityIndex>(target);
+        if (!similarity->open(&error)) {
+            // 索引がなくても転送は続ける
+            emit fileFailed(target, error);
+            similarity.reset();
+        }
+    }
+
+    if (streaming) {
+        runStreaming();
+    } else {
+        runWorkers(workerCount);
+    }
+
+    if (destination->finish(&error)) {
+        writeCatalog();
+    } else {
+        emit fileFailed(target, error);
+        failed.ref();
+        discardImported();
+    }
+    recordThroughput();
+    reportProgress();
+
+    return failed.loadRelaxed() == 0 && cancelled.loadRelaxed() == 0;
+}
+
+void TransferPipeline::cancel()
+{
+    cancelled.storeRelaxed(1);
+}
+
+void TransferPipeline::runWorkers(int workerCount)
+{
+    QVector<QThread *> workers;
+    for (int i = 0; i < workerCount; ++i) {
+        QThread *worker = QThread::create([this]() { workerLoop(); });
+        worker->setObjectName(QString("ワーカー %1").arg(i + 1));
+        workers.append(worker);
+        worker->start();
+    }
+    for (QThread *worker : workers) {
+        worker->wait();
+        delete worker;
+    }
+}
+
+void TransferPipeline::runStreaming()
+{
+    // 窓毎に組分け・割り振りをして転送する。その間も走査は次の窓を用意し、
+    // キューが一杯になれば転送が追いつくまで止まる
+    StreamingScanner scanner(job.streamRoots, job.options.streamWindowFiles, job.options.streamQueueWindows);
+    streamScanner = &scanner;
+    scanner.start();
+    PathTable window;
+    while (!cancelled.loadRelaxed() && scanner.next(&window)) {
+        TraceSpan span("window");
+        job.files = window;
+        buildUnits();
+        runWorkers(scheduleUnits());
+        unitOffset += static_cast<int>(units.size());
+        // 目録は窓毎に、窓の組の確定・永続化を済ませてから書く（ジョブの終わりまで溜めない）
+        QString error;
+        if (destination->checkpoint(&error)) {
+            writeCatalog();
+            destination->trim();
+        } else {
+            emit fileFailed(destination->name(), error);
+            failed.ref();
+            discardImported();
+        }
+        emit streamProgressChanged(scanner.discoveredCount(),
+                                   completed.loadRelaxed() + failed.loadRelaxed() + skipped.loadRelaxed());
+    }
+    scanner.cancel();
+    streamScanner = nullptr;
+    job.files.clear();
+    window.clear();
+    units.clear();
+}
+
+bool TransferPipeline::plan(TransferPlan *result, QString *error)
+{
+    const TransferOptions &options = job.options;
+    if (!folderTemplate.isValid() || !fileNameTemplate.isValid()) {
+        *error = folderTemplate.isValid() ? fileNameTemplate.errorString() : folderTemplate.errorString();
+        return false;
+    }
+    TraceSpan span("planning");
+    buildUnits();
+    if (options.skipImported) {
+        QString catalogError;
+        catalog = ImportCatalog::shared(ImportCatalog::destinationIdOf(options), &catalogError);
+    }
+
+    // 組毎の出力先・判定を並列に求める（テンプレートの展開とstat、目録の照合）
+    QVector<PlannedUnit> planned(units.size());
+    forEachParallel(static_cast<int>(units.size()), [this, &planned](int unitIndex) {
+        QByteArray pathBuffer;
+        UnitPlan unitPlan;
+        planUnit(unitIndex, pathBuffer, unitPlan);
+        PlannedUnit &unit = planned[unitIndex];
+        unit.relativeDir = unitPlan.relativeDir;
+        unit.stem = unitPlan.stem;
+        for (int i = 0; i < unitPlan.sources.size(); ++i) {
+            PlannedMember member;
+            member.source = job.files.pathAt(units.at(unitIndex).members.at(i));
+            member.suffix = unitPlan.suffixes.at(i);
+            member.size = unitPlan.sources.at(i).size();
+            member.modifiedMs = unitPlan.sources.at(i).lastModified().toMSecsSinceEpoch();
+            unit.members.append(member);
+        }
+        if (catalog && isImported(unitIndex)) {
+            unit.action = PlannedUnit::SkipImported;
+        }
+    });
+
+    // デバイス毎に分け、デバイスの中はカード上の配置順のまま並べる（実行の順）
+    TransferPlan plan;
+    plan.createdMs = QDateTime::currentMSecsSinceEpoch();
+    plan.destinations = options.destinations;
+    plan.destinationRoot = options.destinationRoot;
+    plan.folderTemplate = folderTemplate.pattern();
+    plan.fileNameTemplate = fileNameTemplate.pattern();
+    QHash<quint32, int> deviceByDirectory;
+    QHash<QString, int> deviceIndex;
+    for (int i = 0; i < planned.size(); ++i) {
+        PlannedUnit &unit = planned[i];
+        const int primary = units.at(i).members.first();
+        const quint32 directory = job.files.directoryAt(primary);
+        auto it = deviceByDirectory.constFind(directory);
+        if (it == deviceByDirectory.constEnd()) {
+            const QString source = SourceScheduler::sourceOf(QFileInfo(job.files.pathAt(primary)).absolutePath());
+            auto device = deviceIndex.constFind(source);
+            if (device == deviceIndex.constEnd()) {
+                device = deviceIndex.insert(source, static_cast<int>(plan.devices.size()));
+                PlannedDevice entry;
+                entry.source = source;
+                plan.devices.append(entry);
+            }
+            it = deviceByDirectory.insert(directory, device.value());
+        }
+        unit.device = it.value();
+    }
+    std::stable_sort(planned.begin(), planned.end(), [](const PlannedUnit &a, const PlannedUnit &b) {
+        return a.device < b.device;
+    });
+    plan.units = planned;
+
+    findDuplicates(plan);
+    resolveCollisions(plan);
+    estimateTime(plan);
+    *result = plan;
+    return true;
+}
+
+void TransferPipeline::buildUnits()
+{
+    if (job.plan) {
+        // 計画の組をそのまま使う（メンバーはjob.filesに組の順に並んでいる）
+        units.clear();
+        int member = 0;
+        for (const PlannedUnit &planned : job.plan->units) {
+            TransferUnit unit;
+            unit.stem = planned.stem;
+            for (const PlannedMember &plannedMember : planned.members) {
+                unit.members.append(member++);
+                unit.suffixes.append(plannedMember.suffix);
+            }
+            units.append(unit);
+        }
+        return;
+    }
+    units = buildTransferUnits(job.files);
+    if (folderTemplate.pattern().contains("{event}") || fileNameTemplate.pattern().contains("{event}")) {
+        assignEvents();
+    }
+    if (folderTemplate.pattern().contains("{place}") || fileNameTemplate.pattern().contains("{place}")) {
+        assignPlaces();
+    }
+}
+
+void TransferPipeline::findDuplicates(TransferPlan &plan) const
+{
+    // 大きさが同じ組だけを、先頭64KBのハッシュ、全体のハッシュの順に絞り込む
+    QHash<QByteArray, QVector<int>> groups;
+    for (int i = 0; i < plan.units.size(); ++i) {
+        const PlannedUnit &unit = plan.units.at(i);
+        if (unit.action != PlannedUnit::Copy) {
+            continue;
+        }
+        QByteArray key;
+        for (const PlannedMember &member : unit.members) {
+            key += QByteArray::number(member.size) + ' ';
+        }
+        groups[key].append(i);
+    }
+
+    for (int stage = 0; stage < 2; ++stage) {
+        QVector<int> candidates;
+        for (const QVector<int> &group : groups) {
+            if (group.size() > 1) {
+                candidates += group;
+            }
+        }
+        QVector<QByteArray> signatures(candidates.size());
+        forEachParallel(static_cast<int>(candidates.size()), [&](int i) {
+            for (const PlannedMember &member : plan.units.at(candidates.at(i)).members) {
+                const QByteArray hash = stage == 0 ? ImportCatalog::partialHashOf(member.source)
+                                                   : contentHashOf(member.source);
+                // 読めなかったファイルを含む組は重複としない
+                if (hash.isEmpty()) {
+                    signatures[i].clear();
+                    return;
+                }
+                signatures[i] += hash + ' ';
+            }
+        });
+        QHash<QByteArray, QVector<int>> next;
+        for (int i = 0; i < candidates.size(); ++i) {
+            if (!signatures.at(i).isEmpty()) {
+                next[signatures.at(i)].append(candidates.at(i));
+            }
+        }
+        groups.swap(next);
+    }
+
+    for (QVector<int> group : groups) {
+        if (group.size() < 2) {
+            continue;
+        }
+        std::sort(group.begin(), group.end());
+        for (int i = 1; i < group.size(); ++i) {
+            PlannedUnit &unit = plan.units[group.at(i)];
+            unit.duplicateOf = group.first();
+            if (job.options.duplicateCheck) {
+                unit.action = PlannedUnit::SkipDuplicate;
+            }
+            ++plan.duplicateCount;
+        }
+    }
+}
+
+void TransferPipeline::resolveCollisions(TransferPlan &plan) const
+{
+    // ローカルの出力先は既存のファイルと、それ以外は計画の組同士で名前の衝突を調べる
+    QString localRoot;
+    for (const QString &spec : job.options.destinations) {
+        if (spec == "local") {
+            localRoot = job.options.destinationRoot;
+        } else if (spec.startsWith("local:")) {
+            localRoot = spec.mid(6);
+        }
+        if (!localRoot.isEmpty()) {
+            break;
+        }
+    }
+    NameRegistry names(!localRoot.isEmpty());
+    const QByteArray root = localRoot.isEmpty() ? QByteArray() : QFile::encodeName(localRoot);
+
+    for (PlannedUnit &unit : plan.units) {
+        if (unit.action == PlannedUnit::SkipImported) {
+            ++plan.importedCount;
+            continue;
+        }
+        if (unit.action != PlannedUnit::Copy) {
+            continue;
+        }
+        QByteArray dir = root;
+        if (!unit.relativeDir.isEmpty()) {
+            dir.append('/');
+            dir.append(unit.relativeDir);
+        }
+        QVector<QByteArray> suffixes;
+        for (const PlannedMember &member : unit.members) {
+            suffixes.append(member.suffix);
+        }
+        const int number = names.claimGroup(dir, unit.stem, suffixes);
+        if (number > 0) {
+            unit.requestedStem = unit.stem;
+            unit.stem += '_' + QByteArray::number(number);
+            ++plan.collisionCount;
+        }
+    }
+}
+
+void TransferPipeline::estimateTime(TransferPlan &plan) const
+{
+    // デバイス毎の実測の速度（なければ最も大きいファイルの先頭を読んで計測）から推定する
+    QVector<QString> largest(plan.devices.size());
+    QVector<qint64> largestSize(plan.devices.size(), -1);
+    for (const PlannedUnit &unit : plan.units) {
+        if (unit.action != PlannedUnit::Copy) {
+            continue;
+        }
+        PlannedDevice &device = plan.devices[unit.device];
+        device.files += static_cast<int>(unit.members.size());
+        device.bytes += unit.bytes();
+        plan.totalBytes += unit.bytes();
+        for (const PlannedMember &member : unit.members) {
+            if (member.size > largestSize.at(unit.device)) {
+                largestSize[unit.device] = member.size;
+                largest[unit.device] = member.source;
+            }
+        }
+    }
+
+    for (int i = 0; i < plan.devices.size(); ++i) {
+        PlannedDevice &device = plan.devices[i];
+        device.bytesPerSecond = DeviceThroughput::bytesPerSecond(device.source);
+        device.throughputSource = "history";
+        if (device.bytesPerSecond <= 0 && !largest.at(i).isEmpty()) {
+            device.bytesPerSecond = DeviceThroughput::probe(largest.at(i));
+            device.throughputSource = "probe";
+        }
+        if (device.bytesPerSecond > 0) {
+            device.estimatedSeconds = device.bytes / device.bytesPerSecond;
+        }
+        // デバイスは並行して読む
+        plan.estimatedSeconds = qMax(plan.estimatedSeconds, device.estimatedSeconds);
+    }
+}
+
+QByteArray TransferPipeline::contentHashOf(const QString &path)
+{
+    TraceSpan span("hash", path);
+    QFile in(path);
+    if (!in.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    if (!hash.addData(&in)) {
+        return QByteArray();
+    }
+    return hash.result().toHex();
+}
+
+FanOutDestination::Sink TransferPipeline::createDestination(const QString &spec) const
+{
+    const TransferOptions &options = job.options;
+    FanOutDestination::Sink sink;
+    sink.label = spec;
+    if (spec == "s3") {
+        sink.destination = std::make_unique<S3Destination>(options.s3);
+    } else if (spec == "dropbox") {
+        sink.destination = std::make_unique<DropboxDestination>(options.dropbox);
+    } else if (spec == "onedrive") {
+        sink.destination = std::make_unique<OneDriveDestination>(options.onedrive);
+    } else if (spec.startsWith("chunks:")) {
+        sink.label = spec.mid(7);
+        sink.destination = std::make_unique<ChunkStoreDestination>(sink.label);
+    } else {
+        // "local" は既定の出力先フォルダ、"local:<フォルダ>" は2台目以降のディスク
+        sink.label = spec.startsWith("local:") ? spec.mid(6) : options.destinationRoot;
+        sink.destination = std::make_unique<LocalDestination>(sink.label, options.durability, options.resume,
+                                                              options.verify);
+    }
+    // 出力先毎の速度制限（設定画面から実行中に変更できる）
+    sink.destination = std::make_unique<ThrottledDestination>(std::move(sink.destination));
+    return sink;
+}
+
+int TransferPipeline::scheduleUnits()
+{
+    // 組をソース（デバイス）毎のキューに分ける
+    const TransferOptions &options = job.options;
+    scheduler = std::make_unique<SourceScheduler>(options.readersPerSource);
+    QHash<quint32, QString> sourceByDirectory;     // ディレクトリの番号 → ソース
+    QHash<QString, int> sourceNumbers;     // ソース → sourceStatsの位置+1（ストリーミングでは窓をまたいで数える）
+    for (int i = 0; i < sourceStats.size(); ++i) {
+        sourceNumbers.insert(sourceStats.at(i).source, i + 1);
+    }
+    unitSources.fill(0, units.size());
+    for (int i = 0; i < units.size(); ++i) {
+        const int primary = units.at(i).members.first();
+        const quint32 directory = job.files.directoryAt(primary);
+        auto it = sourceByDirectory.constFind(directory);
+        if (it == sourceByDirectory.constEnd()) {
+            const QString path = QFileInfo(job.files.pathAt(primary)).absolutePath();
+            it = sourceByDirectory.insert(directory, SourceScheduler::sourceOf(path));
+        }
+        scheduler->addUnit(it.value(), i);
+        int &source = sourceNumbers[it.value()];
+        if (source == 0) {
+            sourceStats.append(SourceStats());
+            sourceStats.last().source = it.value();
+            source = static_cast<int>(sourceStats.size());
+        }
+        unitSources[i] = source - 1;
+    }
+    for (auto it = options.sourceWeights.constBegin(); it != options.sourceWeights.constEnd(); ++it) {
+        scheduler->setWeight(it.key(), it.value());
+    }
+
+    // すべてのソースを上限まで同時に読めるだけのワーカーを用意する
+    const int wanted = qMax(options.workerCount, scheduler->sourceCount() * options.readersPerSource);
+    return qBound(1, wanted, static_cast<int>(units.size()));
+}
+
+void TransferPipeline::workerLoop()
+{
+    QByteArray pathBuffer;
+    QByteArray readBuffer(job.options.chunkSize, Qt::Uninitialized);
+
+    while (true) {
+        const int index = scheduler->take(cancelled);
+        if (index < 0) {
+            break;
+        }
+        // 実行中に切り替えられるため、組毎に合わせる
+        RateLimiter::instance()->applyIoPriority();
+        const qint64 startMs = jobTimer.elapsed();
+        const qint64 unitBytes = processUnit(index, pathBuffer, readBuffer);
+        scheduler->done(index, unitBytes);
+        if (unitBytes > 0) {
+            QMutexLocker locker(&statsMutex);
+            SourceStats &stats = sourceStats[unitSources.at(index)];
+            stats.bytes += unitBytes;
+            stats.firstMs = stats.firstMs < 0 ? startMs : qMin(stats.firstMs, startMs);
+            stats.lastMs = qMax(stats.lastMs, jobTimer.elapsed());
+        }
+        reportProgress();
+    }
+}
+
+qint64 TransferPipeline::processUnit(int unitIndex, QByteArray &pathBuffer, QByteArray &readBuffer)
+{
+    TraceSpan span("unit");
+    if (span.isActive()) {
+        span.setDetail(job.files.pathAt(units.at(unitIndex).members.first()));
+    }
+    // 計画で飛ばすと決めた組、目録に記録済みの組は読まずに飛ばす
+    if (job.plan && job.plan->units.at(unitIndex).action != PlannedUnit::Copy) {
+        skipped.fetchAndAddRelaxed(static_cast<int>(units.at(unitIndex).members.size()));
+        return 0;
+    }
+    if (!job.plan && catalog && job.options.skipImported && isImported(unitIndex)) {
+        skipped.fetchAndAddRelaxed(static_cast<int>(units.at(unitIndex).members.size()));
+        return 0;
+    }
+
+    UnitPlan plan;
+    planUnit(unitIndex, pathBuffer, plan);
+
+    QString error;
+    if (job.plan && !matchesPlan(unitIndex, plan, &error)) {
+        failUnit(plan.sources, error);
+        return 0;
+    }
+    std::unique_ptr<UnitWriter> writer = destination->beginUnit(plan, &error);
+    if (!writer) {
+        failUnit(plan.sources, error);
+        return 0;
+    }
+
+    // 出力先で転送済みのメンバーは飛ばし、残りだけを1つの組として転送する
+    QVector<QFileInfo> sources;
+    for (int i = 0; i < plan.sources.size(); ++i) {
+        if (!writer->wants(i)) {
+            skipped.ref();
+            continue;
+        }
+        sources.append(plan.sources.at(i));
+    }
+    if (sources.isEmpty()) {
+        if (catalog) {
+            recordImported(plan, QVector<SourceFingerprint>(plan.sources.size()), writer->destinationPaths());
+        }
+        return 0;
+    }
+
+    // 組のファイルを続けて読み込み、すべて書き終えてからまとめて確定する
+    qint64 unitBytes = 0;
+    QVector<ChunkIndex::Chunk> freshChunks;
+    QVector<SourceFingerprint> fingerprints(plan.sources.size());
+    for (int i = 0; i < plan.sources.size(); ++i) {
+        if (writer->wants(i) && !copyMember(plan.sources.at(i), i, *writer, readBuffer, unitBytes,
+                                            chunks ? &freshChunks : nullptr, catalog ? &fingerprints[i] : nullptr,
+                                            &error)) {
+            writer->abort();
+            failUnit(sources, error);
+            return unitBytes;
+        }
+    }
+
+    bool committed;
+    {
+        TraceSpan commitSpan("commit");
+        committed = writer->commit(&error);
+    }
+    if (committed) {
+        completed.fetchAndAddRelaxed(static_cast<int>(sources.size()));
+        if (chunks) {
+            chunks->add(freshChunks);
+        }
+        if (similarity) {
+            indexSimilarity(plan);
+        }
+        if (catalog) {
+            recordImported(plan, fingerprints, writer->destinationPaths());
+        }
+    } else {
+        failUnit(sources, error);
+    }
+    return unitBytes;
+}
+
+void TransferPipeline::planUnit(int unitIndex, QByteArray &path, UnitPlan &plan)
+{
+    TraceSpan span("plan");
+    const TransferUnit &unit = units.at(unitIndex);
+    for (int member : unit.members) {
+        plan.sources.append(QFileInfo(job.files.pathAt(member)));
+    }
+    plan.suffixes = unit.suffixes;
+    if (job.plan) {
+        const PlannedUnit &planned = job.plan->units.at(unitIndex);
+        plan.relativeDir = planned.relativeDir;
+        plan.stem = planned.stem;
+        return;
+    }
+
+    const QFileInfo &primary = plan.sources.first();
+    const QDateTime modified = primary.lastModified();
+    const QDate date = modified.date();
+    const QTime time = modified.time();
+    // カメラはEXIF解析が未実装のため、イベント分けと同じくデバイス名で代用する
+    const QByteArray device = needsDeviceName ? deviceNameFor(primary) : QByteArray();
+    const QByteArray &primarySuffix = unit.suffixes.first();
+
+    PathFields fields;
+    fields.year = date.year();
+    fields.month = date.month();
+    fields.day = date.day();
+    fields.hour = time.hour();
+    fields.minute = time.minute();
+    fields.second = time.second();
+    fields.sequence = unitOffset + unitIndex + 1;
+    fields.name = unit.stem;
+    fields.extension = QByteArrayView(primarySuffix.constData() + qMin<qsizetype>(1, primarySuffix.size()),
+                                      qMax<qsizetype>(0, primarySuffix.size() - 1));
+    fields.device = device;
+    fields.camera = device;
+    if (!unitEvents.isEmpty()) {
+        fields.event = unitEvents.at(unitIndex);
+    }
+    if (!unitPlaces.isEmpty()) {
+        fields.place = unitPlaces.at(unitIndex);
+    }
+
+    path.resize(0);
+    folderTemplate.render(fields, path);
+    plan.relativeDir = path;
+
+    path.resize(0);
+    fileNameTemplate.render(fields, path);
+    plan.stem = path;
+}
+
+void TransferPipeline::assignEvents()
+{
+    TraceSpan span("metadata");
+    // 撮影日時は更新日時、カメラはデバイス名で代用する（EXIF解析が未実装のため）
+    QVector<EventClusterer::Item> items;
+    items.reserve(units.size());
+    for (const TransferUnit &unit : units) {
+        const QFileInfo primary(job.files.pathAt(unit.members.first()));
+        EventClusterer::Item item;
+        item.path = primary.absoluteFilePath();
+        item.captureMs = primary.lastModified().toMSecsSinceEpoch();
+        item.camera = QString::fromUtf8(deviceNameFor(primary));
+        items.append(item);
+    }
+
+    EventClusterer clusterer;
+    clusterer.add(items);
+    QVector<QByteArray> labels;
+    for (const EventClusterer::Event &event : clusterer.events()) {
+        labels.append(EventClusterer::labelOf(event).toUtf8());
+    }
+    unitEvents.clear();
+    unitEvents.reserve(items.size());
+    for (const EventClusterer::Item &item : items) {
+        const int event = clusterer.eventOf(item.path);
+        unitEvents.append(event >= 0 ? labels.at(event) : QByteArray());
+    }
+}
+
+void TransferPipeline::assignPlaces()
+{
+    // 地名の索引がなくても、撮影位置のまとまりでは分けられる
+    PlaceIndex places;
+    QString error;
+    if (!places.open(&error)) {
+        emit warningIssued("地名の索引がないため、撮影位置の座標でフォルダを分けます（" + error + "）");
+    }
+
+    unitPlaces.clear();
+    unitPlaces.resize(units.size());
+    QVector<GeoPoint> unnamed;
+    QVector<int> unnamedUnits;
+    for (int i = 0; i < units.size(); ++i) {
+        GeoPoint point;
+        // 位置の記録がない組は空（"Unknown"として展開）
+        if (!GeoTag::read(job.files.pathAt(units.at(i).members.first()), &point)) {
+            continue;
+        }
+        const QString name = places.nearest(point, placeRadiusKm);
+        if (!name.isEmpty()) {
+            unitPlaces[i] = name.toUtf8();
+        } else {
+            unnamed.append(point);
+            unnamedUnits.append(i);
+        }
+    }
+
+    // 近くに地名のない撮影位置は、まとまりの中心の座標を名前にする
+    const QVector<int> clusters = PlaceIndex::cluster(unnamed, unnamedClusterRadiusKm);
+    QVector<GeoPoint> centers;
+    QVector<int> sizes;
+    for (int i = 0; i < clusters.size(); ++i) {
+        const int cluster = clusters.at(i);
+        if (cluster >= centers.size()) {
+            centers.resize(cluster + 1);
+            sizes.resize(cluster + 1);
+        }
+        centers[cluster].latitude += unnamed.at(i).latitude;
+        centers[cluster].longitude += unnamed.at(i).longitude;
+        ++sizes[cluster];
+    }
+    QVector<QByteArray> labels;
+    for (int cluster = 0; cluster < centers.size(); ++cluster) {
+        GeoPoint center;
+        center.latitude = centers.at(cluster).latitude / sizes.at(cluster);
+        center.longitude = centers.at(cluster).longitude / sizes.at(cluster);
+        labels.append(PlaceIndex::coordinateLabel(center).toUtf8());
+    }
+    for (int i = 0; i < clusters.size(); ++i) {
+        unitPlaces[unnamedUnits.at(i)] = labels.at(clusters.at(i));
+    }
+}
+
+bool TransferPipeline::matchesPlan(int unitIndex, const UnitPlan &plan, QString *error) const
+{
+    TraceSpan span("stat");
+    const PlannedUnit &planned = job.plan->units.at(unitIndex);
+    for (int i = 0; i < plan.sources.size(); ++i) {
+        const QFileInfo &source = plan.sources.at(i);
+        const PlannedMember &member = planned.members.at(i);
+        if (!source.exists() || source.size() != member.size
+            || source.lastModified().toMSecsSinceEpoch() != member.modifiedMs) {
+            *error = "計画の作成後にファイルが変更されました: " + source.absoluteFilePath();
+            return false;
+        }
+    }
+    return true;
+}
+
+void TransferPipeline::recordThroughput()
+{
+    // 短すぎる転送は速度が安定しないため記録しない
+    for (const SourceStats &stats : sourceStats) {
+        const qint64 elapsedMs = stats.lastMs - stats.firstMs;
+        if (stats.bytes >= minThroughputSample && elapsedMs > 0) {
+            DeviceThroughput::record(stats.source, stats.bytes * 1000.0 / elapsedMs);
+        }
+    }
+}
+
+bool TransferPipeline::isImported(int unitIndex) const
+{
+    TraceSpan span("catalog");
+    for (int member : units.at(unitIndex).members) {
+        if (catalog->destinationOf(QFileInfo(job.files.pathAt(member))).isEmpty()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool TransferPipeline::copyMember(const QFileInfo &source, int member, UnitWriter &writer,
+                                  QByteArray &buffer, qint64 &unitBytes, QVector<ChunkIndex::Chunk> *freshChunks,
+                                  SourceFingerprint *fingerprint, QString *error)
+{
+    // 全出力先の合計の速度制限
+    RateLimiter::Scope *limit = RateLimiter::instance()->scope(RateLimiter::globalScope());
+    limit->acquireOperation();
+
+    // ファイル毎の区間の中に、読み込み・書き込み・ハッシュの区間がチャンク毎に入る
+    const QString path = source.absoluteFilePath();
+    TraceSpan span("copy", path);
+    QFile in(path);
+    if (!in.open(QIODevice::ReadOnly)) {
+        *error = in.errorString();
+        return false;
+    }
+    if (!writer.beginFile(member, error)) {
+        return false;
+    }
+
+    // 動画は読んだデータをそのままチャンクに分割し、取り込み済みの内容の量を数える
+    std::unique_ptr<ContentChunker> chunker;
+    qint64 existingBytes = 0;
+    if (freshChunks && ContentChunker::isVideo(source.suffix())) {
+        chunker = std::make_unique<ContentChunker>([this, freshChunks, &existingBytes](const char *data, qint64 size) {
+            const QByteArray hash = ContentChunker::chunkHash(data, size);
+            if (chunks->contains(hash)) {
+                existingBytes += size;
+            } else {
+                freshChunks->append({hash, size});
+            }
+        });
+    }
+
+    // 目録用の部分ハッシュは読んだデータの先頭から求める
+    QCryptographicHash partialHash(QCryptographicHash::Sha256);
+    if (fingerprint) {
+        ImportCatalog::fingerprintOf(source, fingerprint);
+    }
+
+    qint64 copied = 0;
+    while (true) {
+        qint64 n;
+        {
+            TraceSpan readSpan("read");
+            n = in.read(buffer.data(), buffer.size());
+            readSpan.addBytes(n);
+        }
+        if (n == 0) {
+            break;
+        }
+        if (n < 0) {
+            *error = in.errorString();
+            return false;
+        }
+        {
+            // 速度制限で待った時間も区間にする
+            TraceSpan throttleSpan("throttle");
+            limit->acquireBytes(n);
+        }
+        if (cancelled.loadRelaxed()) {
+            *error = "キャンセルされました";
+            return false;
+        }
+        {
+            TraceSpan writeSpan("write");
+            writeSpan.addBytes(n);
+            if (!writer.write(buffer.constData(), n, error)) {
+                return false;
+            }
+        }
+        if (chunker || (fingerprint && copied < ImportCatalog::partialHashSize)) {
+            TraceSpan hashSpan("hash");
+            hashSpan.addBytes(n);
+            if (chunker) {
+                chunker->feed(buffer.constData(), n);
+            }
+            if (fingerprint && copied < ImportCatalog::partialHashSize) {
+                partialHash.addData(QByteArrayView(buffer.constData(), qMin(n, ImportCatalog::partialHashSize - copied)));
+            }
+        }
+        copied += n;
+        unitBytes += n;
+    }
+    bytes.fetchAndAddRelaxed(copied);
+    span.addBytes(copied);
+    if (fingerprint) {
+        fingerprint->partialHash = partialHash.result().toHex();
+    }
+    if (chunker) {
+        chunker->finish();
+        emit chunkDedupReported(path, existingBytes, copied);
+    }
+    return writer.endFile(error);
+}
+
+void TransferPipeline::indexSimilarity(const UnitPlan &plan)
+{
+    // 組の代表（最初のメンバー）が静止画の場合だけ。ソースは読んだ直後でキャッシュに載っている
+    const QFileInfo &primary = plan.sources.first();
+    if (!PerceptualHash::isSupported(primary.suffix())) {
+        return;
+    }
+    PerceptualHash hash;
+    if (!PerceptualHash::fromFile(primary.absoluteFilePath(), &hash)) {
+        return;
+    }
+    for (const SimilarityIndex::Match &match : similarity->find(hash, job.options.similarImageRadius)) {
+        emit similarFound(primary.absoluteFilePath(), match.path, match.distance);
+    }
+    similarity->add(hash, QString::fromUtf8(plan.relativePath(0)));
+}
+
+void TransferPipeline::recordImported(const UnitPlan &plan, const QVector<SourceFingerprint> &fingerprints,
+                                      const std::shared_ptr<const UnitPaths> &paths)
+{
+    QVector<ImportedFile> files;
+    for (int i = 0; i < plan.sources.size(); ++i) {
+        ImportedFile file;
+        file.fingerprint = fingerprints.at(i);
+        file.sourcePath = plan.sources.at(i).absoluteFilePath();
+        file.paths = paths;
+        file.member = i;
+        if (file.fingerprint.partialHash.isEmpty()) {
+            // 出力先で転送済みだったメンバー（目録を使う前に取り込んだファイル）も記録しておく
+            if (!ImportCatalog::fingerprintOf(plan.sources.at(i), &file.fingerprint)) {
+                continue;
+            }
+            file.fingerprint.partialHash = ImportCatalog::partialHashOf(file.sourcePath);
+        }
+        files.append(file);
+    }
+    QMutexLocker locker(&catalogMutex);
+    importedFiles += files;
+}
+
+void TransferPipeline::writeCatalog()
+{
+    if (!catalog) {
+        return;
+    }
+    TraceSpan span("catalog");
+    QMutexLocker locker(&catalogMutex);
+    for (const ImportedFile &file : importedFiles) {
+        const QByteArray destinationPath = file.paths->at(file.member);
+        if (!destinationPath.isEmpty() && !failedSources.contains(file.sourcePath)) {
+            catalog->add(file.fingerprint, QFileInfo(file.sourcePath).fileName(), QString::fromUtf8(destinationPath));
+        }
+    }
+    importedFiles.clear();
+    catalog->flush();
+}
+
+void TransferPipeline::discardImported()
+{
+    QMutexLocker locker(&catalogMutex);
+    importedFiles.clear();
+}
+
+void TransferPipeline::failUnit(const QVector<QFileInfo> &sources, const QString &error)
+{
+    if (catalog) {
+        // 確定後に失敗した組（読み戻し検証など）を目録に記録しないようにする
+        QMutexLocker locker(&catalogMutex);
+        for (const QFileInfo &source : sources) {
+            failedSources.insert(source.absoluteFilePath());
+        }
+    }
+    failed.fetchAndAddRelaxed(static_cast<int>(sources.size()));
+    for (const QFileInfo &source : sources) {
+        emit fileFailed(source.absoluteFilePath(), error);
+    }
+}
+
+QByteArray TransferPipeline::deviceNameFor(const QFileInfo &source)
+{
+    const QString dir = source.absolutePath();
+    QMutexLocker locker(&deviceMutex);
+    auto it = deviceNames.constFind(dir);
+    if (it != deviceNames.constEnd()) {
+        return it.value();
+    }
+    const QByteArray name = QStorageInfo(dir).displayName().toUtf8();
+    deviceNames.insert(dir, name);
+    return name;
+}
+
+void TransferPipeline::reportProgress()
+{
+    const int done = completed.loadRelaxed() + failed.loadRelaxed() + skipped.loadRelaxed();
+    if (streamScanner) {
+        // 一定件数毎に知らせる（窓の終わりにも runStreaming が知らせる）
+        int previous = lastReportedDone.loadRelaxed();
+        while (done >= previous + streamProgressStep) {
+            if (lastReportedDone.testAndSetRelaxed(previous, done)) {
+                emit streamProgressChanged(streamScanner->discoveredCount(), done);
+                break;
+            }
+            previous = lastReportedDone.loadRelaxed();
+        }
+        return;
+    }
+
+    const int total = static_cast<int>(job.files.size());
+    if (total == 0) {
+        return;
+    }
+
+    const int percentage = qMin(100, (done * 100) / total);
+    int previous = lastPercentage.loadRelaxed();
+    while (percentage > previous) {
+        if (lastPercentage.testAndSetRelaxed(previous, percentage)) {
+            emit progressChanged(percentage);
+            break;
+        }
+        previous = lastPercentage.loadRelaxed();
+    }
+}
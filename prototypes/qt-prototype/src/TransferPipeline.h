@@ -0,0 +1,150 @@
+#ifndef TRANSFERPIPELINE_H
+#define TRANSFERPIPELINE_H
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QFileInfo>
+#include <QHash>
+#include <QMutex>
+#include <QSet>
+#include <QElapsedTimer>
+#include <memory>
+#include "TransferJob.h"
+#include "PathTemplate.h"
+#include "TransferUnit.h"
+#include "TransferDestination.h"
+#include "FanOutDestination.h"
+#include "SourceScheduler.h"
+#include "SimilarityIndex.h"
+#include "ChunkIndex.h"
+#include "ImportCatalog.h"
+#include "StreamingScanner.h"
+
+// ファイル転送パイプライン
+// ProcessingThreadから呼ばれ、複数のワーカースレッドでソースを読み込んで出力先（TransferDestination）に渡す。
+// 出力先が複数の場合はFanOutDestinationでまとめ、ソースは1回だけ読む。
+// 取り込み済みファイルの目録（ImportCatalog）に記録済みの組は、出力先を確認せずに飛ばす。
+// 読み込む組はSourceSchedulerがソース（カードリーダー等）毎に公平に割り振る。
+// 関連ファイル（RAW+JPEG、Live Photo、サイドカー）は1つの組として続けて読み、まとめて確定する。
+// 動画の重複の集計を有効にすると、読んだデータをチャンクに分割して取り込み済みの内容の量を報告する。
+// 類似画像の検出を有効にすると、確定した組の画像の知覚ハッシュを索引と照合してから追加する。
+// ストリーミングでは StreamingScanner の窓毎に組分け・転送し、目録も窓毎に書く。
+class TransferPipeline : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TransferPipeline(const TransferJob &job, QObject *parent = nullptr);
+    ~TransferPipeline();
+
+    // 全ファイルの処理が終わるまでブロックする
+    bool run();
+    // ジョブ全体を前もって計算する（コピーはしない）
+    // 組毎の出力先を並列に求め、名前の衝突・同じジョブ内の重複・取り込み済みを判定し、
+    // デバイス毎の量と実測の速度から時間を推定する。結果はそのまま job.plan として実行できる
+    bool plan(TransferPlan *plan, QString *error);
+    void cancel();
+
+    int completedCount() const { return completed.loadRelaxed(); }
+    int failedCount() const { return failed.loadRelaxed(); }
+    int skippedCount() const { return skipped.loadRelaxed(); }
+    qint64 bytesTransferred() const { return bytes.loadRelaxed(); }
+
+signals:
+    void progressChanged(int percentage);
+    void fileFailed(const QString &filePath, const QString &reason);
+    // ファイル毎の失敗ではない、ジョブ全体への注意（地名の索引がない等）
+    void warningIssued(const QString &message);
+    // 取り込み済みの画像と似ている（existingPathは出力先からの相対パス）
+    void similarFound(const QString &filePath, const QString &existingPath, int distance);
+    // 動画のうち取り込み済みのチャンクと同じ内容の量
+    void chunkDedupReported(const QString &filePath, qint64 existingBytes, qint64 totalBytes);
+    // ストリーミングでは総数が分からないため、見つけた数と終わった数を知らせる
+    void streamProgressChanged(qint64 discovered, qint64 done);
+
+private:
+    void buildUnits();
+    int scheduleUnits();
+    void runWorkers(int workerCount);
+    void runStreaming();
+    FanOutDestination::Sink createDestination(const QString &spec) const;
+    void workerLoop();
+    qint64 processUnit(int unitIndex, QByteArray &pathBuffer, QByteArray &readBuffer);
+    void planUnit(int unitIndex, QByteArray &pathBuffer, UnitPlan &plan);
+    void assignEvents();
+    void assignPlaces();
+    bool isImported(int unitIndex) const;
+    bool matchesPlan(int unitIndex, const UnitPlan &plan, QString *error) const;
+    void findDuplicates(TransferPlan &plan) const;
+    void resolveCollisions(TransferPlan &plan) const;
+    void estimateTime(TransferPlan &plan) const;
+    static QByteArray contentHashOf(const QString &path);
+    void recordThroughput();
+    bool copyMember(const QFileInfo &source, int member, UnitWriter &writer, QByteArray &readBuffer,
+                    qint64 &unitBytes, QVector<ChunkIndex::Chunk> *freshChunks, SourceFingerprint *fingerprint,
+                    QString *error);
+    void recordImported(const UnitPlan &plan, const QVector<SourceFingerprint> &fingerprints,
+                        const std::shared_ptr<const UnitPaths> &paths);
+    void writeCatalog();
+    // 確定できたか分からない組の記録を目録に載せずに捨てる
+    void discardImported();
+    void indexSimilarity(const UnitPlan &plan);
+    void failUnit(const QVector<QFileInfo> &sources, const QString &error);
+    QByteArray deviceNameFor(const QFileInfo &source);
+    void reportProgress();
+
+    TransferJob job;
+    QVector<TransferUnit> units;
+    std::unique_ptr<SourceScheduler> scheduler;
+    std::unique_ptr<TransferDestination> destination;
+    std::unique_ptr<SimilarityIndex> similarity;
+    std::unique_ptr<ChunkIndex> chunks;
+    std::shared_ptr<ImportCatalog> catalog;     // 同じ出力先の組に取り込む他のジョブと共有する
+
+    // 目録にはジョブの終わりに、後から失敗した組を除いてまとめて追記する
+    // 出力先のパスは確定時に付け直すことがあるため、追記するときに読む
+    struct ImportedFile
+    {
+        SourceFingerprint fingerprint;
+        QString sourcePath;
+        std::shared_ptr<const UnitPaths> paths;
+        int member = 0;
+    };
+    QMutex catalogMutex;
+    QVector<ImportedFile> importedFiles;
+    QSet<QString> failedSources;
+
+    PathTemplate folderTemplate;
+    PathTemplate fileNameTemplate;
+    bool needsDeviceName = false;       // テンプレートが {device} か {camera} を使う
+    QMutex deviceMutex;
+    QHash<QString, QByteArray> deviceNames;
+    QVector<QByteArray> unitEvents;     // 組毎のイベント名（{event} を使う場合のみ）
+    QVector<QByteArray> unitPlaces;     // 組毎の地名（{place} を使う場合のみ）
+
+    // ソース毎の読み込み量と時間（速度を記録して次の計画の推定に使う）
+    struct SourceStats
+    {
+        QString source;
+        qint64 bytes = 0;
+        qint64 firstMs = -1;
+        qint64 lastMs = 0;
+    };
+    QMutex statsMutex;
+    QVector<SourceStats> sourceStats;
+    QVector<int> unitSources;           // 組 → sourceStatsの位置
+    QElapsedTimer jobTimer;
+
+    QAtomicInt completed;
+    QAtomicInt failed;
+    QAtomicInt skipped;
+    QAtomicInt lastPercentage;
+    StreamingScanner *streamScanner = nullptr;
+    int unitOffset = 0;             // これまでの窓の組の数（{sequence}をジョブ全体で通し番号にする）
+    QAtomicInt lastReportedDone;
+    QAtomicInteger<qint64> bytes;
+    QAtomicInt cancelled;
+};
+
+#endif // TRANSFERPIPELINE_H
@@ -0,0 +1,241 @@
+#include "TransferPlan.h"
+#include <QDateTime>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+
+namespace {
+
+const char *const actionNames[] = {"copy", "skip-imported", "skip-duplicate"};
+
+QString actionName(PlannedUnit::Action action)
+{
+    return QString::fromLatin1(actionNames[action]);
+}
+
+bool actionFromName(const QString &name, PlannedUnit::Action *action)
+{
+    for (int i = 0; i < 3; ++i) {
+        if (name == QLatin1String(actionNames[i])) {
+            *action = static_cast<PlannedUnit::Action>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+QString formatDuration(double seconds)
+{
+    const qint64 total = static_cast<qint64>(seconds + 0.5);
+    if (total < 60) {
+        return QString("%1 秒").arg(total);
+    }
+    if (total < 3600) {
+        return QString("%1 分 %2 秒").arg(total / 60).arg(total % 60);
+    }
+    return QString("%1 時間 %2 分").arg(total / 3600).arg((total % 3600) / 60);
+}
+
+} // namespace
+
+qint64 PlannedUnit::bytes() const
+{
+    qint64 total = 0;
+    for (const PlannedMember &member : members) {
+        total += member.size;
+    }
+    return total;
+}
+
+PathTable TransferPlan::files() const
+{
+    PathTable paths;
+    for (const PlannedUnit &unit : units) {
+        for (const PlannedMember &member : unit.members) {
+            paths.append(member.source);
+        }
+    }
+    return paths;
+}
+
+QString TransferPlan::summary() const
+{
+    int copyUnits = 0;
+    for (const PlannedUnit &unit : units) {
+        if (unit.action == PlannedUnit::Copy) {
+            ++copyUnits;
+        }
+    }
+    QStringList lines;
+    lines << QString("コピー: %1 組（%2 MB）").arg(copyUnits).arg(totalBytes / (1024 * 1024));
+    lines << QString("取り込み済みで飛ばす: %1 組").arg(importedCount);
+    lines << QString("同じ内容の重複: %1 組").arg(duplicateCount);
+    lines << QString("名前の衝突で改名: %1 組").arg(collisionCount);
+    for (const PlannedDevice &device : devices) {
+        lines << QString("💾 %1: %2 件 %3 MB、%4 MB/s（%5）、約 %6")
+                     .arg(device.source)
+                     .arg(device.files)
+                     .arg(device.bytes / (1024 * 1024))
+                     .arg(device.bytesPerSecond / (1024 * 1024), 0, 'f', 1)
+                     .arg(device.throughputSource == "history" ? "実測" : "計画時に計測")
+                     .arg(formatDuration(device.estimatedSeconds));
+    }
+    lines << QString("推定時間: 約 %1").arg(formatDuration(estimatedSeconds));
+    return lines.join('\n');
+}
+
+bool TransferPlan::save(const QString &path, QString *error) const
+{
+    QJsonArray deviceArray;
+    for (const PlannedDevice &device : devices) {
+        QJsonObject object;
+        object["source"] = device.source;
+        object["files"] = device.files;
+        object["bytes"] = device.bytes;
+        object["bytesPerSecond"] = device.bytesPerSecond;
+        object["throughputSource"] = device.throughputSource;
+        object["estimatedSeconds"] = device.estimatedSeconds;
+        deviceArray.append(object);
+    }
+
+    QJsonArray unitArray;
+    for (const PlannedUnit &unit : units) {
+        QJsonObject object;
+        object["action"] = actionName(unit.action);
+        object["dir"] = QString::fromUtf8(unit.relativeDir);
+        object["stem"] = QString::fromUtf8(unit.stem);
+        if (!unit.requestedStem.isEmpty()) {
+            object["requestedStem"] = QString::fromUtf8(unit.requestedStem);
+        }
+        if (unit.duplicateOf >= 0) {
+            object["duplicateOf"] = unit.duplicateOf;
+        }
+        object["device"] = unit.device;
+        QJsonArray memberArray;
+        for (const PlannedMember &member : unit.members) {
+            QJsonObject m;
+            m["source"] = member.source;
+            m["suffix"] = QString::fromUtf8(member.suffix);
+            m["size"] = member.size;
+            m["modifiedMs"] = member.modifiedMs;
+            memberArray.append(m);
+        }
+        object["members"] = memberArray;
+        unitArray.append(object);
+    }
+
+    QJsonObject summaryObject;
+    summaryObject["totalBytes"] = totalBytes;
+    summaryObject["collisions"] = collisionCount;
+    summaryObject["duplicates"] = duplicateCount;
+    summaryObject["imported"] = importedCount;
+    summaryObject["estimatedSeconds"] = estimatedSeconds;
+
+    QJsonObject root;
+    root["version"] = formatVersion;
+    root["createdAt"] = QDateTime::fromMSecsSinceEpoch(createdMs).toString(Qt::ISODate);
+    root["createdMs"] = createdMs;
+    root["destinations"] = QJsonArray::fromStringList(destinations);
+    root["destinationRoot"] = destinationRoot;
+    root["folderTemplate"] = folderTemplate;
+    root["fileNameTemplate"] = fileNameTemplate;
+    root["summary"] = summaryObject;
+    root["devices"] = deviceArray;
+    root["units"] = unitArray;
+
+    // 差分を取りやすいよう整形して書く
+    QSaveFile out(path);
+    if (!out.open(QIODevice::WriteOnly)) {
+        *error = "計画を保存できません: " + out.errorString();
+        return false;
+    }
+    out.write(QJsonDocument(root).toJson(QJsonDocument::Indented));
+    if (!out.commit()) {
+        *error = "計画を保存できません: " + out.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool TransferPlan::load(const QString &path, TransferPlan *plan, QString *error)
+{
+    QFile in(path);
+    if (!in.open(QIODevice::ReadOnly)) {
+        *error = "計画を開けません: " + in.errorString();
+        return false;
+    }
+    QJsonParseError parseError;
+    const QJsonDocument document = QJsonDocument::fromJson(in.readAll(), &parseError);
+    if (parseError.error != QJsonParseError::NoError || !document.isObject()) {
+        *error = "計画を読み込めません: " + parseError.errorString();
+        return false;
+    }
+    const QJsonObject root = document.object();
+    if (root["version"].toInt() != formatVersion) {
+        *error = QString("計画の形式のバージョンが違います: %1").arg(root["version"].toInt());
+        return false;
+    }
+
+    TransferPlan result;
+    result.createdMs = root["createdMs"].toInteger();
+    for (const QJsonValue &value : root["destinations"].toArray()) {
+        result.destinations << value.toString();
+    }
+    result.destinationRoot = root["destinationRoot"].toString();
+    result.folderTemplate = root["folderTemplate"].toString();
+    result.fileNameTemplate = root["fileNameTemplate"].toString();
+
+    const QJsonObject summaryObject = root["summary"].toObject();
+    result.totalBytes = summaryObject["totalBytes"].toInteger();
+    result.collisionCount = summaryObject["collisions"].toInt();
+    result.duplicateCount = summaryObject["duplicates"].toInt();
+    result.importedCount = summaryObject["imported"].toInt();
+    result.estimatedSeconds = summaryObject["estimatedSeconds"].toDouble();
+
+    for (const QJsonValue &value : root["devices"].toArray()) {
+        const QJsonObject object = value.toObject();
+        PlannedDevice device;
+        device.source = object["source"].toString();
+        device.files = object["files"].toInt();
+        device.bytes = object["bytes"].toInteger();
+        device.bytesPerSecond = object["bytesPerSecond"].toDouble();
+        device.throughputSource = object["throughputSource"].toString();
+        device.estimatedSeconds = object["estimatedSeconds"].toDouble();
+        result.devices.append(device);
+    }
+
+    const QJsonArray unitArray = root["units"].toArray();
+    result.units.reserve(unitArray.size());
+    for (const QJsonValue &value : unitArray) {
+        const QJsonObject object = value.toObject();
+        PlannedUnit unit;
+        if (!actionFromName(object["action"].toString(), &unit.action)) {
+            *error = "計画の処理の種類が不明です: " + object["action"].toString();
+            return false;
+        }
+        unit.relativeDir = object["dir"].toString().toUtf8();
+        unit.stem = object["stem"].toString().toUtf8();
+        unit.requestedStem = object["requestedStem"].toString().toUtf8();
+        unit.duplicateOf = object["duplicateOf"].toInt(-1);
+        unit.device = object["device"].toInt();
+        for (const QJsonValue &memberValue : object["members"].toArray()) {
+            const QJsonObject m = memberValue.toObject();
+            PlannedMember member;
+            member.source = m["source"].toString();
+            member.suffix = m["suffix"].toString().toUtf8();
+            member.size = m["size"].toInteger();
+            member.modifiedMs = m["modifiedMs"].toInteger();
+            unit.members.append(member);
+        }
+        if (unit.stem.isEmpty() || unit.members.isEmpty()) {
+            *error = "計画の組にファイル名またはファイルがありません";
+            return false;
+        }
+        result.units.append(unit);
+    }
+
+    *plan = result;
+    return true;
+}
@@ -0,0 +1,79 @@
+#ifndef TRANSFERPLAN_H
+#define TRANSFERPLAN_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QVector>
+#include "PathTable.h"
+
+// 転送の計画（ドライラン）の結果
+// 組毎の出力先のパス・ファイル名の衝突・重複・取り込み済みの判定と、デバイス毎の量と推定時間を持つ。
+// JSONに保存して確認・比較でき、読み込んだ計画はテンプレートの展開や判定をせずにそのまま実行する。
+// 組の並びが実行の順（デバイス毎、カード上の配置順）になっている。
+struct PlannedMember
+{
+    QString source;
+    QByteArray suffix;              // stem 以降（".JPG", ".JPG.xmp" など）
+    qint64 size = 0;
+    qint64 modifiedMs = 0;          // 実行時にこれと違えば計画後に変更されたものとして失敗にする
+};
+
+struct PlannedUnit
+{
+    enum Action {
+        Copy = 0,
+        SkipImported,               // 取り込み済みファイルの目録にある
+        SkipDuplicate,              // 同じジョブ内の別の組と内容が同じ
+    };
+
+    QByteArray relativeDir;         // 出力先の直下からの相対フォルダ（UTF-8）
+    QByteArray stem;                // 衝突を避けた後のファイル名
+    QByteArray requestedStem;       // テンプレートを展開したファイル名（衝突で変えた場合のみ）
+    QVector<PlannedMember> members;
+    int device = 0;                 // TransferPlan::devices の位置
+    Action action = Copy;
+    int duplicateOf = -1;           // 内容が同じ組（units の位置）
+
+    qint64 bytes() const;
+};
+
+struct PlannedDevice
+{
+    QString source;                 // SourceScheduler::sourceOf
+    int files = 0;
+    qint64 bytes = 0;               // コピーする量
+    double bytesPerSecond = 0;
+    QString throughputSource;       // "history"（前回までの実測）/ "probe"（計画時に読んで計測）
+    double estimatedSeconds = 0;
+};
+
+struct TransferPlan
+{
+    static constexpr int formatVersion = 1;
+
+    qint64 createdMs = 0;
+    QStringList destinations;
+    QString destinationRoot;
+    QString folderTemplate;
+    QString fileNameTemplate;
+    QVector<PlannedUnit> units;
+    QVector<PlannedDevice> devices;
+
+    int collisionCount = 0;
+    int duplicateCount = 0;
+    int importedCount = 0;
+    qint64 totalBytes = 0;          // コピーする量
+    double estimatedSeconds = 0;    // デバイスは並行して読むため、最も時間のかかるデバイスの時間
+
+    bool isEmpty() const { return units.isEmpty(); }
+    // 実行するジョブのファイル（組のメンバーを並び順に並べたもの）
+    PathTable files() const;
+    // 画面表示用の要約（複数行）
+    QString summary() const;
+
+    bool save(const QString &path, QString *error) const;
+    static bool load(const QString &path, TransferPlan *plan, QString *error);
+};
+
+#endif // TRANSFERPLAN_H
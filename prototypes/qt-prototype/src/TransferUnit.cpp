@@ -0,0 +1,88 @@
+#include "TransferUnit.h"
+#include <QHash>
+#include <algorithm>
+
+namespace {
+
+bool isSidecarExtension(const QString &extension)
+{
+    return extension.compare("xmp", Qt::CaseInsensitive) == 0
+        || extension.compare("thm", Qt::CaseInsensitive) == 0
+        || extension.compare("lrv", Qt::CaseInsensitive) == 0
+        || extension.compare("aae", Qt::CaseInsensitive) == 0;
+}
+
+// 同じディレクトリ+ファイル名（小文字）を表すキー。ディレクトリは番号で区別する
+QString keyOf(quint32 directory, const QString &stem)
+{
+    return QString::number(directory) + '/' + stem.toLower();
+}
+
+} // namespace
+
+QVector<TransferUnit> buildTransferUnits(const PathTable &files)
+{
+    QVector<TransferUnit> units;
+    QHash<QString, int> index;  // "ディレクトリの番号/stem"（小文字）→ units の位置
+    QVector<int> sidecars;
+    index.reserve(files.size());
+
+    // 本体ファイル（画像・動画）を同じディレクトリ+ファイル名でまとめる
+    for (int i = 0; i < files.size(); ++i) {
+        const QString fileName = files.fileNameAt(i);
+        qsizetype dot = fileName.lastIndexOf('.');
+        if (dot <= 0) {
+            dot = fileName.size();
+        }
+        if (isSidecarExtension(fileName.mid(dot + 1))) {
+            sidecars.append(i);
+            continue;
+        }
+
+        const QString key = keyOf(files.directoryAt(i), fileName.left(dot));
+        int unitIndex = index.value(key, -1);
+        if (unitIndex < 0) {
+            unitIndex = static_cast<int>(units.size());
+            index.insert(key, unitIndex);
+            TransferUnit unit;
+            unit.stem = fileName.left(dot).toUtf8();
+            units.append(unit);
+        }
+        units[unitIndex].members.append(i);
+        units[unitIndex].suffixes.append(fileName.mid(dot).toUtf8());
+    }
+
+    // サイドカーは "IMG_0001.xmp" と "IMG_0001.JPG.xmp" の両方の形式で本体を探す
+    for (int i : sidecars) {
+        const quint32 directory = files.directoryAt(i);
+        const QString fileName = files.fileNameAt(i);
+        const qsizetype dot = fileName.lastIndexOf('.');
+
+        qsizetype stemLength = dot;
+        int unitIndex = index.value(keyOf(directory, fileName.left(dot)), -1);
+        if (unitIndex < 0) {
+            const qsizetype innerDot = fileName.lastIndexOf('.', dot - 1);
+            if (innerDot > 0) {
+                unitIndex = index.value(keyOf(directory, fileName.left(innerDot)), -1);
+                stemLength = innerDot;
+            }
+        }
+        if (unitIndex < 0) {
+            // 本体が選択されていないサイドカーは単独で転送する
+            stemLength = dot;
+            unitIndex = static_cast<int>(units.size());
+            index.insert(keyOf(directory, fileName.left(dot)), unitIndex);
+            TransferUnit unit;
+            unit.stem = fileName.left(dot).toUtf8();
+            units.append(unit);
+        }
+        units[unitIndex].members.append(i);
+        units[unitIndex].suffixes.append(fileName.mid(stemLength).toUtf8());
+    }
+
+    const PathOrder order(files);
+    std::sort(units.begin(), units.end(), [&order](const TransferUnit &a, const TransferUnit &b) {
+        return order.lessThan(a.members.first(), b.members.first());
+    });
+    return units;
+}
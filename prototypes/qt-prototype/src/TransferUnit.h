@@ -0,0 +1,23 @@
+#ifndef TRANSFERUNIT_H
+#define TRANSFERUNIT_H
+
+#include <QByteArray>
+#include <QStringList>
+#include <QVector>
+#include "PathTable.h"
+
+// まとめて転送・確定するファイルの組
+// Live Photo（HEIC+MOV）、RAW+JPEG（CR3+JPG）、サイドカー（XMP/THM/LRV/AAE）を
+// 同じフォルダ・同じファイル名で揃えて出力し、片方だけの取り込みを防ぐ。
+struct TransferUnit
+{
+    QVector<int> members;           // TransferJob::files のインデックス（先頭が代表ファイル）
+    QByteArray stem;                // 共通のファイル名（UTF-8）
+    QVector<QByteArray> suffixes;   // 各メンバーの stem 以降（".HEIC", ".JPG.xmp" など）
+};
+
+// ディレクトリ+ファイル名のハッシュ索引で関連ファイルをまとめる。
+// 返す組は代表ファイルのパス順に並べる（カード上の配置に近い順で読むため）。
+QVector<TransferUnit> buildTransferUnits(const PathTable &files);
+
+#endif // TRANSFERUNIT_H
@@ -0,0 +1,277 @@
+#include "TrigramIndex.h"
+#include <algorithm>
+#include <numeric>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TRIGRAMINDEX_SSE2
+#endif
+
+namespace {
+
+void appendVarint(QByteArray &out, quint32 value)
+{
+    while (value >= 0x80) {
+        out.append(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.append(static_cast<char>(value));
+}
+
+} // namespace
+
+void TrigramIndex::build(const QStringList &paths)
+{
+    clear();
+    QHash<QString, int> directoryIds;
+    directoryOf.reserve(paths.size());
+    names.texts.reserve(paths.size());
+    for (int i = 0; i < paths.size(); ++i) {
+        const QString &path = paths.at(i);
+        const qsizetype slash = path.lastIndexOf('/');
+        const QString directory = slash >= 0 ? path.left(slash) : QString();
+        auto it = directoryIds.constFind(directory);
+        if (it == directoryIds.constEnd()) {
+            it = directoryIds.insert(directory, static_cast<int>(directories.texts.size()));
+            directories.texts.append(normalize(directory));
+            entriesOfDirectory.append(QVector<int>());
+        }
+        directoryOf.append(it.value());
+        entriesOfDirectory[it.value()].append(i);
+        names.texts.append(normalize(path.mid(slash + 1)));
+    }
+    names.build();
+    directories.build();
+}
+
+void TrigramIndex::clear()
+{
+    names = Field();
+    directories = Field();
+    directoryOf.clear();
+    entriesOfDirectory.clear();
+}
+
+QVector<int> TrigramIndex::search(const QString &query, int maxEdits) const
+{
+    const Text normalized = normalize(query);
+    if (normalized.isEmpty()) {
+        return QVector<int>();
+    }
+    QVector<int> result = names.search(normalized, maxEdits);
+
+    // ディレクトリが一致したエントリを加える
+    const QVector<int> directoryHits = directories.search(normalized, maxEdits);
+    if (!directoryHits.isEmpty()) {
+        QVector<int> entries;
+        for (int directory : directoryHits) {
+            entries += entriesOfDirectory.at(directory);
+        }
+        std::sort(entries.begin(), entries.end());
+        QVector<int> merged;
+        merged.reserve(result.size() + entries.size());
+        std::set_union(result.constBegin(), result.constEnd(), entries.constBegin(), entries.constEnd(),
+                       std::back_inserter(merged));
+        result.swap(merged);
+    }
+    return result;
+}
+
+QVector<int> TrigramIndex::intersect(const QVector<int> &a, const QVector<int> &b)
+{
+    QVector<int> out;
+    out.reserve(qMin(a.size(), b.size()));
+    const int *pa = a.constData();
+    const int *pb = b.constData();
+    const qsizetype na = a.size();
+    const qsizetype nb = b.size();
+    qsizetype i = 0;
+    qsizetype j = 0;
+
+#ifdef TRIGRAMINDEX_SSE2
+    // aの4要素とbの4要素の16通りを、bを回転させた4回の比較で調べる
+    while (i + 4 <= na && j + 4 <= nb) {
+        const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pa + i));
+        const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pb + j));
+        __m128i equal = _mm_cmpeq_epi32(va, vb);
+        equal = _mm_or_si128(equal, _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1))));
+        equal = _mm_or_si128(equal, _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2))));
+        equal = _mm_or_si128(equal, _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(2, 1, 0, 3))));
+        const int mask = _mm_movemask_ps(_mm_castsi128_ps(equal));
+        for (int k = 0; k < 4; ++k) {
+            if (mask & (1 << k)) {
+                out.append(pa[i + k]);
+            }
+        }
+        const int lastA = pa[i + 3];
+        const int lastB = pb[j + 3];
+        if (lastA <= lastB) {
+            i += 4;
+        }
+        if (lastB <= lastA) {
+            j += 4;
+        }
+    }
+#endif
+
+    while (i < na && j < nb) {
+        if (pa[i] < pb[j]) {
+            ++i;
+        } else if (pb[j] < pa[i]) {
+            ++j;
+        } else {
+            out.append(pa[i]);
+            ++i;
+            ++j;
+        }
+    }
+    return out;
+}
+
+void TrigramIndex::Field::build()
+{
+    // エントリ番号の昇順に追加するため、一覧は最初から整列している
+    QHash<quint64, QVector<int>> lists;
+    for (int i = 0; i < texts.size(); ++i) {
+        for (quint64 trigram : trigramsOf(texts.at(i))) {
+            lists[trigram].append(i);
+        }
+    }
+    postings.reserve(lists.size());
+    for (auto it = lists.constBegin(); it != lists.constEnd(); ++it) {
+        QByteArray encoded;
+        encoded.reserve(it.value().size() * 2);
+        int previous = 0;
+        for (int entry : it.value()) {
+            appendVarint(encoded, static_cast<quint32>(entry - previous));
+            previous = entry;
+        }
+        postings.insert(it.key(), encoded);
+    }
+}
+
+QVector<int> TrigramIndex::Field::decode(quint64 trigram) const
+{
+    QVector<int> entries;
+    const QByteArray encoded = postings.value(trigram);
+    entries.reserve(encoded.size());
+    const uchar *p = reinterpret_cast<const uchar *>(encoded.constData());
+    const uchar *end = p + encoded.size();
+    int value = 0;
+    while (p < end) {
+        quint32 delta = 0;
+        int shift = 0;
+        while (p < end) {
+            const uchar byte = *p++;
+            delta |= quint32(byte & 0x7f) << shift;
+            shift += 7;
+            if (!(byte & 0x80)) {
+                break;
+            }
+        }
+        value += static_cast<int>(delta);
+        entries.append(value);
+    }
+    return entries;
+}
+
+QVector<int> TrigramIndex::Field::search(const Text &query, int maxEdits) const
+{
+    const QVector<quint64> trigrams = trigramsOf(query);
+    // 1文字の誤りで失われるトライグラムは高々3つ
+    const int required = static_cast<int>(trigrams.size()) - 3 * maxEdits;
+
+    QVector<int> candidates;
+    if (required <= 0) {
+        // 短い検索語は索引を使えないため全件を調べる
+        candidates.resize(texts.size());
+        std::iota(candidates.begin(), candidates.end(), 0);
+    } else if (maxEdits == 0) {
+        QVector<QVector<int>> lists;
+        for (quint64 trigram : trigrams) {
+            if (!postings.contains(trigram)) {
+                return QVector<int>();
+            }
+            lists.append(decode(trigram));
+        }
+        std::sort(lists.begin(), lists.end(), [](const QVector<int> &a, const QVector<int> &b) {
+            return a.size() < b.size();
+        });
+        candidates = lists.first();
+        for (int i = 1; i < lists.size() && !candidates.isEmpty(); ++i) {
+            candidates = intersect(candidates, lists.at(i));
+        }
+    } else {
+        // 検索語のトライグラムを必要な数以上含むエントリを候補にする
+        QVector<quint8> counts(texts.size(), 0);
+        for (quint64 trigram : trigrams) {
+            for (int entry : decode(trigram)) {
+                if (counts.at(entry) < 255) {
+                    ++counts[entry];
+                }
+            }
+        }
+        for (int i = 0; i < counts.size(); ++i) {
+            if (counts.at(i) >= required) {
+                candidates.append(i);
+            }
+        }
+    }
+
+    QVector<int> result;
+    for (int entry : candidates) {
+        if (matches(texts.at(entry), query, maxEdits)) {
+            result.append(entry);
+        }
+    }
+    return result;
+}
+
+TrigramIndex::Text TrigramIndex::normalize(const QString &text)
+{
+    const QList<uint> ucs4 = text.toLower().toUcs4();
+    return Text(ucs4.constBegin(), ucs4.constEnd());
+}
+
+QVector<quint64> TrigramIndex::trigramsOf(const Text &text)
+{
+    // コードポイントは21ビットに収まるため、3文字を1つの64ビット値に詰める
+    QVector<quint64> trigrams;
+    const char32_t *p = text.constData();
+    for (qsizetype i = 0; i + 3 <= text.size(); ++i) {
+        trigrams.append((quint64(p[i]) << 42) | (quint64(p[i + 1]) << 21) | p[i + 2]);
+    }
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+    return trigrams;
+}
+
+bool TrigramIndex::matches(const Text &text, const Text &query, int maxEdits)
+{
+    if (maxEdits <= 0) {
+        return std::search(text.constBegin(), text.constEnd(), query.constBegin(), query.constEnd())
+               != text.constEnd();
+    }
+    // 部分文字列との編集距離（どの位置から始めてもよい）が maxEdits 以下か
+    const qsizetype m = query.size();
+    if (m <= maxEdits) {
+        return true;
+    }
+    QVector<int> previous(m + 1);
+    QVector<int> current(m + 1);
+    for (qsizetype j = 0; j <= m; ++j) {
+        previous[j] = static_cast<int>(j);
+    }
+    for (const char32_t c : text) {
+        current[0] = 0;
+        for (qsizetype j = 1; j <= m; ++j) {
+            const int substitute = previous[j - 1] + (query.at(j - 1) != c ? 1 : 0);
+            current[j] = qMin(substitute, qMin(previous[j], current[j - 1]) + 1);
+        }
+        if (current[m] <= maxEdits) {
+            return true;
+        }
+        previous.swap(current);
+    }
+    return false;
+}
@@ -0,0 +1,55 @@
+#ifndef TRIGRAMINDEX_H
+#define TRIGRAMINDEX_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QHash>
+#include <QVector>
+
+// ファイル名・パスの部分一致検索用のトライグラム転置索引
+// ファイル名とディレクトリを別々に索引し（ディレクトリは同じものを1回だけ）、小文字にした文字列の
+// 連続する3文字（コードポイント）毎にエントリ番号の一覧を差分の可変長整数で圧縮して持つ。
+// 日本語のファイル名でも1文字の誤りで失われるトライグラムは3つまでで、編集距離も文字単位で数える。
+// 検索では短い一覧から順にSIMDで積集合を取り、残った候補だけを実際の文字列で確かめる。
+// ファイル名とディレクトリにまたがる検索語（"05/C0142" など）は一致しない。
+class TrigramIndex
+{
+public:
+    // pathsの並び順がエントリ番号になる
+    void build(const QStringList &paths);
+    void clear();
+
+    int size() const { return static_cast<int>(directoryOf.size()); }
+
+    // 大文字小文字を区別しない部分一致。maxEditsが1以上なら、その数までの文字の誤りを許す
+    // 一致したエントリ番号を昇順で返す
+    QVector<int> search(const QString &query, int maxEdits = 0) const;
+
+    // 昇順の2つの一覧の積集合（SSE2が使える場合は4要素ずつ比較する）
+    static QVector<int> intersect(const QVector<int> &a, const QVector<int> &b);
+
+private:
+    using Text = QVector<char32_t>;
+
+    struct Field
+    {
+        QVector<Text> texts;                    // 小文字にしたコードポイント列
+        QHash<quint64, QByteArray> postings;    // トライグラム → エントリ番号（差分の可変長整数）
+
+        void build();
+        QVector<int> search(const Text &query, int maxEdits) const;
+        QVector<int> decode(quint64 trigram) const;
+    };
+
+    static Text normalize(const QString &text);
+    static QVector<quint64> trigramsOf(const Text &text);
+    static bool matches(const Text &text, const Text &query, int maxEdits);
+
+    Field names;                                // ファイル名（エントリ毎）
+    Field directories;                          // ディレクトリ（重複を除いたもの）
+    QVector<int> directoryOf;                   // エントリ → ディレクトリ番号
+    QVector<QVector<int>> entriesOfDirectory;   // ディレクトリ番号 → エントリ（昇順）
+};
+
+#endif // TRIGRAMINDEX_H
@@ -0,0 +1,59 @@
+#include "UploadStateStore.h"
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QJsonDocument>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+UploadStateStore::UploadStateStore(const QString &directory)
+    : directory(directory)
+{
+    QDir().mkpath(directory);
+}
+
+QJsonObject UploadStateStore::load(const QString &key) const
+{
+    QMutexLocker locker(&mutex);
+    QFile file(pathFor(key));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QJsonObject();
+    }
+    const QJsonObject state = QJsonDocument::fromJson(file.readAll()).object();
+    // ハッシュの衝突に備えてキーも照合する
+    return state.value("key").toString() == key ? state : QJsonObject();
+}
+
+bool UploadStateStore::save(const QString &key, const QJsonObject &state)
+{
+    QJsonObject stored = state;
+    stored.insert("key", key);
+
+    QMutexLocker locker(&mutex);
+    QSaveFile file(pathFor(key));
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    file.write(QJsonDocument(stored).toJson(QJsonDocument::Compact));
+    return file.commit();
+}
+
+void UploadStateStore::remove(const QString &key)
+{
+    QMutexLocker locker(&mutex);
+    QFile::remove(pathFor(key));
+}
+
+QString UploadStateStore::defaultDirectory(const QString &destinationId)
+{
+    const QByteArray id = QCryptographicHash::hash(destinationId.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation)
+         + "/uploads/" + QString::fromLatin1(id);
+}
+
+QString UploadStateStore::pathFor(const QString &key) const
+{
+    const QByteArray id = QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return directory + '/' + QString::fromLatin1(id) + ".json";
+}
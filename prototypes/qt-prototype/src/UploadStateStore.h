@@ -0,0 +1,30 @@
+#ifndef UPLOADSTATESTORE_H
+#define UPLOADSTATESTORE_H
+
+#include <QString>
+#include <QJsonObject>
+#include <QMutex>
+
+// 途中で止まったクラウドアップロードの再開情報
+// アップロード先キー毎に1つのJSONファイルとして保存する（マルチパートのUploadIdと完了済みパート、
+// アップロードセッションのIDとオフセットなど、内容は出力先毎に異なる）。
+class UploadStateStore
+{
+public:
+    // directoryは出力先（バケット・アカウント）毎に分ける
+    explicit UploadStateStore(const QString &directory);
+
+    QJsonObject load(const QString &key) const;
+    bool save(const QString &key, const QJsonObject &state);
+    void remove(const QString &key);
+
+    static QString defaultDirectory(const QString &destinationId);
+
+private:
+    QString pathFor(const QString &key) const;
+
+    QString directory;
+    mutable QMutex mutex;
+};
+
+#endif // UPLOADSTATESTORE_H
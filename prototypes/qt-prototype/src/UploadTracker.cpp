@@ -0,0 +1,41 @@
+#include "UploadTracker.h"
+#include <QMutexLocker>
+
+bool UploadTracker::begin(int limit, QString *error)
+{
+    QMutexLocker locker(&mutex);
+    while (running >= limit && firstError.isEmpty()) {
+        idle.wait(&mutex);
+    }
+    if (!firstError.isEmpty()) {
+        *error = firstError;
+        return false;
+    }
+    ++running;
+    return true;
+}
+
+void UploadTracker::end(const QString &error)
+{
+    QMutexLocker locker(&mutex);
+    if (!error.isEmpty() && firstError.isEmpty()) {
+        firstError = error;
+    }
+    --running;
+    idle.wakeAll();
+}
+
+bool UploadTracker::wait(QString *error)
+{
+    QMutexLocker locker(&mutex);
+    while (running > 0) {
+        idle.wait(&mutex);
+    }
+    if (!firstError.isEmpty()) {
+        if (error) {
+            *error = firstError;
+        }
+        return false;
+    }
+    return true;
+}
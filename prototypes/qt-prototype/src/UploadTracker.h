@@ -0,0 +1,29 @@
+#ifndef UPLOADTRACKER_H
+#define UPLOADTRACKER_H
+
+#include <QString>
+#include <QMutex>
+#include <QWaitCondition>
+
+// 1ファイル分のアップロードタスク（パート、チャンク）の同時実行数と失敗の管理
+// 読み込み側のスレッドがbegin()でタスクを登録し、スレッドプール側がend()で完了を伝える。
+class UploadTracker
+{
+public:
+    // 実行中のタスクがlimit個未満になるまで待ってから1つ登録する。既に失敗していればfalse
+    bool begin(int limit, QString *error);
+
+    // タスクの完了。errorが空でなければ失敗として記録する（最初の失敗のみ保持）
+    void end(const QString &error = QString());
+
+    // すべてのタスクの完了を待つ。失敗があればfalse
+    bool wait(QString *error);
+
+private:
+    QMutex mutex;
+    QWaitCondition idle;
+    int running = 0;
+    QString firstError;
+};
+
+#endif // UPLOADTRACKER_H
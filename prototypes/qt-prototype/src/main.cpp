@@ -2,11 +2,42 @@
 #include <QFile>
 #include <QStyleFactory>
 #include <QDir>
+#include <QTextStream>
+#include <QThread>
 #include "MainWindow.h"
+#include "CommandLineRunner.h"
+#include "StageTrace.h"
+
+namespace {
+
+// 記録したトレースを書き出してから終了する
+int finishTrace(int code)
+{
+    QString error;
+    if (!StageTrace::finish(&error)) {
+        QTextStream(stderr) << error << Qt::endl;
+    }
+    return code;
+}
+
+} // namespace
 
 int main(int argc, char *argv[])
 {
+    // MEDIA_TRANSFER_TRACE=<ファイル> で処理の段階毎の時間を記録する（コマンドラインでは --trace も使える）
+    StageTrace::startFromEnvironment();
+
+    // コマンドライン専用の機能はGUIを作らずに実行
+    if (CommandLineRunner::isRequested(argc, argv)) {
+        QCoreApplication app(argc, argv);
+        app.setApplicationName("Media Transfer Tool");
+        app.setApplicationVersion("1.0.0");
+        QThread::currentThread()->setObjectName("main");
+        return finishTrace(CommandLineRunner::run(app.arguments()));
+    }
+    
     QApplication app(argc, argv);
+    QThread::currentThread()->setObjectName("GUI");
     
     // アプリケーション情報の設定
     app.setApplicationName("Media Transfer Tool");
@@ -28,5 +59,5 @@ int main(int argc, char *argv[])
     MainWindow window;
     window.show();
     
-    return app.exec();
+    return finishTrace(app.exec());
 }
\ No newline at end of file
@@ -0,0 +1,181 @@
+#include "MockHttpServer.h"
+#include <QHostAddress>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+
+namespace {
+
+QByteArray reasonPhrase(int status)
+{
+    switch (status) {
+    case 200: return "OK";
+    case 201: return "Created";
+    case 202: return "Accepted";
+    case 204: return "No Content";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 409: return "Conflict";
+    case 412: return "Precondition Failed";
+    case 416: return "Range Not Satisfiable";
+    case 429: return "Too Many Requests";
+    case 500: return "Internal Server Error";
+    case 503: return "Service Unavailable";
+    }
+    return "Status";
+}
+
+} // namespace
+
+QByteArray MockRequest::header(const QByteArray &name) const
+{
+    for (const auto &item : headers) {
+        if (item.first.compare(name, Qt::CaseInsensitive) == 0) {
+            return item.second;
+        }
+    }
+    return QByteArray();
+}
+
+bool MockRequest::hasQueryItem(const QByteArray &name) const
+{
+    for (const QByteArray &item : query.split('&')) {
+        if (item == name || item.startsWith(name + '=')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+QByteArray MockRequest::queryItem(const QByteArray &name) const
+{
+    for (const QByteArray &item : query.split('&')) {
+        if (item.startsWith(name + '=')) {
+            return QByteArray::fromPercentEncoding(item.mid(name.size() + 1));
+        }
+    }
+    return QByteArray();
+}
+
+struct MockHttpServer::Connection
+{
+    QTcpSocket *socket = nullptr;
+    QByteArray buffer;
+    int number = 0;
+    bool busy = false;          // 応答待ちのリクエストがある
+};
+
+// MockHttpServer Implementation
+MockHttpServer::MockHttpServer(Handler handler)
+    : handler(std::move(handler))
+    , context(new QObject())
+{
+    thread.setObjectName("MockHttpServer");
+    context->moveToThread(&thread);
+    QObject::connect(&thread, &QThread::finished, context, &QObject::deleteLater);
+    thread.start();
+
+    QMetaObject::invokeMethod(context, [this]() {
+        server = new QTcpServer(context);
+        QObject::connect(server, &QTcpServer::newConnection, context, [this]() { accept(); });
+        if (server->listen(QHostAddress::LocalHost)) {
+            port = server->serverPort();
+        }
+    }, Qt::BlockingQueuedConnection);
+}
+
+MockHttpServer::~MockHttpServer()
+{
+    thread.quit();
+    thread.wait();
+}
+
+QUrl MockHttpServer::url() const
+{
+    return QUrl(QString("http://127.0.0.1:%1").arg(port));
+}
+
+void MockHttpServer::accept()
+{
+    while (server->hasPendingConnections()) {
+        auto connection = std::make_shared<Connection>();
+        connection->socket = server->nextPendingConnection();
+        connection->number = connections.fetchAndAddRelaxed(1) + 1;
+        QObject::connect(connection->socket, &QTcpSocket::readyRead, context, [this, connection]() {
+            connection->buffer += connection->socket->readAll();
+            processNext(connection);
+        });
+        QObject::connect(connection->socket, &QTcpSocket::disconnected, connection->socket, &QObject::deleteLater);
+    }
+}
+
+void MockHttpServer::processNext(const std::shared_ptr<Connection> &connection)
+{
+    if (connection->busy) {
+        return;
+    }
+    const qsizetype headerEnd = connection->buffer.indexOf("\r\n\r\n");
+    if (headerEnd < 0) {
+        return;
+    }
+
+    MockRequest request;
+    request.connection = connection->number;
+    const QList<QByteArray> lines = connection->buffer.left(headerEnd).split('\n');
+    const QList<QByteArray> requestLine = lines.first().trimmed().split(' ');
+    if (requestLine.size() < 2) {
+        connection->socket->abort();
+        return;
+    }
+    request.method = requestLine.at(0);
+    const QByteArray target = requestLine.at(1);
+    const qsizetype question = target.indexOf('?');
+    request.path = question < 0 ? target : target.left(question);
+    request.query = question < 0 ? QByteArray() : target.mid(question + 1);
+    for (qsizetype i = 1; i < lines.size(); ++i) {
+        const qsizetype colon = lines.at(i).indexOf(':');
+        if (colon > 0) {
+            request.headers.append({lines.at(i).left(colon).trimmed(), lines.at(i).mid(colon + 1).trimmed()});
+        }
+    }
+
+    const qint64 length = request.header("Content-Length").toLongLong();
+    const qsizetype bodyStart = headerEnd + 4;
+    if (connection->buffer.size() - bodyStart < length) {
+        return;
+    }
+    request.body = connection->buffer.mid(bodyStart, length);
+    connection->buffer.remove(0, bodyStart + length);
+
+    connection->busy = true;
+    requests.fetchAndAddRelaxed(1);
+    const int running = inFlight.fetchAndAddRelaxed(1) + 1;
+    int peak = peakInFlight.loadRelaxed();
+    while (running > peak && !peakInFlight.testAndSetRelaxed(peak, running)) {
+        peak = peakInFlight.loadRelaxed();
+    }
+
+    const MockResponse response = handler(request);
+    if (response.delayMs > 0) {
+        QTimer::singleShot(response.delayMs, connection->socket, [this, connection, response]() {
+            respond(connection, response);
+        });
+    } else {
+        respond(connection, response);
+    }
+}
+
+void MockHttpServer::respond(const std::shared_ptr<Connection> &connection, const MockResponse &response)
+{
+    QByteArray message = "HTTP/1.1 " + QByteArray::number(response.status) + ' ' + reasonPhrase(response.status) + "\r\n";
+    for (const auto &header : response.headers) {
+        message += header.first + ": " + header.second + "\r\n";
+    }
+    message += "Content-Length: " + QByteArray::number(response.body.size()) + "\r\n\r\n";
+    message += response.body;
+    connection->socket->write(message);
+
+    inFlight.fetchAndAddRelaxed(-1);
+    connection->busy = false;
+    processNext(connection);
+}
@@ -0,0 +1,78 @@
+#ifndef MOCKHTTPSERVER_H
+#define MOCKHTTPSERVER_H
+
+#include <QThread>
+#include <QUrl>
+#include <QAtomicInt>
+#include <QList>
+#include <QPair>
+#include <functional>
+
+class QObject;
+class QTcpServer;
+class QTcpSocket;
+
+using MockHeaders = QList<QPair<QByteArray, QByteArray>>;
+
+// テストで受け取った1リクエスト
+struct MockRequest
+{
+    QByteArray method;
+    QByteArray path;            // パーセントエンコードされたまま
+    QByteArray query;           // '?' より後（パーセントエンコードされたまま）
+    MockHeaders headers;
+    QByteArray body;
+    int connection = 0;         // 受け付けた接続の通し番号（1から）
+
+    QByteArray header(const QByteArray &name) const;
+    bool hasQueryItem(const QByteArray &name) const;
+    QByteArray queryItem(const QByteArray &name) const;    // デコード済み
+};
+
+struct MockResponse
+{
+    int status = 200;
+    MockHeaders headers;
+    QByteArray body;
+    int delayMs = 0;            // 応答を返すまで待つ時間（同時に処理中のリクエスト数の確認用）
+};
+
+// テスト用のHTTP/1.1サーバー（127.0.0.1の空いているポート）
+// 専用スレッドで動くため、テスト側のスレッドがブロックする送信（HttpClient）を使っても応答できる。
+// handlerはサーバーのスレッドで呼ばれる。1つの接続のリクエストは届いた順に1つずつ処理し、keep-aliveで接続を残す。
+class MockHttpServer
+{
+public:
+    using Handler = std::function<MockResponse(const MockRequest &)>;
+
+    explicit MockHttpServer(Handler handler);
+    ~MockHttpServer();
+
+    QUrl url() const;
+
+    int connectionCount() const { return connections.loadRelaxed(); }
+    int requestCount() const { return requests.loadRelaxed(); }
+    // 受け取ってから応答を返すまでの間にあったリクエスト数の最大
+    int maxInFlight() const { return peakInFlight.loadRelaxed(); }
+
+private:
+    struct Connection;
+
+    // 以下はサーバーのスレッドでのみ呼ぶ
+    void accept();
+    void processNext(const std::shared_ptr<Connection> &connection);
+    void respond(const std::shared_ptr<Connection> &connection, const MockResponse &response);
+
+    Handler handler;
+    QThread thread;
+    QObject *context;
+    QTcpServer *server = nullptr;
+    quint16 port = 0;
+
+    QAtomicInt connections;
+    QAtomicInt requests;
+    QAtomicInt inFlight;
+    QAtomicInt peakInFlight;
+};
+
+#endif // MOCKHTTPSERVER_H
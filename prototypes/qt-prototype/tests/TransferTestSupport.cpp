@@ -0,0 +1,82 @@
+#include "TransferTestSupport.h"
+#include <QDir>
+#include <QFile>
+#include <QRandomGenerator>
+#include <QStandardPaths>
+
+namespace {
+
+// 書き込みに渡す1回の大きさ（パイプラインの読み込み単位に合わせる）
+const qint64 readSize = 1024 * 1024;
+
+} // namespace
+
+void TransferTestSupport::resetLocalData()
+{
+    QStandardPaths::setTestModeEnabled(true);
+    QDir(QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation)).removeRecursively();
+}
+
+QFileInfo TransferTestSupport::writeSource(const QString &path, qint64 size, quint32 seed)
+{
+    QRandomGenerator random(seed);
+    QByteArray data(size, Qt::Uninitialized);
+    random.fillRange(reinterpret_cast<quint32 *>(data.data()), size / 4);
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != size) {
+        return QFileInfo();
+    }
+    file.close();
+    return QFileInfo(path);
+}
+
+UnitPlan TransferTestSupport::singleFilePlan(const QString &directory, const QString &stem, const QString &suffix,
+                                             qint64 size, quint32 seed)
+{
+    UnitPlan plan;
+    plan.stem = stem.toUtf8();
+    plan.suffixes = {suffix.toUtf8()};
+    plan.sources = {writeSource(QDir(directory).filePath(stem + suffix), size, seed)};
+    return plan;
+}
+
+QByteArray TransferTestSupport::contentsOf(const QFileInfo &file)
+{
+    QFile in(file.absoluteFilePath());
+    return in.open(QIODevice::ReadOnly) ? in.readAll() : QByteArray();
+}
+
+bool TransferTestSupport::transferUnit(TransferDestination *destination, const UnitPlan &plan, QString *error)
+{
+    std::unique_ptr<UnitWriter> writer = destination->beginUnit(plan, error);
+    if (!writer) {
+        return false;
+    }
+    for (int member = 0; member < plan.sources.size(); ++member) {
+        if (!writer->wants(member)) {
+            continue;
+        }
+        QFile file(plan.sources.at(member).absoluteFilePath());
+        if (!file.open(QIODevice::ReadOnly)) {
+            *error = file.errorString();
+            writer->abort();
+            return false;
+        }
+        if (!writer->beginFile(member, error)) {
+            writer->abort();
+            return false;
+        }
+        while (!file.atEnd()) {
+            const QByteArray chunk = file.read(readSize);
+            if (!writer->write(chunk.constData(), chunk.size(), error)) {
+                writer->abort();
+                return false;
+            }
+        }
+        if (!writer->endFile(error)) {
+            writer->abort();
+            return false;
+        }
+    }
+    return writer->commit(error);
+}
@@ -0,0 +1,28 @@
+#ifndef TRANSFERTESTSUPPORT_H
+#define TRANSFERTESTSUPPORT_H
+
+#include <QString>
+#include <QByteArray>
+#include <QFileInfo>
+#include "TransferDestination.h"
+
+// 出力先のテストで共通の手順
+namespace TransferTestSupport {
+
+// 出力先が書くマニフェストと再開情報をテスト用の場所に置き、前のテストの分を消す（init()で呼ぶ）
+void resetLocalData();
+
+// seedで決まる内容の元ファイルをpathに書き出す
+QFileInfo writeSource(const QString &path, qint64 size, quint32 seed);
+
+// 元ファイル1つだけの組（元ファイルはdirectoryに "stem + suffix" で書き出す）
+UnitPlan singleFilePlan(const QString &directory, const QString &stem, const QString &suffix, qint64 size, quint32 seed);
+
+QByteArray contentsOf(const QFileInfo &file);
+
+// パイプラインと同じ順（beginFile → write → endFile、最後にcommit）で組を書き込む。途中で失敗したらabortする
+bool transferUnit(TransferDestination *destination, const UnitPlan &plan, QString *error);
+
+}
+
+#endif // TRANSFERTESTSUPPORT_H
@@ -0,0 +1,372 @@
+#include <QtTest>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMap>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSet>
+#include <QTemporaryDir>
+#include "DropboxDestination.h"
+#include "MockHttpServer.h"
+#include "TransferTestSupport.h"
+
+namespace {
+
+const qint64 mb = 1024 * 1024;
+
+MockResponse jsonResponse(int status, const QJsonObject &object)
+{
+    MockResponse response;
+    response.status = status;
+    response.headers.append({"Content-Type", "application/json"});
+    response.body = QJsonDocument(object).toJson(QJsonDocument::Compact);
+    return response;
+}
+
+} // namespace
+
+// Dropbox APIのうち、DropboxDestinationが使う部分だけを持つテスト用のサーバー
+// api（一覧・確定）とcontent（アップロード）の両方をこのサーバーで受ける。
+class FakeDropbox
+{
+public:
+    struct Session
+    {
+        bool concurrent = false;
+        bool closed = false;
+        QMap<qint64, QByteArray> chunks;    // 先頭オフセット毎
+    };
+
+    MockResponse handle(const MockRequest &request)
+    {
+        QMutexLocker locker(&mutex);
+        if (request.header("Authorization") != "Bearer test-token") {
+            return jsonResponse(401, {{"error_summary", "invalid_access_token/"}});
+        }
+        const QJsonObject arg = QJsonDocument::fromJson(request.header("Dropbox-API-Arg")).object();
+        if (request.path == "/2/files/upload_session/start") {
+            const QByteArray id = "session-" + QByteArray::number(++nextSession);
+            Session session;
+            session.concurrent = arg.value("session_type").toString() == "concurrent";
+            session.closed = arg.value("close").toBool();
+            if (!request.body.isEmpty()) {
+                session.chunks.insert(0, request.body);
+            }
+            sessions.insert(id, session);
+            return jsonResponse(200, {{"session_id", QString::fromLatin1(id)}});
+        }
+        if (request.path == "/2/files/upload_session/append_v2") {
+            return append(request, arg);
+        }
+        if (request.path == "/2/files/upload_session/finish_batch_v2") {
+            return finishBatch(QJsonDocument::fromJson(request.body).object());
+        }
+        if (request.path == "/2/files/list_folder") {
+            return listFolder(QJsonDocument::fromJson(request.body).object());
+        }
+        if (request.path == "/2/files/move_v2") {
+            return move(QJsonDocument::fromJson(request.body).object());
+        }
+        return jsonResponse(400, {{"error_summary", "unknown_endpoint/"}});
+    }
+
+    QMutex mutex;
+    QMap<QString, QByteArray> files;        // パス（表示どおり）毎
+    QMap<QByteArray, Session> sessions;
+    int nextSession = 0;
+    int appends = 0;
+    int finishBatches = 0;
+    QSet<QString> failPaths;                // 確定を失敗させるパス
+    QStringList finishedPaths;              // finish_batch_v2で受け取ったパス（順に）
+
+private:
+    MockResponse append(const MockRequest &request, const QJsonObject &arg)
+    {
+        const QJsonObject cursor = arg.value("cursor").toObject();
+        auto session = sessions.find(cursor.value("session_id").toString().toLatin1());
+        if (session == sessions.end()) {
+            return jsonResponse(409, {{"error_summary", "not_found/"}});
+        }
+        // 並列追記のセッションでは、最後以外のチャンクは4MBの倍数
+        if (session->concurrent && !arg.value("close").toBool() && request.body.size() % (4 * mb) != 0) {
+            return jsonResponse(400, {{"error_summary", "incorrect_offset/"}});
+        }
+        ++appends;
+        session->chunks.insert(cursor.value("offset").toInteger(), request.body);
+        if (arg.value("close").toBool()) {
+            session->closed = true;
+        }
+        MockResponse response;
+        response.delayMs = 100;     // 同時に送られたチャンクが重なるようにする
+        response.body = "null";
+        return response;
+    }
+
+    // チャンクが隙間なく揃っていれば連結して返す
+    static bool assemble(const Session &session, qint64 size, QByteArray *data)
+    {
+        data->clear();
+        for (auto chunk = session.chunks.constBegin(); chunk != session.chunks.constEnd(); ++chunk) {
+            if (chunk.key() != data->size()) {
+                return false;
+            }
+            *data += chunk.value();
+        }
+        return data->size() == size;
+    }
+
+    MockResponse finishBatch(const QJsonObject &body)
+    {
+        ++finishBatches;
+        QJsonArray results;
+        for (const QJsonValue &value : body.value("entries").toArray()) {
+            const QJsonObject entry = value.toObject();
+            const QJsonObject cursor = entry.value("cursor").toObject();
+            const QJsonObject commit = entry.value("commit").toObject();
+            const QString path = commit.value("path").toString();
+            finishedPaths << path;
+
+            auto session = sessions.constFind(cursor.value("session_id").toString().toLatin1());
+            QByteArray data;
+            if (session == sessions.constEnd() || !session->closed
+                || !assemble(*session, cursor.value("offset").toInteger(), &data)) {
+                results.append(QJsonObject{{".tag", "failure"},
+                                           {"failure", QJsonObject{{".tag", "lookup_failed"}}}});
+                continue;
+            }
+            if (failPaths.contains(path)) {
+                results.append(QJsonObject{{".tag", "failure"},
+                                           {"failure", QJsonObject{{".tag", "too_many_write_operations"}}}});
+                continue;
+            }
+            if (files.contains(path) && commit.value("mode").toString() == "add") {
+                results.append(QJsonObject{{".tag", "failure"},
+                                           {"failure", QJsonObject{{".tag", "path"},
+                                                                   {"path", QJsonObject{{".tag", "conflict"}}}}}});
+                continue;
+            }
+            files.insert(path, data);
+            sessions.remove(cursor.value("session_id").toString().toLatin1());
+            results.append(QJsonObject{{".tag", "success"}, {"path_display", path}, {"size", data.size()},
+                                       {"content_hash", "hash"}});
+        }
+        return jsonResponse(200, {{"entries", results}});
+    }
+
+    MockResponse move(const QJsonObject &arg)
+    {
+        const QString from = arg.value("from_path").toString();
+        const QString to = arg.value("to_path").toString();
+        if (!files.contains(from)) {
+            return jsonResponse(409, {{"error_summary", "from_lookup/not_found/"}});
+        }
+        if (files.contains(to)) {
+            return jsonResponse(409, {{"error_summary", "to/conflict/"}});
+        }
+        files.insert(to, files.take(from));
+        return jsonResponse(200, {{"metadata", QJsonObject{{".tag", "file"}, {"path_display", to}}}});
+    }
+
+    MockResponse listFolder(const QJsonObject &arg)
+    {
+        // 再帰しない場合は直下のファイルとフォルダだけを返す
+        const QString folder = arg.value("path").toString() + '/';
+        const bool recursive = arg.value("recursive").toBool();
+        QJsonArray entries;
+        QSet<QString> folders;
+        for (auto file = files.constBegin(); file != files.constEnd(); ++file) {
+            if (!file.key().startsWith(folder)) {
+                continue;
+            }
+            const qsizetype slash = file.key().indexOf('/', folder.size());
+            if (!recursive && slash >= 0) {
+                folders.insert(file.key().left(slash));
+                continue;
+            }
+            entries.append(QJsonObject{{".tag", "file"}, {"path_display", file.key()},
+                                       {"size", file.value().size()}, {"content_hash", "hash"}});
+        }
+        for (const QString &path : folders) {
+            entries.append(QJsonObject{{".tag", "folder"}, {"path_display", path}});
+        }
+        return jsonResponse(200, {{"entries", entries}, {"has_more", false}});
+    }
+};
+
+using TransferTestSupport::contentsOf;
+using TransferTestSupport::singleFilePlan;
+using TransferTestSupport::transferUnit;
+
+// DropboxDestination（並列追記、finish_batch_v2の部分的な失敗、名前の衝突）
+class DropboxDestinationTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void init();
+
+    void appendsChunksConcurrently();
+    void reportsPartialBatchFailure();
+    void renamesConflictingPath();
+    void movesCommittedMembersWhenRenaming();
+
+private:
+    DropboxOptions defaultOptions() const;
+
+    QTemporaryDir sources;
+};
+
+void DropboxDestinationTest::initTestCase()
+{
+    qputenv("DROPBOX_ACCESS_TOKEN", "test-token");
+    QVERIFY(sources.isValid());
+}
+
+void DropboxDestinationTest::init()
+{
+    TransferTestSupport::resetLocalData();
+}
+
+DropboxOptions DropboxDestinationTest::defaultOptions() const
+{
+    DropboxOptions options;
+    options.chunkSize = 4 * mb;
+    options.concurrency = 3;
+    return options;
+}
+
+void DropboxDestinationTest::appendsChunksConcurrently()
+{
+    FakeDropbox dropbox;
+    MockHttpServer server([&dropbox](const MockRequest &request) { return dropbox.handle(request); });
+    qputenv("DROPBOX_API_URL", server.url().toString().toUtf8());
+    qputenv("DROPBOX_CONTENT_URL", server.url().toString().toUtf8());
+
+    // 4MBのチャンク4つ（最後は2MB）を同時に最大3つまで送る
+    const UnitPlan plan = singleFilePlan(sources.path(), "CLIP0001", ".MP4", 14 * mb, 1);
+    DropboxDestination destination(defaultOptions());
+    QString error;
+    QVERIFY2(destination.prepare(&error), qPrintable(error));
+    // 一覧の取り直しを先に済ませ、同時に処理したリクエストをチャンクだけにする
+    QVERIFY2(destination.waitForRefresh(&error), qPrintable(error));
+    QVERIFY2(transferUnit(&destination, plan, &error), qPrintable(error));
+    QVERIFY2(destination.finish(&error), qPrintable(error));
+
+    QMutexLocker locker(&dropbox.mutex);
+    QCOMPARE(dropbox.appends, 4);
+    QVERIFY2(server.maxInFlight() >= 2, qPrintable(QString("同時に処理したリクエスト: %1").arg(server.maxInFlight())));
+    QVERIFY(server.maxInFlight() <= 3);
+    QCOMPARE(dropbox.files.value("/MediaTransfer/CLIP0001.MP4"), contentsOf(plan.sources.at(0)));
+    QVERIFY(dropbox.sessions.isEmpty());
+}
+
+void DropboxDestinationTest::reportsPartialBatchFailure()
+{
+    FakeDropbox dropbox;
+    MockHttpServer server([&dropbox](const MockRequest &request) { return dropbox.handle(request); });
+    qputenv("DROPBOX_API_URL", server.url().toString().toUtf8());
+    qputenv("DROPBOX_CONTENT_URL", server.url().toString().toUtf8());
+    {
+        QMutexLocker locker(&dropbox.mutex);
+        dropbox.failPaths = {"/MediaTransfer/IMG_0001.JPG", "/MediaTransfer/IMG_0004.JPG"};
+    }
+
+    DropboxOptions options = defaultOptions();
+    options.batchSize = 2;
+    DropboxDestination destination(options);
+    QStringList reported;
+    destination.setFailureHandler([&reported](const QVector<QFileInfo> &failed, const QString &) {
+        for (const QFileInfo &source : failed) {
+            reported << source.fileName();
+        }
+    });
+    QString error;
+    QVERIFY2(destination.prepare(&error), qPrintable(error));
+
+    // 1つ目はバッチに溜まるだけで、2つ目の組のcommit()でまとめて確定する。
+    // 他の組（1つ目）の失敗はfailureHandlerに、自分の組の失敗はcommit()の戻り値で知らされる
+    QVERIFY2(transferUnit(&destination, singleFilePlan(sources.path(), "IMG_0001", ".JPG", 1000, 1), &error),
+             qPrintable(error));
+    QVERIFY2(transferUnit(&destination, singleFilePlan(sources.path(), "IMG_0002", ".JPG", 1000, 2), &error),
+             qPrintable(error));
+    QCOMPARE(reported, QStringList{"IMG_0001.JPG"});
+
+    QVERIFY2(transferUnit(&destination, singleFilePlan(sources.path(), "IMG_0003", ".JPG", 1000, 3), &error),
+             qPrintable(error));
+    error.clear();
+    QVERIFY(!transferUnit(&destination, singleFilePlan(sources.path(), "IMG_0004", ".JPG", 1000, 4), &error));
+    QVERIFY2(error.contains("IMG_0004.JPG"), qPrintable(error));
+    QCOMPARE(reported, QStringList{"IMG_0001.JPG"});
+    QVERIFY2(destination.finish(&error), qPrintable(error));
+
+    QMutexLocker locker(&dropbox.mutex);
+    QCOMPARE(dropbox.finishBatches, 2);
+    QCOMPARE(dropbox.files.keys(), (QStringList{"/MediaTransfer/IMG_0002.JPG", "/MediaTransfer/IMG_0003.JPG"}));
+}
+
+void DropboxDestinationTest::renamesConflictingPath()
+{
+    FakeDropbox dropbox;
+    MockHttpServer server([&dropbox](const MockRequest &request) { return dropbox.handle(request); });
+    qputenv("DROPBOX_API_URL", server.url().toString().toUtf8());
+    qputenv("DROPBOX_CONTENT_URL", server.url().toString().toUtf8());
+
+    DropboxDestination destination(defaultOptions());
+    QString error;
+    QVERIFY2(destination.prepare(&error), qPrintable(error));
+    QVERIFY2(destination.waitForRefresh(&error), qPrintable(error));
+    {
+        // マニフェストの一覧を取った後に、別のクライアントが同じ名前で置いた
+        QMutexLocker locker(&dropbox.mutex);
+        dropbox.files.insert("/MediaTransfer/IMG_0005.JPG", "other");
+    }
+
+    const UnitPlan plan = singleFilePlan(sources.path(), "IMG_0005", ".JPG", 1000, 5);
+    QVERIFY2(transferUnit(&destination, plan, &error), qPrintable(error));
+    QVERIFY2(destination.finish(&error), qPrintable(error));
+
+    // 既存のファイルは上書きせず、次の連番で確定し直す
+    QMutexLocker locker(&dropbox.mutex);
+    QCOMPARE(dropbox.files.value("/MediaTransfer/IMG_0005.JPG"), QByteArray("other"));
+    QCOMPARE(dropbox.files.value("/MediaTransfer/IMG_0005_1.JPG"), contentsOf(plan.sources.at(0)));
+    QCOMPARE(dropbox.finishedPaths,
+             (QStringList{"/MediaTransfer/IMG_0005.JPG", "/MediaTransfer/IMG_0005_1.JPG"}));
+}
+
+void DropboxDestinationTest::movesCommittedMembersWhenRenaming()
+{
+    FakeDropbox dropbox;
+    MockHttpServer server([&dropbox](const MockRequest &request) { return dropbox.handle(request); });
+    qputenv("DROPBOX_API_URL", server.url().toString().toUtf8());
+    qputenv("DROPBOX_CONTENT_URL", server.url().toString().toUtf8());
+
+    DropboxDestination destination(defaultOptions());
+    QString error;
+    QVERIFY2(destination.prepare(&error), qPrintable(error));
+    QVERIFY2(destination.waitForRefresh(&error), qPrintable(error));
+    {
+        // JPGは確定できるが、RAWの名前は別のクライアントが使っていた
+        QMutexLocker locker(&dropbox.mutex);
+        dropbox.files.insert("/MediaTransfer/IMG_0006.CR3", "other");
+    }
+
+    UnitPlan plan;
+    plan.stem = "IMG_0006";
+    plan.suffixes = {".JPG", ".CR3"};
+    plan.sources = {TransferTestSupport::writeSource(sources.filePath("IMG_0006.JPG"), 1000, 6),
+                    TransferTestSupport::writeSource(sources.filePath("IMG_0006.CR3"), 2000, 7)};
+    QVERIFY2(transferUnit(&destination, plan, &error), qPrintable(error));
+    QVERIFY2(destination.finish(&error), qPrintable(error));
+
+    // 確定済みのJPGも移動して、組を同じ連番にそろえる
+    QMutexLocker locker(&dropbox.mutex);
+    QVERIFY(!dropbox.files.contains("/MediaTransfer/IMG_0006.JPG"));
+    QCOMPARE(dropbox.files.value("/MediaTransfer/IMG_0006.CR3"), QByteArray("other"));
+    QCOMPARE(dropbox.files.value("/MediaTransfer/IMG_0006_1.JPG"), contentsOf(plan.sources.at(0)));
+    QCOMPARE(dropbox.files.value("/MediaTransfer/IMG_0006_1.CR3"), contentsOf(plan.sources.at(1)));
+}
+
+QTEST_GUILESS_MAIN(DropboxDestinationTest)
+#include "tst_dropboxdestination.moc"
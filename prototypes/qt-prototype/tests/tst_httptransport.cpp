@@ -0,0 +1,120 @@
+#include <QtTest>
+#include <QElapsedTimer>
+#include "HttpTransport.h"
+#include "MockHttpServer.h"
+
+// HttpTransport（共有接続プール・同時リクエスト数の上限）とHttpClientの再試行
+class HttpTransportTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void limitsConcurrentRequests();
+    void drainsQueueAfterRaisingLimit();
+    void reusesConnection();
+    void retryHonoursRetryAfter();
+};
+
+void HttpTransportTest::limitsConcurrentRequests()
+{
+    MockHttpServer server([](const MockRequest &) {
+        MockResponse response;
+        response.body = "ok";
+        response.delayMs = 100;
+        return response;
+    });
+
+    HttpTransport transport;
+    transport.setMaxConcurrentRequests(2);
+
+    // 上限を超えた分は待たされ、すべて順に送られる
+    const int count = 8;
+    QAtomicInt completed;
+    QAtomicInt succeeded;
+    for (int i = 0; i < count; ++i) {
+        // 本体のあるリクエストはパイプラインで1つの接続にまとめられないため、同時に送った数がサーバーから見える
+        HttpRequest request{"PUT", QUrl(server.url().toString() + "/item/" + QString::number(i)), {}, "body"};
+        transport.send(request, [&completed, &succeeded](const HttpResponse &response) {
+            if (response.isSuccess() && response.body == "ok") {
+                succeeded.fetchAndAddRelaxed(1);
+            }
+            completed.fetchAndAddRelaxed(1);
+        });
+    }
+    QTRY_COMPARE_WITH_TIMEOUT(completed.loadRelaxed(), count, 10000);
+    QCOMPARE(succeeded.loadRelaxed(), count);
+    QCOMPARE(server.requestCount(), count);
+    QVERIFY(server.maxInFlight() <= 2);
+    QCOMPARE(server.maxInFlight(), 2);
+}
+
+void HttpTransportTest::drainsQueueAfterRaisingLimit()
+{
+    MockHttpServer server([](const MockRequest &) {
+        MockResponse response;
+        response.delayMs = 200;
+        return response;
+    });
+
+    HttpTransport transport;
+    transport.setMaxConcurrentRequests(1);
+
+    const int count = 4;
+    QAtomicInt completed;
+    for (int i = 0; i < count; ++i) {
+        transport.send({"PUT", QUrl(server.url().toString() + "/queued"), {}, "body"},
+                       [&completed](const HttpResponse &) { completed.fetchAndAddRelaxed(1); });
+    }
+    // 待っているリクエストは上限を上げた時点で送られる
+    QTest::qWait(50);
+    transport.setMaxConcurrentRequests(count);
+    QTRY_COMPARE_WITH_TIMEOUT(completed.loadRelaxed(), count, 10000);
+    QVERIFY(server.maxInFlight() > 1);
+}
+
+void HttpTransportTest::reusesConnection()
+{
+    MockHttpServer server([](const MockRequest &request) {
+        MockResponse response;
+        response.body = request.body;
+        return response;
+    });
+
+    // 順に送ったリクエストはkeep-aliveで同じ接続を使う
+    HttpTransport transport;
+    for (int i = 0; i < 5; ++i) {
+        const QByteArray body = "request " + QByteArray::number(i);
+        const HttpResponse response = transport.sendAndWait({"PUT", QUrl(server.url().toString() + "/echo"), {}, body});
+        QCOMPARE(response.status, 200);
+        QCOMPARE(response.body, body);
+    }
+    QCOMPARE(server.requestCount(), 5);
+    QCOMPARE(server.connectionCount(), 1);
+}
+
+void HttpTransportTest::retryHonoursRetryAfter()
+{
+    QAtomicInt attempts;
+    MockHttpServer server([&attempts](const MockRequest &) {
+        MockResponse response;
+        if (attempts.fetchAndAddRelaxed(1) == 0) {
+            response.status = 503;
+            response.headers.append({"Retry-After", "2"});
+        } else {
+            response.body = "done";
+        }
+        return response;
+    });
+
+    // 既定の待機（初回は400ms）ではなく、Retry-Afterの秒数だけ待ってから送り直す
+    QElapsedTimer timer;
+    timer.start();
+    const HttpResponse response = HttpClient::sendWithRetry("GET", QUrl(server.url().toString() + "/busy"), {}, QByteArray());
+    QCOMPARE(response.status, 200);
+    QCOMPARE(response.body, QByteArray("done"));
+    QCOMPARE(attempts.loadRelaxed(), 2);
+    QVERIFY2(timer.elapsed() >= 1900, qPrintable(QString("待機: %1ms").arg(timer.elapsed())));
+}
+
+QTEST_GUILESS_MAIN(HttpTransportTest)
+#include "tst_httptransport.moc"
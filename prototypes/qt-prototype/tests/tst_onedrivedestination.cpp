@@ -0,0 +1,321 @@
+#include <QtTest>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMap>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSet>
+#include <QTemporaryDir>
+#include "OneDriveDestination.h"
+#include "MockHttpServer.h"
+#include "TransferTestSupport.h"
+
+namespace {
+
+const QByteArray itemPrefix = "/v1.0/me/drive/root:";
+const QByteArray uploadPrefix = "/upload/";
+const qint64 fragment = 320 * 1024;
+
+MockResponse jsonResponse(int status, const QJsonObject &object)
+{
+    MockResponse response;
+    response.status = status;
+    response.headers.append({"Content-Type", "application/json"});
+    response.body = QJsonDocument(object).toJson(QJsonDocument::Compact);
+    return response;
+}
+
+MockResponse errorResponse(int status, const QString &code)
+{
+    return jsonResponse(status, {{"error", QJsonObject{{"code", code}, {"message", code}}}});
+}
+
+} // namespace
+
+// Microsoft GraphのうちOneDriveDestinationが使う部分だけを持つテスト用のサーバー
+// アップロードURLもこのサーバーを指す。
+class FakeOneDrive
+{
+public:
+    struct Session
+    {
+        QString path;
+        QByteArray received;
+        qint64 size = -1;
+    };
+
+    MockResponse handle(const MockRequest &request)
+    {
+        QMutexLocker locker(&mutex);
+        if (request.path.startsWith(uploadPrefix)) {
+            // アップロードURLには認証情報が含まれる（Authorizationは付かない）
+            if (!request.header("Authorization").isEmpty()) {
+                ++authorizedUploads;
+            }
+            return upload(request, request.path.mid(uploadPrefix.size()));
+        }
+        if (request.header("Authorization") != "Bearer test-token") {
+            return errorResponse(401, "InvalidAuthenticationToken");
+        }
+        if (!request.path.startsWith(itemPrefix)) {
+            return errorResponse(400, "invalidRequest");
+        }
+        const QByteArray target = request.path.mid(itemPrefix.size());
+        const qsizetype colon = target.lastIndexOf(":/");
+        if (colon < 0) {
+            return errorResponse(400, "invalidRequest");
+        }
+        const QString path = QString::fromUtf8(QByteArray::fromPercentEncoding(target.left(colon)));
+        const QByteArray action = target.mid(colon + 2);
+
+        if (request.method == "GET" && action == "children") {
+            return children(path);
+        }
+        if (request.method == "POST" && action == "createUploadSession") {
+            const QJsonObject item = QJsonDocument::fromJson(request.body).object().value("item").toObject();
+            if (files.contains(path) && item.value("@microsoft.graph.conflictBehavior").toString() == "fail") {
+                return errorResponse(409, "nameAlreadyExists");
+            }
+            const QByteArray id = "session-" + QByteArray::number(++nextSession);
+            sessions.insert(id, Session{path, QByteArray(), -1});
+            return jsonResponse(200, {{"uploadUrl", uploadBase.toString() + QString::fromLatin1(uploadPrefix + id)}});
+        }
+        if (request.method == "PUT" && action == "content") {
+            if (files.contains(path) && request.queryItem("@microsoft.graph.conflictBehavior") == "fail") {
+                return errorResponse(409, "nameAlreadyExists");
+            }
+            files.insert(path, request.body);
+            return jsonResponse(201, itemOf(path));
+        }
+        return errorResponse(400, "invalidRequest");
+    }
+
+    QMutex mutex;
+    QUrl uploadBase;                        // アップロードURLの接続先（このサーバー）
+    QMap<QString, QByteArray> files;        // パス毎
+    QMap<QByteArray, Session> sessions;
+    int nextSession = 0;
+    int authorizedUploads = 0;
+    int statusRequests = 0;
+    qint64 failAtOffset = -1;               // この位置から始まるチャンクを1回だけ失敗させる
+    QVector<qint64> fragmentOffsets;        // 受け取ったチャンクの先頭（順に）
+
+private:
+    QJsonObject itemOf(const QString &path) const
+    {
+        return QJsonObject{
+            {"name", path.section('/', -1)},
+            {"size", files.value(path).size()},
+            {"file", QJsonObject{{"hashes", QJsonObject{{"quickXorHash", "hash"}}}}}
+        };
+    }
+
+    MockResponse upload(const MockRequest &request, const QByteArray &id)
+    {
+        auto session = sessions.find(id);
+        if (session == sessions.end()) {
+            return errorResponse(404, "itemNotFound");
+        }
+        const QJsonArray expected{QString::number(session->received.size()) + '-'};
+        if (request.method == "GET") {
+            ++statusRequests;
+            return jsonResponse(200, {{"nextExpectedRanges", expected}});
+        }
+
+        // Content-Range: bytes 先頭-末尾/全体
+        const QByteArray range = request.header("Content-Range");
+        const qint64 first = range.mid(6, range.indexOf('-') - 6).toLongLong();
+        const qint64 total = range.mid(range.indexOf('/') + 1).toLongLong();
+        if (first != session->received.size()) {
+            return errorResponse(416, "invalidRange");
+        }
+        // 最後以外のチャンクは320KiBの倍数
+        if (first + request.body.size() < total && request.body.size() % fragment != 0) {
+            return errorResponse(400, "invalidRequest");
+        }
+        if (first == failAtOffset) {
+            failAtOffset = -1;
+            return errorResponse(400, "invalidRequest");
+        }
+        fragmentOffsets.append(first);
+        session->received += request.body;
+        session->size = total;
+        if (session->received.size() < total) {
+            return jsonResponse(202, {{"nextExpectedRanges", QJsonArray{QString::number(session->received.size()) + '-'}}});
+        }
+        const QString path = session->path;
+        if (files.contains(path)) {
+            sessions.erase(session);
+            return errorResponse(409, "nameAlreadyExists");
+        }
+        files.insert(path, session->received);
+        sessions.erase(session);
+        return jsonResponse(201, itemOf(path));
+    }
+
+    MockResponse children(const QString &folder)
+    {
+        QJsonArray value;
+        QSet<QString> folders;
+        bool found = false;
+        for (auto file = files.constBegin(); file != files.constEnd(); ++file) {
+            if (!file.key().startsWith(folder + '/')) {
+                continue;
+            }
+            found = true;
+            const QString rest = file.key().mid(folder.size() + 1);
+            if (rest.contains('/')) {
+                folders.insert(rest.section('/', 0, 0));
+                continue;
+            }
+            value.append(itemOf(file.key()));
+        }
+        if (!found) {
+            return errorResponse(404, "itemNotFound");
+        }
+        for (const QString &name : folders) {
+            value.append(QJsonObject{{"name", name}, {"folder", QJsonObject()}});
+        }
+        return jsonResponse(200, {{"value", value}});
+    }
+};
+
+using TransferTestSupport::contentsOf;
+using TransferTestSupport::singleFilePlan;
+using TransferTestSupport::transferUnit;
+
+// OneDriveDestination（nextExpectedRangesによる再開、名前の衝突）
+class OneDriveDestinationTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void init();
+
+    void uploadsInFragments();
+    void resumesFromNextExpectedRanges();
+    void renamesWhenNameExists();
+
+private:
+    OneDriveOptions defaultOptions() const;
+
+    QTemporaryDir sources;
+};
+
+void OneDriveDestinationTest::initTestCase()
+{
+    qputenv("ONEDRIVE_ACCESS_TOKEN", "test-token");
+    QVERIFY(sources.isValid());
+}
+
+void OneDriveDestinationTest::init()
+{
+    TransferTestSupport::resetLocalData();
+}
+
+OneDriveOptions OneDriveDestinationTest::defaultOptions() const
+{
+    OneDriveOptions options;
+    options.chunkSize = 4 * fragment;
+    return options;
+}
+
+void OneDriveDestinationTest::uploadsInFragments()
+{
+    FakeOneDrive onedrive;
+    MockHttpServer server([&onedrive](const MockRequest &request) { return onedrive.handle(request); });
+    onedrive.uploadBase = server.url();
+    qputenv("ONEDRIVE_GRAPH_URL", server.url().toString().toUtf8() + "/v1.0");
+
+    // 4MBを超えるファイルはアップロードセッションで、1.25MBずつ順に送る
+    const UnitPlan plan = singleFilePlan(sources.path(), "CLIP0001", ".MP4", 20 * fragment + 1000, 1);
+    OneDriveDestination destination(defaultOptions());
+    QString error;
+    QVERIFY2(destination.prepare(&error), qPrintable(error));
+    QVERIFY2(transferUnit(&destination, plan, &error), qPrintable(error));
+    QVERIFY2(destination.finish(&error), qPrintable(error));
+
+    QMutexLocker locker(&onedrive.mutex);
+    QCOMPARE(onedrive.fragmentOffsets, (QVector<qint64>{0, 4 * fragment, 8 * fragment, 12 * fragment,
+                                                        16 * fragment, 20 * fragment}));
+    QCOMPARE(onedrive.authorizedUploads, 0);
+    QCOMPARE(onedrive.files.value("/MediaTransfer/CLIP0001.MP4"), contentsOf(plan.sources.at(0)));
+}
+
+void OneDriveDestinationTest::resumesFromNextExpectedRanges()
+{
+    FakeOneDrive onedrive;
+    MockHttpServer server([&onedrive](const MockRequest &request) { return onedrive.handle(request); });
+    onedrive.uploadBase = server.url();
+    qputenv("ONEDRIVE_GRAPH_URL", server.url().toString().toUtf8() + "/v1.0");
+
+    const UnitPlan plan = singleFilePlan(sources.path(), "CLIP0002", ".MP4", 20 * fragment + 1000, 2);
+    {
+        // 3つ目のチャンクで失敗させる（受け取り済みの範囲はサーバーに残る）
+        QMutexLocker locker(&onedrive.mutex);
+        onedrive.failAtOffset = 8 * fragment;
+    }
+    {
+        OneDriveDestination destination(defaultOptions());
+        QString error;
+        QVERIFY2(destination.prepare(&error), qPrintable(error));
+        QVERIFY(!transferUnit(&destination, plan, &error));
+        destination.finish(&error);
+    }
+    {
+        QMutexLocker locker(&onedrive.mutex);
+        QCOMPARE(onedrive.sessions.size(), 1);
+        QCOMPARE(onedrive.sessions.first().received.size(), 8 * fragment);
+        onedrive.fragmentOffsets.clear();
+    }
+
+    // 次の実行ではアップロードURLの状態を取り、サーバーが次に期待する位置から送る
+    OneDriveDestination destination(defaultOptions());
+    QString error;
+    QVERIFY2(destination.prepare(&error), qPrintable(error));
+    QVERIFY2(transferUnit(&destination, plan, &error), qPrintable(error));
+    QVERIFY2(destination.finish(&error), qPrintable(error));
+
+    QMutexLocker locker(&onedrive.mutex);
+    QCOMPARE(onedrive.statusRequests, 1);
+    QCOMPARE(onedrive.nextSession, 1);
+    QCOMPARE(onedrive.fragmentOffsets, (QVector<qint64>{8 * fragment, 12 * fragment, 16 * fragment, 20 * fragment}));
+    QCOMPARE(onedrive.files.value("/MediaTransfer/CLIP0002.MP4"), contentsOf(plan.sources.at(0)));
+}
+
+void OneDriveDestinationTest::renamesWhenNameExists()
+{
+    FakeOneDrive onedrive;
+    MockHttpServer server([&onedrive](const MockRequest &request) { return onedrive.handle(request); });
+    onedrive.uploadBase = server.url();
+    qputenv("ONEDRIVE_GRAPH_URL", server.url().toString().toUtf8() + "/v1.0");
+
+    OneDriveDestination destination(defaultOptions());
+    QString error;
+    QVERIFY2(destination.prepare(&error), qPrintable(error));
+    QVERIFY2(destination.waitForRefresh(&error), qPrintable(error));
+    {
+        // マニフェストの一覧を取った後に、別のクライアントが同じ名前で置いた
+        QMutexLocker locker(&onedrive.mutex);
+        onedrive.files.insert("/MediaTransfer/IMG_0001.JPG", "other");
+        onedrive.files.insert("/MediaTransfer/CLIP0003.MP4", "other");
+    }
+
+    // 小さなファイル（PUT）も大きなファイル（アップロードセッション）も既存のファイルを置き換えない
+    const UnitPlan small = singleFilePlan(sources.path(), "IMG_0001", ".JPG", 1000, 3);
+    const UnitPlan large = singleFilePlan(sources.path(), "CLIP0003", ".MP4", 20 * fragment, 4);
+    QVERIFY2(transferUnit(&destination, small, &error), qPrintable(error));
+    QVERIFY2(transferUnit(&destination, large, &error), qPrintable(error));
+    QVERIFY2(destination.finish(&error), qPrintable(error));
+
+    QMutexLocker locker(&onedrive.mutex);
+    QCOMPARE(onedrive.files.value("/MediaTransfer/IMG_0001.JPG"), QByteArray("other"));
+    QCOMPARE(onedrive.files.value("/MediaTransfer/IMG_0001_1.JPG"), contentsOf(small.sources.at(0)));
+    QCOMPARE(onedrive.files.value("/MediaTransfer/CLIP0003.MP4"), QByteArray("other"));
+    QCOMPARE(onedrive.files.value("/MediaTransfer/CLIP0003_1.MP4"), contentsOf(large.sources.at(0)));
+}
+
+QTEST_GUILESS_MAIN(OneDriveDestinationTest)
+#include "tst_onedrivedestination.moc"
@@ -0,0 +1,478 @@
+#include <QtTest>
+#include <QCryptographicHash>
+#include <QMap>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSet>
+#include <QTemporaryDir>
+#include <QXmlStreamReader>
+#include <algorithm>
+#include "S3Destination.h"
+#include "MockHttpServer.h"
+#include "TransferTestSupport.h"
+
+namespace {
+
+const QByteArray bucketPath = "/test-bucket/";
+const qint64 mb = 1024 * 1024;
+
+QByteArray errorBody(const QByteArray &code)
+{
+    return "<Error><Code>" + code + "</Code><Message>" + code + "</Message></Error>";
+}
+
+MockResponse errorResponse(int status, const QByteArray &code)
+{
+    MockResponse response;
+    response.status = status;
+    response.body = errorBody(code);
+    return response;
+}
+
+} // namespace
+
+// S3のREST APIのうち、S3Destinationが使う部分だけを持つテスト用のサーバー
+// パートとPutObjectのチェックサム（x-amz-checksum-sha256）を照合し、違えば400を返す。
+class FakeS3
+{
+public:
+    struct Part
+    {
+        QByteArray data;
+        QByteArray etag;
+        QByteArray checksum;
+    };
+
+    struct Upload
+    {
+        QByteArray key;
+        QMap<int, Part> parts;
+    };
+
+    MockResponse handle(const MockRequest &request)
+    {
+        QMutexLocker locker(&mutex);
+        if (request.method == "GET" && request.path == bucketPath) {
+            return listObjects(request);
+        }
+        if (!request.path.startsWith(bucketPath)) {
+            return errorResponse(404, "NoSuchBucket");
+        }
+        const QByteArray key = QByteArray::fromPercentEncoding(request.path.mid(bucketPath.size()));
+
+        if (request.method == "POST" && request.hasQueryItem("uploads")) {
+            const QByteArray uploadId = "upload-" + QByteArray::number(++nextUploadId);
+            uploads.insert(uploadId, Upload{key, {}});
+            MockResponse response;
+            response.body = "<InitiateMultipartUploadResult><UploadId>" + uploadId + "</UploadId></InitiateMultipartUploadResult>";
+            return response;
+        }
+        if (request.method == "PUT" && request.hasQueryItem("partNumber")) {
+            return uploadPart(request, key);
+        }
+        if (request.method == "GET" && request.hasQueryItem("uploadId")) {
+            return listParts(request);
+        }
+        if (request.method == "POST" && request.hasQueryItem("uploadId")) {
+            return complete(request, key);
+        }
+        if (request.method == "DELETE" && request.hasQueryItem("uploadId")) {
+            uploads.remove(request.queryItem("uploadId"));
+            MockResponse response;
+            response.status = 204;
+            return response;
+        }
+        if (request.method == "PUT") {
+            return putObject(request, key);
+        }
+        if (request.method == "DELETE") {
+            objects.remove(key);
+            MockResponse response;
+            response.status = 204;
+            return response;
+        }
+        return errorResponse(400, "NotImplemented");
+    }
+
+    QMutex mutex;
+    QMap<QByteArray, QByteArray> objects;
+    QMap<QByteArray, Upload> uploads;
+    int nextUploadId = 0;
+    int partUploads = 0;
+    int listPartsRequests = 0;
+    int failPart = 0;                       // このパート番号のアップロードを1回だけ失敗させる
+    QSet<QByteArray> failPuts;              // このキーのPutObjectを1回だけ失敗させる
+    QVector<int> uploadedParts;             // アップロードを受け付けたパート番号（順不同）
+    QVector<QByteArray> completedChecksums; // CompleteMultipartUploadで送られたパートのチェックサム
+
+private:
+    static QByteArray checksumOf(const QByteArray &data)
+    {
+        return QCryptographicHash::hash(data, QCryptographicHash::Sha256).toBase64();
+    }
+
+    MockResponse uploadPart(const MockRequest &request, const QByteArray &key)
+    {
+        const int number = request.queryItem("partNumber").toInt();
+        auto upload = uploads.find(request.queryItem("uploadId"));
+        if (upload == uploads.end() || upload->key != key) {
+            return errorResponse(404, "NoSuchUpload");
+        }
+        if (request.header("x-amz-checksum-sha256") != checksumOf(request.body)) {
+            return errorResponse(400, "BadDigest");
+        }
+        if (failPart == number) {
+            failPart = 0;
+            return errorResponse(400, "InvalidRequest");
+        }
+        ++partUploads;
+        uploadedParts.append(number);
+        const QByteArray etag = '"' + QCryptographicHash::hash(request.body, QCryptographicHash::Md5).toHex() + '"';
+        upload->parts.insert(number, Part{request.body, etag, checksumOf(request.body)});
+        MockResponse response;
+        response.headers.append({"ETag", etag});
+        return response;
+    }
+
+    MockResponse listParts(const MockRequest &request)
+    {
+        ++listPartsRequests;
+        auto upload = uploads.constFind(request.queryItem("uploadId"));
+        if (upload == uploads.constEnd()) {
+            return errorResponse(404, "NoSuchUpload");
+        }
+        QByteArray body = "<ListPartsResult><IsTruncated>false</IsTruncated>";
+        for (auto part = upload->parts.constBegin(); part != upload->parts.constEnd(); ++part) {
+            body += "<Part><PartNumber>" + QByteArray::number(part.key()) + "</PartNumber>"
+                  + "<ETag>" + QByteArray(part->etag).replace('"', "&quot;") + "</ETag>"
+                  + "<ChecksumSHA256>" + part->checksum + "</ChecksumSHA256></Part>";
+        }
+        body += "</ListPartsResult>";
+        MockResponse response;
+        response.body = body;
+        return response;
+    }
+
+    MockResponse complete(const MockRequest &request, const QByteArray &key)
+    {
+        const QByteArray uploadId = request.queryItem("uploadId");
+        auto upload = uploads.find(uploadId);
+        if (upload == uploads.end() || upload->key != key) {
+            return errorResponse(404, "NoSuchUpload");
+        }
+        if (request.header("If-None-Match") == "*" && objects.contains(key)) {
+            return errorResponse(412, "PreconditionFailed");
+        }
+
+        QXmlStreamReader xml(request.body);
+        QByteArray data;
+        int number = 0;
+        int count = 0;
+        QByteArray etag;
+        QByteArray checksum;
+        while (!xml.atEnd()) {
+            xml.readNext();
+            if (xml.isStartElement()) {
+                if (xml.name() == u"PartNumber") {
+                    number = xml.readElementText().toInt();
+                } else if (xml.name() == u"ETag") {
+                    etag = xml.readElementText().toUtf8();
+                } else if (xml.name() == u"ChecksumSHA256") {
+                    checksum = xml.readElementText().toUtf8();
+                }
+            } else if (xml.isEndElement() && xml.name() == u"Part") {
+                auto part = upload->parts.constFind(number);
+                if (part == upload->parts.constEnd() || part->etag != etag || part->checksum != checksum) {
+                    return errorResponse(400, "InvalidPart");
+                }
+                completedChecksums.append(checksum);
+                data += part->data;
+                ++count;
+            }
+        }
+        if (count != upload->parts.size()) {
+            return errorResponse(400, "InvalidPart");
+        }
+        objects.insert(key, data);
+        uploads.erase(upload);
+        MockResponse response;
+        response.body = "<CompleteMultipartUploadResult><ETag>&quot;" + uploadId + '-' + QByteArray::number(count)
+                      + "&quot;</ETag></CompleteMultipartUploadResult>";
+        return response;
+    }
+
+    MockResponse putObject(const MockRequest &request, const QByteArray &key)
+    {
+        if (failPuts.remove(key)) {
+            return errorResponse(400, "InvalidRequest");
+        }
+        if (request.header("If-None-Match") == "*" && objects.contains(key)) {
+            return errorResponse(412, "PreconditionFailed");
+        }
+        if (request.header("x-amz-checksum-sha256") != checksumOf(request.body)) {
+            return errorResponse(400, "BadDigest");
+        }
+        objects.insert(key, request.body);
+        MockResponse response;
+        response.headers.append({"ETag", '"' + QCryptographicHash::hash(request.body, QCryptographicHash::Md5).toHex() + '"'});
+        return response;
+    }
+
+    MockResponse listObjects(const MockRequest &request)
+    {
+        // delimiterがあれば直下のオブジェクトとフォルダだけを返す
+        const QByteArray prefix = request.queryItem("prefix");
+        const bool delimited = request.hasQueryItem("delimiter");
+        QByteArray body = "<ListBucketResult><IsTruncated>false</IsTruncated>";
+        QSet<QByteArray> folders;
+        for (auto object = objects.constBegin(); object != objects.constEnd(); ++object) {
+            if (!object.key().startsWith(prefix)) {
+                continue;
+            }
+            const qsizetype slash = object.key().indexOf('/', prefix.size());
+            if (delimited && slash >= 0) {
+                folders.insert(object.key().left(slash + 1));
+                continue;
+            }
+            body += "<Contents><Key>" + object.key() + "</Key><Size>" + QByteArray::number(object->size())
+                  + "</Size><ETag>&quot;etag&quot;</ETag></Contents>";
+        }
+        for (const QByteArray &folder : folders) {
+            body += "<CommonPrefixes><Prefix>" + folder + "</Prefix></CommonPrefixes>";
+        }
+        body += "</ListBucketResult>";
+        MockResponse response;
+        response.body = body;
+        return response;
+    }
+};
+
+using TransferTestSupport::contentsOf;
+using TransferTestSupport::singleFilePlan;
+using TransferTestSupport::transferUnit;
+
+// S3Destination（マルチパートアップロード、パート毎のチェックサム、ListPartsによる再開）
+class S3DestinationTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void init();
+
+    void uploadsMultipartWithChecksums();
+    void resumesFromListedParts();
+    void resendsPartsMissingOnServer();
+    void renamesWhenKeyWasTaken();
+    void renamesWholeUnitWhenMemberWasTaken();
+    void releasesKeysWhenCommitFails();
+
+private:
+    QFileInfo writeSource(const QString &name, qint64 size, quint32 seed);
+    S3Options optionsFor(const MockHttpServer &server) const;
+
+    QTemporaryDir sources;
+};
+
+void S3DestinationTest::initTestCase()
+{
+    qputenv("AWS_ACCESS_KEY_ID", "test-access-key");
+    qputenv("AWS_SECRET_ACCESS_KEY", "test-secret-key");
+    QVERIFY(sources.isValid());
+}
+
+void S3DestinationTest::init()
+{
+    TransferTestSupport::resetLocalData();
+}
+
+QFileInfo S3DestinationTest::writeSource(const QString &name, qint64 size, quint32 seed)
+{
+    return TransferTestSupport::writeSource(sources.filePath(name), size, seed);
+}
+
+S3Options S3DestinationTest::optionsFor(const MockHttpServer &server) const
+{
+    S3Options options;
+    options.bucket = "test-bucket";
+    options.endpoint = server.url().toString();
+    options.partSize = 5 * mb;
+    options.concurrency = 3;
+    return options;
+}
+
+void S3DestinationTest::uploadsMultipartWithChecksums()
+{
+    FakeS3 s3;
+    MockHttpServer server([&s3](const MockRequest &request) { return s3.handle(request); });
+
+    UnitPlan plan;
+    plan.relativeDir = "2026";
+    plan.stem = "IMG_0001";
+    plan.suffixes = {".CR3", ".CR3.xmp"};
+    plan.sources = {writeSource("IMG_0001.CR3", 12 * mb + 100, 1), writeSource("IMG_0001.CR3.xmp", 2000, 2)};
+
+    S3Destination destination(optionsFor(server));
+    QString error;
+    QVERIFY2(destination.prepare(&error), qPrintable(error));
+    QVERIFY2(transferUnit(&destination, plan, &error), qPrintable(error));
+    QVERIFY2(destination.finish(&error), qPrintable(error));
+
+    QMutexLocker locker(&s3.mutex);
+    // 12MBは5MBのパート3つ（最後は残り）に分かれ、すべてチェックサムの照合を通っている
+    QCOMPARE(s3.partUploads, 3);
+    QCOMPARE(s3.completedChecksums.size(), 3);
+    QCOMPARE(s3.objects.value("2026/IMG_0001.CR3"), contentsOf(plan.sources.at(0)));
+    QCOMPARE(s3.objects.value("2026/IMG_0001.CR3.xmp"), contentsOf(plan.sources.at(1)));
+    QVERIFY(s3.uploads.isEmpty());
+}
+
+void S3DestinationTest::resumesFromListedParts()
+{
+    FakeS3 s3;
+    MockHttpServer server([&s3](const MockRequest &request) { return s3.handle(request); });
+
+    const UnitPlan plan = singleFilePlan(sources.path(), "CLIP0001", ".MP4", 12 * mb, 3);
+
+    // 最後のパートで失敗させる（完了済みのパートはサーバーに残る）
+    s3.failPart = 3;
+    {
+        S3Destination destination(optionsFor(server));
+        QString error;
+        QVERIFY2(destination.prepare(&error), qPrintable(error));
+        QVERIFY(!transferUnit(&destination, plan, &error));
+        destination.finish(&error);
+    }
+    {
+        QMutexLocker locker(&s3.mutex);
+        QCOMPARE(s3.partUploads, 2);
+        QCOMPARE(s3.uploads.size(), 1);
+        s3.uploadedParts.clear();
+    }
+
+    // 次の実行では記録したUploadIdの一覧を取り、残っているパートは送らない
+    S3Destination destination(optionsFor(server));
+    QString error;
+    QVERIFY2(destination.prepare(&error), qPrintable(error));
+    QVERIFY2(transferUnit(&destination, plan, &error), qPrintable(error));
+    QVERIFY2(destination.finish(&error), qPrintable(error));
+
+    QMutexLocker locker(&s3.mutex);
+    QCOMPARE(s3.listPartsRequests, 1);
+    QCOMPARE(s3.uploadedParts, QVector<int>{3});
+    QCOMPARE(s3.nextUploadId, 1);
+    QCOMPARE(s3.objects.value("CLIP0001.MP4"), contentsOf(plan.sources.at(0)));
+}
+
+void S3DestinationTest::resendsPartsMissingOnServer()
+{
+    FakeS3 s3;
+    MockHttpServer server([&s3](const MockRequest &request) { return s3.handle(request); });
+
+    const UnitPlan plan = singleFilePlan(sources.path(), "CLIP0002", ".MP4", 12 * mb, 4);
+
+    s3.failPart = 3;
+    {
+        S3Destination destination(optionsFor(server));
+        QString error;
+        QVERIFY2(destination.prepare(&error), qPrintable(error));
+        QVERIFY(!transferUnit(&destination, plan, &error));
+        destination.finish(&error);
+    }
+    {
+        // 記録にはあるがサーバーの一覧にないパートは送り直す
+        QMutexLocker locker(&s3.mutex);
+        QCOMPARE(s3.uploads.size(), 1);
+        s3.uploads.first().parts.remove(2);
+        s3.uploadedParts.clear();
+    }
+
+    S3Destination destination(optionsFor(server));
+    QString error;
+    QVERIFY2(destination.prepare(&error), qPrintable(error));
+    QVERIFY2(transferUnit(&destination, plan, &error), qPrintable(error));
+    QVERIFY2(destination.finish(&error), qPrintable(error));
+
+    QMutexLocker locker(&s3.mutex);
+    std::sort(s3.uploadedParts.begin(), s3.uploadedParts.end());
+    QCOMPARE(s3.uploadedParts, (QVector<int>{2, 3}));
+    QCOMPARE(s3.objects.value("CLIP0002.MP4"), contentsOf(plan.sources.at(0)));
+}
+
+void S3DestinationTest::renamesWhenKeyWasTaken()
+{
+    FakeS3 s3;
+    MockHttpServer server([&s3](const MockRequest &request) { return s3.handle(request); });
+
+    const UnitPlan plan = singleFilePlan(sources.path(), "IMG_0002", ".JPG", 3000, 5);
+
+    S3Destination destination(optionsFor(server));
+    QString error;
+    QVERIFY2(destination.prepare(&error), qPrintable(error));
+    QVERIFY2(destination.waitForRefresh(&error), qPrintable(error));
+    {
+        // マニフェストの一覧を取った後に、別のクライアントが同じ名前で置いた
+        QMutexLocker locker(&s3.mutex);
+        s3.objects.insert("IMG_0002.JPG", "other");
+    }
+    QVERIFY2(transferUnit(&destination, plan, &error), qPrintable(error));
+
+    QMutexLocker locker(&s3.mutex);
+    QCOMPARE(s3.objects.value("IMG_0002.JPG"), QByteArray("other"));
+    QCOMPARE(s3.objects.value("IMG_0002_1.JPG").size(), 3000);
+}
+
+void S3DestinationTest::renamesWholeUnitWhenMemberWasTaken()
+{
+    FakeS3 s3;
+    MockHttpServer server([&s3](const MockRequest &request) { return s3.handle(request); });
+
+    UnitPlan plan;
+    plan.stem = "IMG_0003";
+    plan.suffixes = {".JPG", ".CR3"};
+    plan.sources = {writeSource("IMG_0003.JPG", 3000, 6), writeSource("IMG_0003.CR3", 4000, 7)};
+
+    S3Destination destination(optionsFor(server));
+    QString error;
+    QVERIFY2(destination.prepare(&error), qPrintable(error));
+    QVERIFY2(destination.waitForRefresh(&error), qPrintable(error));
+    {
+        // JPGを置いた後でRAWの名前が使われていたと分かる
+        QMutexLocker locker(&s3.mutex);
+        s3.objects.insert("IMG_0003.CR3", "other");
+    }
+    QVERIFY2(transferUnit(&destination, plan, &error), qPrintable(error));
+
+    // 組は同じ連番にそろえて置き直す
+    QMutexLocker locker(&s3.mutex);
+    QVERIFY(!s3.objects.contains("IMG_0003.JPG"));
+    QCOMPARE(s3.objects.value("IMG_0003.CR3"), QByteArray("other"));
+    QCOMPARE(s3.objects.value("IMG_0003_1.JPG"), contentsOf(plan.sources.at(0)));
+    QCOMPARE(s3.objects.value("IMG_0003_1.CR3"), contentsOf(plan.sources.at(1)));
+}
+
+void S3DestinationTest::releasesKeysWhenCommitFails()
+{
+    FakeS3 s3;
+    MockHttpServer server([&s3](const MockRequest &request) { return s3.handle(request); });
+    {
+        QMutexLocker locker(&s3.mutex);
+        s3.failPuts = {"IMG_0004.JPG"};
+    }
+
+    const UnitPlan plan = singleFilePlan(sources.path(), "IMG_0004", ".JPG", 3000, 8);
+
+    S3Destination destination(optionsFor(server));
+    QString error;
+    QVERIFY2(destination.prepare(&error), qPrintable(error));
+    QVERIFY(!transferUnit(&destination, plan, &error));
+
+    // 置けなかった名前の予約は外れ、送り直すと同じ名前で置く
+    QVERIFY2(transferUnit(&destination, plan, &error), qPrintable(error));
+    QVERIFY2(destination.finish(&error), qPrintable(error));
+    QMutexLocker locker(&s3.mutex);
+    QCOMPARE(s3.objects.keys(), QList<QByteArray>{"IMG_0004.JPG"});
+}
+
+QTEST_GUILESS_MAIN(S3DestinationTest)
+#include "tst_s3destination.moc"